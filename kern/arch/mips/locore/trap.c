@@ -160,10 +160,13 @@ mips_trap(struct trapframe *tf)
 	/* Interrupt? Call the interrupt handler and return. */
 	if (code == EX_IRQ) {
 		int old_in;
+		bool old_fromuser;
 		bool doadjust;
 
 		old_in = curthread->t_in_interrupt;
+		old_fromuser = curthread->t_intr_fromuser;
 		curthread->t_in_interrupt = 1;
+		curthread->t_intr_fromuser = !iskern;
 
 		/*
 		 * The processor has turned interrupts off; if the
@@ -203,6 +206,7 @@ mips_trap(struct trapframe *tf)
 		}
 
 		curthread->t_in_interrupt = old_in;
+		curthread->t_intr_fromuser = old_fromuser;
 		goto done2;
 	}
 
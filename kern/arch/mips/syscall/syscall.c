@@ -113,6 +113,11 @@ syscall(struct trapframe *tf)
 				 (userptr_t)tf->tf_a1);
 		break;
 
+	    case SYS_nanosleep:
+		err = sys_nanosleep((const_userptr_t)tf->tf_a0,
+				    (userptr_t)tf->tf_a1);
+		break;
+
 
 	    /* process calls */
 
@@ -120,6 +125,10 @@ syscall(struct trapframe *tf)
 		err = sys_fork(tf, &retval);
 		break;
 
+	    case SYS_vfork:
+		err = sys_vfork(tf, &retval);
+		break;
+
 	    case SYS_execv:
 		err = sys_execv(
 			(userptr_t)tf->tf_a0,
@@ -138,10 +147,23 @@ syscall(struct trapframe *tf)
 			&retval);
 		break;
 
+	    case SYS_wait4:
+		err = sys_wait4(
+			tf->tf_a0,
+			(userptr_t)tf->tf_a1,
+			tf->tf_a2,
+			(userptr_t)tf->tf_a3,
+			&retval);
+		break;
+
 	    case SYS_getpid:
 		err = sys_getpid(&retval);
 		break;
 
+	    case SYS_getrusage:
+		err = sys_getrusage(tf->tf_a0, (userptr_t)tf->tf_a1);
+		break;
+
 
 	    /* file calls */
 
@@ -178,6 +200,107 @@ syscall(struct trapframe *tf)
 			tf->tf_a2,
 			&retval);
 		break;
+	    case SYS_pread:
+	    case SYS_pwrite:
+		{
+			/*
+			 * The 64-bit position has to start in an even
+			 * register, and a2 is taken by the size, so it
+			 * goes on the stack.
+			 */
+			off_t pos;
+
+			err = copyin((userptr_t)tf->tf_sp + 16,
+				     &pos, sizeof(pos));
+			if (err) {
+				break;
+			}
+
+			err = (callno == SYS_pread) ?
+				sys_pread(tf->tf_a0, (userptr_t)tf->tf_a1,
+					  tf->tf_a2, pos, &retval) :
+				sys_pwrite(tf->tf_a0, (userptr_t)tf->tf_a1,
+					   tf->tf_a2, pos, &retval);
+		}
+		break;
+	    case SYS_readv:
+		err = sys_readv(
+			tf->tf_a0,
+			(const_userptr_t)tf->tf_a1,
+			tf->tf_a2,
+			&retval);
+		break;
+	    case SYS_writev:
+		err = sys_writev(
+			tf->tf_a0,
+			(const_userptr_t)tf->tf_a1,
+			tf->tf_a2,
+			&retval);
+		break;
+	    case SYS_select:
+		{
+			/* The fifth argument is on the stack. */
+			userptr_t timeout;
+
+			err = copyin((userptr_t)tf->tf_sp + 16,
+				     &timeout, sizeof(timeout));
+			if (err) {
+				break;
+			}
+
+			err = sys_select(
+				tf->tf_a0,
+				(userptr_t)tf->tf_a1,
+				(userptr_t)tf->tf_a2,
+				(userptr_t)tf->tf_a3,
+				timeout,
+				&retval);
+		}
+		break;
+	    case SYS_poll:
+		err = sys_poll(
+			(userptr_t)tf->tf_a0,
+			tf->tf_a1,
+			tf->tf_a2,
+			&retval);
+		break;
+	    case SYS_aio_submit:
+		err = sys_aio_submit(
+			(const_userptr_t)tf->tf_a0,
+			tf->tf_a1,
+			&retval);
+		break;
+	    case SYS_aio_reap:
+		err = sys_aio_reap(
+			(userptr_t)tf->tf_a0,
+			tf->tf_a1,
+			tf->tf_a2,
+			&retval);
+		break;
+	    case SYS_copy_file_range:
+		{
+			/* Arguments past the fourth are on the stack. */
+			struct {
+				size_t len;
+				unsigned flags;
+			} more;
+
+			err = copyin((userptr_t)tf->tf_sp + 16,
+				     &more, sizeof(more));
+			if (err) {
+				break;
+			}
+
+			err = sys_copy_file_range(
+				tf->tf_a0,
+				(userptr_t)tf->tf_a1,
+				tf->tf_a2,
+				(userptr_t)tf->tf_a3,
+				more.len,
+				more.flags,
+				&retval);
+		}
+		break;
 	    case SYS_lseek:
 		{
 			/*
@@ -211,6 +334,10 @@ syscall(struct trapframe *tf)
 		}
 		break;
 
+	    case SYS_pipe:
+		err = sys_pipe((userptr_t)tf->tf_a0, &retval);
+		break;
+
 	    case SYS_chdir:
 		err = sys_chdir((userptr_t)tf->tf_a0);
 		break;
@@ -262,6 +389,43 @@ syscall(struct trapframe *tf)
 		break;
 
 
+	    /* synchronization calls */
+
+	    case SYS_futex:
+		err = sys_futex(
+			(userptr_t)tf->tf_a0,
+			tf->tf_a1,
+			tf->tf_a2,
+			&retval);
+		break;
+
+
+	    /* misc calls */
+
+	    case SYS___sysctl:
+		{
+			/* The last two arguments come from the stack. */
+			userptr_t newp;
+			size_t newlen;
+
+			err = copyin((userptr_t)tf->tf_sp + 16,
+				     &newp, sizeof(newp));
+			if (err) {
+				break;
+			}
+			err = copyin((userptr_t)tf->tf_sp + 20,
+				     &newlen, sizeof(newlen));
+			if (err) {
+				break;
+			}
+			err = sys___sysctl((const_userptr_t)tf->tf_a0,
+					   tf->tf_a1,
+					   (userptr_t)tf->tf_a2,
+					   (userptr_t)tf->tf_a3,
+					   newp, newlen);
+		}
+		break;
+
 
 	    default:
 		kprintf("Unknown syscall %d\n", callno);
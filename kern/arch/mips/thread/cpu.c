@@ -176,6 +176,23 @@ cpu_identify(char *buf, size_t max)
 	}
 }
 
+/*
+ * Read the cycle counter (cop0 register 9, c0_count). This is the
+ * same counter the on-chip timer compares against.
+ */
+uint32_t
+cpu_cycles(void)
+{
+	uint32_t count;
+
+	__asm volatile(".set push;"		/* save assembler mode */
+		       ".set mips32;"		/* allow mips32 registers */
+		       "mfc0 %0,$9;"		/* get cop0 reg 9 */
+		       ".set pop"		/* restore assembler mode */
+		       : "=r" (count));
+	return count;
+}
+
 ////////////////////////////////////////////////////////////
 
 /*
@@ -213,6 +213,37 @@ vm_fault(int faulttype, vaddr_t faultaddress)
 	return EFAULT;
 }
 
+/*
+ * Find the kernel address of user address VA in AS. Everything dumbvm
+ * maps is resident and writable, so WRITE doesn't matter.
+ */
+vaddr_t
+vm_userpage(struct addrspace *as, vaddr_t va, bool write)
+{
+	vaddr_t stackbase;
+	paddr_t paddr;
+
+	(void)write;
+
+	stackbase = USERSTACK - DUMBVM_STACKPAGES * PAGE_SIZE;
+
+	if (va >= as->as_vbase1 &&
+	    va < as->as_vbase1 + as->as_npages1 * PAGE_SIZE) {
+		paddr = (va - as->as_vbase1) + as->as_pbase1;
+	}
+	else if (va >= as->as_vbase2 &&
+		 va < as->as_vbase2 + as->as_npages2 * PAGE_SIZE) {
+		paddr = (va - as->as_vbase2) + as->as_pbase2;
+	}
+	else if (va >= stackbase && va < USERSTACK) {
+		paddr = (va - stackbase) + as->as_stackpbase;
+	}
+	else {
+		return 0;
+	}
+	return PADDR_TO_KVADDR(paddr);
+}
+
 struct addrspace *
 as_create(void)
 {
@@ -49,6 +49,7 @@
 
 #include <types.h>
 #include <kern/errno.h>
+#include <kern/poll.h>
 #include <lib.h>
 #include <uio.h>
 #include <cpu.h>
@@ -58,6 +59,7 @@
 #include <generic/console.h>
 #include <vfs.h>
 #include <device.h>
+#include <poll.h>
 #include "autoconf.h"
 
 /*
@@ -72,6 +74,11 @@ static struct con_softc *the_console = NULL;
 static struct lock *con_userlock_read = NULL;
 static struct lock *con_userlock_write = NULL;
 
+/*
+ * Pollers waiting for input.
+ */
+static struct pollhead con_pollhead;
+
 //////////////////////////////////////////////////
 
 /*
@@ -174,6 +181,7 @@ con_input(void *vcs, int ch)
 	cs->cs_gotchars_head = nexthead;
 
 	V(cs->cs_rsem);
+	pollhead_wakeup(&con_pollhead);
 }
 
 /*
@@ -302,10 +310,48 @@ con_ioctl(struct device *dev, int op, userptr_t data)
 	return EINVAL;
 }
 
+/*
+ * Reads return a line at a time, so only call the console readable
+ * once a whole line has been typed (or the buffer is full, in which
+ * case no more is coming until someone reads). Writing never waits
+ * for long.
+ */
+static
+int
+con_poll(struct device *dev, int events, struct pollwait *pw, int *revents)
+{
+	struct con_softc *cs = dev->d_data;
+	unsigned i, head, tail;
+	bool ready;
+	char ch;
+
+	if (pw != NULL) {
+		pollwait_register(pw, &con_pollhead);
+	}
+
+	*revents = events & (POLLOUT | POLLWRNORM);
+
+	head = cs->cs_gotchars_head;
+	tail = cs->cs_gotchars_tail;
+	ready = (head + 1) % CONSOLE_INPUT_BUFFER_SIZE == tail;
+	for (i = tail; i != head && !ready;
+	     i = (i + 1) % CONSOLE_INPUT_BUFFER_SIZE) {
+		ch = cs->cs_gotchars[i];
+		if (ch == '\r' || ch == '\n') {
+			ready = true;
+		}
+	}
+	if (ready) {
+		*revents |= events & (POLLIN | POLLRDNORM);
+	}
+	return 0;
+}
+
 static const struct device_ops console_devops = {
 	.devop_eachopen = con_eachopen,
 	.devop_io = con_io,
 	.devop_ioctl = con_ioctl,
+	.devop_poll = con_poll,
 };
 
 static
@@ -386,6 +432,7 @@ config_con(struct con_softc *cs, int unit)
 	cs->cs_wsem = wsem;
 	cs->cs_gotchars_head = 0;
 	cs->cs_gotchars_tail = 0;
+	pollhead_init(&con_pollhead);
 
 	the_console = cs;
 	con_userlock_read = rlk;
@@ -62,6 +62,7 @@ semfs_sem_create(const char *name)
 	if (sem->sems_cv == NULL) {
 		goto fail_lock;
 	}
+	pollhead_init(&sem->sems_pollhead);
 	sem->sems_count = 0;
 	sem->sems_hasvnode = false;
 	sem->sems_linked = false;
@@ -81,6 +82,7 @@ semfs_sem_create(const char *name)
 void
 semfs_sem_destroy(struct semfs_sem *sem)
 {
+	pollhead_cleanup(&sem->sems_pollhead);
 	cv_destroy(sem->sems_cv);
 	lock_destroy(sem->sems_lock);
 	kfree(sem);
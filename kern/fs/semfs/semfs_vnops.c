@@ -30,6 +30,7 @@
 #include <types.h>
 #include <kern/errno.h>
 #include <kern/fcntl.h>
+#include <kern/poll.h>
 #include <stat.h>
 #include <uio.h>
 #include <synch.h>
@@ -136,7 +137,8 @@ semfs_getsem(struct semfs_vnode *semv)
  * Wakeup helper. We only need to wake up if there are sleepers, which
  * should only be the case if the old count is 0; and we only
  * potentially need to wake more than one sleeper if the new count
- * will be more than 1.
+ * will be more than 1. The same goes for pollers, which only care
+ * whether the count is 0.
  */
 static
 void
@@ -151,6 +153,7 @@ semfs_wakeup(struct semfs_sem *sem, unsigned newcount)
 	else {
 		cv_broadcast(sem->sems_cv, sem->sems_lock);
 	}
+	pollhead_wakeup(&sem->sems_pollhead);
 }
 
 /*
@@ -255,6 +258,33 @@ semfs_write(struct vnode *vn, struct uio *uio)
 	return 0;
 }
 
+/*
+ * Poll. Reading (P) won't block if the count is nonzero; writing (V)
+ * never blocks.
+ */
+static
+int
+semfs_poll(struct vnode *vn, int events, struct pollwait *pw, int *revents)
+{
+	struct semfs_vnode *semv = vn->vn_data;
+	struct semfs_sem *sem;
+
+	sem = semfs_getsem(semv);
+
+	if (pw != NULL) {
+		pollwait_register(pw, &sem->sems_pollhead);
+	}
+
+	*revents = events & (POLLOUT | POLLWRNORM);
+	lock_acquire(sem->sems_lock);
+	if (sem->sems_count > 0) {
+		*revents |= events & (POLLIN | POLLRDNORM);
+	}
+	lock_release(sem->sems_lock);
+
+	return 0;
+}
+
 /*
  * Truncate. Set the count to the specified value.
  *
@@ -662,10 +692,13 @@ static const struct vnode_ops semfs_dirops = {
 	.vop_stat = semfs_dirstat,
 	.vop_gettype = semfs_gettype,
 	.vop_isseekable = semfs_isseekable,
+	.vop_poll = vop_poll_ready,
 	.vop_fsync = semfs_fsync,
 	.vop_mmap = vopfail_mmap_isdir,
 	.vop_truncate = vopfail_truncate_isdir,
 	.vop_namefile = semfs_namefile,
+	.vop_copyfrom = vopfail_copyfrom_isdir,
+	.vop_readahead = vop_readahead_none,
 
 	.vop_creat = semfs_creat,
 	.vop_symlink = vopfail_symlink_nosys,
@@ -695,10 +728,13 @@ static const struct vnode_ops semfs_semops = {
 	.vop_stat = semfs_semstat,
 	.vop_gettype = semfs_gettype,
 	.vop_isseekable = semfs_isseekable,
+	.vop_poll = semfs_poll,
 	.vop_fsync = semfs_fsync,
 	.vop_mmap = vopfail_mmap_perm,
 	.vop_truncate = semfs_truncate,
 	.vop_namefile = vopfail_uio_notdir,
+	.vop_copyfrom = vopfail_copyfrom_xdev,
+	.vop_readahead = vop_readahead_none,
 
 	.vop_creat = vopfail_creat_notdir,
 	.vop_symlink = vopfail_symlink_notdir,
@@ -35,10 +35,25 @@
 #include <types.h>
 #include <kern/errno.h>
 #include <lib.h>
+#include <vm.h>
 #include <vfs.h>
+#include <buf.h>
 #include <sfs.h>
 #include "sfsprivate.h"
 
+/* A full linear directory this many blocks long becomes hashed. */
+#define SFS_DIRHASH_MINBLOCKS	4
+
+/* Buckets to try for a free slot before making the table bigger. */
+#define SFS_DIRHASH_MAXPROBE	4
+
+/*
+ * Buckets per page of the table sfs_dir_rehash builds in memory. It's
+ * built a page at a time, since kmalloc can't give us more than one
+ * contiguous page.
+ */
+#define SFS_DIRHASH_PERPAGE	(PAGE_SIZE / SFS_BLOCKSIZE)
+
 /*
  * Read the directory entry out of slot SLOT of a directory vnode.
  * The "slot" is the index of the directory entry, starting at 0.
@@ -96,12 +111,13 @@ sfs_dir_nentries(struct sfs_vnode *sv)
 }
 
 /*
- * Search a directory for a particular filename in a directory, and
- * return its inode number, its slot, and/or the slot number of an
- * empty directory slot if one is found.
+ * Search a linear directory for a particular filename, and return its
+ * inode number, its slot, and/or the slot number of an empty directory
+ * slot if one is found.
  */
+static
 int
-sfs_dir_findname(struct sfs_vnode *sv, const char *name,
+sfs_dir_findlinear(struct sfs_vnode *sv, const char *name,
 		uint32_t *ino, int *slot, int *emptyslot)
 {
 	struct sfs_direntry tsd;
@@ -146,14 +162,479 @@ sfs_dir_findname(struct sfs_vnode *sv, const char *name,
 	return found ? 0 : ENOENT;
 }
 
+////////////////////////////////////////////////////////////
+// Hashed directories (see kern/sfs.h)
+
+/*
+ * Hash a name.
+ */
+static
+uint32_t
+sfs_dir_hash(const char *name)
+{
+	uint32_t hash = SFS_DIRHASH_BASIS;
+
+	while (*name) {
+		hash ^= (unsigned char)*name++;
+		hash *= SFS_DIRHASH_PRIME;
+	}
+	return hash;
+}
+
+/*
+ * Check if a directory is hashed. If the fields that say so don't
+ * make sense, it isn't.
+ */
+static
+bool
+sfs_dir_ishashed(struct sfs_vnode *sv)
+{
+	uint32_t nbuckets = sv->sv_i.sfi_dirbuckets;
+
+	return nbuckets != 0 &&
+		(nbuckets & (nbuckets - 1)) == 0 &&
+		nbuckets <= SFS_DIRHASH_MAXBUCKETS &&
+		sv->sv_i.sfi_dirprobe < nbuckets &&
+		sv->sv_i.sfi_size == nbuckets * SFS_BLOCKSIZE;
+}
+
+/*
+ * Look through one bucket of a hashed directory, straight out of the
+ * buffer cache. If NAME isn't NULL, look for it and hand back its
+ * inode number and slot. (Names that aren't null-terminated, which
+ * sfsck would fix, never match.) Also hand back the first free slot in the
+ * bucket in *FREESLOT, unless that's already been set (isn't -1).
+ *
+ * Returns ENOENT if NAME isn't there (or is NULL).
+ */
+static
+int
+sfs_dir_scanbucket(struct sfs_vnode *sv, unsigned bucket, const char *name,
+		   uint32_t *ino, int *slot, int *freeslot)
+{
+	struct sfs_fs *sfs = sv->sv_absvn.vn_fs->fs_data;
+	struct sfs_direntry *sds;
+	struct buf *b;
+	daddr_t diskblock;
+	unsigned i;
+	int result;
+
+	result = sfs_bmap(sv, bucket, false, &diskblock);
+	if (result) {
+		return result;
+	}
+	if (diskblock == 0) {
+		/* Never written, so all free. */
+		if (*freeslot < 0) {
+			*freeslot = bucket * SFS_DIRPERBLOCK;
+		}
+		return ENOENT;
+	}
+
+	result = buf_read(&sfs->sfs_absfs, diskblock, &b);
+	if (result) {
+		return result;
+	}
+	sds = buf_map(b);
+
+	result = ENOENT;
+	for (i=0; i<SFS_DIRPERBLOCK; i++) {
+		if (sds[i].sfd_ino == SFS_NOINO) {
+			if (*freeslot < 0) {
+				*freeslot = bucket * SFS_DIRPERBLOCK + i;
+			}
+		}
+		else if (name != NULL &&
+			 sds[i].sfd_name[sizeof(sds[i].sfd_name)-1] == 0 &&
+			 !strcmp(sds[i].sfd_name, name)) {
+			if (ino != NULL) {
+				*ino = sds[i].sfd_ino;
+			}
+			if (slot != NULL) {
+				*slot = bucket * SFS_DIRPERBLOCK + i;
+			}
+			result = 0;
+			break;
+		}
+	}
+
+	buf_release(b);
+	return result;
+}
+
+/*
+ * Search a hashed directory; arguments as for sfs_dir_findlinear.
+ * The empty slot, if any, is the first one in the buckets NAME could
+ * be in.
+ */
+static
+int
+sfs_dir_findhashed(struct sfs_vnode *sv, const char *name,
+		uint32_t *ino, int *slot, int *emptyslot)
+{
+	unsigned nbuckets, bucket, i;
+	int freeslot = -1;
+	int result = ENOENT;
+
+	if (strlen(name) >= SFS_NAMELEN) {
+		/* Can't be there. */
+		return ENOENT;
+	}
+
+	nbuckets = sv->sv_i.sfi_dirbuckets;
+	bucket = sfs_dir_hash(name) & (nbuckets - 1);
+	for (i=0; i<=sv->sv_i.sfi_dirprobe; i++) {
+		result = sfs_dir_scanbucket(sv, (bucket + i) & (nbuckets - 1),
+					    name, ino, slot, &freeslot);
+		if (result != ENOENT) {
+			return result;
+		}
+	}
+
+	if (emptyslot != NULL && freeslot >= 0) {
+		*emptyslot = freeslot;
+	}
+	return result;
+}
+
+/*
+ * The table sfs_dir_rehash builds: an array of pages, each holding
+ * up to SFS_DIRHASH_PERPAGE buckets. Make an empty one of NBUCKETS
+ * buckets.
+ */
+static
+struct sfs_direntry **
+sfs_dir_tablecreate(unsigned nbuckets)
+{
+	struct sfs_direntry **table;
+	unsigned npages, i;
+	size_t pagesize;
+
+	npages = DIVROUNDUP(nbuckets, SFS_DIRHASH_PERPAGE);
+	pagesize = nbuckets < SFS_DIRHASH_PERPAGE ?
+		nbuckets * SFS_BLOCKSIZE : PAGE_SIZE;
+
+	table = kmalloc(npages * sizeof(*table));
+	if (table == NULL) {
+		return NULL;
+	}
+	for (i=0; i<npages; i++) {
+		table[i] = kmalloc(pagesize);
+		if (table[i] == NULL) {
+			while (i-- > 0) {
+				kfree(table[i]);
+			}
+			kfree(table);
+			return NULL;
+		}
+		bzero(table[i], pagesize);
+	}
+	return table;
+}
+
+/*
+ * Free a table of NBUCKETS buckets.
+ */
+static
+void
+sfs_dir_tabledestroy(struct sfs_direntry **table, unsigned nbuckets)
+{
+	unsigned npages, i;
+
+	npages = DIVROUNDUP(nbuckets, SFS_DIRHASH_PERPAGE);
+	for (i=0; i<npages; i++) {
+		kfree(table[i]);
+	}
+	kfree(table);
+}
+
+/*
+ * Get bucket BUCKET of a table.
+ */
+static
+struct sfs_direntry *
+sfs_dir_tablebucket(struct sfs_direntry **table, unsigned bucket)
+{
+	return &table[bucket / SFS_DIRHASH_PERPAGE]
+		[(bucket % SFS_DIRHASH_PERPAGE) * SFS_DIRPERBLOCK];
+}
+
+/*
+ * Put SD in TABLE, a hashed directory of NBUCKETS buckets being
+ * built in memory, and hand back how many buckets past its own it
+ * went. The caller makes sure there's room.
+ */
+static
+unsigned
+sfs_dir_tableadd(struct sfs_direntry **table, unsigned nbuckets,
+		 const struct sfs_direntry *sd)
+{
+	struct sfs_direntry *sds;
+	unsigned home, probe, i;
+
+	home = sfs_dir_hash(sd->sfd_name) & (nbuckets - 1);
+	for (probe=0; probe<nbuckets; probe++) {
+		sds = sfs_dir_tablebucket(table,
+					  (home + probe) & (nbuckets - 1));
+		for (i=0; i<SFS_DIRPERBLOCK; i++) {
+			if (sds[i].sfd_ino == SFS_NOINO) {
+				sds[i] = *sd;
+				return probe;
+			}
+		}
+	}
+	panic("sfs: rehash: no room in table of %u buckets\n", nbuckets);
+}
+
+/*
+ * Rebuild a directory, linear or hashed, as a hashed directory with
+ * NBUCKETS buckets, which must have room for all its entries and be
+ * no smaller than it is now.
+ *
+ * The new table is built in memory, a page at a time, and then
+ * copied over the old one.
+ * Every block it needs is allocated, and every buffer for them held,
+ * before anything is copied, so nothing can fail once the directory
+ * starts to change: on any error it's left as it was.
+ */
+static
+int
+sfs_dir_rehash(struct sfs_vnode *sv, unsigned nbuckets)
+{
+	struct sfs_fs *sfs = sv->sv_absvn.vn_fs->fs_data;
+	struct sfs_direntry **table, *sds, sd;
+	struct buf *b, **bufs;
+	daddr_t diskblock;
+	unsigned nentries, oldblocks, block, i, probe, maxprobe;
+	int result;
+
+	KASSERT(nbuckets != 0 && (nbuckets & (nbuckets - 1)) == 0);
+	KASSERT(nbuckets <= SFS_DIRHASH_MAXBUCKETS);
+	KASSERT(sv->sv_i.sfi_size <= nbuckets * SFS_BLOCKSIZE);
+
+	table = sfs_dir_tablecreate(nbuckets);
+	if (table == NULL) {
+		return ENOMEM;
+	}
+	bufs = kmalloc(nbuckets * sizeof(*bufs));
+	if (bufs == NULL) {
+		sfs_dir_tabledestroy(table, nbuckets);
+		return ENOMEM;
+	}
+
+	/* Read every entry and put it in the new table. */
+	nentries = sfs_dir_nentries(sv);
+	oldblocks = DIVROUNDUP(nentries, SFS_DIRPERBLOCK);
+	maxprobe = 0;
+	for (block=0; block<oldblocks; block++) {
+		result = sfs_bmap(sv, block, false, &diskblock);
+		if (result) {
+			goto fail;
+		}
+		if (diskblock == 0) {
+			continue;
+		}
+		result = buf_read(&sfs->sfs_absfs, diskblock, &b);
+		if (result) {
+			goto fail;
+		}
+		sds = buf_map(b);
+		for (i=0; i<SFS_DIRPERBLOCK; i++) {
+			if (block * SFS_DIRPERBLOCK + i >= nentries) {
+				break;
+			}
+			if (sds[i].sfd_ino == SFS_NOINO) {
+				continue;
+			}
+			sd = sds[i];
+			sd.sfd_name[sizeof(sd.sfd_name)-1] = 0;
+			probe = sfs_dir_tableadd(table, nbuckets, &sd);
+			if (probe > maxprobe) {
+				maxprobe = probe;
+			}
+		}
+		buf_release(b);
+	}
+
+	/* Allocate its blocks, giving them back if we can't get them all. */
+	for (block=0; block<nbuckets; block++) {
+		result = sfs_bmap(sv, block, true, &diskblock);
+		if (result) {
+			sfs_itrunc(sv, sv->sv_i.sfi_size);
+			goto fail;
+		}
+	}
+
+	/*
+	 * Get a buffer for each block. They're overwritten completely,
+	 * so there's no need to read them.
+	 */
+	for (block=0; block<nbuckets; block++) {
+		result = sfs_bmap(sv, block, false, &diskblock);
+		if (result == 0) {
+			KASSERT(diskblock != 0);
+			result = buf_get(&sfs->sfs_absfs, diskblock,
+					 &bufs[block]);
+		}
+		if (result) {
+			while (block-- > 0) {
+				buf_release(bufs[block]);
+			}
+			sfs_itrunc(sv, sv->sv_i.sfi_size);
+			goto fail;
+		}
+	}
+
+	/* Now copy it in; nothing from here on can fail. */
+	for (block=0; block<nbuckets; block++) {
+		memcpy(buf_map(bufs[block]), sfs_dir_tablebucket(table, block),
+		       SFS_BLOCKSIZE);
+		buf_markdirty(bufs[block]);
+		buf_release(bufs[block]);
+	}
+	kfree(bufs);
+	sfs_dir_tabledestroy(table, nbuckets);
+
+	sv->sv_i.sfi_size = nbuckets * SFS_BLOCKSIZE;
+	sv->sv_i.sfi_dirbuckets = nbuckets;
+	sv->sv_i.sfi_dirprobe = maxprobe;
+	sv->sv_dirty = true;
+	return 0;
+
+ fail:
+	kfree(bufs);
+	sfs_dir_tabledestroy(table, nbuckets);
+	return result;
+}
+
+/*
+ * Find a free slot for NAME in a hashed directory that has none in
+ * the buckets it's searched in now: look a few buckets further on,
+ * and if that doesn't work, double the size of the table and try
+ * again. Once the table is as big as it gets, any bucket will do.
+ *
+ * If the table is full, or there's no memory or space to make it
+ * bigger, the directory goes back to being linear, and we hand back
+ * -1 so the caller adds the name at the end.
+ */
+static
+int
+sfs_dir_hashslot(struct sfs_vnode *sv, const char *name, int *ret)
+{
+	struct sfs_fs *sfs = sv->sv_absvn.vn_fs->fs_data;
+	unsigned nbuckets, home, limit, probe;
+	int freeslot, result;
+
+	while (1) {
+		nbuckets = sv->sv_i.sfi_dirbuckets;
+		home = sfs_dir_hash(name) & (nbuckets - 1);
+		limit = nbuckets;
+		if (nbuckets < SFS_DIRHASH_MAXBUCKETS &&
+		    limit > SFS_DIRHASH_MAXPROBE) {
+			limit = SFS_DIRHASH_MAXPROBE;
+		}
+
+		for (probe=0; probe<limit; probe++) {
+			freeslot = -1;
+			result = sfs_dir_scanbucket(sv,
+					(home + probe) & (nbuckets - 1),
+					NULL, NULL, NULL, &freeslot);
+			if (result != ENOENT) {
+				return result;
+			}
+			if (freeslot >= 0) {
+				if (probe > sv->sv_i.sfi_dirprobe) {
+					sv->sv_i.sfi_dirprobe = probe;
+					sv->sv_dirty = true;
+				}
+				*ret = freeslot;
+				return 0;
+			}
+		}
+
+		if (nbuckets >= SFS_DIRHASH_MAXBUCKETS) {
+			break;
+		}
+		result = sfs_dir_rehash(sv, nbuckets * 2);
+		if (result == ENOMEM || result == ENOSPC) {
+			/* The table is untouched, so it can be read linearly. */
+			break;
+		}
+		if (result) {
+			return result;
+		}
+	}
+
+	kprintf("sfs: %s: directory %u: no room to hash, now linear\n",
+		sfs->sfs_sb.sb_volname, sv->sv_ino);
+	sv->sv_i.sfi_dirbuckets = 0;
+	sv->sv_i.sfi_dirprobe = 0;
+	sv->sv_dirty = true;
+	*ret = -1;
+	return 0;
+}
+
+/*
+ * Turn a full linear directory of NENTRIES slots into a hashed one
+ * with room to spare, if it isn't too big. Hands back whether it did.
+ */
+static
+int
+sfs_dir_tohashed(struct sfs_vnode *sv, unsigned nentries, bool *done)
+{
+	unsigned nbuckets;
+	int result;
+
+	*done = false;
+
+	/* Start at most half full. */
+	nbuckets = 1;
+	while (nbuckets * SFS_DIRPERBLOCK < 2 * (nentries + 1)) {
+		nbuckets *= 2;
+	}
+	if (nbuckets > SFS_DIRHASH_MAXBUCKETS) {
+		return 0;
+	}
+
+	result = sfs_dir_rehash(sv, nbuckets);
+	if (result == ENOMEM || result == ENOSPC) {
+		/* Just stay linear. */
+		return 0;
+	}
+	if (result) {
+		return result;
+	}
+	*done = true;
+	return 0;
+}
+
+/*
+ * Search a directory for a particular filename in a directory, and
+ * return its inode number, its slot, and/or the slot number of an
+ * empty directory slot if one is found.
+ */
+int
+sfs_dir_findname(struct sfs_vnode *sv, const char *name,
+		uint32_t *ino, int *slot, int *emptyslot)
+{
+	if (sfs_dir_ishashed(sv)) {
+		return sfs_dir_findhashed(sv, name, ino, slot, emptyslot);
+	}
+	return sfs_dir_findlinear(sv, name, ino, slot, emptyslot);
+}
+
 /*
  * Create a link in a directory to the specified inode by number, with
  * the specified name, and optionally hand back the slot.
+ *
+ * This may rebuild the directory, moving other entries to new slots.
  */
 int
 sfs_dir_link(struct sfs_vnode *sv, const char *name, uint32_t ino, int *slot)
 {
 	int emptyslot = -1;
+	unsigned nentries;
+	bool hashed;
 	int result;
 	struct sfs_direntry sd;
 
@@ -170,6 +651,25 @@ sfs_dir_link(struct sfs_vnode *sv, const char *name, uint32_t ino, int *slot)
 		return ENAMETOOLONG;
 	}
 
+	if (emptyslot < 0) {
+		hashed = sfs_dir_ishashed(sv);
+		nentries = sfs_dir_nentries(sv);
+		if (!hashed &&
+		    nentries >= SFS_DIRHASH_MINBLOCKS * SFS_DIRPERBLOCK) {
+			/* Rather than make it longer still, hash it. */
+			result = sfs_dir_tohashed(sv, nentries, &hashed);
+			if (result) {
+				return result;
+			}
+		}
+		if (hashed) {
+			result = sfs_dir_hashslot(sv, name, &emptyslot);
+			if (result) {
+				return result;
+			}
+		}
+	}
+
 	/* If we didn't get an empty slot, add the entry at the end. */
 	if (emptyslot < 0) {
 		emptyslot = sfs_dir_nentries(sv);
@@ -207,7 +707,9 @@ sfs_dir_unlink(struct sfs_vnode *sv, int slot)
 
 /*
  * Look for a name in a directory and hand back a vnode for the
- * file, if there is one.
+ * file, if there is one. The directory must be locked. A file's link
+ * count only changes with a directory it's in locked too, so it's
+ * safe to look at here without locking the file.
  */
 int
 sfs_lookonce(struct sfs_vnode *sv, const char *name,
@@ -38,9 +38,11 @@
 #include <lib.h>
 #include <array.h>
 #include <bitmap.h>
+#include <synch.h>
 #include <uio.h>
 #include <vfs.h>
 #include <device.h>
+#include <buf.h>
 #include <sfs.h>
 #include "sfsprivate.h"
 
@@ -106,21 +108,58 @@ sfs_freemapio(struct sfs_fs *sfs, enum uio_rw rw)
 }
 
 /*
- * Sync routine for the vnode table.
+ * Sync routine for the vnode table. This only gets the inodes into
+ * the buffer cache; sfs_sync flushes the cache afterwards, once,
+ * rather than once per vnode as VOP_FSYNC would.
+ *
+ * Each inode has to be locked to sync it, and that can't be done
+ * holding sfs_vnlock, so take a reference to each vnode in the table
+ * first and then go through them without it.
  */
 static
 int
 sfs_sync_vnodes(struct sfs_fs *sfs)
 {
+	struct vnode **vns;
+	struct sfs_vnode *sv;
 	unsigned i, num;
+	int result, err = 0;
+
+	lock_acquire(sfs->sfs_vnlock);
+	num = sfs->sfs_nvnodes;
+	vns = kmalloc((num > 0 ? num : 1) * sizeof(*vns));
+	if (vns == NULL) {
+		lock_release(sfs->sfs_vnlock);
+		return ENOMEM;
+	}
+	num = 0;
+	for (i=0; i<sfs->sfs_vnhashsize; i++) {
+		for (sv = sfs->sfs_vnhash[i]; sv != NULL;
+		     sv = sv->sv_hashnext) {
+			if (sv->sv_reclaiming) {
+				/* sfs_reclaim syncs it itself. */
+				continue;
+			}
+			vns[num] = &sv->sv_absvn;
+			VOP_INCREF(vns[num]);
+			num++;
+		}
+	}
+	KASSERT(num <= sfs->sfs_nvnodes);
+	lock_release(sfs->sfs_vnlock);
 
-	/* Go over the array of loaded vnodes, syncing as we go. */
-	num = vnodearray_num(sfs->sfs_vnodes);
 	for (i=0; i<num; i++) {
-		struct vnode *v = vnodearray_get(sfs->sfs_vnodes, i);
-		VOP_FSYNC(v);
+		sv = vns[i]->vn_data;
+		lock_acquire(sv->sv_lock);
+		result = sfs_sync_inode(sv);
+		lock_release(sv->sv_lock);
+		if (result && err == 0) {
+			err = result;
+		}
+		VOP_DECREF(vns[i]);
 	}
-	return 0;
+	kfree(vns);
+	return err;
 }
 
 /*
@@ -130,17 +169,18 @@ static
 int
 sfs_sync_freemap(struct sfs_fs *sfs)
 {
-	int result;
+	int result = 0;
 
+	lock_acquire(sfs->sfs_freemaplock);
 	if (sfs->sfs_freemapdirty) {
 		result = sfs_freemapio(sfs, UIO_WRITE);
-		if (result) {
-			return result;
+		if (result == 0) {
+			sfs->sfs_freemapdirty = false;
 		}
-		sfs->sfs_freemapdirty = false;
 	}
+	lock_release(sfs->sfs_freemaplock);
 
-	return 0;
+	return result;
 }
 
 /*
@@ -150,17 +190,19 @@ static
 int
 sfs_sync_superblock(struct sfs_fs *sfs)
 {
-	int result;
+	int result = 0;
 
+	lock_acquire(sfs->sfs_freemaplock);
 	if (sfs->sfs_superdirty) {
 		result = sfs_writeblock(sfs, SFS_SUPER_BLOCK, &sfs->sfs_sb,
 					sizeof(sfs->sfs_sb));
-		if (result) {
-			return result;
+		if (result == 0) {
+			sfs->sfs_superdirty = false;
 		}
-		sfs->sfs_superdirty = false;
 	}
-	return 0;
+	lock_release(sfs->sfs_freemaplock);
+
+	return result;
 }
 
 /*
@@ -174,8 +216,6 @@ sfs_sync(struct fs *fs)
 	struct sfs_fs *sfs;
 	int result;
 
-	vfs_biglock_acquire();
-
 	/*
 	 * Get the sfs_fs from the generic abstract fs.
 	 *
@@ -211,25 +251,31 @@ sfs_sync(struct fs *fs)
 	/* If any vnodes need to be written, write them. */
 	result = sfs_sync_vnodes(sfs);
 	if (result) {
-		vfs_biglock_release();
+		return result;
+	}
+
+	/*
+	 * Write back the buffer cache. This goes before the freemap,
+	 * so newly allocated blocks are on disk (zeroed, at least)
+	 * before the freemap says they're in use.
+	 */
+	result = buf_flush(fs);
+	if (result) {
 		return result;
 	}
 
 	/* If the free block map needs to be written, write it. */
 	result = sfs_sync_freemap(sfs);
 	if (result) {
-		vfs_biglock_release();
 		return result;
 	}
 
 	/* If the superblock needs to be written, write it. */
 	result = sfs_sync_superblock(sfs);
 	if (result) {
-		vfs_biglock_release();
 		return result;
 	}
 
-	vfs_biglock_release();
 	return 0;
 }
 
@@ -243,13 +289,9 @@ const char *
 sfs_getvolname(struct fs *fs)
 {
 	struct sfs_fs *sfs = fs->fs_data;
-	const char *ret;
 
-	vfs_biglock_acquire();
-	ret = sfs->sfs_sb.sb_volname;
-	vfs_biglock_release();
-
-	return ret;
+	/* It's set at mount time and never changes, so no need to lock. */
+	return sfs->sfs_sb.sb_volname;
 }
 
 /*
@@ -262,7 +304,10 @@ sfs_fs_destroy(struct sfs_fs *sfs)
 	if (sfs->sfs_freemap != NULL) {
 		bitmap_destroy(sfs->sfs_freemap);
 	}
-	vnodearray_destroy(sfs->sfs_vnodes);
+	sfs_vnhash_cleanup(sfs);
+	lock_destroy(sfs->sfs_freemaplock);
+	cv_destroy(sfs->sfs_vncv);
+	lock_destroy(sfs->sfs_vnlock);
 	KASSERT(sfs->sfs_device == NULL);
 	kfree(sfs);
 }
@@ -278,18 +323,25 @@ sfs_unmount(struct fs *fs)
 {
 	struct sfs_fs *sfs = fs->fs_data;
 
-	vfs_biglock_acquire();
-
-	/* Do we have any files open? If so, can't unmount. */
-	if (vnodearray_num(sfs->sfs_vnodes) > 0) {
-		vfs_biglock_release();
+	/*
+	 * Do we have any files open? If so, can't unmount. Once
+	 * there are none, no more can turn up: with the filesystem
+	 * being unmounted, there's nothing to look them up from.
+	 */
+	lock_acquire(sfs->sfs_vnlock);
+	if (sfs->sfs_nvnodes > 0) {
+		lock_release(sfs->sfs_vnlock);
 		return EBUSY;
 	}
+	lock_release(sfs->sfs_vnlock);
 
 	/* We should have just had sfs_sync called. */
 	KASSERT(sfs->sfs_superdirty == false);
 	KASSERT(sfs->sfs_freemapdirty == false);
 
+	/* Nothing of ours can be in use, so forget our buffers. */
+	buf_dropall(fs);
+
 	/* The vfs layer takes care of the device for us */
 	sfs->sfs_device = NULL;
 
@@ -297,10 +349,43 @@ sfs_unmount(struct fs *fs)
 	sfs_fs_destroy(sfs);
 
 	/* nothing else to do */
-	vfs_biglock_release();
 	return 0;
 }
 
+/*
+ * Block I/O for the buffer cache.
+ */
+static
+int
+sfs_fsblockio(struct fs *fs, struct uio *uio)
+{
+	return sfs_rwblock(fs->fs_data, uio);
+}
+
+/*
+ * Writeback routine for the syncer: get dirty inodes into the buffer
+ * cache, and write the freemap and superblock. Unlike sfs_sync, this
+ * leaves the cache alone, so recently dirtied buffers can wait to be
+ * written out by age with their neighbours.
+ */
+static
+int
+sfs_writeback(struct fs *fs)
+{
+	struct sfs_fs *sfs = fs->fs_data;
+	int result;
+
+	result = sfs_sync_vnodes(sfs);
+	if (result == 0) {
+		result = sfs_sync_freemap(sfs);
+	}
+	if (result == 0) {
+		result = sfs_sync_superblock(sfs);
+	}
+
+	return result;
+}
+
 /*
  * File system operations table.
  */
@@ -309,6 +394,8 @@ static const struct fs_ops sfs_fsops = {
 	.fsop_getvolname = sfs_getvolname,
 	.fsop_getroot = sfs_getroot,
 	.fsop_unmount = sfs_unmount,
+	.fsop_blockio = sfs_fsblockio,
+	.fsop_writeback = sfs_writeback,
 };
 
 /*
@@ -328,6 +415,7 @@ sfs_fs_create(void)
 	COMPILE_ASSERT(sizeof(struct sfs_superblock)==SFS_BLOCKSIZE);
 	COMPILE_ASSERT(sizeof(struct sfs_dinode)==SFS_BLOCKSIZE);
 	COMPILE_ASSERT(SFS_BLOCKSIZE % sizeof(struct sfs_direntry) == 0);
+	COMPILE_ASSERT(SFS_BLOCKSIZE == BUF_SIZE);
 
 	/* Allocate object */
 	sfs = kmalloc(sizeof(struct sfs_fs));
@@ -351,17 +439,34 @@ sfs_fs_create(void)
 	sfs->sfs_device = NULL;
 
 	/* vnode table */
-	sfs->sfs_vnodes = vnodearray_create();
-	if (sfs->sfs_vnodes == NULL) {
+	sfs->sfs_vnlock = lock_create("sfs vnodes");
+	if (sfs->sfs_vnlock == NULL) {
 		goto cleanup_object;
 	}
+	sfs->sfs_vncv = cv_create("sfs reclaim");
+	if (sfs->sfs_vncv == NULL) {
+		goto cleanup_vnlock;
+	}
+	if (sfs_vnhash_init(sfs)) {
+		goto cleanup_vncv;
+	}
 
 	/* freemap */
+	sfs->sfs_freemaplock = lock_create("sfs freemap");
+	if (sfs->sfs_freemaplock == NULL) {
+		goto cleanup_vnodes;
+	}
 	sfs->sfs_freemap = NULL;
 	sfs->sfs_freemapdirty = false;
 
 	return sfs;
 
+cleanup_vnodes:
+	sfs_vnhash_cleanup(sfs);
+cleanup_vncv:
+	cv_destroy(sfs->sfs_vncv);
+cleanup_vnlock:
+	lock_destroy(sfs->sfs_vnlock);
 cleanup_object:
 	kfree(sfs);
 fail:
@@ -388,8 +493,6 @@ sfs_domount(void *options, struct device *dev, struct fs **ret)
 	int result;
 	struct sfs_fs *sfs;
 
-	vfs_biglock_acquire();
-
 	/* We don't pass any options through mount */
 	(void)options;
 
@@ -402,7 +505,6 @@ sfs_domount(void *options, struct device *dev, struct fs **ret)
 	 * don't do that in sfs.)
 	 */
 	if (dev->d_blocksize != SFS_BLOCKSIZE) {
-		vfs_biglock_release();
 		kprintf("sfs: Cannot mount on device with blocksize %zu\n",
 			dev->d_blocksize);
 		return ENXIO;
@@ -410,7 +512,6 @@ sfs_domount(void *options, struct device *dev, struct fs **ret)
 
 	sfs = sfs_fs_create();
 	if (sfs == NULL) {
-		vfs_biglock_release();
 		return ENOMEM;
 	}
 
@@ -423,7 +524,6 @@ sfs_domount(void *options, struct device *dev, struct fs **ret)
 	if (result) {
 		sfs->sfs_device = NULL;
 		sfs_fs_destroy(sfs);
-		vfs_biglock_release();
 		return result;
 	}
 
@@ -436,7 +536,6 @@ sfs_domount(void *options, struct device *dev, struct fs **ret)
 			SFS_MAGIC);
 		sfs->sfs_device = NULL;
 		sfs_fs_destroy(sfs);
-		vfs_biglock_release();
 		return EINVAL;
 	}
 
@@ -453,21 +552,18 @@ sfs_domount(void *options, struct device *dev, struct fs **ret)
 	if (sfs->sfs_freemap == NULL) {
 		sfs->sfs_device = NULL;
 		sfs_fs_destroy(sfs);
-		vfs_biglock_release();
 		return ENOMEM;
 	}
 	result = sfs_freemapio(sfs, UIO_READ);
 	if (result) {
 		sfs->sfs_device = NULL;
 		sfs_fs_destroy(sfs);
-		vfs_biglock_release();
 		return result;
 	}
 
 	/* Hand back the abstract fs */
 	*ret = &sfs->sfs_absfs;
 
-	vfs_biglock_release();
 	return 0;
 }
 
@@ -35,26 +35,188 @@
 #include <types.h>
 #include <kern/errno.h>
 #include <lib.h>
+#include <synch.h>
+#include <vm.h>
 #include <vfs.h>
+#include <buf.h>
 #include <sfs.h>
 #include "sfsprivate.h"
 
+/* Initial number of vnode hash chains; must be a power of 2. */
+#define SFS_VNHASH_INITSIZE	32
+
+/* Most chains: a page's worth, as kmalloc can't give us more. */
+#define SFS_VNHASH_MAXSIZE	(PAGE_SIZE / sizeof(struct sfs_vnode *))
+
 
 /*
- * Write an on-disk inode structure back out to disk.
+ * Vnode table. This is a hash table of the loaded vnodes keyed on
+ * inode number, with the chains doubly linked so a vnode can be taken
+ * off in constant time when it's reclaimed. It grows when the chains
+ * average more than two vnodes, up to a page of chains; if it's that
+ * big already, or there's no memory to grow it, it stays as it is,
+ * which is slower but still correct.
+ *
+ * Inode numbers are block numbers, and those of files created
+ * together tend to be close together, so the low bits make a fine
+ * hash.
+ */
+
+int
+sfs_vnhash_init(struct sfs_fs *sfs)
+{
+	unsigned i;
+
+	sfs->sfs_vnhash = kmalloc(SFS_VNHASH_INITSIZE *
+				  sizeof(*sfs->sfs_vnhash));
+	if (sfs->sfs_vnhash == NULL) {
+		return ENOMEM;
+	}
+	for (i=0; i<SFS_VNHASH_INITSIZE; i++) {
+		sfs->sfs_vnhash[i] = NULL;
+	}
+	sfs->sfs_vnhashsize = SFS_VNHASH_INITSIZE;
+	sfs->sfs_nvnodes = 0;
+	return 0;
+}
+
+void
+sfs_vnhash_cleanup(struct sfs_fs *sfs)
+{
+	KASSERT(sfs->sfs_nvnodes == 0);
+	kfree(sfs->sfs_vnhash);
+	sfs->sfs_vnhash = NULL;
+}
+
+/*
+ * Put SV on the front of the chain in TABLE (of SIZE chains) for its
+ * inode number.
+ */
+static
+void
+sfs_vnhash_link(struct sfs_vnode **table, unsigned size,
+		struct sfs_vnode *sv)
+{
+	struct sfs_vnode **chain;
+
+	chain = &table[sv->sv_ino & (size - 1)];
+	sv->sv_hashnext = *chain;
+	if (sv->sv_hashnext != NULL) {
+		sv->sv_hashnext->sv_hashpprev = &sv->sv_hashnext;
+	}
+	sv->sv_hashpprev = chain;
+	*chain = sv;
+}
+
+/*
+ * Double the size of the table, rehashing everything into the new
+ * one. The caller makes sure it's not at SFS_VNHASH_MAXSIZE yet.
+ * Failing is harmless, so we don't report it.
+ */
+static
+void
+sfs_vnhash_grow(struct sfs_fs *sfs)
+{
+	struct sfs_vnode **newtable, *sv;
+	unsigned newsize, i;
+
+	KASSERT(lock_do_i_hold(sfs->sfs_vnlock));
+
+	newsize = sfs->sfs_vnhashsize * 2;
+	KASSERT(newsize <= SFS_VNHASH_MAXSIZE);
+	newtable = kmalloc(newsize * sizeof(*newtable));
+	if (newtable == NULL) {
+		return;
+	}
+	for (i=0; i<newsize; i++) {
+		newtable[i] = NULL;
+	}
+	for (i=0; i<sfs->sfs_vnhashsize; i++) {
+		while ((sv = sfs->sfs_vnhash[i]) != NULL) {
+			sfs->sfs_vnhash[i] = sv->sv_hashnext;
+			sfs_vnhash_link(newtable, newsize, sv);
+		}
+	}
+	kfree(sfs->sfs_vnhash);
+	sfs->sfs_vnhash = newtable;
+	sfs->sfs_vnhashsize = newsize;
+}
+
+/*
+ * Add a newly loaded vnode to the table.
+ */
+static
+void
+sfs_vnhash_add(struct sfs_fs *sfs, struct sfs_vnode *sv)
+{
+	KASSERT(lock_do_i_hold(sfs->sfs_vnlock));
+
+	sfs_vnhash_link(sfs->sfs_vnhash, sfs->sfs_vnhashsize, sv);
+	sfs->sfs_nvnodes++;
+	if (sfs->sfs_nvnodes > 2 * sfs->sfs_vnhashsize &&
+	    sfs->sfs_vnhashsize < SFS_VNHASH_MAXSIZE) {
+		sfs_vnhash_grow(sfs);
+	}
+}
+
+/*
+ * Take a vnode being reclaimed out of the table.
+ */
+static
+void
+sfs_vnhash_remove(struct sfs_fs *sfs, struct sfs_vnode *sv)
+{
+	KASSERT(lock_do_i_hold(sfs->sfs_vnlock));
+	KASSERT(sfs->sfs_nvnodes > 0);
+
+	*sv->sv_hashpprev = sv->sv_hashnext;
+	if (sv->sv_hashnext != NULL) {
+		sv->sv_hashnext->sv_hashpprev = sv->sv_hashpprev;
+	}
+	sv->sv_hashnext = NULL;
+	sv->sv_hashpprev = NULL;
+	sfs->sfs_nvnodes--;
+}
+
+/*
+ * Find the loaded vnode for inode INO, if any.
+ */
+static
+struct sfs_vnode *
+sfs_vnhash_find(struct sfs_fs *sfs, uint32_t ino)
+{
+	struct sfs_vnode *sv;
+
+	KASSERT(lock_do_i_hold(sfs->sfs_vnlock));
+
+	sv = sfs->sfs_vnhash[ino & (sfs->sfs_vnhashsize - 1)];
+	while (sv != NULL && sv->sv_ino != ino) {
+		sv = sv->sv_hashnext;
+	}
+	return sv;
+}
+
+/*
+ * Write an on-disk inode structure back out to its buffer. (The
+ * inode fills the whole block, so there's no need to read it first.)
  */
 int
 sfs_sync_inode(struct sfs_vnode *sv)
 {
 	struct sfs_fs *sfs = sv->sv_absvn.vn_fs->fs_data;
+	struct buf *b;
 	int result;
 
+	KASSERT(lock_do_i_hold(sv->sv_lock));
+
 	if (sv->sv_dirty) {
-		result = sfs_writeblock(sfs, sv->sv_ino, &sv->sv_i,
-					sizeof(sv->sv_i));
+		result = buf_get(&sfs->sfs_absfs, sv->sv_ino, &b);
 		if (result) {
 			return result;
 		}
+		memcpy(buf_map(b), &sv->sv_i, sizeof(sv->sv_i));
+		buf_markdirty(b);
+		buf_release(b);
 		sv->sv_dirty = false;
 	}
 	return 0;
@@ -64,21 +226,25 @@ sfs_sync_inode(struct sfs_vnode *sv)
  * Called when the vnode refcount (in-memory usage count) hits zero.
  *
  * This function should try to avoid returning errors other than EBUSY.
+ *
+ * sfs_vnlock is only held to check the refcount and mark the vnode,
+ * and at the end to take it out of the table, so truncating a large
+ * file doesn't hold up everyone else loading vnodes. In between,
+ * sfs_loadvnode waits rather than hand out a new reference.
  */
 int
 sfs_reclaim(struct vnode *v)
 {
 	struct sfs_vnode *sv = v->vn_data;
 	struct sfs_fs *sfs = v->vn_fs->fs_data;
-	unsigned ix, i, num;
 	int result;
 
-	vfs_biglock_acquire();
+	lock_acquire(sfs->sfs_vnlock);
 
 	/*
 	 * Make sure someone else hasn't picked up the vnode since the
-	 * decision was made to reclaim it. (You must also synchronize
-	 * this with sfs_loadvnode.)
+	 * decision was made to reclaim it. Marking it keeps
+	 * sfs_loadvnode from doing so from here on.
 	 */
 	spinlock_acquire(&v->vn_countlock);
 	if (v->vn_refcount != 1) {
@@ -88,25 +254,33 @@ sfs_reclaim(struct vnode *v)
 		v->vn_refcount--;
 
 		spinlock_release(&v->vn_countlock);
-		vfs_biglock_release();
+		lock_release(sfs->sfs_vnlock);
 		return EBUSY;
 	}
 	spinlock_release(&v->vn_countlock);
+	KASSERT(!sv->sv_reclaiming);
+	sv->sv_reclaiming = true;
+	lock_release(sfs->sfs_vnlock);
+
+	/*
+	 * Nobody else has a reference, so nobody else can hold or be
+	 * waiting for the vnode's lock; we take it for the sake of
+	 * the functions below.
+	 */
+	lock_acquire(sv->sv_lock);
 
 	/* If there are no on-disk references to the file either, erase it. */
 	if (sv->sv_i.sfi_linkcount == 0) {
 		result = sfs_itrunc(sv, 0);
 		if (result) {
-			vfs_biglock_release();
-			return result;
+			goto fail;
 		}
 	}
 
 	/* Sync the inode to disk */
 	result = sfs_sync_inode(sv);
 	if (result) {
-		vfs_biglock_release();
-		return result;
+		goto fail;
 	}
 
 	/* If there are no on-disk references, discard the inode */
@@ -114,32 +288,38 @@ sfs_reclaim(struct vnode *v)
 		sfs_bfree(sfs, sv->sv_ino);
 	}
 
+	lock_release(sv->sv_lock);
+
 	/* Remove the vnode structure from the table in the struct sfs_fs. */
-	num = vnodearray_num(sfs->sfs_vnodes);
-	ix = num;
-	for (i=0; i<num; i++) {
-		struct vnode *v2 = vnodearray_get(sfs->sfs_vnodes, i);
-		struct sfs_vnode *sv2 = v2->vn_data;
-		if (sv2 == sv) {
-			ix = i;
-			break;
-		}
-	}
-	if (ix == num) {
+	lock_acquire(sfs->sfs_vnlock);
+	spinlock_acquire(&v->vn_countlock);
+	KASSERT(v->vn_refcount == 1);
+	spinlock_release(&v->vn_countlock);
+	if (sfs_vnhash_find(sfs, sv->sv_ino) != sv) {
 		panic("sfs: %s: reclaim vnode %u not in vnode pool\n",
 		      sfs->sfs_sb.sb_volname, sv->sv_ino);
 	}
-	vnodearray_remove(sfs->sfs_vnodes, ix);
+	sfs_vnhash_remove(sfs, sv);
 
 	vnode_cleanup(&sv->sv_absvn);
 
-	vfs_biglock_release();
+	cv_broadcast(sfs->sfs_vncv, sfs->sfs_vnlock);
+	lock_release(sfs->sfs_vnlock);
 
 	/* Release the storage for the vnode structure itself. */
+	lock_destroy(sv->sv_lock);
 	kfree(sv);
 
 	/* Done */
 	return 0;
+
+ fail:
+	lock_release(sv->sv_lock);
+	lock_acquire(sfs->sfs_vnlock);
+	sv->sv_reclaiming = false;
+	cv_broadcast(sfs->sfs_vncv, sfs->sfs_vnlock);
+	lock_release(sfs->sfs_vnlock);
+	return result;
 }
 
 /*
@@ -150,42 +330,47 @@ int
 sfs_loadvnode(struct sfs_fs *sfs, uint32_t ino, int forcetype,
 		 struct sfs_vnode **ret)
 {
-	struct vnode *v;
 	struct sfs_vnode *sv;
+	struct buf *b;
 	const struct vnode_ops *ops;
-	unsigned i, num;
 	int result;
 
-	/* Look in the vnodes table */
-	num = vnodearray_num(sfs->sfs_vnodes);
-
-	/* Linear search. Is this too slow? You decide. */
-	for (i=0; i<num; i++) {
-		v = vnodearray_get(sfs->sfs_vnodes, i);
-		sv = v->vn_data;
+	lock_acquire(sfs->sfs_vnlock);
 
+	/* Look in the vnodes table */
+	sv = sfs_vnhash_find(sfs, ino);
+	while (sv != NULL && sv->sv_reclaiming) {
+		/* Wait for it to go away (or for the reclaim to fail). */
+		cv_wait(sfs->sfs_vncv, sfs->sfs_vnlock);
+		sv = sfs_vnhash_find(sfs, ino);
+	}
+	if (sv != NULL) {
 		/* Every inode in memory must be in an allocated block */
 		if (!sfs_bused(sfs, sv->sv_ino)) {
 			panic("sfs: %s: Found inode %u in unallocated block\n",
 			      sfs->sfs_sb.sb_volname, sv->sv_ino);
 		}
 
-		if (sv->sv_ino==ino) {
-			/* Found */
-
-			/* forcetype is only allowed when creating objects */
-			KASSERT(forcetype==SFS_TYPE_INVAL);
+		/* forcetype is only allowed when creating objects */
+		KASSERT(forcetype==SFS_TYPE_INVAL);
 
-			VOP_INCREF(&sv->sv_absvn);
-			*ret = sv;
-			return 0;
-		}
+		VOP_INCREF(&sv->sv_absvn);
+		lock_release(sfs->sfs_vnlock);
+		*ret = sv;
+		return 0;
 	}
 
 	/* Didn't have it loaded; load it */
 
 	sv = kmalloc(sizeof(struct sfs_vnode));
 	if (sv==NULL) {
+		lock_release(sfs->sfs_vnlock);
+		return ENOMEM;
+	}
+	sv->sv_lock = lock_create("sfs vnode");
+	if (sv->sv_lock == NULL) {
+		kfree(sv);
+		lock_release(sfs->sfs_vnlock);
 		return ENOMEM;
 	}
 
@@ -196,14 +381,19 @@ sfs_loadvnode(struct sfs_fs *sfs, uint32_t ino, int forcetype,
 	}
 
 	/* Read the block the inode is in */
-	result = sfs_readblock(sfs, ino, &sv->sv_i, sizeof(sv->sv_i));
+	result = buf_read(&sfs->sfs_absfs, ino, &b);
 	if (result) {
+		lock_destroy(sv->sv_lock);
 		kfree(sv);
+		lock_release(sfs->sfs_vnlock);
 		return result;
 	}
+	memcpy(&sv->sv_i, buf_map(b), sizeof(sv->sv_i));
+	buf_release(b);
 
 	/* Not dirty yet */
 	sv->sv_dirty = false;
+	sv->sv_reclaiming = false;
 
 	/*
 	 * FORCETYPE is set if we're creating a new file, because the
@@ -235,7 +425,9 @@ sfs_loadvnode(struct sfs_fs *sfs, uint32_t ino, int forcetype,
 	/* Call the common vnode initializer */
 	result = vnode_init(&sv->sv_absvn, ops, &sfs->sfs_absfs, sv);
 	if (result) {
+		lock_destroy(sv->sv_lock);
 		kfree(sv);
+		lock_release(sfs->sfs_vnlock);
 		return result;
 	}
 
@@ -243,12 +435,9 @@ sfs_loadvnode(struct sfs_fs *sfs, uint32_t ino, int forcetype,
 	sv->sv_ino = ino;
 
 	/* Add it to our table */
-	result = vnodearray_add(sfs->sfs_vnodes, &sv->sv_absvn, NULL);
-	if (result) {
-		vnode_cleanup(&sv->sv_absvn);
-		kfree(sv);
-		return result;
-	}
+	sfs_vnhash_add(sfs, sv);
+
+	lock_release(sfs->sfs_vnlock);
 
 	/* Hand it back */
 	*ret = sv;
@@ -296,25 +485,20 @@ sfs_getroot(struct fs *fs, struct vnode **ret)
 	struct sfs_vnode *sv;
 	int result;
 
-	vfs_biglock_acquire();
-
 	result = sfs_loadvnode(sfs, SFS_ROOTDIR_INO, SFS_TYPE_INVAL, &sv);
 	if (result) {
 		kprintf("sfs: %s: getroot: Cannot load root vnode\n",
 			sfs->sfs_sb.sb_volname);
-		vfs_biglock_release();
 		return result;
 	}
 
 	if (sv->sv_i.sfi_type != SFS_TYPE_DIR) {
 		kprintf("sfs: %s: getroot: not directory (type %u)\n",
 			sfs->sfs_sb.sb_volname, sv->sv_i.sfi_type);
-		vfs_biglock_release();
+		VOP_DECREF(&sv->sv_absvn);
 		return EINVAL;
 	}
 
-	vfs_biglock_release();
-
 	*ret = &sv->sv_absvn;
 	return 0;
 }
@@ -36,8 +36,12 @@
 #include <kern/errno.h>
 #include <lib.h>
 #include <uio.h>
+#include <synch.h>
 #include <vfs.h>
 #include <device.h>
+#include <buf.h>
+#include <thread.h>
+#include <current.h>
 #include <sfs.h>
 #include "sfsprivate.h"
 
@@ -46,6 +50,11 @@
 // Basic block-level I/O routines
 
 /*
+ * These go straight to the disk. The buffer cache does its I/O with
+ * sfs_rwblock, and sfs_readblock and sfs_writeblock are used for the
+ * superblock and freemap, which are kept in memory anyway; everything
+ * else should go through the cache.
+ *
  * Note: sfs_readblock is used to read the superblock
  * early in mount, before sfs is fully (or even mostly)
  * initialized, and so may not use anything from sfs
@@ -53,21 +62,27 @@
  */
 
 /*
- * Read or write a block, retrying I/O errors.
+ * Read or write a block, or several consecutive blocks, retrying I/O
+ * errors.
  */
-static
 int
 sfs_rwblock(struct sfs_fs *sfs, struct uio *uio)
 {
 	int result;
 	int tries=0;
 
-	KASSERT(vfs_biglock_do_i_hold());
-
 	DEBUG(DB_SFS, "sfs: %s %llu\n",
 	      uio->uio_rw == UIO_READ ? "read" : "write",
 	      uio->uio_offset / SFS_BLOCKSIZE);
 
+	/* Charge the I/O to whoever asked for it. */
+	if (uio->uio_rw == UIO_READ) {
+		curthread->t_usage.u_inblock++;
+	}
+	else {
+		curthread->t_usage.u_oublock++;
+	}
+
  retry:
 	result = DEVOP_IO(sfs->sfs_device, uio);
 	if (result == EINVAL) {
@@ -150,16 +165,8 @@ int
 sfs_partialio(struct sfs_vnode *sv, struct uio *uio,
 	      uint32_t skipstart, uint32_t len)
 {
-	/*
-	 * I/O buffer for handling partial sectors.
-	 *
-	 * Note: in real life (and when you've done the fs assignment)
-	 * you would get space from the disk buffer cache for this,
-	 * not use a static area.
-	 */
-	static char iobuf[SFS_BLOCKSIZE];
-
 	struct sfs_fs *sfs = sv->sv_absvn.vn_fs->fs_data;
+	struct buf *b;
 	daddr_t diskblock;
 	uint32_t fileblock;
 	int result;
@@ -169,9 +176,6 @@ sfs_partialio(struct sfs_vnode *sv, struct uio *uio,
 
 	KASSERT(skipstart + len <= SFS_BLOCKSIZE);
 
-	/* We're using a global static buffer; it had better be locked */
-	KASSERT(vfs_biglock_do_i_hold());
-
 	/* Compute the block offset of this block in the file */
 	fileblock = uio->uio_offset / SFS_BLOCKSIZE;
 
@@ -184,40 +188,32 @@ sfs_partialio(struct sfs_vnode *sv, struct uio *uio,
 	if (diskblock == 0) {
 		/*
 		 * There was no block mapped at this point in the file.
-		 * Zero the buffer.
+		 * It reads as zeros.
 		 */
 		KASSERT(uio->uio_rw == UIO_READ);
-		bzero(iobuf, sizeof(iobuf));
-	}
-	else {
-		/*
-		 * Read the block.
-		 */
-		result = sfs_readblock(sfs, diskblock, iobuf, sizeof(iobuf));
-		if (result) {
-			return result;
-		}
+		return uiomovezeros(len, uio);
 	}
 
 	/*
-	 * Now perform the requested operation into/out of the buffer.
+	 * Get the block from the buffer cache.
 	 */
-	result = uiomove(iobuf+skipstart, len, uio);
+	result = buf_read(&sfs->sfs_absfs, diskblock, &b);
 	if (result) {
 		return result;
 	}
 
 	/*
-	 * If it was a write, write back the modified block.
+	 * Now perform the requested operation into/out of the buffer.
+	 * If it was a write, the buffer is now dirty; even if uiomove
+	 * failed partway, some of it may have been changed.
 	 */
+	result = uiomove((char *)buf_map(b) + skipstart, len, uio);
 	if (uio->uio_rw == UIO_WRITE) {
-		result = sfs_writeblock(sfs, diskblock, iobuf, sizeof(iobuf));
-		if (result) {
-			return result;
-		}
+		buf_markdirty(b);
 	}
+	buf_release(b);
 
-	return 0;
+	return result;
 }
 
 /*
@@ -228,14 +224,12 @@ int
 sfs_blockio(struct sfs_vnode *sv, struct uio *uio)
 {
 	struct sfs_fs *sfs = sv->sv_absvn.vn_fs->fs_data;
+	struct buf *b;
 	daddr_t diskblock;
 	uint32_t fileblock;
 	int result;
 	bool doalloc = (uio->uio_rw==UIO_WRITE);
-	off_t saveoff;
-	off_t diskoff;
-	off_t saveres;
-	off_t diskres;
+	bool wasvalid;
 
 	/* Get the block number within the file */
 	fileblock = uio->uio_offset / SFS_BLOCKSIZE;
@@ -257,36 +251,41 @@ sfs_blockio(struct sfs_vnode *sv, struct uio *uio)
 		return uiomovezeros(SFS_BLOCKSIZE, uio);
 	}
 
-	/*
-	 * Do the I/O directly to the uio region. Save the uio_offset,
-	 * and substitute one that makes sense to the device.
-	 */
-	saveoff = uio->uio_offset;
-	diskoff = diskblock * SFS_BLOCKSIZE;
-	uio->uio_offset = diskoff;
-
-	/*
-	 * Temporarily set the residue to be one block size.
-	 */
 	KASSERT(uio->uio_resid >= SFS_BLOCKSIZE);
-	saveres = uio->uio_resid;
-	diskres = SFS_BLOCKSIZE;
-	uio->uio_resid = diskres;
 
-	result = sfs_rwblock(sfs, uio);
+	if (uio->uio_rw == UIO_READ) {
+		result = buf_read(&sfs->sfs_absfs, diskblock, &b);
+		if (result) {
+			return result;
+		}
+		result = uiomove(buf_map(b), SFS_BLOCKSIZE, uio);
+		buf_release(b);
+		return result;
+	}
 
 	/*
-	 * Now, restore the original uio_offset and uio_resid and update
-	 * them by the amount of I/O done.
+	 * We're overwriting the whole block, so there's no need to
+	 * read it first. But if the copy fails and the buffer didn't
+	 * hold the block already, what's in it now is garbage.
 	 */
-	uio->uio_offset = (uio->uio_offset - diskoff) + saveoff;
-	uio->uio_resid = (uio->uio_resid - diskres) + saveres;
-
+	result = buf_get(&sfs->sfs_absfs, diskblock, &b);
+	if (result) {
+		return result;
+	}
+	wasvalid = buf_isvalid(b);
+	result = uiomove(buf_map(b), SFS_BLOCKSIZE, uio);
+	if (result && !wasvalid) {
+		buf_discard(b);
+		return result;
+	}
+	buf_markdirty(b);
+	buf_release(b);
 	return result;
 }
 
 /*
  * Do I/O of a whole region of data, whether or not it's block-aligned.
+ * The file must be locked.
  */
 int
 sfs_io(struct sfs_vnode *sv, struct uio *uio)
@@ -388,6 +387,45 @@ sfs_io(struct sfs_vnode *sv, struct uio *uio)
 	return result;
 }
 
+/*
+ * Start reading the blocks holding LEN bytes at POS into the buffer
+ * cache, for readahead. Stops at EOF; holes are skipped, and so is
+ * everything if the block map can't be read, as this is only a hint.
+ * Mapping may read indirect blocks, but the data blocks themselves
+ * are read in the background.
+ */
+void
+sfs_prefetch(struct sfs_vnode *sv, off_t pos, off_t len)
+{
+	struct sfs_fs *sfs = sv->sv_absvn.vn_fs->fs_data;
+	off_t size;
+	uint32_t fileblock, endblock;
+	daddr_t diskblock;
+	int result;
+
+	KASSERT(lock_do_i_hold(sv->sv_lock));
+
+	size = sv->sv_i.sfi_size;
+	if (pos < 0 || len <= 0 || pos >= size) {
+		return;
+	}
+	if (len > size - pos) {
+		len = size - pos;
+	}
+
+	endblock = (pos + len + SFS_BLOCKSIZE - 1) / SFS_BLOCKSIZE;
+	for (fileblock = pos / SFS_BLOCKSIZE; fileblock < endblock;
+	     fileblock++) {
+		result = sfs_bmap(sv, fileblock, false, &diskblock);
+		if (result) {
+			return;
+		}
+		if (diskblock != 0) {
+			buf_prefetch(&sfs->sfs_absfs, diskblock);
+		}
+	}
+}
+
 ////////////////////////////////////////////////////////////
 // Metadata I/O
 
@@ -407,6 +445,8 @@ sfs_metaio(struct sfs_vnode *sv, off_t actualpos, void *data, size_t len,
 	   enum uio_rw rw)
 {
 	struct sfs_fs *sfs = sv->sv_absvn.vn_fs->fs_data;
+	struct buf *b;
+	char *blockdata;
 	off_t endpos;
 	uint32_t vnblock;
 	uint32_t blockoffset;
@@ -414,18 +454,6 @@ sfs_metaio(struct sfs_vnode *sv, off_t actualpos, void *data, size_t len,
 	bool doalloc;
 	int result;
 
-	/*
-	 * I/O buffer for metadata ops.
-	 *
-	 * Note: in real life (and when you've done the fs assignment) you
-	 * would get space from the disk buffer cache for this, not use a
-	 * static area.
-	 */
-	static char metaiobuf[SFS_BLOCKSIZE];
-
-	/* We're using a global static buffer; it had better be locked */
-	KASSERT(vfs_biglock_do_i_hold());
-
 	/* Figure out which block of the vnode (directory, whatever) this is */
 	vnblock = actualpos / SFS_BLOCKSIZE;
 	blockoffset = actualpos % SFS_BLOCKSIZE;
@@ -446,26 +474,23 @@ sfs_metaio(struct sfs_vnode *sv, off_t actualpos, void *data, size_t len,
 		return 0;
 	}
 
-	/* Read the block */
-	result = sfs_readblock(sfs, diskblock, metaiobuf, sizeof(metaiobuf));
+	/* Get the block */
+	result = buf_read(&sfs->sfs_absfs, diskblock, &b);
 	if (result) {
 		return result;
 	}
+	blockdata = buf_map(b);
 
 	if (rw == UIO_READ) {
 		/* Copy out the selected region */
-		memcpy(data, metaiobuf + blockoffset, len);
+		memcpy(data, blockdata + blockoffset, len);
+		buf_release(b);
 	}
 	else {
 		/* Update the selected region */
-		memcpy(metaiobuf + blockoffset, data, len);
-
-		/* Write the block back */
-		result = sfs_writeblock(sfs, diskblock,
-					metaiobuf, sizeof(metaiobuf));
-		if (result) {
-			return result;
-		}
+		memcpy(blockdata + blockoffset, data, len);
+		buf_markdirty(b);
+		buf_release(b);
 
 		/* Update the vnode size if needed */
 		endpos = actualpos + len;
@@ -478,3 +503,173 @@ sfs_metaio(struct sfs_vnode *sv, off_t actualpos, void *data, size_t len,
 	/* Done */
 	return 0;
 }
+
+////////////////////////////////////////////////////////////
+// File-to-file copy
+
+/*
+ * Copy one whole, block-aligned block from file SRC to file DST.
+ * Copies the source block's buffer straight into the destination's,
+ * without the read-modify-write sfs_partialio would do. A hole in the
+ * source stays a hole if the destination has one there too.
+ *
+ * To keep two copies going in opposite directions from deadlocking,
+ * the two buffers are always taken lower block number first.
+ */
+static
+int
+sfs_copyblock(struct sfs_vnode *dst, uint32_t dstblock,
+	      struct sfs_vnode *src, uint32_t srcblock)
+{
+	struct sfs_fs *sfs = dst->sv_absvn.vn_fs->fs_data;
+	struct buf *srcbuf, *dstbuf;
+	daddr_t srcdisk, dstdisk;
+	int result;
+
+	result = sfs_bmap(src, srcblock, false, &srcdisk);
+	if (result) {
+		return result;
+	}
+	result = sfs_bmap(dst, dstblock, srcdisk != 0, &dstdisk);
+	if (result) {
+		return result;
+	}
+
+	if (srcdisk == 0) {
+		if (dstdisk == 0) {
+			/* Hole onto hole; nothing to do. */
+			return 0;
+		}
+		result = buf_get(&sfs->sfs_absfs, dstdisk, &dstbuf);
+		if (result) {
+			return result;
+		}
+		bzero(buf_map(dstbuf), SFS_BLOCKSIZE);
+		buf_markdirty(dstbuf);
+		buf_release(dstbuf);
+		return 0;
+	}
+
+	KASSERT(srcdisk != dstdisk);
+	if (srcdisk < dstdisk) {
+		result = buf_read(&sfs->sfs_absfs, srcdisk, &srcbuf);
+		if (result) {
+			return result;
+		}
+		result = buf_get(&sfs->sfs_absfs, dstdisk, &dstbuf);
+		if (result) {
+			buf_release(srcbuf);
+			return result;
+		}
+	}
+	else {
+		result = buf_get(&sfs->sfs_absfs, dstdisk, &dstbuf);
+		if (result) {
+			return result;
+		}
+		result = buf_read(&sfs->sfs_absfs, srcdisk, &srcbuf);
+		if (result) {
+			buf_release(dstbuf);
+			return result;
+		}
+	}
+
+	memcpy(buf_map(dstbuf), buf_map(srcbuf), SFS_BLOCKSIZE);
+	buf_markdirty(dstbuf);
+	buf_release(dstbuf);
+	buf_release(srcbuf);
+	return 0;
+}
+
+/*
+ * Copy up to LEN bytes from SRC at SRCPOS to DST at DSTPOS, stopping
+ * at the end of SRC. Whenever both positions are block-aligned, whole
+ * blocks go through sfs_copyblock; the rest goes through sfs_io, one
+ * piece at a time so no piece crosses a block boundary on either
+ * side, via a bounce buffer allocated on first use. Sets *COPIED to
+ * the number of bytes copied, even on error.
+ *
+ * SRC and DST must be different files, and both locked.
+ */
+int
+sfs_copy(struct sfs_vnode *dst, off_t dstpos,
+	 struct sfs_vnode *src, off_t srcpos, size_t len, size_t *copied)
+{
+	char *piecebuf = NULL;
+	struct iovec iov;
+	struct uio ku;
+	off_t srcsize, spos, dpos;
+	size_t done, piece;
+	int result = 0;
+
+	KASSERT(lock_do_i_hold(src->sv_lock));
+	KASSERT(lock_do_i_hold(dst->sv_lock));
+	KASSERT(src != dst);
+
+	*copied = 0;
+
+	srcsize = src->sv_i.sfi_size;
+	if (srcpos >= srcsize) {
+		return 0;
+	}
+	if ((off_t)len > srcsize - srcpos) {
+		len = srcsize - srcpos;
+	}
+
+	done = 0;
+	while (done < len) {
+		spos = srcpos + done;
+		dpos = dstpos + done;
+
+		if (spos % SFS_BLOCKSIZE == 0 && dpos % SFS_BLOCKSIZE == 0 &&
+		    len - done >= SFS_BLOCKSIZE) {
+			piece = SFS_BLOCKSIZE;
+			result = sfs_copyblock(dst, dpos / SFS_BLOCKSIZE,
+					       src, spos / SFS_BLOCKSIZE);
+			if (result) {
+				break;
+			}
+		}
+		else {
+			piece = len - done;
+			if (piece > SFS_BLOCKSIZE - spos % SFS_BLOCKSIZE) {
+				piece = SFS_BLOCKSIZE - spos % SFS_BLOCKSIZE;
+			}
+			if (piece > SFS_BLOCKSIZE - dpos % SFS_BLOCKSIZE) {
+				piece = SFS_BLOCKSIZE - dpos % SFS_BLOCKSIZE;
+			}
+			if (piecebuf == NULL) {
+				piecebuf = kmalloc(SFS_BLOCKSIZE);
+				if (piecebuf == NULL) {
+					result = ENOMEM;
+					break;
+				}
+			}
+
+			uio_kinit(&iov, &ku, piecebuf, piece, spos, UIO_READ);
+			result = sfs_io(src, &ku);
+			if (result) {
+				break;
+			}
+			KASSERT(ku.uio_resid == 0);
+
+			uio_kinit(&iov, &ku, piecebuf, piece, dpos, UIO_WRITE);
+			result = sfs_io(dst, &ku);
+			if (result) {
+				break;
+			}
+		}
+
+		done += piece;
+		if (dpos + (off_t)piece > (off_t)dst->sv_i.sfi_size) {
+			dst->sv_i.sfi_size = dpos + piece;
+			dst->sv_dirty = true;
+		}
+	}
+
+	if (piecebuf != NULL) {
+		kfree(piecebuf);
+	}
+	*copied = done;
+	return result;
+}
@@ -0,0 +1,137 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009, 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _BUF_H_
+#define _BUF_H_
+
+/*
+ * Buffer cache.
+ *
+ * Filesystems read and write their blocks through here instead of
+ * going to the device every time. Buffers are named by filesystem
+ * and block number (a mounted filesystem stands for its device), and
+ * the cache does the actual I/O with the filesystem's fsop_blockio.
+ *
+ * A buffer obtained with buf_read or buf_get is held exclusively
+ * until buf_release: other threads asking for the same block wait.
+ * Buffers nobody holds are kept in least-recently-used order, and
+ * the oldest is reused when the cache is full. Changes are written
+ * back later, not when the buffer is released.
+ *
+ * Writing back is mostly up to the syncer thread. Once a second it
+ * writes out the buffers that have been dirty longer than the dirty
+ * age, sorted by block so neighbouring blocks go to the disk as one
+ * request; a block written many times in that interval is written
+ * out once. Every dirty age it also calls each filesystem's
+ * fsop_writeback, so dirty inodes and the like get into the cache
+ * and from there to the disk. Writers call buf_throttle before
+ * starting; if more than the dirty limit of the cache is dirty, it
+ * waits for the syncer to bring that down.
+ *
+ * Filesystems can also ask for blocks they expect to need soon with
+ * buf_prefetch. Worker threads read them in, so the caller doesn't
+ * wait, and a later buf_read finds them cached.
+ *
+ * buf_bootstrap  - set up the cache; call once during boot.
+ * buf_syncer_bootstrap - start the syncer; call once threads work.
+ * buf_prefetch_bootstrap - start the prefetch workers, likewise.
+ * buf_read       - get a block, reading it in if it isn't cached.
+ * buf_prefetch   - start reading a block into the cache in the
+ *                  background, unless it's there already. Only a
+ *                  hint: it may be ignored.
+ * buf_get        - get a block the caller is going to fill in
+ *                  completely, without reading it. Check
+ *                  buf_isvalid to see if the contents are good.
+ * buf_map        - the buffer's data (BUF_SIZE bytes).
+ * buf_isvalid    - whether the contents match the block.
+ * buf_markdirty  - the data has been changed (and is now valid).
+ * buf_release    - done with a buffer.
+ * buf_discard    - done with a buffer whose contents are garbage,
+ *                  e.g. after a failed attempt to fill it.
+ * buf_flush      - write back all of a filesystem's dirty buffers.
+ * buf_drop       - forget a block that's been freed, so it isn't
+ *                  written back. Waits for anyone holding it, so
+ *                  the caller mustn't hold it.
+ * buf_dropall    - forget all of a filesystem's buffers, at unmount.
+ *                  It must have been flushed and none may be held.
+ * buf_throttle   - wait if there's too much dirty data. Call this
+ *                  holding no buffers and no filesystem locks, as
+ *                  the syncer may need them.
+ *
+ * buf_setmax     - set the size of the cache, in buffers. Shrinking
+ *                  takes effect as buffers come free.
+ * buf_setdirtyage - set how long, in seconds, a buffer can stay dirty
+ *                  before the syncer writes it.
+ * buf_setdirtymax - set the dirty limit, as a percentage of the cache.
+ * buf_gettunables - get the size, dirty age, and dirty limit, as set
+ *                  by the three above.
+ * buf_printstats - print the hit rate and other statistics.
+ */
+
+#include <fs.h>
+
+/* Size of every buffer. Filesystems using the cache have this blocksize. */
+#define BUF_SIZE	512
+
+/* Default and smallest number of buffers. */
+#define BUF_DEFAULTMAX	256
+#define BUF_MINMAX	16
+
+/* Default dirty age (seconds) and dirty limit (percent). */
+#define BUF_DEFAULTAGE		10
+#define BUF_DEFAULTDIRTYMAX	50
+
+struct buf;	/* Opaque. */
+
+void buf_bootstrap(void);
+void buf_syncer_bootstrap(void);
+void buf_prefetch_bootstrap(void);
+
+int buf_read(struct fs *fs, daddr_t block, struct buf **ret);
+void buf_prefetch(struct fs *fs, daddr_t block);
+int buf_get(struct fs *fs, daddr_t block, struct buf **ret);
+void *buf_map(struct buf *b);
+bool buf_isvalid(struct buf *b);
+void buf_markdirty(struct buf *b);
+void buf_release(struct buf *b);
+void buf_discard(struct buf *b);
+
+int buf_flush(struct fs *fs);
+void buf_drop(struct fs *fs, daddr_t block);
+void buf_dropall(struct fs *fs);
+void buf_throttle(void);
+
+void buf_setmax(unsigned max);
+void buf_setdirtyage(unsigned seconds);
+void buf_setdirtymax(unsigned percent);
+void buf_gettunables(unsigned *max, unsigned *dirtyage, unsigned *dirtymax);
+void buf_printstats(void);
+
+
+#endif /* _BUF_H_ */
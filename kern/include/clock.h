@@ -79,5 +79,11 @@ void timespec_sub(const struct timespec *t1,
  */
 void clocksleep(int seconds);
 
+/*
+ * clocknanosleep() suspends execution for at least the given time,
+ * rounded up to the next hardclock tick.
+ */
+void clocknanosleep(const struct timespec *duration);
+
 
 #endif /* _CLOCK_H_ */
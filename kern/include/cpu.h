@@ -117,6 +117,12 @@ void cpu_hatch(unsigned software_number);
  */
 void cpu_identify(char *buf, size_t max);
 
+/*
+ * Read the current CPU's free-running cycle counter. It wraps, so
+ * only differences between nearby readings are meaningful.
+ */
+uint32_t cpu_cycles(void);
+
 /*
  * Hardware-level interrupt on/off, for the current CPU.
  *
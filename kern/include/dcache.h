@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009, 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _DCACHE_H_
+#define _DCACHE_H_
+
+/*
+ * Name cache.
+ *
+ * Remembers what recent VOP_LOOKUPs found, keyed on the directory
+ * vnode and the name looked up in it, so looking up the same name
+ * again doesn't go back to the filesystem. A name that wasn't there
+ * is remembered too (a negative entry), so failed lookups are cheap
+ * as well. Only single names are cached, not paths, and not "." or
+ * "..", which would go stale when a directory is moved.
+ *
+ * An entry holds a reference to both its directory and its vnode.
+ * Entries are kept in least-recently-used order, and the oldest is
+ * reused once there are DCACHE_MAX of them.
+ *
+ * The cache is only right if every change to a directory comes
+ * through the VFS layer, which purges the names it changes. A lookup
+ * that misses gets a generation number from dcache_lookup to pass to
+ * dcache_enter; if anything has been purged in between, the entry
+ * isn't made, since what the lookup found may already be out of date.
+ *
+ * dcache_bootstrap  - set up the cache; call once during boot.
+ * dcache_cacheable  - whether NAME in DIR is something the cache
+ *                     will hold.
+ * dcache_lookup     - look up NAME in DIR. On a hit, returns true
+ *                     and hands back the vnode (with a reference
+ *                     added) or NULL if the name doesn't exist. On a
+ *                     miss, returns false and hands back GEN.
+ * dcache_enter      - remember that NAME in DIR is VN (or nothing, if
+ *                     VN is NULL), as found by a lookup that started
+ *                     at generation GEN.
+ * dcache_purge      - forget NAME in DIR. Call after anything that
+ *                     may have changed it: create, remove, rename,
+ *                     link, mkdir, rmdir.
+ * dcache_purgefs    - forget everything on FS, dropping the entries'
+ *                     references, and its statistics. Call before
+ *                     unmounting.
+ * dcache_printstats - print each filesystem's hit statistics.
+ */
+
+#include <fs.h>
+
+/* Longest name cached, and most entries. */
+#define DCACHE_NAMELEN	31
+#define DCACHE_MAX	256
+
+void dcache_bootstrap(void);
+
+bool dcache_cacheable(struct vnode *dir, const char *name);
+bool dcache_lookup(struct vnode *dir, const char *name,
+		   struct vnode **ret, unsigned *gen);
+void dcache_enter(struct vnode *dir, const char *name, struct vnode *vn,
+		  unsigned gen);
+void dcache_purge(struct vnode *dir, const char *name);
+void dcache_purgefs(struct fs *fs);
+
+void dcache_printstats(void);
+
+
+#endif /* _DCACHE_H_ */
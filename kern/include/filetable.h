@@ -36,27 +36,41 @@
 
 #include <limits.h> /* for OPEN_MAX */
 
+struct fdarray;	/* private to filetable.c */
+struct openfile;
+
 
 /*
- * The file table is an array of open files.
+ * The file table maps file handles to open files.
+ *
+ * The slots live in a separate array (struct fdarray, private to
+ * filetable.c) that starts small and doubles as needed up to
+ * OPEN_MAX, with a bitmap of the slots in use so the lowest free
+ * handle is found a word at a time rather than a slot at a time.
+ *
+ * On fork the array is not copied; the child's table shares it, and
+ * whichever table next changes it gets its own copy first. So a
+ * fork followed by exec or exit costs nothing per open file. Each
+ * table sharing an array keeps an empty spare (ft_spare) to copy
+ * into, so that closing a file never needs memory.
  *
- * There is no particular reason to use a fixed size array (of size
- * OPEN_MAX) instead of a dynamically sized array (using array.h) --
- * the code was just written this way years ago and there's no
- * compelling reason to change it that outweighs this benefit: you can
- * look through the code to see what it would take to make it dynamic,
- * or even to make it dynamic with the limit being user-settable. (See
- * setrlimit(2) on a Unix machine.)
+ * Looking up a handle, which every read and write does, takes no
+ * lock. Changes are serialized by ft_lock, and never free anything
+ * (an old array, or the openfile a slot used to hold) until every
+ * other thread in the process has been seen outside filetable_get
+ * (see t_ftseq), so a lookup that raced with the change is done with
+ * it by then. Consequently changes may only be made by threads of
+ * the process that owns the table.
  *
- * Because we only have single-threaded processes, the file table is
- * never shared and so it doesn't require synchronization. On fork,
- * the table is copied. Another exercise: what would you need to do to
- * make this code safe for multithreaded processes? What happens if
- * one thread calls close() while another one is in the middle of e.g.
- * read() using the same file handle?
+ * filetable_get takes a reference to the openfile it returns
+ * (dropped by filetable_put), so that if one thread calls close()
+ * while another is in the middle of e.g. read() on the same file
+ * handle, the openfile doesn't vanish under the reader.
  */
 struct filetable {
-	struct openfile *ft_openfiles[OPEN_MAX];
+	struct lock *ft_lock;		/* serializes changes */
+	struct fdarray *ft_files;	/* the slots; maybe shared */
+	struct fdarray *ft_spare;	/* for unsharing; NULL if not */
 };
 
 /*
@@ -71,7 +85,9 @@ struct filetable {
  *           is not NULL.) Call put with the file returned from get.
  * place -   Insert a file and return the fd.
  * placeat - Insert a file at a specific slot and return the file
- *           previously there.
+ *           previously there. May fail with ENOMEM, since the table
+ *           may need to grow first; placing NULL (closing) never
+ *           fails.
  */
 
 struct filetable *filetable_create(void);
@@ -83,8 +99,8 @@ int filetable_get(struct filetable *ft, int fd, struct openfile **ret);
 void filetable_put(struct filetable *ft, int fd, struct openfile *file);
 
 int filetable_place(struct filetable *ft, struct openfile *file, int *fd);
-void filetable_placeat(struct filetable *ft, struct openfile *newfile, int fd,
-		       struct openfile **oldfile_ret);
+int filetable_placeat(struct filetable *ft, struct openfile *newfile, int fd,
+		      struct openfile **oldfile_ret);
 
 
 #endif /* _FILETABLE_H_ */
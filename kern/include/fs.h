@@ -31,6 +31,7 @@
 #define _FS_H_
 
 struct vnode; /* in vnode.h */
+struct uio;   /* in uio.h */
 
 
 /*
@@ -51,6 +52,10 @@ struct fs {
  *      fsop_getvolname - Return volume name of filesystem.
  *      fsop_getroot    - Return root vnode of filesystem.
  *      fsop_unmount    - Attempt unmount of filesystem.
+ *      fsop_blockio    - Read or write blocks on the device, bypassing
+ *                        the buffer cache.
+ *      fsop_writeback  - Push dirty metadata kept outside the buffer
+ *                        cache toward the disk.
  *
  * fsop_getvolname may return NULL on filesystem types that don't
  * support the concept of a volume name. The string returned is
@@ -68,12 +73,23 @@ struct fs {
  * consequently the struct fs instance should remain valid. On success,
  * however, the filesystem object and all storage associated with the
  * filesystem should have been discarded/released.
+ *
+ * fsop_blockio and fsop_writeback are for the buffer cache (see
+ * buf.h); filesystems that don't use the cache can leave them NULL.
+ * fsop_blockio is how the cache does its I/O. The uio is in kernel
+ * space, its offset is a block number times BUF_SIZE, and it may
+ * cover several consecutive blocks. fsop_writeback is called now and
+ * then by the syncer thread; it should hand dirty in-memory inodes
+ * and the like to the cache (or write them), but needn't flush the
+ * cache, which the syncer does itself.
  */
 struct fs_ops {
 	int           (*fsop_sync)(struct fs *);
 	const char   *(*fsop_getvolname)(struct fs *);
 	int           (*fsop_getroot)(struct fs *, struct vnode **);
 	int           (*fsop_unmount)(struct fs *);
+	int           (*fsop_blockio)(struct fs *, struct uio *);
+	int           (*fsop_writeback)(struct fs *);
 };
 
 /*
@@ -83,6 +99,8 @@ struct fs_ops {
 #define FSOP_GETVOLNAME(fs)  ((fs)->fs_ops->fsop_getvolname(fs))
 #define FSOP_GETROOT(fs, ret) ((fs)->fs_ops->fsop_getroot(fs, ret))
 #define FSOP_UNMOUNT(fs)     ((fs)->fs_ops->fsop_unmount(fs))
+#define FSOP_BLOCKIO(fs, uio) ((fs)->fs_ops->fsop_blockio(fs, uio))
+#define FSOP_WRITEBACK(fs)   ((fs)->fs_ops->fsop_writeback(fs))
 
 /* Initialization functions for builtin fake file systems. */
 void semfs_bootstrap(void);
@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009, 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _KERN_AIO_H_
+#define _KERN_AIO_H_
+
+/*
+ * Definitions for asynchronous I/O (aio_submit and aio_reap).
+ */
+
+
+/* Operations */
+#define AIO_READ	0	/* like pread */
+#define AIO_WRITE	1	/* like pwrite */
+
+/* Limits */
+#define AIO_MAXLEN	(64*1024)	/* Longest single request. */
+#define AIO_MAXREQS	16		/* Most requests a process may have
+					   submitted and not yet reaped. */
+
+/* A request, as passed to aio_submit. */
+struct aioreq {
+	int ar_fd;		/* file handle */
+	int ar_op;		/* AIO_READ or AIO_WRITE */
+	__off_t ar_pos;		/* position in file */
+#ifdef _KERNEL
+	userptr_t ar_buf;	/* buffer */
+	__size_t ar_len;	/* size of buffer */
+	userptr_t ar_data;	/* passed back in the event */
+#else
+	void *ar_buf;		/* buffer */
+	__size_t ar_len;	/* size of buffer */
+	void *ar_data;		/* passed back in the event */
+#endif
+};
+
+/* A completion, as returned by aio_reap. */
+struct aioevent {
+#ifdef _KERNEL
+	userptr_t ae_data;	/* ar_data from the request */
+#else
+	void *ae_data;		/* ar_data from the request */
+#endif
+	int ae_error;		/* 0, or an errno value */
+	__ssize_t ae_result;	/* bytes transferred */
+};
+
+
+#endif /* _KERN_AIO_H_ */
@@ -89,7 +89,7 @@
 #define __PIPE_BUF      512
 
 /* Max number of processes at once. */
-#define __PROCS_MAX       128
+#define __PROCS_MAX       1024
 
 
 /*
@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009, 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _KERN_POLL_H_
+#define _KERN_POLL_H_
+
+#include <kern/limits.h>	/* for __OPEN_MAX */
+
+/*
+ * Definitions for poll() and select().
+ */
+
+
+/* Structure for poll(); one per file handle asked about. */
+struct pollfd {
+	int fd;			/* file handle; ignored if negative */
+	short events;		/* events asked about */
+	short revents;		/* events that happened */
+};
+
+/* Event bits. The last three are reported whether asked for or not. */
+#define POLLIN		0x0001	/* Reading won't block. */
+#define POLLPRI		0x0002	/* Urgent data (never, in OS/161). */
+#define POLLOUT		0x0004	/* Writing won't block. */
+#define POLLRDNORM	0x0040	/* Same as POLLIN. */
+#define POLLRDBAND	0x0080	/* Priority data (never, in OS/161). */
+#define POLLWRNORM	0x0100	/* Same as POLLOUT. */
+#define POLLWRBAND	0x0200	/* Priority data (never, in OS/161). */
+#define POLLERR		0x0008	/* Error; e.g. writing a pipe with no reader. */
+#define POLLHUP		0x0010	/* Hung up; e.g. no writer left on a pipe. */
+#define POLLNVAL	0x0020	/* Not an open file handle. */
+
+
+/*
+ * Sets of file handles for select().
+ *
+ * FD_SETSIZE is the number of file handles a set can hold; select
+ * can't look at higher-numbered ones.
+ */
+#define FD_SETSIZE	__OPEN_MAX
+
+#define _NFDBITS	32	/* bits per __fds_bits word */
+
+typedef struct {
+	__u32 __fds_bits[(FD_SETSIZE + _NFDBITS - 1) / _NFDBITS];
+} fd_set;
+
+#define FD_SET(fd, set) \
+	((set)->__fds_bits[(fd) / _NFDBITS] |= (1U << ((fd) % _NFDBITS)))
+#define FD_CLR(fd, set) \
+	((set)->__fds_bits[(fd) / _NFDBITS] &= ~(1U << ((fd) % _NFDBITS)))
+#define FD_ISSET(fd, set) \
+	(((set)->__fds_bits[(fd) / _NFDBITS] & (1U << ((fd) % _NFDBITS))) != 0)
+#define FD_ZERO(set) \
+	do { \
+		unsigned __i; \
+		for (__i = 0; __i < sizeof((set)->__fds_bits) / \
+			     sizeof((set)->__fds_bits[0]); __i++) { \
+			(set)->__fds_bits[__i] = 0; \
+		} \
+	} while (0)
+
+
+#endif /* _KERN_POLL_H_ */
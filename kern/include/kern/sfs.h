@@ -86,7 +86,9 @@ struct sfs_dinode {
 	uint16_t sfi_linkcount;			/* # hard links to this file */
 	uint32_t sfi_direct[SFS_NDIRECT];	/* Direct blocks */
 	uint32_t sfi_indirect;			/* Indirect block */
-	uint32_t sfi_waste[128-3-SFS_NDIRECT];	/* unused space, set to 0 */
+	uint16_t sfi_dirbuckets;		/* Hashed dir: # of buckets */
+	uint16_t sfi_dirprobe;			/* Hashed dir: longest probe */
+	uint32_t sfi_waste[128-4-SFS_NDIRECT];	/* unused space, set to 0 */
 };
 
 /*
@@ -97,5 +99,39 @@ struct sfs_direntry {
 	char sfd_name[SFS_NAMELEN];		/* Filename */
 };
 
+/* Number of directory entries in a block */
+#define SFS_DIRPERBLOCK  (SFS_BLOCKSIZE / sizeof(struct sfs_direntry))
+
+/*
+ * Hashed directories
+ *
+ * A directory is an array of directory entries, and is normally
+ * searched from one end to the other. A large directory can instead
+ * be hashed: each block of it is a bucket, and an entry goes in the
+ * bucket its name hashes to or, if that's full, one of the buckets
+ * after it (wrapping around at the end). So a name is found by
+ * looking at only a few buckets.
+ *
+ * A hashed directory has sfi_dirbuckets buckets, a power of 2 no
+ * larger than SFS_DIRHASH_MAXBUCKETS, and is exactly that many blocks
+ * long. sfi_dirprobe is the furthest any entry is past its own bucket
+ * (less than sfi_dirbuckets), so a search looks at sfi_dirprobe+1
+ * buckets. Linear directories have both fields 0.
+ *
+ * The entries themselves are the same either way, so anything that
+ * scans a directory linearly still sees every name. Something that
+ * changes the directory without knowing about hashing might put a
+ * name in the wrong bucket, though; a directory whose size doesn't
+ * match its bucket count is taken to be linear, and sfsck puts
+ * things right otherwise.
+ *
+ * The hash is 32-bit FNV-1a over the bytes of the name: start with
+ * SFS_DIRHASH_BASIS, and for each byte, XOR it in and multiply by
+ * SFS_DIRHASH_PRIME. The bucket is the hash modulo sfi_dirbuckets.
+ */
+#define SFS_DIRHASH_MAXBUCKETS  128
+#define SFS_DIRHASH_BASIS       2166136261U
+#define SFS_DIRHASH_PRIME       16777619U
+
 
 #endif /* _KERN_SFS_H_ */
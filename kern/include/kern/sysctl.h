@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009, 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _KERN_SYSCTL_H_
+#define _KERN_SYSCTL_H_
+
+/*
+ * Names for __sysctl().
+ *
+ * As in BSD, a name is an array of integers, most general first.
+ * Nothing is writable at present.
+ */
+
+#define CTL_MAXNAME	8	/* Longest name */
+
+/* Top level */
+#define CTL_KERN	1	/* Kernel (nothing yet) */
+#define CTL_VM		2	/* Memory */
+
+/* Second level names for CTL_VM */
+#define VM_KMALLOCSITES	1	/* struct kmallocsite[] */
+
+/*
+ * Per-call-site kmalloc statistics, returned by
+ * { CTL_VM, VM_KMALLOCSITES } in kernels built with "options
+ * kmallocprof". Allocations from sites that didn't fit in the
+ * kernel's table are lumped together under ks_pc == 0. Small
+ * allocations count as the heap blocks they take, large ones as the
+ * whole pages. The peak is the most the kernel has seen live when
+ * asked for these, since the counters are only added up then.
+ */
+struct kmallocsite {
+	__u32 ks_pc;		/* kernel address the call returns to */
+	__u32 ks_allocs;	/* number of allocations */
+	__u32 ks_frees;		/* number of frees */
+	__u32 ks_live;		/* bytes currently allocated */
+	__u32 ks_peak;		/* most bytes seen allocated at once */
+};
+
+
+#endif /* _KERN_SYSCTL_H_ */
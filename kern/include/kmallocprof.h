@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009, 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _KMALLOCPROF_H_
+#define _KMALLOCPROF_H_
+
+/*
+ * kmalloc call-site profiling. Enable with "options kmallocprof" in
+ * the kernel config.
+ *
+ * Each kmalloc is charged to the address it returns to. For every
+ * such call site we count allocations, frees, bytes currently live,
+ * and the most of those seen. Small allocations count as the blocks
+ * they take, whole-page ones as their pages.
+ *
+ * It's cheap enough to leave on. Nothing is added to the blocks
+ * themselves: each heap page has a side map with a byte per 16 bytes
+ * naming the site of the block there, and whole-page allocations are
+ * tracked in a table indexed by page. The counters are kept per CPU,
+ * so kmalloc and kfree take no lock (except the first time a site
+ * or page turns up); they're only added up when someone reads them.
+ *
+ * Results can be printed from the kernel menu (most live bytes first)
+ * or fetched with __sysctl { CTL_VM, VM_KMALLOCSITES }. Turn the
+ * addresses into function names with nm or addr2line on the kernel.
+ *
+ * Functions (called from kmalloc.c):
+ *    kmprof_allocblock - account for a new subpage block PTR of
+ *                        BLOCKSIZE bytes allocated from PC.
+ *    kmprof_allocpages - same for NPAGES whole pages at ADDR.
+ *    kmprof_freeblock  - account for freeing subpage block PTR.
+ *    kmprof_freepages  - same for the whole pages at ADDR.
+ *
+ *    kmprof_dump       - print the MAX sites with most live bytes.
+ *    kmprof_sysctl     - copy the sites out for __sysctl.
+ */
+
+#include "opt-kmallocprof.h"
+
+#if OPT_KMALLOCPROF
+
+#include <kern/sysctl.h>
+
+/* Granularity of the block maps; no larger than the smallest block. */
+#define KMPROF_GRAIN 16
+
+void kmprof_allocblock(void *ptr, size_t blocksize, vaddr_t pc);
+void kmprof_allocpages(vaddr_t addr, unsigned npages, vaddr_t pc);
+void kmprof_freeblock(void *ptr, size_t blocksize);
+void kmprof_freepages(vaddr_t addr);
+
+void kmprof_dump(unsigned max);
+int kmprof_sysctl(userptr_t oldp, size_t *oldlen);
+
+#endif /* OPT_KMALLOCPROF */
+
+
+#endif /* _KMALLOCPROF_H_ */
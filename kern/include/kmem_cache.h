@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009, 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _KMEM_CACHE_H_
+#define _KMEM_CACHE_H_
+
+/*
+ * Object caches: allocators for many objects of one type.
+ *
+ * A cache hands out objects of one exact size from slabs, which are
+ * single pages carved into as many objects as fit, so there is no
+ * rounding up to kmalloc's power-of-two sizes and each type has its
+ * own lock rather than sharing kmalloc's.
+ *
+ * If a constructor is given, it is called on each object once, when
+ * the slab holding it is created, not on every allocation. Objects
+ * must be handed back to kmem_cache_free in their constructed state,
+ * so the next kmem_cache_alloc gets them still initialized. This is
+ * for state that a destroy function naturally leaves the way it
+ * found it, such as empty lists and self-pointers. Constructors may
+ * not sleep or allocate memory; as there is nothing to undo, there
+ * are no destructors, and empty slabs are simply freed.
+ *
+ * Objects must fit in a page along with a small slab header.
+ *
+ * Functions:
+ *    kmem_cache_create  - make a cache of SIZE-byte objects aligned to
+ *                         ALIGN bytes (0 for the default of 8). CTOR
+ *                         may be NULL. NAME is not copied.
+ *    kmem_cache_destroy - destroy a cache; all objects must have been
+ *                         freed.
+ *    kmem_cache_alloc   - get an object; returns NULL if out of memory.
+ *    kmem_cache_free    - give back an object from kmem_cache_alloc on
+ *                         the same cache.
+ *    kmem_cache_printstats - print usage statistics for every cache.
+ */
+
+struct kmem_cache;	/* Opaque. */
+
+struct kmem_cache *kmem_cache_create(const char *name, size_t size,
+				     size_t align, void (*ctor)(void *));
+void kmem_cache_destroy(struct kmem_cache *);
+void *kmem_cache_alloc(struct kmem_cache *);
+void kmem_cache_free(struct kmem_cache *, void *ptr);
+
+void kmem_cache_printstats(void);
+
+
+#endif /* _KMEM_CACHE_H_ */
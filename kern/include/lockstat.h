@@ -0,0 +1,113 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009, 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _LOCKSTAT_H_
+#define _LOCKSTAT_H_
+
+/*
+ * Lock contention statistics. Enable with "options lockstat" in the
+ * kernel config.
+ *
+ * Each spinlock and sleep lock carries a record of how many times it
+ * was acquired, how many of those acquisitions had to wait, and how
+ * long the waits were, in CPU cycles. Records are put on a global
+ * list the first time their lock is acquired and taken off again
+ * when the lock is cleaned up; the lists can be dumped (most
+ * contended first) and reset from the kernel menu.
+ *
+ * The counters are only updated by the thread or CPU that holds the
+ * lock, so they need no locking of their own. Dumping and resetting
+ * read and write them without holding the locks, so numbers from a
+ * busy system may be slightly off.
+ *
+ * Sleep locks are reported by name. Spinlocks have no names, so they
+ * are reported by where they were set up: the caller of spinlock_init,
+ * or for static spinlocks (SPINLOCK_INITIALIZER), the place they were
+ * first acquired. Look the address up with nm or addr2line.
+ */
+
+#include "opt-lockstat.h"
+
+#if OPT_LOCKSTAT
+
+struct lockstat {
+	const char *ls_name;		/* lock name, or NULL */
+	vaddr_t ls_initpc;		/* where set up, if no name */
+	vaddr_t ls_holderpc;		/* call site of latest acquire */
+	vaddr_t ls_blockerpc;		/* holder call site at latest wait */
+	unsigned ls_acquires;		/* total acquisitions */
+	unsigned ls_contended;		/* acquisitions that had to wait */
+	uint64_t ls_waitcycles;		/* total cycles spent waiting */
+	uint32_t ls_maxwait;		/* longest single wait */
+	bool ls_onlist;			/* on the global list? */
+	struct lockstat *ls_prev;	/* global list linkage */
+	struct lockstat *ls_next;
+};
+
+void lockstat_init(struct lockstat *ls, const char *name, vaddr_t initpc);
+void lockstat_cleanup(struct lockstat *ls);
+uint32_t lockstat_now(void);
+void lockstat_acquired(struct lockstat *ls, vaddr_t pc,
+		       bool contended, uint32_t start);
+
+void lockstat_dump(unsigned max);
+void lockstat_reset(void);
+
+#define LOCKSTAT(sym)		struct lockstat sym
+
+#define LOCKSTAT_INIT(ls, n)	lockstat_init(ls, n, 0)
+#define LOCKSTAT_INIT_UNNAMED(ls) \
+	lockstat_init(ls, NULL, (vaddr_t)__builtin_return_address(0))
+#define LOCKSTAT_CLEANUP(ls)	lockstat_cleanup(ls)
+
+#define LOCKSTAT_INITIALIZER	{ NULL, 0, 0, 0, 0, 0, 0, 0, false, \
+				  NULL, NULL }
+
+#define LOCKSTAT_NOW()		lockstat_now()
+#define LOCKSTAT_ACQUIRED(ls, contended, start) \
+	lockstat_acquired(ls, (vaddr_t)__builtin_return_address(0), \
+			  contended, start)
+
+#else
+
+#define LOCKSTAT(sym)
+
+#define LOCKSTAT_INIT(ls, n)
+#define LOCKSTAT_INIT_UNNAMED(ls)
+#define LOCKSTAT_CLEANUP(ls)
+
+#define LOCKSTAT_INITIALIZER
+
+#define LOCKSTAT_NOW()		0
+#define LOCKSTAT_ACQUIRED(ls, contended, start) \
+	((void)(contended), (void)(start))
+
+#endif
+
+#endif /* _LOCKSTAT_H_ */
@@ -47,6 +47,11 @@
  * Open files are reference-counted because they get shared via fork
  * and dup2 calls. And they need locking because that sharing can be
  * among multiple concurrent processes.
+ *
+ * We also keep track of whether the file is being read sequentially,
+ * for readahead. Each read that starts where the last one ended
+ * doubles the readahead window, up to OPENFILE_RAMAX bytes; any other
+ * read shuts readahead off until reads are sequential again.
  */
 struct openfile {
 	struct vnode *of_vnode;
@@ -57,12 +62,30 @@ struct openfile {
 
 	struct spinlock of_reflock;	/* lock for of_refcount */
 	int of_refcount;
+
+	struct spinlock of_ralock;	/* lock for readahead state */
+	off_t of_ranext;		/* where a sequential read starts */
+	off_t of_raend;			/* end of what's been read ahead */
+	off_t of_rawindow;		/* how far to read ahead */
 };
 
+/* Smallest and largest readahead windows, in bytes. */
+#define OPENFILE_RAMIN	4096
+#define OPENFILE_RAMAX	32768
+
+/* set up openfile allocation (called at boot) */
+void openfile_bootstrap(void);
+
 /* open a file (args must be kernel pointers; destroys filename) */
 int openfile_open(char *filename, int openflags, mode_t mode,
 		  struct openfile **ret);
 
+/* wrap a vnode that's already open (e.g. a pipe end); consumes VN */
+int openfile_fromvnode(struct vnode *vn, int accmode, struct openfile **ret);
+
+/* note a read of LEN bytes at POS, and read ahead if it's sequential */
+void openfile_readahead(struct openfile *file, off_t pos, size_t len);
+
 /* adjust the refcount on an openfile */
 void openfile_incref(struct openfile *);
 void openfile_decref(struct openfile *);
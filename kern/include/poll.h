@@ -0,0 +1,93 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009, 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _POLL_H_
+#define _POLL_H_
+
+/*
+ * Readiness notification, for poll() and select().
+ *
+ * Anything a thread can block on for I/O (the console, a pipe, a
+ * semfs semaphore) embeds a pollhead and calls pollhead_wakeup on it
+ * whenever it may have become ready: more data, more space, the other
+ * end going away. A thread waiting on several objects at once keeps a
+ * pollwait; vop_poll registers it with the pollheads it cares about,
+ * and pollwait_sleep then sleeps until any of them is woken.
+ *
+ * To avoid missing a wakeup, vop_poll must register before it checks
+ * whether the object is ready. Registrations stay in place until
+ * pollwait_cleanup, so after sleeping the caller just checks again
+ * (passing NULL for the pollwait).
+ *
+ * The caller must hold a reference to each object it registered with
+ * until pollwait_cleanup, so the pollheads can't go away first.
+ *
+ * pollhead_init    - set up a pollhead.
+ * pollhead_cleanup - tear one down; nobody may be registered.
+ * pollhead_wakeup  - wake everyone registered. Callable from interrupt
+ *                    handlers and with spinlocks held.
+ *
+ * pollwait_init     - set up a pollwait. May fail with ENOMEM.
+ * pollwait_cleanup  - drop all registrations and tear it down.
+ * pollwait_register - register with a pollhead. If there's no memory
+ *                     for the registration, pollwait_sleep fails.
+ * pollwait_sleep    - sleep until woken, or for at most TICKS ticks
+ *                     if TICKS is nonzero. Returns at once if woken
+ *                     since the last call. Returns 0, ETIMEDOUT, or
+ *                     ENOMEM.
+ */
+
+#include <spinlock.h>
+
+struct pollentry;	/* private to vfspoll.c */
+
+struct pollhead {
+	struct spinlock ph_lock;	/* protects ph_entries */
+	struct pollentry *ph_entries;	/* registered waiters */
+};
+
+struct pollwait {
+	struct spinlock pw_lock;	/* protects pw_woken */
+	struct wchan *pw_wchan;		/* where we sleep */
+	bool pw_woken;			/* woken since last sleep */
+	int pw_error;			/* a registration failed */
+	struct pollentry *pw_entries;	/* our registrations */
+};
+
+void pollhead_init(struct pollhead *ph);
+void pollhead_cleanup(struct pollhead *ph);
+void pollhead_wakeup(struct pollhead *ph);
+
+int pollwait_init(struct pollwait *pw);
+void pollwait_cleanup(struct pollwait *pw);
+void pollwait_register(struct pollwait *pw, struct pollhead *ph);
+int pollwait_sleep(struct pollwait *pw, unsigned ticks);
+
+
+#endif /* _POLL_H_ */
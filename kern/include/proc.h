@@ -40,6 +40,7 @@
 #include <thread.h> /* required for struct threadarray */
 
 struct addrspace;
+struct aioctx;
 struct vnode;
 
 /*
@@ -60,10 +61,16 @@ struct proc {
 
 	/* VM */
 	struct addrspace *p_addrspace;	/* virtual address space */
+	struct semaphore *p_vforksem;	/* V'd to release vfork parent */
 
 	/* VFS */
 	struct vnode *p_cwd;		/* current working directory */
 	struct filetable *p_filetable;	/* table of open files */
+	struct aioctx *p_aio;		/* asynchronous I/O, if any */
+
+	/* Accounting; protected by p_threadslock */
+	struct usage p_usage;		/* from threads no longer here */
+	struct usage p_cusage;		/* from children waited for */
 
 	/* add more material here as needed */
 };
@@ -80,6 +87,12 @@ int proc_create_runprogram(const char *name, struct proc **ret);
 /* Create a fresh process for use by fork() */
 int proc_fork(struct proc **ret);
 
+/* Same, but borrowing our address space until DONESEM is V'd. */
+int proc_vfork(struct semaphore *donesem, struct proc **ret);
+
+/* Release a vfork parent, once its address space is no longer used. */
+void proc_vforkdone(struct proc *proc);
+
 /* Undo proc_fork if nothing's run in the new process yet. */
 void proc_unfork(struct proc *proc);
 
@@ -107,5 +120,8 @@ struct addrspace *proc_getas(void);
 /* Change the address space of the current process, and return the old one. */
 struct addrspace *proc_setas(struct addrspace *);
 
+/* Get the resource usage of a process's threads, or of its children. */
+void proc_getusage(struct proc *proc, bool children, struct usage *ret);
+
 
 #endif /* _PROC_H_ */
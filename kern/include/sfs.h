@@ -50,23 +50,50 @@
 
 /*
  * In-memory inode
+ *
+ * sv_lock protects sv_i and sv_dirty, and for a directory, its
+ * contents. sv_ino and the inode's type never change. sfs_vnlock
+ * protects sv_reclaiming, which is set while sfs_reclaim is getting
+ * rid of the vnode; nobody may take a new reference to it then.
  */
 struct sfs_vnode {
 	struct vnode sv_absvn;          /* abstract vnode structure */
+	struct lock *sv_lock;           /* lock for the inode */
 	struct sfs_dinode sv_i;		/* copy of on-disk inode */
 	uint32_t sv_ino;                /* inode number */
 	bool sv_dirty;                  /* true if sv_i modified */
+	bool sv_reclaiming;             /* true while being reclaimed */
+	struct sfs_vnode *sv_hashnext;  /* next on vnode hash chain */
+	struct sfs_vnode **sv_hashpprev; /* pointer to us on hash chain */
 };
 
 /*
  * In-memory info for a whole fs volume
+ *
+ * The vnodes loaded into memory are kept in a hash table by inode
+ * number, chained through sv_hashnext; the table doubles in size as
+ * it fills up. sfs_vnlock protects the table and the hash chains,
+ * and sfs_vncv, on which sfs_loadvnode waits for a vnode being
+ * reclaimed to go away. sfs_freemaplock protects the freemap and the
+ * superblock. The volume name never changes.
+ *
+ * Lock order: a directory's sv_lock, then that of a file in it (two
+ * files: lower inode number first), then sfs_vnlock, then
+ * sfs_freemaplock. sfs_reclaim holds sfs_vnlock only to mark the
+ * vnode and to take it out of the table, not while it truncates and
+ * writes back the inode under sv_lock.
  */
 struct sfs_fs {
 	struct fs sfs_absfs;            /* abstract filesystem structure */
 	struct sfs_superblock sfs_sb;	/* copy of on-disk superblock */
 	bool sfs_superdirty;            /* true if superblock modified */
 	struct device *sfs_device;      /* device mounted on */
-	struct vnodearray *sfs_vnodes;  /* vnodes loaded into memory */
+	struct lock *sfs_vnlock;        /* lock for the vnode table */
+	struct cv *sfs_vncv;            /* a reclaim has finished */
+	struct sfs_vnode **sfs_vnhash;  /* vnodes loaded, hashed by inode */
+	unsigned sfs_vnhashsize;        /* number of chains (power of 2) */
+	unsigned sfs_nvnodes;           /* number of vnodes loaded */
+	struct lock *sfs_freemaplock;   /* lock for freemap and superblock */
 	struct bitmap *sfs_freemap;     /* blocks in use are marked 1 */
 	bool sfs_freemapdirty;          /* true if freemap modified */
 };
@@ -37,6 +37,8 @@
 
 #include <cdefs.h>
 #include <hangman.h>
+#include <lockstat.h>
+#include "opt-ticketlock.h"
 
 /* Inlining support - for making sure an out-of-line copy gets built */
 #ifndef SPINLOCK_INLINE
@@ -54,21 +56,45 @@
  * This structure is made public so spinlocks do not have to be
  * malloc'd; however, code that uses spinlocks should not look inside
  * the structure directly but always use the spinlock API functions.
+ *
+ * With "options ticketlock" spinlocks are ticket locks: each CPU
+ * takes a number from splk_next and waits until splk_lock (the number
+ * now being served) reaches it. This hands the lock out in FIFO order
+ * and stops everyone hammering the lock word with LL/SC at once.
+ * Otherwise splk_lock is a plain test-and-set word.
  */
 struct spinlock {
 	volatile spinlock_data_t splk_lock; /* Memory word where we spin. */
+#if OPT_TICKETLOCK
+	volatile spinlock_data_t splk_next; /* Next ticket to hand out. */
+#endif
 	struct cpu *splk_holder;	    /* CPU holding this lock. */
 	HANGMAN_LOCKABLE(splk_hangman);     /* Deadlock detector hook. */
+	LOCKSTAT(splk_stat);                /* Contention statistics. */
 };
 
 /*
  * Initializer for cases where a spinlock needs to be static or global.
  */
-#ifdef OPT_HANGMAN
-#define SPINLOCK_INITIALIZER	{ SPINLOCK_DATA_INITIALIZER, NULL, \
+#if OPT_TICKETLOCK
+#define SPINLOCK_WORDS_INITIALIZER	SPINLOCK_DATA_INITIALIZER, \
+					SPINLOCK_DATA_INITIALIZER
+#else
+#define SPINLOCK_WORDS_INITIALIZER	SPINLOCK_DATA_INITIALIZER
+#endif
+
+#if OPT_HANGMAN && OPT_LOCKSTAT
+#define SPINLOCK_INITIALIZER	{ SPINLOCK_WORDS_INITIALIZER, NULL, \
+				  HANGMAN_LOCKABLE_INITIALIZER, \
+				  LOCKSTAT_INITIALIZER }
+#elif OPT_HANGMAN
+#define SPINLOCK_INITIALIZER	{ SPINLOCK_WORDS_INITIALIZER, NULL, \
 				  HANGMAN_LOCKABLE_INITIALIZER }
+#elif OPT_LOCKSTAT
+#define SPINLOCK_INITIALIZER	{ SPINLOCK_WORDS_INITIALIZER, NULL, \
+				  LOCKSTAT_INITIALIZER }
 #else
-#define SPINLOCK_INITIALIZER	{ SPINLOCK_DATA_INITIALIZER, NULL }
+#define SPINLOCK_INITIALIZER	{ SPINLOCK_WORDS_INITIALIZER, NULL }
 #endif
 
 /*
@@ -37,6 +37,11 @@
 
 #include <spinlock.h>
 
+/*
+ * Set up allocation of synchronization objects. Called early in boot.
+ */
+void synch_bootstrap(void);
+
 /*
  * Dijkstra-style semaphore.
  *
@@ -58,9 +63,13 @@ void sem_destroy(struct semaphore *);
  *     P (proberen): decrement count. If the count is 0, block until
  *                   the count is 1 again before decrementing.
  *     V (verhogen): increment count.
+ *
+ * P_timed is P that gives up after TICKS hardclock ticks (see HZ in
+ * clock.h) without decrementing. Returns 0 or ETIMEDOUT.
  */
 void P(struct semaphore *);
 void V(struct semaphore *);
+int P_timed(struct semaphore *, unsigned ticks);
 
 
 /*
@@ -75,6 +84,7 @@ void V(struct semaphore *);
 struct lock {
         char *lk_name;
         HANGMAN_LOCKABLE(lk_hangman);   /* Deadlock detector hook. */
+        LOCKSTAT(lk_stat);              /* Contention statistics. */
         struct wchan *lk_wchan;
         struct spinlock lk_lock;
         struct thread *volatile lk_holder;
@@ -128,6 +138,10 @@ void cv_destroy(struct cv *);
  *                   waking up again, re-acquire the lock.
  *    cv_signal    - Wake up one thread that's sleeping on this CV.
  *    cv_broadcast - Wake up all threads sleeping on this CV.
+ *    cv_timedwait - Like cv_wait, but wake up on our own after TICKS
+ *                   hardclock ticks (see HZ in clock.h) if not
+ *                   signalled first. Returns 0, or ETIMEDOUT if the
+ *                   time ran out. The lock is re-acquired either way.
  *
  * For all three operations, the current thread must hold the lock passed
  * in. Note that under normal circumstances the same lock should be used
@@ -138,6 +152,62 @@ void cv_destroy(struct cv *);
 void cv_wait(struct cv *cv, struct lock *lock);
 void cv_signal(struct cv *cv, struct lock *lock);
 void cv_broadcast(struct cv *cv, struct lock *lock);
+int cv_timedwait(struct cv *cv, struct lock *lock, unsigned ticks);
+
+
+/*
+ * Reader-writer lock.
+ *
+ * Any number of readers may hold the lock at once, or one writer.
+ * Writers are preferred: once a writer is waiting, newly arriving
+ * readers queue up behind it. To keep readers from starving in
+ * turn, a writer releasing the lock admits every reader that was
+ * waiting at that moment before the next writer gets in.
+ *
+ * Only writers are tracked by the deadlock detector as holders;
+ * readers are checked when they wait but not recorded once they
+ * get in, since the lockable can only name one holder.
+ *
+ * The name field is for easier debugging. A copy of the name is
+ * made internally.
+ */
+struct rwlock {
+        char *rw_name;
+        HANGMAN_LOCKABLE(rw_hangman);   /* Deadlock detector hook. */
+        struct wchan *rw_readwchan;     /* Readers wait here. */
+        struct wchan *rw_writewchan;    /* Writers wait here. */
+        struct spinlock rw_lock;
+        struct thread *volatile rw_writer;
+        volatile unsigned rw_readers;   /* Readers holding the lock. */
+        volatile unsigned rw_waitreaders;
+        volatile unsigned rw_waitwriters;
+        volatile unsigned rw_readgrant; /* Readers let past writers. */
+};
+
+struct rwlock *rwlock_create(const char *name);
+void rwlock_destroy(struct rwlock *);
+
+/*
+ * Operations:
+ *    rwlock_acquire_read  - Get the lock for reading. Blocks while a
+ *                           writer holds the lock or is waiting for it.
+ *    rwlock_release_read  - Drop a read hold.
+ *    rwlock_acquire_write - Get the lock exclusively.
+ *    rwlock_release_write - Drop the exclusive hold. Only the thread
+ *                           holding the lock for writing may do this.
+ *    rwlock_do_i_hold_write - Return true if the current thread holds
+ *                           the lock for writing. (There is no
+ *                           equivalent for readers.)
+ *
+ * A thread must not take a read hold it already has a second time:
+ * if a writer arrives in between, the second request waits behind
+ * the writer, which waits for the first hold, and nothing moves.
+ */
+void rwlock_acquire_read(struct rwlock *);
+void rwlock_release_read(struct rwlock *);
+void rwlock_acquire_write(struct rwlock *);
+void rwlock_release_write(struct rwlock *);
+bool rwlock_do_i_hold_write(struct rwlock *);
 
 
 #endif /* _SYNCH_H_ */
@@ -54,6 +54,9 @@ __DEAD void enter_new_process(int argc, userptr_t argv, userptr_t env,
 /* Setup function for exec. */
 void exec_bootstrap(void);
 
+/* Setup function for futex wait queues. */
+void futex_bootstrap(void);
+
 
 /*
  * Prototypes for IN-KERNEL entry points for system call implementations.
@@ -64,11 +67,16 @@ void exec_bootstrap(void);
 
 int sys_reboot(int code);
 int sys___time(userptr_t user_seconds, userptr_t user_nanoseconds);
+int sys_nanosleep(const_userptr_t req, userptr_t rem);
 
 int sys_fork(struct trapframe *tf, pid_t *retval);
+int sys_vfork(struct trapframe *tf, pid_t *retval);
 int sys_execv(userptr_t prog, userptr_t args);
 __DEAD void sys__exit(int code);
 int sys_waitpid(pid_t pid, userptr_t returncode, int flags, pid_t *retval);
+int sys_wait4(pid_t pid, userptr_t returncode, int flags, userptr_t rusage,
+	      pid_t *retval);
+int sys_getrusage(int who, userptr_t rusage);
 int sys_getpid(pid_t *retval);
 
 int sys_open(const_userptr_t filename, int flags, mode_t mode, int *retval);
@@ -76,7 +84,19 @@ int sys_dup2(int oldfd, int newfd, int *retval);
 int sys_close(int fd);
 int sys_read(int fd, userptr_t buf, size_t size, int *retval);
 int sys_write(int fd, userptr_t buf, size_t size, int *retval);
+int sys_pread(int fd, userptr_t buf, size_t size, off_t pos, int *retval);
+int sys_pwrite(int fd, userptr_t buf, size_t size, off_t pos, int *retval);
+int sys_readv(int fd, const_userptr_t iov, int iovcnt, int *retval);
+int sys_writev(int fd, const_userptr_t iov, int iovcnt, int *retval);
+int sys_copy_file_range(int infd, userptr_t inpos, int outfd, userptr_t outpos,
+			size_t len, unsigned flags, int *retval);
 int sys_lseek(int fd, off_t offset, int code, off_t *retval);
+int sys_pipe(userptr_t fds, int *retval);
+int sys_poll(userptr_t fds, nfds_t nfds, int timeout, int *retval);
+int sys_select(int nfds, userptr_t readfds, userptr_t writefds,
+	       userptr_t exceptfds, userptr_t timeout, int *retval);
+int sys_aio_submit(const_userptr_t reqs, int nreqs, int *retval);
+int sys_aio_reap(userptr_t evs, int nevs, int minwait, int *retval);
 
 int sys_chdir(const_userptr_t path);
 int sys___getcwd(userptr_t buf, size_t buflen, int *retval);
@@ -92,4 +112,10 @@ int sys_fstat(int fd, userptr_t statptr);
 int sys_fsync(int fd);
 int sys_ftruncate(int fd, off_t len);
 
+int sys_futex(userptr_t uaddr, int op, int val, int *retval);
+
+int sys___sysctl(const_userptr_t name, unsigned namelen,
+		 userptr_t oldp, userptr_t oldlenp,
+		 const_userptr_t newp, size_t newlen);
+
 #endif /* _SYSCALL_H_ */
@@ -42,6 +42,7 @@
 
 /* For testing the wait implementation. */
 int waittest(int, char **);
+int pipetest(int, char **);
 
 /* data structure tests */
 int arraytest(int, char **);
@@ -57,6 +58,10 @@ int semtest(int, char **);
 int locktest(int, char **);
 int cvtest(int, char **);
 int cvtest2(int, char **);
+int rwtest(int, char **);
+int rwbench(int, char **);
+int spinlockbench(int, char **);
+int timeouttest(int, char **);
 
 /* semaphore unit tests */
 int semu1(int, char **);
@@ -89,6 +94,7 @@ int writestress(int, char **);
 int writestress2(int, char **);
 int longstress(int, char **);
 int createstress(int, char **);
+int buftest(int, char **);
 int printfile(int, char **);
 
 /* other tests */
@@ -96,6 +102,7 @@ int kmalloctest(int, char **);
 int kmallocstress(int, char **);
 int kmalloctest3(int, char **);
 int kmalloctest4(int, char **);
+int kmemcachetest(int, char **);
 int nettest(int, char **);
 
 /* Routine for running a user-level program. */
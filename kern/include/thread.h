@@ -39,6 +39,7 @@
 #include <array.h>
 #include <spinlock.h>
 #include <threadlist.h>
+#include <usage.h>
 
 struct cpu;
 
@@ -99,6 +100,7 @@ struct thread {
 	 * rather than per-cpu or global?
 	 */
 	bool t_in_interrupt;		/* Are we in an interrupt? */
+	bool t_intr_fromuser;		/* Did it interrupt user mode? */
 	int t_curspl;			/* Current spl*() state */
 	int t_iplhigh_count;		/* # of times IPL has been raised */
 
@@ -106,6 +108,9 @@ struct thread {
 	 * Public fields
 	 */
 
+	struct usage t_usage;		/* Resources used (see usage.h) */
+	volatile unsigned t_ftseq;	/* Odd while in filetable_get */
+
 	/* add more here as needed */
 };
 
@@ -90,6 +90,9 @@ void threadlist_insertbefore(struct threadlist *tl,
 			     struct thread *addee, struct thread *onlist);
 void threadlist_remove(struct threadlist *tl, struct thread *t);
 
+/* Move everything on FROM to the end of TL, leaving FROM empty. */
+void threadlist_splice(struct threadlist *tl, struct threadlist *from);
+
 /* Iteration; itervar should previously be declared as (struct thread *) */
 #define THREADLIST_FORALL(itervar, tl) \
 	for ((itervar) = (tl).tl_head.tln_next->tln_self; \
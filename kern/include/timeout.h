@@ -0,0 +1,81 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009, 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _TIMEOUT_H_
+#define _TIMEOUT_H_
+
+/*
+ * Timeouts: call a function after a given number of hardclock ticks
+ * (see HZ in clock.h).
+ *
+ * Pending timeouts live in a hierarchical timer wheel that is
+ * advanced one tick per hardclock on CPU 0, so setting and cancelling
+ * are constant time and each tick only looks at the timeouts due in
+ * it (plus, every 64 ticks, a cascade of the next group down from a
+ * coarser level).
+ *
+ * The function is called on CPU 0 in interrupt context, with no
+ * locks held; it must not sleep. It may re-arm its own timeout.
+ *
+ * Functions:
+ *    timeout_init   - set up TO to call FUNC(DATA) when it expires.
+ *    timeout_set    - (re)arm TO to expire TICKS ticks from now
+ *                     (at least 1; very long delays are clamped to
+ *                     TIMEOUT_MAXTICKS, about 46 hours).
+ *    timeout_cancel - disarm TO. Returns true if it was pending and
+ *                     now won't fire, false if it had already fired.
+ *                     If the function is running on another CPU,
+ *                     waits for it to finish, so on return it is safe
+ *                     to destroy TO and whatever its data points to.
+ *                     May not be called from interrupt context.
+ *    timeout_now    - the number of ticks processed since boot.
+ *
+ *    timeout_hardclock - advance the wheel; called from hardclock().
+ */
+
+#define TIMEOUT_MAXTICKS	((1U << 24) - 1)
+
+struct timeout {
+	struct timeout *to_next;	/* list in wheel slot */
+	struct timeout **to_pprev;	/* pointer to us in that list */
+	uint64_t to_expire;		/* tick at which to fire */
+	void (*to_func)(void *);	/* function to call */
+	void *to_data;			/* argument for it */
+	unsigned to_state;		/* idle/pending/running */
+};
+
+void timeout_init(struct timeout *to, void (*func)(void *), void *data);
+void timeout_set(struct timeout *to, unsigned ticks);
+bool timeout_cancel(struct timeout *to);
+uint64_t timeout_now(void);
+
+void timeout_hardclock(void);
+
+
+#endif /* _TIMEOUT_H_ */
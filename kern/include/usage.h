@@ -0,0 +1,70 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009, 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _USAGE_H_
+#define _USAGE_H_
+
+/*
+ * Resource usage accounting, for wait4() and getrusage().
+ *
+ * Each thread counts its own usage in t_usage, without locking: the
+ * counters are only changed by the thread itself, or by hardclock on
+ * the thread's own CPU. When a thread leaves a process its counts are
+ * added to the process's p_usage. When a process exits, its total
+ * (including the children it waited for) goes back to its parent
+ * with the exit status, and is added to the parent's p_cusage when
+ * the parent waits for it.
+ *
+ * CPU time is counted in hardclock ticks, charged to whatever thread
+ * the tick interrupted. It's therefore statistical, and only as fine
+ * as 1/HZ.
+ *
+ * Functions:
+ *    usage_add       - add the counts in FROM to TO.
+ *    usage_torusage  - convert to the user-visible struct rusage.
+ */
+
+struct rusage;
+
+struct usage {
+	unsigned u_uticks;		/* hardclocks in user mode */
+	unsigned u_sticks;		/* hardclocks in the kernel */
+	unsigned u_minflt;		/* page faults not needing I/O */
+	unsigned u_majflt;		/* page faults needing I/O */
+	unsigned u_inblock;		/* filesystem blocks read */
+	unsigned u_oublock;		/* filesystem blocks written */
+	unsigned u_nvcsw;		/* voluntary context switches */
+	unsigned u_nivcsw;		/* involuntary context switches */
+};
+
+void usage_add(struct usage *to, const struct usage *from);
+void usage_torusage(const struct usage *u, struct rusage *ru);
+
+
+#endif /* _USAGE_H_ */
@@ -55,16 +55,24 @@ struct vnode;  /* abstract structure for an on-disk file (vnode.h) */
  *    vfs_clearcurdir - change current directory of current thread to "none"
  *    vfs_getcurdir - retrieve vnode of current directory of current thread
  *    vfs_sync      - force all dirty buffers to disk
+ *    vfs_writeback - have each filesystem push its dirty metadata
+ *                    toward the disk (see fsop_writeback)
  *    vfs_getroot   - get root vnode for the filesystem named DEVNAME
  *    vfs_getdevname - get mounted device name for the filesystem passed in
+ *    vfs_copy      - copy LEN bytes between files at the given offsets,
+ *                    in the filesystem if it can (see vop_copyfrom),
+ *                    otherwise through a kernel buffer
  */
 
 int vfs_setcurdir(struct vnode *dir);
 int vfs_clearcurdir(void);
 int vfs_getcurdir(struct vnode **retdir);
 int vfs_sync(void);
+void vfs_writeback(void);
 int vfs_getroot(const char *devname, struct vnode **result);
 const char *vfs_getdevname(struct fs *fs);
+int vfs_copy(struct vnode *dst, off_t dstpos, struct vnode *src, off_t srcpos,
+	     size_t len, size_t *copied);
 
 /*
  * VFS layer mid-level operations.
@@ -84,6 +84,14 @@ uint32_t hpt_hash(struct addrspace *as, vaddr_t faultaddr);
 /* Fault handling function called by trap code */
 int vm_fault(int faulttype, vaddr_t faultaddress);
 
+/*
+ * Kernel address of the user page at VA in address space AS, or 0 if
+ * it isn't resident (or, with WRITE set, isn't writable). For copying
+ * to or from a process other than the current one; the caller must
+ * make sure AS stays alive.
+ */
+vaddr_t vm_userpage(struct addrspace *as, vaddr_t va, bool write);
+
 /* Allocate/free kernel heap pages (called by kmalloc/kfree) */
 vaddr_t alloc_kpages(unsigned npages);
 void free_kpages(vaddr_t addr);
@@ -33,6 +33,7 @@
 #include <spinlock.h>
 struct uio;
 struct stat;
+struct pollwait;
 
 
 /*
@@ -117,6 +118,13 @@ struct vnode {
  *                      and directories are seekable, but some devices are
  *                      not.
  *
+ *    vop_poll        - Check which of the poll events (kern/poll.h)
+ *                      in EVENTS would happen now, i.e. which I/O
+ *                      wouldn't block, and put them in *REVENTS. If PW
+ *                      isn't NULL, first register it (see poll.h) so
+ *                      it's woken when that might change. Objects that
+ *                      never block use vop_poll_ready.
+ *
  *    vop_fsync       - Force any dirty buffers associated with this file
  *                      to stable storage.
  *
@@ -132,6 +140,21 @@ struct vnode {
  *                      uio. Need not work on objects that are not
  *                      directories.
  *
+ *    vop_copyfrom    - Copy up to LEN bytes from file SRC, starting at
+ *                      offset SRCPOS, into this file at offset DSTPOS,
+ *                      and hand back the number of bytes copied.
+ *                      This is less than LEN only at the end of SRC.
+ *                      Return EXDEV if the filesystem can't do it
+ *                      itself (e.g. SRC is on another filesystem);
+ *                      vfs_copy then copies through a buffer instead.
+ *                      Use vfs_copy rather than calling this directly.
+ *
+ *    vop_readahead   - Hint that LEN bytes of the file starting at POS
+ *                      will probably be read soon, so the filesystem
+ *                      can start reading them in now. Must not wait
+ *                      for the I/O. Objects with nothing to gain use
+ *                      vop_readahead_none.
+ *
  *****************************************
  *
  *    vop_creat       - Create a regular file named NAME in the passed
@@ -192,10 +215,16 @@ struct vnode_ops {
 	int (*vop_stat)(struct vnode *object, struct stat *statbuf);
 	int (*vop_gettype)(struct vnode *object, mode_t *result);
 	bool (*vop_isseekable)(struct vnode *object);
+	int (*vop_poll)(struct vnode *object, int events, struct pollwait *pw,
+			int *revents);
 	int (*vop_fsync)(struct vnode *object);
 	int (*vop_mmap)(struct vnode *file /* add stuff */);
 	int (*vop_truncate)(struct vnode *file, off_t len);
 	int (*vop_namefile)(struct vnode *file, struct uio *uio);
+	int (*vop_copyfrom)(struct vnode *file, off_t dstpos,
+			    struct vnode *src, off_t srcpos, size_t len,
+			    size_t *copied);
+	void (*vop_readahead)(struct vnode *file, off_t pos, off_t len);
 
 
 	int (*vop_creat)(struct vnode *dir,
@@ -236,10 +265,13 @@ struct vnode_ops {
 #define VOP_STAT(vn, ptr) 	        (__VOP(vn, stat)(vn, ptr))
 #define VOP_GETTYPE(vn, result)         (__VOP(vn, gettype)(vn, result))
 #define VOP_ISSEEKABLE(vn)              (__VOP(vn, isseekable)(vn))
+#define VOP_POLL(vn, ev, pw, rev)       (__VOP(vn, poll)(vn, ev, pw, rev))
 #define VOP_FSYNC(vn)                   (__VOP(vn, fsync)(vn))
 #define VOP_MMAP(vn /*add stuff */)     (__VOP(vn, mmap)(vn /*add stuff */))
 #define VOP_TRUNCATE(vn, pos)           (__VOP(vn, truncate)(vn, pos))
 #define VOP_NAMEFILE(vn, uio)           (__VOP(vn, namefile)(vn, uio))
+#define VOP_COPYFROM(vn,dp,src,sp,l,r) (__VOP(vn,copyfrom)(vn,dp,src,sp,l,r))
+#define VOP_READAHEAD(vn, pos, len)     (__VOP(vn, readahead)(vn, pos, len))
 
 #define VOP_CREAT(vn,nm,excl,mode,res)  (__VOP(vn, creat)(vn,nm,excl,mode,res))
 #define VOP_SYMLINK(vn, name, content)  (__VOP(vn, symlink)(vn, name, content))
@@ -279,6 +311,18 @@ int vnode_init(struct vnode *, const struct vnode_ops *ops,
  */
 void vnode_cleanup(struct vnode *);
 
+/*
+ * Common vop_poll for objects whose I/O never has to wait, such as
+ * regular files and directories: always readable and writable.
+ */
+int vop_poll_ready(struct vnode *vn, int events, struct pollwait *pw,
+		   int *revents);
+
+/*
+ * Common vop_readahead for objects that don't read ahead.
+ */
+void vop_readahead_none(struct vnode *vn, off_t pos, off_t len);
+
 /*
  * Common stubs for vnode functions that just fail, in various ways.
  */
@@ -290,6 +334,12 @@ int vopfail_mmap_isdir(struct vnode *vn /* add stuff */);
 int vopfail_mmap_perm(struct vnode *vn /* add stuff */);
 int vopfail_mmap_nosys(struct vnode *vn /* add stuff */);
 int vopfail_truncate_isdir(struct vnode *vn, off_t pos);
+int vopfail_copyfrom_isdir(struct vnode *vn, off_t dstpos,
+			   struct vnode *src, off_t srcpos, size_t len,
+			   size_t *copied);
+int vopfail_copyfrom_xdev(struct vnode *vn, off_t dstpos,
+			  struct vnode *src, off_t srcpos, size_t len,
+			  size_t *copied);
 int vopfail_creat_notdir(struct vnode *vn, const char *name, bool excl,
 			 mode_t mode, struct vnode **result);
 int vopfail_symlink_notdir(struct vnode *vn, const char *contents,
@@ -38,6 +38,11 @@
 struct spinlock; /* in spinlock.h */
 struct wchan; /* Opaque */
 
+/*
+ * Set up wait channel allocation. Called early in boot.
+ */
+void wchan_bootstrap(void);
+
 /*
  * Create a wait channel. Use NAME as a symbolic name for the channel.
  * NAME should be a string constant; if not, the caller is responsible
@@ -66,6 +71,13 @@ bool wchan_isempty(struct wchan *wc, struct spinlock *lk);
  */
 void wchan_sleep(struct wchan *wc, struct spinlock *lk);
 
+/*
+ * Like wchan_sleep, but wake up on our own after TICKS hardclock
+ * ticks (see HZ in clock.h) if nobody else does first. Returns 0 if
+ * woken up, or ETIMEDOUT.
+ */
+int wchan_timedsleep(struct wchan *wc, struct spinlock *lk, unsigned ticks);
+
 /*
  * Wake up one thread, or all threads, sleeping on a wait channel.
  * The associated spinlock should be locked.
@@ -42,11 +42,16 @@
 #include <proc.h>
 #include <current.h>
 #include <synch.h>
+#include <wchan.h>
 #include <vm.h>
 #include <mainbus.h>
 #include <vfs.h>
+#include <buf.h>
+#include <dcache.h>
 #include <device.h>
 #include <pid.h>
+#include <openfile.h>
+#include <aio.h>
 #include <syscall.h>
 #include <test.h>
 #include <version.h>
@@ -109,11 +114,16 @@ boot(void)
 
 	/* Early initialization. */
 	ram_bootstrap();
+	wchan_bootstrap();
+	synch_bootstrap();
 	proc_bootstrap();
 	thread_bootstrap();
 	pid_bootstrap();
 	hardclock_bootstrap();
 	vfs_bootstrap();
+	openfile_bootstrap();
+	buf_bootstrap();
+	dcache_bootstrap();
 	kheap_nextgeneration();
 
 	/* Probe and initialize devices. Interrupts should come on. */
@@ -130,6 +140,10 @@ boot(void)
 	vm_bootstrap();
 	kprintf_bootstrap();
 	exec_bootstrap();
+	futex_bootstrap();
+	aio_bootstrap();
+	buf_syncer_bootstrap();
+	buf_prefetch_bootstrap();
 	thread_start_cpus();
 
 	/* Default bootfs - but ignore failure, in case emu0 doesn't exist */
@@ -41,12 +41,18 @@
 #include <thread.h>
 #include <proc.h>
 #include <vfs.h>
+#include <buf.h>
+#include <dcache.h>
 #include <sfs.h>
 #include <pid.h>
+#include <kmem_cache.h>
+#include <kmallocprof.h>
 #include <syscall.h>
 #include <test.h>
 #include "opt-sfs.h"
 #include "opt-net.h"
+#include "opt-lockstat.h"
+#include "opt-kmallocprof.h"
 
 /*
  * In-kernel menu and command dispatcher.
@@ -130,7 +136,7 @@ common_prog(int nargs, char **args)
 		return result;
 	}
 
-	pid_wait(childpid, &status, 0, NULL);
+	pid_wait(childpid, &status, 0, NULL, NULL);
 	if (WIFEXITED(status)) {
 		kprintf("Program (pid %d) exited with status %d\n",
 			childpid, WEXITSTATUS(status));
@@ -500,6 +506,177 @@ cmd_kheapdump(int nargs, char **args)
 	return 0;
 }
 
+static
+int
+cmd_kmemcachestats(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	kmem_cache_printstats();
+
+	return 0;
+}
+
+static
+int
+cmd_bufstats(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	buf_printstats();
+
+	return 0;
+}
+
+static
+int
+cmd_dcachestats(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	dcache_printstats();
+
+	return 0;
+}
+
+/*
+ * Command to set the size of the buffer cache. Can be given in the
+ * boot arguments, so the cache is sized before anything is mounted.
+ */
+static
+int
+cmd_bufsize(int nargs, char **args)
+{
+	int max;
+
+	if (nargs != 2) {
+		kprintf("Usage: bcsize buffers\n");
+		return EINVAL;
+	}
+	max = atoi(args[1]);
+	if (max < BUF_MINMAX) {
+		kprintf("bcsize: At least %d buffers are needed\n",
+			BUF_MINMAX);
+		return EINVAL;
+	}
+
+	buf_setmax(max);
+
+	return 0;
+}
+
+/*
+ * Command to set how long a buffer can stay dirty, in seconds.
+ */
+static
+int
+cmd_bufage(int nargs, char **args)
+{
+	int seconds;
+
+	if (nargs != 2) {
+		kprintf("Usage: bcage seconds\n");
+		return EINVAL;
+	}
+	seconds = atoi(args[1]);
+	if (seconds < 0) {
+		kprintf("bcage: Invalid age\n");
+		return EINVAL;
+	}
+
+	buf_setdirtyage(seconds);
+
+	return 0;
+}
+
+/*
+ * Command to set how much of the buffer cache can be dirty before
+ * writers have to wait, as a percentage.
+ */
+static
+int
+cmd_bufdirty(int nargs, char **args)
+{
+	int percent;
+
+	if (nargs != 2) {
+		kprintf("Usage: bcdirty percent\n");
+		return EINVAL;
+	}
+	percent = atoi(args[1]);
+	if (percent < 1 || percent > 100) {
+		kprintf("bcdirty: Percentage must be 1 to 100\n");
+		return EINVAL;
+	}
+
+	buf_setdirtymax(percent);
+
+	return 0;
+}
+
+#if OPT_LOCKSTAT
+static
+int
+cmd_lockstat(int nargs, char **args)
+{
+	unsigned max;
+
+	if (nargs == 1) {
+		max = 10;
+	}
+	else if (nargs == 2) {
+		max = atoi(args[1]);
+	}
+	else {
+		kprintf("Usage: lk [count]\n");
+		return EINVAL;
+	}
+
+	lockstat_dump(max);
+
+	return 0;
+}
+
+static
+int
+cmd_lockstatreset(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	lockstat_reset();
+
+	return 0;
+}
+#endif /* OPT_LOCKSTAT */
+
+#if OPT_KMALLOCPROF
+static
+int
+cmd_kmallocprof(int nargs, char **args)
+{
+	unsigned max;
+
+	if (nargs == 1) {
+		max = 10;
+	}
+	else if (nargs == 2) {
+		max = atoi(args[1]);
+	}
+	else {
+		kprintf("Usage: kmp [count]\n");
+		return EINVAL;
+	}
+
+	kmprof_dump(max);
+
+	return 0;
+}
+#endif /* OPT_KMALLOCPROF */
+
 ////////////////////////////////////////
 //
 // Menus.
@@ -566,6 +743,7 @@ static const char *testmenu[] = {
 	"[km2] kmalloc stress test           ",
 	"[km3] Large kmalloc test            ",
 	"[km4] Multipage kmalloc test        ",
+	"[kmc] Object cache test             ",
 	"[tt1] Thread test 1                 ",
 	"[tt2] Thread test 2                 ",
 	"[tt3] Thread test 3                 ",
@@ -576,14 +754,20 @@ static const char *testmenu[] = {
 	"[sy2] Lock test                     ",
 	"[sy3] CV test                       ",
 	"[sy4] CV test #2                    ",
+	"[rwt1] RW lock test                 ",
+	"[rwt2] RW lock contention benchmark ",
+	"[spb] Spinlock fairness benchmark   ",
+	"[tmo] Timeout test                  ",
 	"[semu1-22] Semaphore unit tests     ",
 	"[wt]  waitpid test                  ",
+	"[pt]  Pipe test                     ",
 	"[fs1] Filesystem test               ",
 	"[fs2] FS read stress                ",
 	"[fs3] FS write stress               ",
 	"[fs4] FS write stress 2             ",
 	"[fs5] FS long stress                ",
 	"[fs6] FS create stress              ",
+	"[bct] Buffer cache writeback test   ",
 	NULL
 };
 
@@ -606,6 +790,19 @@ static const char *mainmenu[] = {
 	"[kh] Kernel heap stats              ",
 	"[khgen] Next kernel heap generation ",
 	"[khdump] Dump kernel heap           ",
+	"[kc] Object cache stats             ",
+	"[bc] Buffer cache stats             ",
+	"[bcsize] Set buffer cache size      ",
+	"[bcage] Set buffer dirty age        ",
+	"[bcdirty] Set buffer dirty limit    ",
+	"[dc] Name cache stats               ",
+#if OPT_KMALLOCPROF
+	"[kmp] Top kmalloc call sites        ",
+#endif
+#if OPT_LOCKSTAT
+	"[lk] Most contended locks           ",
+	"[lkreset] Reset lock statistics     ",
+#endif
 	"[q] Quit and shut down              ",
 	NULL
 };
@@ -657,6 +854,19 @@ static struct {
 	{ "kh",         cmd_kheapstats },
 	{ "khgen",      cmd_kheapgeneration },
 	{ "khdump",     cmd_kheapdump },
+	{ "kc",         cmd_kmemcachestats },
+	{ "bc",         cmd_bufstats },
+	{ "bcsize",     cmd_bufsize },
+	{ "bcage",      cmd_bufage },
+	{ "bcdirty",    cmd_bufdirty },
+	{ "dc",         cmd_dcachestats },
+#if OPT_KMALLOCPROF
+	{ "kmp",        cmd_kmallocprof },
+#endif
+#if OPT_LOCKSTAT
+	{ "lk",         cmd_lockstat },
+	{ "lkreset",    cmd_lockstatreset },
+#endif
 
 	/* base system tests */
 	{ "at",		arraytest },
@@ -667,6 +877,7 @@ static struct {
 	{ "km2",	kmallocstress },
 	{ "km3",	kmalloctest3 },
 	{ "km4",	kmalloctest4 },
+	{ "kmc",	kmemcachetest },
 #if OPT_NET
 	{ "net",	nettest },
 #endif
@@ -679,6 +890,10 @@ static struct {
 	{ "sy2",	locktest },
 	{ "sy3",	cvtest },
 	{ "sy4",	cvtest2 },
+	{ "rwt1",	rwtest },
+	{ "rwt2",	rwbench },
+	{ "spb",	spinlockbench },
+	{ "tmo",	timeouttest },
 
 	/* semaphore unit tests */
 	{ "semu1",	semu1 },
@@ -707,6 +922,7 @@ static struct {
 	/* system call assignment tests */
 	/* For testing the wait implementation. */
 	{ "wt",		waittest },
+	{ "pt",		pipetest },
 
 	/* file system assignment tests */
 	{ "fs1",	fstest },
@@ -715,6 +931,7 @@ static struct {
 	{ "fs4",	writestress2 },
 	{ "fs5",	longstress },
 	{ "fs6",	createstress },
+	{ "bct",	buftest },
 
 	{ NULL, NULL }
 };
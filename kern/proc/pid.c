@@ -36,7 +36,8 @@
 #include <kern/wait.h>
 #include <limits.h>
 #include <lib.h>
-#include <array.h>
+#include <spinlock.h>
+#include <membar.h>
 #include <clock.h>
 #include <thread.h>
 #include <proc.h>
@@ -50,57 +51,99 @@
  * If pi_ppid is INVALID_PID, the parent has gone away and will not be
  * waiting. If pi_ppid is INVALID_PID and pi_exited is true, the
  * structure can be freed.
+ *
+ * Each pidinfo is on its parent's list of children (pi_children,
+ * linked through pi_sibling) for as long as pi_ppid is set, so an
+ * exiting process can find its children without searching the table.
  */
 struct pidinfo {
 	pid_t pi_pid;			// process id of this thread
 	pid_t pi_ppid;			// process id of parent thread
 	volatile bool pi_exited;	// true if thread has exited
 	int pi_exitstatus;		// status (only valid if exited)
-	struct cv *pi_cv;		// use to wait for thread exit
+	struct usage pi_usage;		// resources used (ditto)
+	struct semaphore *pi_exitsem;	// V'd once on exit if there's a parent
+	struct pidinfo *pi_children;	// our children
+	struct pidinfo *pi_sibling;	// next child of our parent
+	struct pidinfo **pi_prevp;	// what points to us in that list
 };
 
+/*
+ * Process table entry.
+ *
+ * pe_lock protects pe_info and the pidinfo it points to. The free
+ * list fields (pe_gen, pe_nextfree) belong to pidfree_lock, and are
+ * only used while the slot is free.
+ */
+struct pidentry {
+	struct spinlock pe_lock;
+	struct pidinfo *pe_info;	// process in this slot, if any
+	unsigned pe_slot;		// index of this slot
+	unsigned pe_gen;		// generation to use next
+	struct pidentry *pe_nextfree;	// next free slot
+};
 
 /*
  * Global pid and exit data.
  *
- * The process table is an el-cheapo hash table. It's indexed by
- * (pid % PROCS_MAX), and only allows one process per slot. If a
- * new pid allocation would cause a hash collision, we just don't
- * use that pid.
+ * The process table has PIDTAB_SIZE slots, and a pid is its slot
+ * number plus PIDTAB_SIZE times a generation count that goes up each
+ * time the slot is reused. So pid % PIDTAB_SIZE finds the slot
+ * directly, and no two live processes can ever collide. Slots are
+ * handed out from a FIFO free list, which makes allocation O(1) and
+ * puts off reusing a pid as long as possible.
+ *
+ * The slots are allocated PIDTAB_CHUNK at a time as more processes
+ * appear, and never freed; piddir holds the chunks. A chunk is
+ * initialized before it's published in piddir, so lookups can read
+ * piddir without locking.
+ *
+ * Lookups and exit handling lock only the entries involved. The only
+ * global lock is pidfree_lock, which protects the free list and is
+ * held just long enough to take or return a slot. When a parent's
+ * and a child's entry are both locked, the parent's comes first.
  */
-static struct lock *pidlock;		// lock for global exit data
-static struct pidinfo *pidinfo[PROCS_MAX]; // actual pid info
-static pid_t nextpid;			// next candidate pid
-static int nprocs;			// number of allocated pids
+#define PIDTAB_SIZE	PROCS_MAX
+#define PIDTAB_CHUNK	32
+#define PIDTAB_NCHUNKS	(PIDTAB_SIZE / PIDTAB_CHUNK)
+#define PIDTAB_NGENS	((PID_MAX + 1) / PIDTAB_SIZE)
+
+static struct pidentry *piddir[PIDTAB_NCHUNKS];	// chunks of slots
+static struct spinlock pidfree_lock = SPINLOCK_INITIALIZER;
+static unsigned pidnchunks;		// chunks allocated so far
+static struct pidentry *pidfree_head;	// free list, oldest first
+static struct pidentry *pidfree_tail;
 
 
 
 /*
- * Create a pidinfo structure for the specified pid.
+ * Create a pidinfo structure. It gets its pid later.
  */
 static
 struct pidinfo *
-pidinfo_create(pid_t pid, pid_t ppid)
+pidinfo_create(pid_t ppid)
 {
 	struct pidinfo *pi;
 
-	KASSERT(pid != INVALID_PID);
-
 	pi = kmalloc(sizeof(struct pidinfo));
 	if (pi==NULL) {
 		return NULL;
 	}
 
-	pi->pi_cv = cv_create("pidinfo cv");
-	if (pi->pi_cv == NULL) {
+	pi->pi_exitsem = sem_create("pidinfo exit", 0);
+	if (pi->pi_exitsem == NULL) {
 		kfree(pi);
 		return NULL;
 	}
 
-	pi->pi_pid = pid;
+	pi->pi_pid = INVALID_PID;
 	pi->pi_ppid = ppid;
 	pi->pi_exited = false;
 	pi->pi_exitstatus = 0xbeef;  /* Recognizably invalid value */
+	bzero(&pi->pi_usage, sizeof(pi->pi_usage));
+	pi->pi_children = NULL;
+	pi->pi_sibling = NULL;
+	pi->pi_prevp = NULL;
 
 	return pi;
 }
@@ -114,10 +157,188 @@ pidinfo_destroy(struct pidinfo *pi)
 {
 	KASSERT(pi->pi_exited == true);
 	KASSERT(pi->pi_ppid == INVALID_PID);
-	cv_destroy(pi->pi_cv);
+	KASSERT(pi->pi_children == NULL);
+	KASSERT(pi->pi_prevp == NULL);
+	sem_destroy(pi->pi_exitsem);
 	kfree(pi);
 }
 
+/*
+ * Add CHILD to PARENT's list of children. Caller holds PARENT's entry
+ * lock.
+ */
+static
+void
+pidinfo_addchild(struct pidinfo *parent, struct pidinfo *child)
+{
+	KASSERT(child->pi_prevp == NULL);
+
+	child->pi_sibling = parent->pi_children;
+	if (child->pi_sibling != NULL) {
+		child->pi_sibling->pi_prevp = &child->pi_sibling;
+	}
+	child->pi_prevp = &parent->pi_children;
+	parent->pi_children = child;
+}
+
+/*
+ * Take CHILD off its parent's list of children. Caller holds the
+ * parent's entry lock.
+ */
+static
+void
+pidinfo_rmchild(struct pidinfo *child)
+{
+	KASSERT(child->pi_prevp != NULL);
+
+	*child->pi_prevp = child->pi_sibling;
+	if (child->pi_sibling != NULL) {
+		child->pi_sibling->pi_prevp = child->pi_prevp;
+	}
+	child->pi_sibling = NULL;
+	child->pi_prevp = NULL;
+}
+
+////////////////////////////////////////////////////////////
+
+/*
+ * Add a chunk of slots to the table and put them on the free list.
+ * Returns EAGAIN if the table is already full.
+ */
+static
+int
+pidchunk_add(void)
+{
+	struct pidentry *chunk;
+	unsigned i, slot;
+
+	chunk = kmalloc(PIDTAB_CHUNK * sizeof(*chunk));
+	if (chunk == NULL) {
+		return ENOMEM;
+	}
+
+	spinlock_acquire(&pidfree_lock);
+	if (pidnchunks == PIDTAB_NCHUNKS) {
+		spinlock_release(&pidfree_lock);
+		kfree(chunk);
+		return EAGAIN;
+	}
+
+	for (i=0; i<PIDTAB_CHUNK; i++) {
+		slot = pidnchunks * PIDTAB_CHUNK + i;
+		spinlock_init(&chunk[i].pe_lock);
+		chunk[i].pe_info = NULL;
+		chunk[i].pe_slot = slot;
+		/* pids below PID_MIN are reserved */
+		chunk[i].pe_gen = (slot < PID_MIN) ? 1 : 0;
+		chunk[i].pe_nextfree = NULL;
+		if (slot == KERNEL_PID) {
+			/* the kernel never exits; its slot is never free */
+			continue;
+		}
+		if (pidfree_tail == NULL) {
+			pidfree_head = &chunk[i];
+		}
+		else {
+			pidfree_tail->pe_nextfree = &chunk[i];
+		}
+		pidfree_tail = &chunk[i];
+	}
+
+	/* make sure lookups can't see the chunk before it's set up */
+	membar_store_store();
+	piddir[pidnchunks++] = chunk;
+
+	spinlock_release(&pidfree_lock);
+	return 0;
+}
+
+/*
+ * Take a free slot, adding more slots if there aren't any. Returns
+ * the entry and the pid to use for it.
+ */
+static
+int
+pidslot_get(struct pidentry **ret, pid_t *retpid)
+{
+	struct pidentry *pe;
+	int result;
+
+	spinlock_acquire(&pidfree_lock);
+	while (pidfree_head == NULL) {
+		spinlock_release(&pidfree_lock);
+		result = pidchunk_add();
+		if (result) {
+			return result;
+		}
+		spinlock_acquire(&pidfree_lock);
+	}
+
+	pe = pidfree_head;
+	pidfree_head = pe->pe_nextfree;
+	if (pidfree_head == NULL) {
+		pidfree_tail = NULL;
+	}
+	pe->pe_nextfree = NULL;
+	*retpid = pe->pe_gen * PIDTAB_SIZE + pe->pe_slot;
+
+	spinlock_release(&pidfree_lock);
+
+	KASSERT(*retpid >= PID_MIN && *retpid <= PID_MAX);
+	*ret = pe;
+	return 0;
+}
+
+/*
+ * Return an empty slot to the end of the free list, moving it on to
+ * its next pid.
+ */
+static
+void
+pidslot_put(struct pidentry *pe)
+{
+	KASSERT(pe->pe_info == NULL);
+
+	spinlock_acquire(&pidfree_lock);
+
+	pe->pe_gen = (pe->pe_gen + 1) % PIDTAB_NGENS;
+	if (pe->pe_gen * PIDTAB_SIZE + pe->pe_slot < PID_MIN) {
+		pe->pe_gen++;
+	}
+
+	KASSERT(pe->pe_nextfree == NULL);
+	if (pidfree_tail == NULL) {
+		pidfree_head = pe;
+	}
+	else {
+		pidfree_tail->pe_nextfree = pe;
+	}
+	pidfree_tail = pe;
+
+	spinlock_release(&pidfree_lock);
+}
+
+/*
+ * Find the table entry for a pid, or NULL if its slot doesn't exist
+ * yet. The entry may hold some other pid, or none.
+ */
+static
+struct pidentry *
+pidslot_find(pid_t pid)
+{
+	struct pidentry *chunk;
+	unsigned slot;
+
+	KASSERT(pid>=0);
+
+	slot = pid % PIDTAB_SIZE;
+	chunk = piddir[slot / PIDTAB_CHUNK];
+	if (chunk == NULL) {
+		return NULL;
+	}
+	return &chunk[slot % PIDTAB_CHUNK];
+}
+
 ////////////////////////////////////////////////////////////
 
 /*
@@ -126,154 +347,144 @@ pidinfo_destroy(struct pidinfo *pi)
 void
 pid_bootstrap(void)
 {
-	int i;
+	struct pidentry *pe;
+	struct pidinfo *pi;
 
-	pidlock = lock_create("pidlock");
-	if (pidlock == NULL) {
-		panic("Out of memory creating pid lock\n");
-	}
+	/* pids have to divide evenly into generations */
+	COMPILE_ASSERT((PID_MAX + 1) % PIDTAB_SIZE == 0);
+	COMPILE_ASSERT(PIDTAB_SIZE % PIDTAB_CHUNK == 0);
+	COMPILE_ASSERT(KERNEL_PID < PIDTAB_CHUNK);
 
-	/* not really necessary - should start zeroed */
-	for (i=0; i<PROCS_MAX; i++) {
-		pidinfo[i] = NULL;
+	if (pidchunk_add()) {
+		panic("Out of memory creating process table\n");
 	}
 
-	pidinfo[KERNEL_PID] = pidinfo_create(KERNEL_PID, INVALID_PID);
-	if (pidinfo[KERNEL_PID]==NULL) {
+	pi = pidinfo_create(INVALID_PID);
+	if (pi==NULL) {
 		panic("Out of memory creating kernel pid data\n");
 	}
+	pi->pi_pid = KERNEL_PID;
 
-	nextpid = PID_MIN;
-	nprocs = 1;
+	/* pidchunk_add left the kernel's slot off the free list */
+	pe = pidslot_find(KERNEL_PID);
+	KASSERT(pe != NULL);
+	pe->pe_info = pi;
 }
 
 /*
- * pi_get: look up a pidinfo in the process table.
+ * pi_get: look up a pidinfo in the process table. On success, returns
+ * with its entry locked; release it with pi_release.
  */
 static
 struct pidinfo *
 pi_get(pid_t pid)
 {
+	struct pidentry *pe;
 	struct pidinfo *pi;
 
 	KASSERT(pid>=0);
 	KASSERT(pid != INVALID_PID);
-	KASSERT(lock_do_i_hold(pidlock));
 
-	pi = pidinfo[pid % PROCS_MAX];
-	if (pi==NULL) {
+	pe = pidslot_find(pid);
+	if (pe == NULL) {
 		return NULL;
 	}
-	if (pi->pi_pid != pid) {
+	spinlock_acquire(&pe->pe_lock);
+	pi = pe->pe_info;
+	if (pi == NULL || pi->pi_pid != pid) {
+		spinlock_release(&pe->pe_lock);
 		return NULL;
 	}
 	return pi;
 }
 
 /*
- * pi_put: insert a new pidinfo in the process table. The right slot
- * must be empty.
+ * pi_release: unlock an entry locked with pi_get.
  */
 static
 void
-pi_put(pid_t pid, struct pidinfo *pi)
+pi_release(struct pidinfo *pi)
 {
-	KASSERT(lock_do_i_hold(pidlock));
+	struct pidentry *pe;
 
-	KASSERT(pid != INVALID_PID);
-
-	KASSERT(pidinfo[pid % PROCS_MAX] == NULL);
-	pidinfo[pid % PROCS_MAX] = pi;
-	nprocs++;
+	pe = pidslot_find(pi->pi_pid);
+	KASSERT(spinlock_do_i_hold(&pe->pe_lock));
+	spinlock_release(&pe->pe_lock);
 }
 
 /*
- * pi_drop: remove a pidinfo structure from the process table and free
- * it. It should reflect a process that has already exited and been
- * waited for.
+ * pi_drop: remove a pidinfo from the process table, as part of
+ * dropping it. It should reflect a process that has already exited
+ * and been waited for. Caller holds its entry lock, and must call
+ * pi_free with it after unlocking.
  */
 static
 void
-pi_drop(pid_t pid)
+pi_drop(struct pidinfo *pi)
 {
-	struct pidinfo *pi;
+	struct pidentry *pe;
 
-	KASSERT(lock_do_i_hold(pidlock));
-
-	pi = pidinfo[pid % PROCS_MAX];
-	KASSERT(pi != NULL);
-	KASSERT(pi->pi_pid == pid);
+	pe = pidslot_find(pi->pi_pid);
+	KASSERT(spinlock_do_i_hold(&pe->pe_lock));
+	KASSERT(pe->pe_info == pi);
+	KASSERT(pi->pi_exited);
+	KASSERT(pi->pi_ppid == INVALID_PID);
 
-	pidinfo_destroy(pi);
-	pidinfo[pid % PROCS_MAX] = NULL;
-	nprocs--;
+	pe->pe_info = NULL;
 }
 
-////////////////////////////////////////////////////////////
-
 /*
- * Helper function for pid_alloc.
+ * pi_free: finish dropping a pidinfo: put its slot back on the free
+ * list and destroy it.
  */
 static
 void
-inc_nextpid(void)
+pi_free(struct pidinfo *pi)
 {
-	KASSERT(lock_do_i_hold(pidlock));
-
-	nextpid++;
-	if (nextpid > PID_MAX) {
-		nextpid = PID_MIN;
-	}
+	pidslot_put(pidslot_find(pi->pi_pid));
+	pidinfo_destroy(pi);
 }
 
+////////////////////////////////////////////////////////////
+
 /*
  * pid_alloc: allocate a process id.
  */
 int
 pid_alloc(pid_t *retval)
 {
-	struct pidinfo *pi;
+	struct pidinfo *pi, *parent;
+	struct pidentry *pe;
 	pid_t pid;
-	int count;
+	int result;
 
 	KASSERT(curproc->p_pid != INVALID_PID);
 
-	/* lock the table */
-	lock_acquire(pidlock);
-
-	if (nprocs == PROCS_MAX) {
-		lock_release(pidlock);
-		return EAGAIN;
-	}
-
-	/*
-	 * The above test guarantees that this loop terminates, unless
-	 * our nprocs count is off. Even so, assert we aren't looping
-	 * forever.
-	 */
-	count = 0;
-	while (pidinfo[nextpid % PROCS_MAX] != NULL) {
-
-		/* avoid various boundary cases by allowing extra loops */
-		KASSERT(count < PROCS_MAX*2+5);
-		count++;
-
-		inc_nextpid();
-	}
-
-	pid = nextpid;
-
-	pi = pidinfo_create(pid, curproc->p_pid);
+	pi = pidinfo_create(curproc->p_pid);
 	if (pi==NULL) {
-		lock_release(pidlock);
 		return ENOMEM;
 	}
 
-	pi_put(pid, pi);
+	result = pidslot_get(&pe, &pid);
+	if (result) {
+		/* keep pidinfo_destroy from complaining */
+		pi->pi_exited = true;
+		pi->pi_ppid = INVALID_PID;
+		pidinfo_destroy(pi);
+		return result;
+	}
+	pi->pi_pid = pid;
+
+	parent = pi_get(curproc->p_pid);
+	KASSERT(parent != NULL);
+	pidinfo_addchild(parent, pi);
 
-	inc_nextpid();
+	spinlock_acquire(&pe->pe_lock);
+	KASSERT(pe->pe_info == NULL);
+	pe->pe_info = pi;
+	spinlock_release(&pe->pe_lock);
 
-	lock_release(pidlock);
+	pi_release(parent);
 
 	*retval = pid;
 	return 0;
@@ -286,25 +497,29 @@ pid_alloc(pid_t *retval)
 void
 pid_unalloc(pid_t theirpid)
 {
-	struct pidinfo *them;
+	struct pidinfo *us, *them;
 
 	KASSERT(theirpid >= PID_MIN && theirpid <= PID_MAX);
 
-	lock_acquire(pidlock);
+	us = pi_get(curproc->p_pid);
+	KASSERT(us != NULL);
 
 	them = pi_get(theirpid);
 	KASSERT(them != NULL);
 	KASSERT(them->pi_exited == false);
 	KASSERT(them->pi_ppid == curproc->p_pid);
 
+	pidinfo_rmchild(them);
+
 	/* keep pidinfo_destroy from complaining */
 	them->pi_exitstatus = 0xdead;
 	them->pi_exited = true;
 	them->pi_ppid = INVALID_PID;
 
-	pi_drop(theirpid);
-
-	lock_release(pidlock);
+	pi_drop(them);
+	pi_release(them);
+	pi_release(us);
+	pi_free(them);
 }
 
 /*
@@ -314,22 +529,30 @@ pid_unalloc(pid_t theirpid)
 void
 pid_disown(pid_t theirpid)
 {
-	struct pidinfo *them;
+	struct pidinfo *us, *them;
+	bool drop;
 
 	KASSERT(theirpid >= PID_MIN && theirpid <= PID_MAX);
 
-	lock_acquire(pidlock);
+	us = pi_get(curproc->p_pid);
+	KASSERT(us != NULL);
 
 	them = pi_get(theirpid);
 	KASSERT(them != NULL);
 	KASSERT(them->pi_ppid==curproc->p_pid);
 
+	pidinfo_rmchild(them);
 	them->pi_ppid = INVALID_PID;
-	if (them->pi_exited) {
-		pi_drop(them->pi_pid);
+	drop = them->pi_exited;
+	if (drop) {
+		pi_drop(them);
 	}
 
-	lock_release(pidlock);
+	pi_release(them);
+	pi_release(us);
+	if (drop) {
+		pi_free(them);
+	}
 }
 
 /*
@@ -341,58 +564,74 @@ pid_disown(pid_t theirpid)
  * subsequent reuse; thus we set curproc->p_pid to INVALID_PID.
  */
 void
-pid_setexitstatus(int status)
+pid_setexitstatus(int status, const struct usage *usage)
 {
-	struct pidinfo *us;
-	int i;
+	struct pidinfo *us, *kid, *nextkid;
+	bool drop;
 
-	lock_acquire(pidlock);
 	KASSERT(curproc->p_pid != INVALID_PID);
 
-	/* First, disown all children */
-	for (i=0; i<PROCS_MAX; i++) {
-		if (pidinfo[i]==NULL) {
-			continue;
+	us = pi_get(curproc->p_pid);
+	KASSERT(us != NULL);
+
+	/*
+	 * First, disown all children. Once a child's pi_ppid is
+	 * cleared it may drop itself, so get the next one first.
+	 */
+	for (kid = us->pi_children; kid != NULL; kid = nextkid) {
+		nextkid = kid->pi_sibling;
+
+		spinlock_acquire(&pidslot_find(kid->pi_pid)->pe_lock);
+		KASSERT(kid->pi_ppid == curproc->p_pid);
+		kid->pi_sibling = NULL;
+		kid->pi_prevp = NULL;
+		kid->pi_ppid = INVALID_PID;
+		drop = kid->pi_exited;
+		if (drop) {
+			pi_drop(kid);
 		}
-		if (pidinfo[i]->pi_ppid == curproc->p_pid) {
-			pidinfo[i]->pi_ppid = INVALID_PID;
-			if (pidinfo[i]->pi_exited) {
-				pi_drop(pidinfo[i]->pi_pid);
-			}
+		pi_release(kid);
+
+		if (drop) {
+			pi_free(kid);
 		}
 	}
+	us->pi_children = NULL;
 
 	/* Now, wake up our parent */
-	us = pi_get(curproc->p_pid);
-	KASSERT(us != NULL);
-
 	us->pi_exitstatus = status;
+	us->pi_usage = *usage;
 	us->pi_exited = true;
 
-	if (us->pi_ppid == INVALID_PID) {
+	drop = (us->pi_ppid == INVALID_PID);
+	if (drop) {
 		/* no parent */
-		pi_drop(curproc->p_pid);
+		pi_drop(us);
 	}
 	else {
-		cv_broadcast(us->pi_cv, pidlock);
+		V(us->pi_exitsem);
 	}
+	pi_release(us);
 
+	if (drop) {
+		pi_free(us);
+	}
 	curproc->p_pid = INVALID_PID;
-	lock_release(pidlock);
 }
 
 /*
  * Waits on a pid, returning the exit status when it's available.
- * status and ret are a kernel pointers, but pid/flags may come from
- * userland and may thus be maliciously invalid.
+ * status, ret, and usage are kernel pointers, but pid/flags may come
+ * from userland and may thus be maliciously invalid.
  *
- * status may be null, in which case the status is thrown away. ret
- * may only be null if WNOHANG is not set.
+ * status and usage may be null, in which case they're thrown away.
+ * ret may only be null if WNOHANG is not set.
  */
 int
-pid_wait(pid_t theirpid, int *status, int flags, pid_t *ret)
+pid_wait(pid_t theirpid, int *status, int flags, pid_t *ret,
+	 struct usage *usage)
 {
-	struct pidinfo *them;
+	struct pidinfo *us, *them;
 
 	KASSERT(curproc->p_pid != INVALID_PID);
 
@@ -415,11 +654,8 @@ pid_wait(pid_t theirpid, int *status, int flags, pid_t *ret)
 		return EINVAL;
 	}
 
-	lock_acquire(pidlock);
-
 	them = pi_get(theirpid);
 	if (them==NULL) {
-		lock_release(pidlock);
 		return ESRCH;
 	}
 
@@ -427,25 +663,41 @@ pid_wait(pid_t theirpid, int *status, int flags, pid_t *ret)
 
 	/* Only allow waiting for own children. */
 	if (them->pi_ppid != curproc->p_pid) {
-		lock_release(pidlock);
+		pi_release(them);
 		return EPERM;
 	}
 
-	if (them->pi_exited == false) {
-		if (flags == WNOHANG) {
-			lock_release(pidlock);
-			KASSERT(ret != NULL);
-			*ret = 0;
-			return 0;
-		}
-		/* don't need to loop on this */
-		cv_wait(them->pi_cv, pidlock);
-		KASSERT(them->pi_exited == true);
+	if (them->pi_exited == false && flags == WNOHANG) {
+		pi_release(them);
+		KASSERT(ret != NULL);
+		*ret = 0;
+		return 0;
 	}
 
+	/*
+	 * Now that we know it's our child, we can unlock it to wait:
+	 * only the parent (us) can change pi_ppid while it's set to
+	 * us, and the entry can't be dropped until it isn't.
+	 */
+	pi_release(them);
+
+	/*
+	 * The child V's pi_exitsem exactly once, when it exits while
+	 * it still has a parent; so this doesn't need to loop and
+	 * returns right away if it has exited already.
+	 */
+	P(them->pi_exitsem);
+	KASSERT(them->pi_exited == true);
+
 	if (status != NULL) {
 		*status = them->pi_exitstatus;
 	}
+	if (usage != NULL) {
+		*usage = them->pi_usage;
+	}
+	lock_acquire(curproc->p_threadslock);
+	usage_add(&curproc->p_cusage, &them->pi_usage);
+	lock_release(curproc->p_threadslock);
 	if (ret != NULL) {
 		/*
 		 * In Unix you can wait for any of several possible
@@ -457,9 +709,18 @@ pid_wait(pid_t theirpid, int *status, int flags, pid_t *ret)
 		*ret = theirpid;
 	}
 
-	them->pi_ppid = 0;
-	pi_drop(them->pi_pid);
+	us = pi_get(curproc->p_pid);
+	KASSERT(us != NULL);
+	them = pi_get(theirpid);
+	KASSERT(them != NULL);
+
+	pidinfo_rmchild(them);
+	them->pi_ppid = INVALID_PID;
+	pi_drop(them);
+
+	pi_release(them);
+	pi_release(us);
+	pi_free(them);
 
-	lock_release(pidlock);
 	return 0;
 }
@@ -52,12 +52,19 @@
 #include <vnode.h>
 #include <pid.h>
 #include <filetable.h>
+#include <aio.h>
+#include <kmem_cache.h>
 
 /*
  * The process for the kernel; this holds all the kernel-only threads.
  */
 struct proc *kproc;
 
+/*
+ * Cache for proc structures.
+ */
+static struct kmem_cache *proc_cache;
+
 /*
  * Create a proc structure.
  */
@@ -67,20 +74,20 @@ proc_create(const char *name)
 {
 	struct proc *proc;
 
-	proc = kmalloc(sizeof(*proc));
+	proc = kmem_cache_alloc(proc_cache);
 	if (proc == NULL) {
 		return NULL;
 	}
 	proc->p_name = kstrdup(name);
 	if (proc->p_name == NULL) {
-		kfree(proc);
+		kmem_cache_free(proc_cache, proc);
 		return NULL;
 	}
 
 	proc->p_threadslock = lock_create("p_threads");
 	if (proc->p_threadslock == NULL) {
 		kfree(proc->p_name);
-		kfree(proc);
+		kmem_cache_free(proc_cache, proc);
 		return NULL;
 	}
 	threadarray_init(&proc->p_threads);
@@ -90,10 +97,15 @@ proc_create(const char *name)
 
 	/* VM fields */
 	proc->p_addrspace = NULL;
+	proc->p_vforksem = NULL;
 
 	/* VFS fields */
 	proc->p_cwd = NULL;
 	proc->p_filetable = NULL;
+	proc->p_aio = NULL;
+
+	bzero(&proc->p_usage, sizeof(proc->p_usage));
+	bzero(&proc->p_cusage, sizeof(proc->p_cusage));
 
 	return proc;
 }
@@ -129,12 +141,31 @@ proc_destroy(struct proc *proc)
 		VOP_DECREF(proc->p_cwd);
 		proc->p_cwd = NULL;
 	}
+	if (proc->p_aio) {
+		aio_destroy(proc->p_aio);
+		proc->p_aio = NULL;
+	}
 	if (proc->p_filetable) {
 		filetable_destroy(proc->p_filetable);
 		proc->p_filetable = NULL;
 	}
 
 	/* VM fields */
+	if (proc->p_vforksem != NULL) {
+		/*
+		 * The address space belongs to our vfork parent. Take
+		 * it back out (the same way as below) but don't
+		 * destroy it, and let the parent go.
+		 */
+		if (proc == curproc) {
+			proc_setas(NULL);
+			as_deactivate();
+		}
+		else {
+			proc->p_addrspace = NULL;
+		}
+		proc_vforkdone(proc);
+	}
 	if (proc->p_addrspace) {
 		/*
 		 * If p is the current process, remove it safely from
@@ -188,7 +219,7 @@ proc_destroy(struct proc *proc)
 	lock_destroy(proc->p_threadslock);
 
 	kfree(proc->p_name);
-	kfree(proc);
+	kmem_cache_free(proc_cache, proc);
 }
 
 /*
@@ -197,6 +228,11 @@ proc_destroy(struct proc *proc)
 void
 proc_bootstrap(void)
 {
+	proc_cache = kmem_cache_create("proc", sizeof(struct proc), 0, NULL);
+	if (proc_cache == NULL) {
+		panic("proc_bootstrap: Out of memory\n");
+	}
+
 	kproc = proc_create("[kernel]");
 	if (kproc == NULL) {
 		panic("proc_create for kproc failed\n");
@@ -261,9 +297,13 @@ proc_create_runprogram(const char *name, struct proc **ret)
  * However, the new thread always inherits its current working
  * directory from the caller. The new thread is given no address space
  * (the caller decides that).
+ *
+ * If VFORKSEM is not null, the new process shares our address space
+ * instead of getting a copy; see proc_vfork.
  */
+static
 int
-proc_fork(struct proc **ret)
+proc_dofork(struct semaphore *vforksem, struct proc **ret)
 {
 	struct proc *newproc;
 	struct addrspace *as;
@@ -293,7 +333,7 @@ proc_fork(struct proc **ret)
 
 	/* VM fields */
 	as = proc_getas();
-	if (as != NULL) {
+	if (as != NULL && vforksem == NULL) {
 		result = as_copy(as, &newproc->p_addrspace);
 		if (result) {
 			pid_unalloc(newproc->p_pid);
@@ -329,12 +369,54 @@ proc_fork(struct proc **ret)
 	}
 	spinlock_release(&curproc->p_lock);
 
+	if (vforksem != NULL) {
+		newproc->p_addrspace = as;
+		newproc->p_vforksem = vforksem;
+	}
+
 	*ret = newproc;
 	return 0;
 }
 
 /*
- * Undo proc_fork if nothing's run in the new process yet.
+ * Create a process for fork, with a copy of our address space.
+ */
+int
+proc_fork(struct proc **ret)
+{
+	return proc_dofork(NULL, ret);
+}
+
+/*
+ * Create a process for vfork. It uses our address space directly
+ * rather than a copy, so we must not run again until it's done with
+ * it: the new process V's DONESEM (via proc_vforkdone) when it execs
+ * or exits, and the caller should P it before returning to userlevel.
+ */
+int
+proc_vfork(struct semaphore *donesem, struct proc **ret)
+{
+	KASSERT(donesem != NULL);
+	return proc_dofork(donesem, ret);
+}
+
+/*
+ * Called in a vforked process when it no longer has its parent's
+ * address space (it has exec'd a new one, or is going away) to let
+ * the parent continue.
+ */
+void
+proc_vforkdone(struct proc *proc)
+{
+	KASSERT(proc->p_vforksem != NULL);
+
+	V(proc->p_vforksem);
+	proc->p_vforksem = NULL;
+}
+
+/*
+ * Undo proc_fork or proc_vfork if nothing's run in the new process
+ * yet.
  */
 void
 proc_unfork(struct proc *newproc)
@@ -352,11 +434,19 @@ proc_exit(int status)
 {
 	struct proc *proc = curproc;
 
+	struct usage usage;
+
 	/* The kernel isn't supposed to exit. */
 	KASSERT(proc != kproc);
 
+	/* Everything we and our children used goes to our parent. */
+	proc_getusage(proc, false, &usage);
+	lock_acquire(proc->p_threadslock);
+	usage_add(&usage, &proc->p_cusage);
+	lock_release(proc->p_threadslock);
+
 	/* Set exit status and wake up anyone waiting for us. */
-	pid_setexitstatus(status);
+	pid_setexitstatus(status, &usage);
 
 	/* Detach from the process and attach to the kernel process. */
 	KASSERT(curthread->t_proc == proc);
@@ -428,6 +518,13 @@ proc_remthread(struct thread *t)
 	for (i=0; i<num; i++) {
 		if (threadarray_get(&proc->p_threads, i) == t) {
 			threadarray_remove(&proc->p_threads, i);
+
+			/* leave what it used with the process */
+			spl = splhigh();
+			usage_add(&proc->p_usage, &t->t_usage);
+			bzero(&t->t_usage, sizeof(t->t_usage));
+			splx(spl);
+
 			lock_release(proc->p_threadslock);
 			goto finish;
 		}
@@ -484,3 +581,28 @@ proc_setas(struct addrspace *newas)
 	spinlock_release(&proc->p_lock);
 	return oldas;
 }
+
+/*
+ * Get the resources used so far by PROC's threads (including ones
+ * that have left), or if CHILDREN is true, by the children it has
+ * waited for.
+ */
+void
+proc_getusage(struct proc *proc, bool children, struct usage *ret)
+{
+	unsigned num, i;
+
+	lock_acquire(proc->p_threadslock);
+	if (children) {
+		*ret = proc->p_cusage;
+	}
+	else {
+		*ret = proc->p_usage;
+		num = threadarray_num(&proc->p_threads);
+		for (i=0; i<num; i++) {
+			usage_add(ret,
+				  &threadarray_get(&proc->p_threads, i)->t_usage);
+		}
+	}
+	lock_release(proc->p_threadslock);
+}
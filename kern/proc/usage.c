@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009, 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Resource usage accounting helpers.
+ */
+
+#include <types.h>
+#include <kern/time.h>
+#include <kern/resource.h>
+#include <lib.h>
+#include <clock.h>
+#include <usage.h>
+
+void
+usage_add(struct usage *to, const struct usage *from)
+{
+	to->u_uticks += from->u_uticks;
+	to->u_sticks += from->u_sticks;
+	to->u_minflt += from->u_minflt;
+	to->u_majflt += from->u_majflt;
+	to->u_inblock += from->u_inblock;
+	to->u_oublock += from->u_oublock;
+	to->u_nvcsw += from->u_nvcsw;
+	to->u_nivcsw += from->u_nivcsw;
+}
+
+/*
+ * Turn a tick count into a timeval.
+ */
+static
+void
+usage_ticks(unsigned ticks, struct timeval *tv)
+{
+	tv->tv_sec = ticks / HZ;
+	tv->tv_usec = (ticks % HZ) * (1000000 / HZ);
+}
+
+void
+usage_torusage(const struct usage *u, struct rusage *ru)
+{
+	bzero(ru, sizeof(*ru));
+	usage_ticks(u->u_uticks, &ru->ru_utime);
+	usage_ticks(u->u_sticks, &ru->ru_stime);
+	ru->ru_minflt = u->u_minflt;
+	ru->ru_majflt = u->u_majflt;
+	ru->ru_inblock = u->u_inblock;
+	ru->ru_oublock = u->u_oublock;
+	ru->ru_nvcsw = u->u_nvcsw;
+	ru->ru_nivcsw = u->u_nivcsw;
+}
@@ -0,0 +1,619 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009, 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Asynchronous I/O: aio_submit() and aio_reap().
+ *
+ * aio_submit turns each request into an aiojob and puts it on a
+ * global queue; a small pool of kernel threads takes jobs off the
+ * queue and does the I/O. Each finished job goes on its process's
+ * done list, where aio_reap finds it.
+ *
+ * The worker threads don't run in the submitting process's address
+ * space, so they can't move data to or from user memory. Instead each
+ * job has its own kernel buffer: a write's data is copied in when
+ * it's submitted, and a read's data is copied out when it's reaped.
+ *
+ * Each job holds a reference to its open file until the I/O is done,
+ * so closing the file handle in the meantime is harmless.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/fcntl.h>
+#include <kern/aio.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <synch.h>
+#include <thread.h>
+#include <uio.h>
+#include <vm.h>
+#include <proc.h>
+#include <current.h>
+#include <copyinout.h>
+#include <vnode.h>
+#include <openfile.h>
+#include <filetable.h>
+#include <aio.h>
+#include <syscall.h>
+
+/* Number of worker threads. */
+#define AIO_NWORKERS	4
+
+/* Most pages in one job's buffer. */
+#define AIO_MAXPAGES	((AIO_MAXLEN + PAGE_SIZE - 1) / PAGE_SIZE)
+
+/*
+ * One request.
+ */
+struct aiojob {
+	struct aiojob *aj_next;		/* on the queue or a done list */
+	struct aioctx *aj_ctx;		/* who submitted it */
+	struct openfile *aj_file;	/* the file (we hold a reference) */
+	enum uio_rw aj_rw;		/* UIO_READ or UIO_WRITE */
+	off_t aj_pos;			/* position in file */
+	userptr_t aj_ubuf;		/* user's buffer */
+	size_t aj_len;			/* length of the request */
+	userptr_t aj_data;		/* user's cookie */
+	char *aj_pages[AIO_MAXPAGES];	/* kernel buffer */
+	unsigned aj_npages;		/* pages in aj_pages */
+	int aj_error;			/* result: error */
+	size_t aj_done;			/* result: bytes transferred */
+};
+
+/*
+ * Per-process state.
+ */
+struct aioctx {
+	struct lock *ac_lock;		/* protects the rest */
+	struct cv *ac_cv;		/* signaled when a job finishes */
+	unsigned ac_inflight;		/* jobs submitted and not finished */
+	unsigned ac_ndone;		/* jobs finished and not reaped */
+	struct aiojob *ac_donehead;	/* finished jobs, oldest first */
+	struct aiojob *ac_donetail;
+};
+
+/* The queue of jobs waiting for a worker. */
+static struct lock *aio_qlock;
+static struct cv *aio_qcv;
+static struct aiojob *aio_qhead;
+static struct aiojob *aio_qtail;
+
+////////////////////////////////////////////////////////////
+// jobs
+
+/*
+ * Make a job for REQ, with a buffer of the right size. For writes,
+ * copy in the data.
+ */
+static
+int
+aiojob_create(struct aioctx *ctx, const struct aioreq *req,
+	      struct openfile *file, struct aiojob **ret)
+{
+	struct aiojob *job;
+	size_t left, len;
+	unsigned i;
+	int result;
+
+	job = kmalloc(sizeof(*job));
+	if (job == NULL) {
+		return ENOMEM;
+	}
+	job->aj_next = NULL;
+	job->aj_ctx = ctx;
+	job->aj_file = file;
+	job->aj_rw = req->ar_op == AIO_READ ? UIO_READ : UIO_WRITE;
+	job->aj_pos = req->ar_pos;
+	job->aj_ubuf = req->ar_buf;
+	job->aj_len = req->ar_len;
+	job->aj_data = req->ar_data;
+	job->aj_npages = 0;
+	job->aj_error = 0;
+	job->aj_done = 0;
+
+	left = req->ar_len;
+	for (i=0; left > 0; i++) {
+		KASSERT(i < AIO_MAXPAGES);
+		job->aj_pages[i] = kmalloc(PAGE_SIZE);
+		if (job->aj_pages[i] == NULL) {
+			result = ENOMEM;
+			goto fail;
+		}
+		job->aj_npages++;
+
+		len = left < PAGE_SIZE ? left : PAGE_SIZE;
+		if (job->aj_rw == UIO_WRITE) {
+			result = copyin((const_userptr_t)(req->ar_buf +
+							  i * PAGE_SIZE),
+					job->aj_pages[i], len);
+			if (result) {
+				goto fail;
+			}
+		}
+		left -= len;
+	}
+
+	*ret = job;
+	return 0;
+
+ fail:
+	for (i=0; i<job->aj_npages; i++) {
+		kfree(job->aj_pages[i]);
+	}
+	kfree(job);
+	return result;
+}
+
+/*
+ * Throw away a job. The file reference has already been dropped.
+ */
+static
+void
+aiojob_destroy(struct aiojob *job)
+{
+	unsigned i;
+
+	KASSERT(job->aj_file == NULL);
+	for (i=0; i<job->aj_npages; i++) {
+		kfree(job->aj_pages[i]);
+	}
+	kfree(job);
+}
+
+/*
+ * Do the I/O for a job.
+ */
+static
+void
+aiojob_run(struct aiojob *job)
+{
+	struct iovec iov[AIO_MAXPAGES];
+	struct uio ku;
+	size_t left;
+	unsigned i;
+
+	left = job->aj_len;
+	for (i=0; left > 0; i++) {
+		iov[i].iov_kbase = job->aj_pages[i];
+		iov[i].iov_len = left < PAGE_SIZE ? left : PAGE_SIZE;
+		left -= iov[i].iov_len;
+	}
+	ku.uio_iov = iov;
+	ku.uio_iovcnt = i;
+	ku.uio_offset = job->aj_pos;
+	ku.uio_resid = job->aj_len;
+	ku.uio_segflg = UIO_SYSSPACE;
+	ku.uio_rw = job->aj_rw;
+	ku.uio_space = NULL;
+
+	if (job->aj_rw == UIO_READ) {
+		job->aj_error = VOP_READ(job->aj_file->of_vnode, &ku);
+	}
+	else {
+		job->aj_error = VOP_WRITE(job->aj_file->of_vnode, &ku);
+	}
+	job->aj_done = job->aj_len - ku.uio_resid;
+}
+
+////////////////////////////////////////////////////////////
+// workers
+
+/*
+ * Worker thread: run jobs off the queue forever.
+ */
+static
+void
+aio_worker(void *unused1, unsigned long unused2)
+{
+	struct aiojob *job;
+	struct aioctx *ctx;
+
+	(void)unused1;
+	(void)unused2;
+
+	while (1) {
+		lock_acquire(aio_qlock);
+		while (aio_qhead == NULL) {
+			cv_wait(aio_qcv, aio_qlock);
+		}
+		job = aio_qhead;
+		aio_qhead = job->aj_next;
+		if (aio_qhead == NULL) {
+			aio_qtail = NULL;
+		}
+		lock_release(aio_qlock);
+
+		job->aj_next = NULL;
+		aiojob_run(job);
+		openfile_decref(job->aj_file);
+		job->aj_file = NULL;
+
+		ctx = job->aj_ctx;
+		lock_acquire(ctx->ac_lock);
+		if (ctx->ac_donetail == NULL) {
+			ctx->ac_donehead = job;
+		}
+		else {
+			ctx->ac_donetail->aj_next = job;
+		}
+		ctx->ac_donetail = job;
+		KASSERT(ctx->ac_inflight > 0);
+		ctx->ac_inflight--;
+		ctx->ac_ndone++;
+		cv_broadcast(ctx->ac_cv, ctx->ac_lock);
+		lock_release(ctx->ac_lock);
+	}
+}
+
+/*
+ * Hand a job to the workers.
+ */
+static
+void
+aio_enqueue(struct aiojob *job)
+{
+	lock_acquire(aio_qlock);
+	if (aio_qtail == NULL) {
+		aio_qhead = job;
+	}
+	else {
+		aio_qtail->aj_next = job;
+	}
+	aio_qtail = job;
+	cv_signal(aio_qcv, aio_qlock);
+	lock_release(aio_qlock);
+}
+
+/*
+ * Set up the queue and start the workers.
+ */
+void
+aio_bootstrap(void)
+{
+	unsigned i;
+	int result;
+
+	aio_qlock = lock_create("aio queue");
+	if (aio_qlock == NULL) {
+		panic("aio_bootstrap: Out of memory\n");
+	}
+	aio_qcv = cv_create("aio queue");
+	if (aio_qcv == NULL) {
+		panic("aio_bootstrap: Out of memory\n");
+	}
+	aio_qhead = aio_qtail = NULL;
+
+	for (i=0; i<AIO_NWORKERS; i++) {
+		result = thread_fork("aio worker", NULL, aio_worker, NULL, i);
+		if (result) {
+			panic("aio_bootstrap: thread_fork: %s\n",
+			      strerror(result));
+		}
+	}
+}
+
+////////////////////////////////////////////////////////////
+// per-process state
+
+static
+struct aioctx *
+aioctx_create(void)
+{
+	struct aioctx *ctx;
+
+	ctx = kmalloc(sizeof(*ctx));
+	if (ctx == NULL) {
+		return NULL;
+	}
+	ctx->ac_lock = lock_create("aio");
+	if (ctx->ac_lock == NULL) {
+		kfree(ctx);
+		return NULL;
+	}
+	ctx->ac_cv = cv_create("aio");
+	if (ctx->ac_cv == NULL) {
+		lock_destroy(ctx->ac_lock);
+		kfree(ctx);
+		return NULL;
+	}
+	ctx->ac_inflight = 0;
+	ctx->ac_ndone = 0;
+	ctx->ac_donehead = ctx->ac_donetail = NULL;
+	return ctx;
+}
+
+/*
+ * Get the current process's aio state, making it the first time.
+ */
+static
+int
+aioctx_get(struct aioctx **ret)
+{
+	struct proc *proc = curproc;
+	struct aioctx *ctx;
+
+	spinlock_acquire(&proc->p_lock);
+	ctx = proc->p_aio;
+	spinlock_release(&proc->p_lock);
+	if (ctx != NULL) {
+		*ret = ctx;
+		return 0;
+	}
+
+	ctx = aioctx_create();
+	if (ctx == NULL) {
+		return ENOMEM;
+	}
+
+	/* Another thread in this process may have gotten there first. */
+	spinlock_acquire(&proc->p_lock);
+	if (proc->p_aio == NULL) {
+		proc->p_aio = ctx;
+		ctx = NULL;
+	}
+	*ret = proc->p_aio;
+	spinlock_release(&proc->p_lock);
+	if (ctx != NULL) {
+		aio_destroy(ctx);
+	}
+	return 0;
+}
+
+void
+aio_destroy(struct aioctx *ctx)
+{
+	struct aiojob *job;
+
+	lock_acquire(ctx->ac_lock);
+	while (ctx->ac_inflight > 0) {
+		cv_wait(ctx->ac_cv, ctx->ac_lock);
+	}
+	lock_release(ctx->ac_lock);
+
+	while (ctx->ac_donehead != NULL) {
+		job = ctx->ac_donehead;
+		ctx->ac_donehead = job->aj_next;
+		aiojob_destroy(job);
+	}
+
+	cv_destroy(ctx->ac_cv);
+	lock_destroy(ctx->ac_lock);
+	kfree(ctx);
+}
+
+////////////////////////////////////////////////////////////
+// system calls
+
+/*
+ * Check one request and hand it to the workers.
+ */
+static
+int
+aio_submit_one(struct aioctx *ctx, const struct aioreq *req)
+{
+	struct openfile *file;
+	struct aiojob *job;
+	int badaccmode, result;
+
+	switch (req->ar_op) {
+	    case AIO_READ:
+		badaccmode = O_WRONLY;
+		break;
+	    case AIO_WRITE:
+		badaccmode = O_RDONLY;
+		break;
+	    default:
+		return EINVAL;
+	}
+	if (req->ar_pos < 0 || req->ar_len > AIO_MAXLEN) {
+		return EINVAL;
+	}
+
+	result = filetable_get(curproc->p_filetable, req->ar_fd, &file);
+	if (result) {
+		return result;
+	}
+	if (file->of_accmode == badaccmode) {
+		filetable_put(curproc->p_filetable, req->ar_fd, file);
+		return EBADF;
+	}
+	if (!VOP_ISSEEKABLE(file->of_vnode)) {
+		filetable_put(curproc->p_filetable, req->ar_fd, file);
+		return ESPIPE;
+	}
+
+	/* Take a slot; finished but unreaped jobs count too. */
+	lock_acquire(ctx->ac_lock);
+	if (ctx->ac_inflight + ctx->ac_ndone >= AIO_MAXREQS) {
+		lock_release(ctx->ac_lock);
+		filetable_put(curproc->p_filetable, req->ar_fd, file);
+		return EAGAIN;
+	}
+	ctx->ac_inflight++;
+	lock_release(ctx->ac_lock);
+
+	/* The job keeps the reference filetable_get gave us. */
+	result = aiojob_create(ctx, req, file, &job);
+	if (result) {
+		lock_acquire(ctx->ac_lock);
+		ctx->ac_inflight--;
+		cv_broadcast(ctx->ac_cv, ctx->ac_lock);
+		lock_release(ctx->ac_lock);
+		filetable_put(curproc->p_filetable, req->ar_fd, file);
+		return result;
+	}
+
+	aio_enqueue(job);
+	return 0;
+}
+
+/*
+ * aio_submit() - submit up to NREQS requests, stopping at the first
+ * one that can't be submitted. Returns how many were; only fails if
+ * it's none.
+ */
+int
+sys_aio_submit(const_userptr_t ureqs, int nreqs, int *retval)
+{
+	struct aioctx *ctx;
+	struct aioreq req;
+	int i, result;
+
+	if (nreqs < 0) {
+		return EINVAL;
+	}
+
+	result = aioctx_get(&ctx);
+	if (result) {
+		return result;
+	}
+
+	for (i=0; i<nreqs; i++) {
+		result = copyin(ureqs + i * sizeof(req), &req, sizeof(req));
+		if (result == 0) {
+			result = aio_submit_one(ctx, &req);
+		}
+		if (result) {
+			break;
+		}
+	}
+
+	if (i == 0 && result) {
+		return result;
+	}
+	*retval = i;
+	return 0;
+}
+
+/*
+ * Report a finished job to the user and throw it away.
+ */
+static
+int
+aio_reap_one(struct aiojob *job, userptr_t uev)
+{
+	struct aioevent ev;
+	size_t left, len;
+	unsigned i;
+	int result;
+
+	ev.ae_data = job->aj_data;
+	ev.ae_error = job->aj_error;
+	ev.ae_result = job->aj_error ? -1 : (ssize_t)job->aj_done;
+
+	if (job->aj_rw == UIO_READ && job->aj_error == 0) {
+		left = job->aj_done;
+		for (i=0; left > 0; i++) {
+			len = left < PAGE_SIZE ? left : PAGE_SIZE;
+			result = copyout(job->aj_pages[i],
+					 job->aj_ubuf + i * PAGE_SIZE, len);
+			if (result) {
+				ev.ae_error = result;
+				ev.ae_result = -1;
+				break;
+			}
+			left -= len;
+		}
+	}
+
+	aiojob_destroy(job);
+	return copyout(&ev, uev, sizeof(ev));
+}
+
+/*
+ * aio_reap() - wait until at least MINWAIT jobs have finished (or
+ * until none are left running), then report up to NEVS of them.
+ */
+int
+sys_aio_reap(userptr_t uevs, int nevs, int minwait, int *retval)
+{
+	struct aioctx *ctx;
+	struct aiojob *jobs, *job;
+	int n, result;
+
+	if (nevs < 0 || minwait < 0 || minwait > nevs) {
+		return EINVAL;
+	}
+
+	spinlock_acquire(&curproc->p_lock);
+	ctx = curproc->p_aio;
+	spinlock_release(&curproc->p_lock);
+	if (ctx == NULL) {
+		/* Never submitted anything. */
+		*retval = 0;
+		return 0;
+	}
+
+	/* Take up to NEVS finished jobs off the done list. */
+	lock_acquire(ctx->ac_lock);
+	while (ctx->ac_ndone < (unsigned)minwait && ctx->ac_inflight > 0) {
+		cv_wait(ctx->ac_cv, ctx->ac_lock);
+	}
+	jobs = NULL;
+	job = NULL;
+	for (n = 0; n < nevs && ctx->ac_donehead != NULL; n++) {
+		job = ctx->ac_donehead;
+		ctx->ac_donehead = job->aj_next;
+		if (jobs == NULL) {
+			jobs = job;
+		}
+	}
+	if (job != NULL) {
+		job->aj_next = NULL;
+	}
+	if (ctx->ac_donehead == NULL) {
+		ctx->ac_donetail = NULL;
+	}
+	ctx->ac_ndone -= n;
+	lock_release(ctx->ac_lock);
+
+	/*
+	 * Report them. The jobs are ours now, so if the copyout fails
+	 * the rest of them are lost; but so would be the results of
+	 * read() into a bad buffer.
+	 */
+	result = 0;
+	for (n = 0; jobs != NULL; n++) {
+		job = jobs;
+		jobs = job->aj_next;
+		if (result == 0) {
+			result = aio_reap_one(job,
+				uevs + n * sizeof(struct aioevent));
+		}
+		else {
+			aiojob_destroy(job);
+		}
+	}
+	if (result) {
+		return result;
+	}
+	*retval = n;
+	return 0;
+}
@@ -34,7 +34,7 @@
 #include <types.h>
 #include <kern/errno.h>
 #include <kern/fcntl.h>
-#include <kern/limits.h>
+#include <limits.h>
 #include <kern/seek.h>
 #include <kern/stat.h>
 #include <lib.h>
@@ -42,13 +42,27 @@
 #include <proc.h>
 #include <current.h>
 #include <synch.h>
+#include <vm.h>
 #include <copyinout.h>
 #include <vfs.h>
 #include <vnode.h>
 #include <openfile.h>
 #include <filetable.h>
+#include <pipe.h>
 #include <syscall.h>
 
+/* iovecs readv and writev handle without calling kmalloc */
+#define UIO_SMALLIOV	8
+
+/*
+ * most iovecs readv and writev copy in at once: one page, since
+ * kmalloc can't give us more than that contiguously
+ */
+#define UIO_CHUNKIOV	(PAGE_SIZE / sizeof(struct iovec))
+
+/* most bytes one call can transfer, so the count fits in ssize_t */
+#define RW_MAXSIZE	((size_t)-1 / 2)
+
 /*
  * open() - get the path with copyinstr, then use openfile_open and
  * filetable_place to do the real work.
@@ -105,20 +119,26 @@ sys_open(const_userptr_t upath, int flags, mode_t mode, int *retval)
 }
 
 /*
- * Common logic for read and write.
+ * Common logic for all the read and write calls.
  *
- * Look up the fd, then use VOP_READ or VOP_WRITE.
+ * Look up the fd, then use VOP_READ or VOP_WRITE on a uio made from
+ * the NIOV iovecs in IOV, which hold user pointers adding up to SIZE
+ * bytes. If POS is NULL use (and update) the file's seek position;
+ * otherwise do the I/O at *POS and leave the seek position alone.
+ * Positional I/O doesn't touch the offset lock at all, so threads
+ * using it on the same file don't serialize here. Reads from seekable
+ * files are also passed to openfile_readahead.
  */
 static
 int
-sys_readwrite(int fd, userptr_t buf, size_t size, enum uio_rw rw,
-	      int badaccmode, ssize_t *retval)
+sys_doreadwrite(int fd, struct iovec *iov, unsigned niov, size_t size,
+		const off_t *pos, enum uio_rw rw, int badaccmode,
+		ssize_t *retval)
 {
 	struct openfile *file;
 	bool locked;
-	off_t pos;
-	struct iovec iov;
 	struct uio useruio;
+	off_t startpos;
 	int result;
 
 	/* better be a valid file descriptor */
@@ -127,53 +147,210 @@ sys_readwrite(int fd, userptr_t buf, size_t size, enum uio_rw rw,
 		return result;
 	}
 
+	if (file->of_accmode == badaccmode) {
+		filetable_put(curproc->p_filetable, fd, file);
+		return EBADF;
+	}
+
+	/* set up a uio with the buffers, their size, and the offset */
+	useruio.uio_iov = iov;
+	useruio.uio_iovcnt = niov;
+	useruio.uio_resid = size;
+	useruio.uio_segflg = UIO_USERSPACE;
+	useruio.uio_rw = rw;
+	useruio.uio_space = proc_getas();
+
 	/* Only lock the seek position if we're really using it. */
-	locked = VOP_ISSEEKABLE(file->of_vnode);
-	if (locked) {
+	locked = false;
+	if (pos != NULL) {
+		if (!VOP_ISSEEKABLE(file->of_vnode)) {
+			filetable_put(curproc->p_filetable, fd, file);
+			return ESPIPE;
+		}
+		if (*pos < 0) {
+			filetable_put(curproc->p_filetable, fd, file);
+			return EINVAL;
+		}
+		useruio.uio_offset = *pos;
+	}
+	else if (VOP_ISSEEKABLE(file->of_vnode)) {
+		locked = true;
 		lock_acquire(file->of_offsetlock);
-		pos = file->of_offset;
+		useruio.uio_offset = file->of_offset;
 	}
 	else {
-		pos = 0;
-	}
-
-	if (file->of_accmode == badaccmode) {
-		result = EBADF;
-		goto fail;
+		useruio.uio_offset = 0;
 	}
 
-	/* set up a uio with the buffer, its size, and the current offset */
-	uio_uinit(&iov, &useruio, buf, size, pos, rw);
-
 	/* do the read or write */
+	startpos = useruio.uio_offset;
 	result = (rw == UIO_READ) ?
 		VOP_READ(file->of_vnode, &useruio) :
 		VOP_WRITE(file->of_vnode, &useruio);
-	if (result) {
-		goto fail;
-	}
 
 	if (locked) {
-		/* set the offset to the updated offset in the uio */
-		file->of_offset = useruio.uio_offset;
+		if (result == 0) {
+			/* set the offset to the updated offset in the uio */
+			file->of_offset = useruio.uio_offset;
+		}
 		lock_release(file->of_offsetlock);
 	}
 
+	if (result == 0 && rw == UIO_READ && (pos != NULL || locked) &&
+	    useruio.uio_offset > startpos) {
+		openfile_readahead(file, startpos,
+				   useruio.uio_offset - startpos);
+	}
+
 	filetable_put(curproc->p_filetable, fd, file);
 
+	if (result) {
+		return result;
+	}
+
 	/*
 	 * The amount read (or written) is the original buffer size,
 	 * minus how much is left in it.
 	 */
 	*retval = size - useruio.uio_resid;
+	return 0;
+}
 
+/*
+ * Common logic for read, write, pread, and pwrite: one buffer.
+ */
+static
+int
+sys_readwrite(int fd, userptr_t buf, size_t size, const off_t *pos,
+	      enum uio_rw rw, int badaccmode, ssize_t *retval)
+{
+	struct iovec iov;
+
+	iov.iov_ubase = buf;
+	iov.iov_len = size;
+	return sys_doreadwrite(fd, &iov, 1, size, pos, rw, badaccmode,
+			       retval);
+}
+
+/*
+ * Copy in iovecs START through START+N-1 of the user's array UIOV,
+ * and hand back their total length, which, added to SOFAR, has to
+ * fit in the ssize_t we return.
+ */
+static
+int
+sys_copyiniov(const_userptr_t uiov, unsigned start, unsigned n,
+	      struct iovec *iov, size_t sofar, size_t *size_ret)
+{
+	const_userptr_t src;
+	size_t size;
+	unsigned i;
+	int result;
+
+	/* The user and kernel struct iovec have the same layout. */
+	src = (const_userptr_t)((vaddr_t)uiov + start * sizeof(*iov));
+	result = copyin(src, iov, n * sizeof(*iov));
+	if (result) {
+		return result;
+	}
+
+	size = 0;
+	for (i=0; i<n; i++) {
+		if (iov[i].iov_len > RW_MAXSIZE - sofar - size) {
+			return EINVAL;
+		}
+		size += iov[i].iov_len;
+	}
+	*size_ret = size;
 	return 0;
+}
 
-fail:
-	if (locked) {
-		lock_release(file->of_offsetlock);
+/*
+ * Common logic for readv and writev: copy in the iovec array and
+ * check the total length.
+ *
+ * Arrays longer than UIO_CHUNKIOV are checked a chunk at a time and
+ * then done a chunk at a time, stopping at the first short transfer.
+ * If a later chunk fails, the bytes already done are returned.
+ */
+static
+int
+sys_readwritev(int fd, const_userptr_t uiov, int iovcnt, enum uio_rw rw,
+	       int badaccmode, ssize_t *retval)
+{
+	struct iovec smalliov[UIO_SMALLIOV];
+	struct iovec *iov;
+	size_t size, chunksize;
+	unsigned chunk, start, n;
+	ssize_t done;
+	int result;
+
+	if (iovcnt <= 0 || iovcnt > IOV_MAX) {
+		return EINVAL;
+	}
+
+	chunk = UIO_CHUNKIOV;
+	if ((unsigned)iovcnt < chunk) {
+		chunk = iovcnt;
+	}
+
+	/* Most callers pass only a few; avoid kmalloc for those. */
+	if (chunk <= UIO_SMALLIOV) {
+		iov = smalliov;
+	}
+	else {
+		iov = kmalloc(chunk * sizeof(*iov));
+		if (iov == NULL) {
+			return ENOMEM;
+		}
+	}
+
+	/* Check the whole array before doing any I/O. */
+	size = 0;
+	for (start=0; start<(unsigned)iovcnt; start+=n) {
+		n = iovcnt - start < chunk ? iovcnt - start : chunk;
+		result = sys_copyiniov(uiov, start, n, iov, size, &chunksize);
+		if (result) {
+			goto done;
+		}
+		size += chunksize;
+	}
+
+	if (chunk == (unsigned)iovcnt) {
+		/* It's all still in iov. */
+		result = sys_doreadwrite(fd, iov, iovcnt, size, NULL, rw,
+					 badaccmode, retval);
+		goto done;
+	}
+
+	/* The user may have changed it since, so check it again. */
+	size = 0;
+	for (start=0; start<(unsigned)iovcnt; start+=n) {
+		n = iovcnt - start < chunk ? iovcnt - start : chunk;
+		result = sys_copyiniov(uiov, start, n, iov, size, &chunksize);
+		if (result == 0) {
+			result = sys_doreadwrite(fd, iov, n, chunksize, NULL,
+						 rw, badaccmode, &done);
+		}
+		if (result) {
+			if (size > 0) {
+				result = 0;
+			}
+			break;
+		}
+		size += done;
+		if ((size_t)done < chunksize) {
+			break;
+		}
+	}
+	if (result == 0) {
+		*retval = size;
+	}
+
+ done:
+	if (iov != smalliov) {
+		kfree(iov);
 	}
-	filetable_put(curproc->p_filetable, fd, file);
 	return result;
 }
 
@@ -183,7 +360,7 @@ fail:
 int
 sys_read(int fd, userptr_t buf, size_t size, int *retval)
 {
-	return sys_readwrite(fd, buf, size, UIO_READ, O_WRONLY, retval);
+	return sys_readwrite(fd, buf, size, NULL, UIO_READ, O_WRONLY, retval);
 }
 
 /*
@@ -192,7 +369,174 @@ sys_read(int fd, userptr_t buf, size_t size, int *retval)
 int
 sys_write(int fd, userptr_t buf, size_t size, int *retval)
 {
-	return sys_readwrite(fd, buf, size, UIO_WRITE, O_RDONLY, retval);
+	return sys_readwrite(fd, buf, size, NULL, UIO_WRITE, O_RDONLY, retval);
+}
+
+/*
+ * pread() - use sys_readwrite with an explicit position
+ */
+int
+sys_pread(int fd, userptr_t buf, size_t size, off_t pos, int *retval)
+{
+	return sys_readwrite(fd, buf, size, &pos, UIO_READ, O_WRONLY, retval);
+}
+
+/*
+ * pwrite() - use sys_readwrite with an explicit position
+ */
+int
+sys_pwrite(int fd, userptr_t buf, size_t size, off_t pos, int *retval)
+{
+	return sys_readwrite(fd, buf, size, &pos, UIO_WRITE, O_RDONLY,
+			     retval);
+}
+
+/*
+ * readv() - use sys_readwritev
+ */
+int
+sys_readv(int fd, const_userptr_t iov, int iovcnt, int *retval)
+{
+	return sys_readwritev(fd, iov, iovcnt, UIO_READ, O_WRONLY, retval);
+}
+
+/*
+ * writev() - use sys_readwritev
+ */
+int
+sys_writev(int fd, const_userptr_t iov, int iovcnt, int *retval)
+{
+	return sys_readwritev(fd, iov, iovcnt, UIO_WRITE, O_RDONLY, retval);
+}
+
+/*
+ * Get the position for one side of copy_file_range: from the user's
+ * pointer if there is one, otherwise the file's seek position (the
+ * caller holds the offset lock).
+ */
+static
+int
+sys_copy_getpos(struct openfile *file, const_userptr_t uposp, off_t *pos)
+{
+	int result;
+
+	if (!VOP_ISSEEKABLE(file->of_vnode)) {
+		return ESPIPE;
+	}
+	if (uposp == NULL) {
+		*pos = file->of_offset;
+		return 0;
+	}
+	result = copyin(uposp, pos, sizeof(*pos));
+	if (result) {
+		return result;
+	}
+	return *pos < 0 ? EINVAL : 0;
+}
+
+/*
+ * copy_file_range() - copy between two files without the data going
+ * through user space, using vfs_copy.
+ *
+ * A NULL position pointer means use (and update) that file's seek
+ * position; otherwise the position is read from and written back to
+ * the pointer, and the seek position is left alone. If both seek
+ * positions are in use, the offset locks are taken in address order
+ * so two copies running in opposite directions can't deadlock.
+ */
+int
+sys_copy_file_range(int infd, userptr_t uinpos, int outfd, userptr_t uoutpos,
+		    size_t len, unsigned flags, int *retval)
+{
+	struct openfile *infile, *outfile;
+	struct lock *lock1, *lock2;
+	off_t inpos, outpos;
+	size_t copied;
+	int result;
+
+	if (flags != 0) {
+		return EINVAL;
+	}
+	if (len > RW_MAXSIZE) {
+		len = RW_MAXSIZE;
+	}
+
+	result = filetable_get(curproc->p_filetable, infd, &infile);
+	if (result) {
+		return result;
+	}
+	result = filetable_get(curproc->p_filetable, outfd, &outfile);
+	if (result) {
+		filetable_put(curproc->p_filetable, infd, infile);
+		return result;
+	}
+
+	if (infile->of_accmode == O_WRONLY || outfile->of_accmode == O_RDONLY) {
+		result = EBADF;
+		goto out;
+	}
+	if (infile->of_vnode == outfile->of_vnode) {
+		result = EINVAL;
+		goto out;
+	}
+
+	lock1 = (uinpos == NULL) ? infile->of_offsetlock : NULL;
+	lock2 = (uoutpos == NULL) ? outfile->of_offsetlock : NULL;
+	if (lock1 != NULL && lock2 != NULL && lock2 < lock1) {
+		lock1 = outfile->of_offsetlock;
+		lock2 = infile->of_offsetlock;
+	}
+	if (lock1 != NULL) {
+		lock_acquire(lock1);
+	}
+	if (lock2 != NULL) {
+		lock_acquire(lock2);
+	}
+
+	result = sys_copy_getpos(infile, uinpos, &inpos);
+	if (result) {
+		goto unlock;
+	}
+	result = sys_copy_getpos(outfile, uoutpos, &outpos);
+	if (result) {
+		goto unlock;
+	}
+
+	result = vfs_copy(outfile->of_vnode, outpos, infile->of_vnode, inpos,
+			  len, &copied);
+	if (result && copied == 0) {
+		goto unlock;
+	}
+	/* If we got partway, report that and drop the error. */
+	result = 0;
+
+	inpos += copied;
+	outpos += copied;
+	if (uinpos == NULL) {
+		infile->of_offset = inpos;
+	}
+	else {
+		result = copyout(&inpos, uinpos, sizeof(inpos));
+	}
+	if (uoutpos == NULL) {
+		outfile->of_offset = outpos;
+	}
+	else if (result == 0) {
+		result = copyout(&outpos, uoutpos, sizeof(outpos));
+	}
+	*retval = copied;
+
+ unlock:
+	if (lock2 != NULL) {
+		lock_release(lock2);
+	}
+	if (lock1 != NULL) {
+		lock_release(lock1);
+	}
+ out:
+	filetable_put(curproc->p_filetable, outfd, outfile);
+	filetable_put(curproc->p_filetable, infd, infile);
+	return result;
 }
 
 /*
@@ -203,6 +547,7 @@ sys_close(int fd)
 {
 	struct filetable *ft;
 	struct openfile *file;
+	int result;
 
 	ft = curproc->p_filetable;
 
@@ -211,8 +556,12 @@ sys_close(int fd)
 		return EBADF;
 	}
 
-	/* place null in the filetable and get the file previously there */
-	filetable_placeat(ft, NULL, fd, &file);
+	/*
+	 * place null in the filetable and get the file previously there;
+	 * placing null can't fail
+	 */
+	result = filetable_placeat(ft, NULL, fd, &file);
+	KASSERT(result == 0);
 
 	if (file == NULL) {
 		/* oops, it wasn't open, that's an error */
@@ -224,6 +573,86 @@ sys_close(int fd)
 	return 0;
 }
 
+/*
+ * Take one end of a new pipe back out of the file table, for when
+ * pipe() fails partway.
+ */
+static
+void
+pipe_unplace(struct filetable *ft, int fd)
+{
+	struct openfile *oldfile;
+	int result;
+
+	/* Placing null can't fail, even if another thread has forked. */
+	result = filetable_placeat(ft, NULL, fd, &oldfile);
+	KASSERT(result == 0);
+
+	/* another thread may have closed it already */
+	if (oldfile != NULL) {
+		openfile_decref(oldfile);
+	}
+}
+
+/*
+ * pipe() - make a pipe, wrap each end in an openfile, and place them
+ * in the file table.
+ */
+int
+sys_pipe(userptr_t fdsptr, int *retval)
+{
+	struct filetable *ft;
+	struct vnode *readvn, *writevn;
+	struct openfile *readfile, *writefile;
+	int fds[2];
+	int result;
+
+	ft = curproc->p_filetable;
+
+	result = pipe_create(&readvn, &writevn);
+	if (result) {
+		return result;
+	}
+
+	result = openfile_fromvnode(readvn, O_RDONLY, &readfile);
+	if (result) {
+		vfs_close(readvn);
+		vfs_close(writevn);
+		return result;
+	}
+	result = openfile_fromvnode(writevn, O_WRONLY, &writefile);
+	if (result) {
+		openfile_decref(readfile);
+		vfs_close(writevn);
+		return result;
+	}
+
+	result = filetable_place(ft, readfile, &fds[0]);
+	if (result) {
+		openfile_decref(readfile);
+		openfile_decref(writefile);
+		return result;
+	}
+	result = filetable_place(ft, writefile, &fds[1]);
+	if (result) {
+		openfile_decref(writefile);
+		goto fail;
+	}
+
+	result = copyout(fds, fdsptr, sizeof(fds));
+	if (result) {
+		pipe_unplace(ft, fds[1]);
+		goto fail;
+	}
+
+	*retval = 0;
+	return 0;
+
+ fail:
+	pipe_unplace(ft, fds[0]);
+	return result;
+}
+
 /*
  * lseek() - manipulate the seek position.
  */
@@ -321,7 +750,11 @@ sys_dup2(int oldfd, int newfd, int *retval)
 	filetable_put(ft, oldfd, oldfdfile);
 
 	/* place it */
-	filetable_placeat(ft, oldfdfile, newfd, &newfdfile);
+	result = filetable_placeat(ft, oldfdfile, newfd, &newfdfile);
+	if (result) {
+		openfile_decref(oldfdfile);
+		return result;
+	}
 
 	/* if there was a file already there, drop that reference */
 	if (newfdfile != NULL) {
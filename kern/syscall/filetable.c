@@ -34,9 +34,249 @@
 #include <types.h>
 #include <kern/errno.h>
 #include <lib.h>
+#include <bitmap.h>
+#include <membar.h>
+#include <spinlock.h>
+#include <synch.h>
+#include <thread.h>
+#include <proc.h>
+#include <current.h>
 #include <openfile.h>
 #include <filetable.h>
 
+/* Number of slots a table starts with. */
+#define FILETABLE_MINSIZE	16
+
+/*
+ * The slots. An array shared by more than one table (fa_refcount > 1)
+ * is never changed; a table that wants to change it copies it first.
+ * Each array holds one reference to each openfile in it.
+ */
+struct fdarray {
+	struct spinlock fa_reflock;	/* protects fa_refcount */
+	unsigned fa_refcount;		/* number of tables using this */
+	unsigned fa_size;		/* number of slots */
+	struct bitmap *fa_used;		/* slots that are not NULL */
+	struct openfile **fa_files;	/* the slots */
+};
+
+////////////////////////////////////////////////////////////
+// fdarray
+
+/*
+ * Make an empty array of SIZE slots.
+ */
+static
+struct fdarray *
+fdarray_create(unsigned size)
+{
+	struct fdarray *fa;
+	unsigned i;
+
+	fa = kmalloc(sizeof(*fa));
+	if (fa == NULL) {
+		return NULL;
+	}
+	fa->fa_used = bitmap_create(size);
+	if (fa->fa_used == NULL) {
+		kfree(fa);
+		return NULL;
+	}
+	fa->fa_files = kmalloc(size * sizeof(fa->fa_files[0]));
+	if (fa->fa_files == NULL) {
+		bitmap_destroy(fa->fa_used);
+		kfree(fa);
+		return NULL;
+	}
+	for (i=0; i<size; i++) {
+		fa->fa_files[i] = NULL;
+	}
+	spinlock_init(&fa->fa_reflock);
+	fa->fa_refcount = 1;
+	fa->fa_size = size;
+	return fa;
+}
+
+/*
+ * Fill the empty array FA, which must be at least as big, with the
+ * contents of OLD.
+ */
+static
+void
+fdarray_fill(struct fdarray *fa, struct fdarray *old)
+{
+	struct openfile *file;
+	unsigned i;
+
+	KASSERT(fa->fa_size >= old->fa_size);
+
+	for (i=0; i<old->fa_size; i++) {
+		file = old->fa_files[i];
+		if (file != NULL) {
+			KASSERT(fa->fa_files[i] == NULL);
+			openfile_incref(file);
+			fa->fa_files[i] = file;
+			bitmap_mark(fa->fa_used, i);
+		}
+	}
+}
+
+/*
+ * Make a private copy of OLD with SIZE slots, which must be enough
+ * to hold everything in OLD.
+ */
+static
+struct fdarray *
+fdarray_copy(struct fdarray *old, unsigned size)
+{
+	struct fdarray *fa;
+
+	fa = fdarray_create(size);
+	if (fa == NULL) {
+		return NULL;
+	}
+	fdarray_fill(fa, old);
+	return fa;
+}
+
+/*
+ * Drop a table's reference to an array. The last one closes the
+ * files in it and frees it.
+ */
+static
+void
+fdarray_release(struct fdarray *fa)
+{
+	unsigned i;
+
+	spinlock_acquire(&fa->fa_reflock);
+	KASSERT(fa->fa_refcount > 0);
+	fa->fa_refcount--;
+	if (fa->fa_refcount > 0) {
+		spinlock_release(&fa->fa_reflock);
+		return;
+	}
+	spinlock_release(&fa->fa_reflock);
+
+	for (i=0; i<fa->fa_size; i++) {
+		if (fa->fa_files[i] != NULL) {
+			openfile_decref(fa->fa_files[i]);
+		}
+	}
+	spinlock_cleanup(&fa->fa_reflock);
+	kfree(fa->fa_files);
+	bitmap_destroy(fa->fa_used);
+	kfree(fa);
+}
+
+/*
+ * Check if an array is shared with another table.
+ */
+static
+bool
+fdarray_shared(struct fdarray *fa)
+{
+	bool ret;
+
+	spinlock_acquire(&fa->fa_reflock);
+	ret = fa->fa_refcount > 1;
+	spinlock_release(&fa->fa_reflock);
+	return ret;
+}
+
+////////////////////////////////////////////////////////////
+// lookups and changes
+
+/*
+ * Wait until every other thread in the current process has been
+ * outside filetable_get at some point since we were called. After
+ * this, none of them can still be using anything it found before
+ * the change we just made.
+ *
+ * A thread's t_ftseq is odd while it's in filetable_get; if it's odd
+ * now, we only have to see it change.
+ */
+static
+void
+filetable_synchronize(void)
+{
+	struct proc *proc = curproc;
+	struct thread *t;
+	unsigned num, i, seq;
+
+	/* Make our change visible before we look at anyone's t_ftseq. */
+	membar_any_any();
+
+	lock_acquire(proc->p_threadslock);
+	num = threadarray_num(&proc->p_threads);
+	for (i=0; i<num; i++) {
+		t = threadarray_get(&proc->p_threads, i);
+		if (t == curthread) {
+			continue;
+		}
+		seq = t->t_ftseq;
+		while (seq % 2 == 1 && t->t_ftseq == seq) {
+			thread_yield();
+		}
+	}
+	lock_release(proc->p_threadslock);
+}
+
+/*
+ * Make sure FT has an array of its own with at least MINSIZE slots.
+ * Call with ft_lock held.
+ *
+ * If the array only needs unsharing, the spare set aside when it was
+ * shared is used, so this can't fail unless the table has to grow.
+ */
+static
+int
+filetable_prepare(struct filetable *ft, unsigned minsize)
+{
+	struct fdarray *old, *fa;
+	unsigned size;
+
+	KASSERT(lock_do_i_hold(ft->ft_lock));
+	KASSERT(minsize <= OPEN_MAX);
+
+	old = ft->ft_files;
+	size = old->fa_size;
+	while (size < minsize) {
+		size *= 2;
+	}
+	if (size > OPEN_MAX) {
+		size = OPEN_MAX;
+	}
+	if (size == old->fa_size && !fdarray_shared(old)) {
+		return 0;
+	}
+
+	if (size == old->fa_size && ft->ft_spare != NULL) {
+		fa = ft->ft_spare;
+		ft->ft_spare = NULL;
+		fdarray_fill(fa, old);
+	}
+	else {
+		fa = fdarray_copy(old, size);
+		if (fa == NULL) {
+			return ENOMEM;
+		}
+	}
+
+	/* Fill in the array before anyone can see it. */
+	membar_store_store();
+	ft->ft_files = fa;
+
+	filetable_synchronize();
+	fdarray_release(old);
+
+	/* Ours now; the spare isn't needed until it's shared again. */
+	if (ft->ft_spare != NULL) {
+		fdarray_release(ft->ft_spare);
+		ft->ft_spare = NULL;
+	}
+	return 0;
+}
 
 /*
  * Construct a filetable.
@@ -45,17 +285,26 @@ struct filetable *
 filetable_create(void)
 {
 	struct filetable *ft;
-	int fd;
 
 	ft = kmalloc(sizeof(struct filetable));
 	if (ft == NULL) {
 		return NULL;
 	}
 
+	ft->ft_lock = lock_create("filetable");
+	if (ft->ft_lock == NULL) {
+		kfree(ft);
+		return NULL;
+	}
+
 	/* the table starts empty */
-	for (fd = 0; fd < OPEN_MAX; fd++) {
-		ft->ft_openfiles[fd] = NULL;
+	ft->ft_files = fdarray_create(FILETABLE_MINSIZE);
+	if (ft->ft_files == NULL) {
+		lock_destroy(ft->ft_lock);
+		kfree(ft);
+		return NULL;
 	}
+	ft->ft_spare = NULL;
 
 	return ft;
 }
@@ -66,17 +315,14 @@ filetable_create(void)
 void
 filetable_destroy(struct filetable *ft)
 {
-	int fd;
-
 	KASSERT(ft != NULL);
 
-	/* Close any open files. */
-	for (fd = 0; fd < OPEN_MAX; fd++) {
-		if (ft->ft_openfiles[fd] != NULL) {
-			openfile_decref(ft->ft_openfiles[fd]);
-			ft->ft_openfiles[fd] = NULL;
-		}
+	/* Close any open files, unless another table still has them. */
+	fdarray_release(ft->ft_files);
+	if (ft->ft_spare != NULL) {
+		fdarray_release(ft->ft_spare);
 	}
+	lock_destroy(ft->ft_lock);
 	kfree(ft);
 }
 
@@ -94,13 +340,16 @@ filetable_destroy(struct filetable *ft)
  *
  * produce the intended output instead of having the second echo
  * command overwrite the first.
+ *
+ * The slots aren't copied either, until one of the tables changes.
+ * But each table gets an empty spare array to copy them into, so
+ * that closing a file never has to allocate memory and can't fail.
  */
 int
 filetable_copy(struct filetable *src, struct filetable **dest_ret)
 {
 	struct filetable *dest;
-	struct openfile *file;
-	int fd;
+	struct fdarray *fa, *spare;
 
 	/* Copying the nonexistent table avoids special cases elsewhere */
 	if (src == NULL) {
@@ -108,19 +357,43 @@ filetable_copy(struct filetable *src, struct filetable **dest_ret)
 		return 0;
 	}
 
-	dest = filetable_create();
+	dest = kmalloc(sizeof(struct filetable));
 	if (dest == NULL) {
 		return ENOMEM;
 	}
+	dest->ft_lock = lock_create("filetable");
+	if (dest->ft_lock == NULL) {
+		kfree(dest);
+		return ENOMEM;
+	}
 
-	/* share the entries */
-	for (fd = 0; fd < OPEN_MAX; fd++) {
-		file = src->ft_openfiles[fd];
-		if (file != NULL) {
-			openfile_incref(file);
+	/* share the slots, once both tables have spares */
+	lock_acquire(src->ft_lock);
+	fa = src->ft_files;
+	dest->ft_spare = fdarray_create(fa->fa_size);
+	if (dest->ft_spare == NULL) {
+		lock_release(src->ft_lock);
+		lock_destroy(dest->ft_lock);
+		kfree(dest);
+		return ENOMEM;
+	}
+	if (src->ft_spare == NULL) {
+		spare = fdarray_create(fa->fa_size);
+		if (spare == NULL) {
+			lock_release(src->ft_lock);
+			fdarray_release(dest->ft_spare);
+			lock_destroy(dest->ft_lock);
+			kfree(dest);
+			return ENOMEM;
 		}
-		dest->ft_openfiles[fd] = file;
+		src->ft_spare = spare;
 	}
+	KASSERT(src->ft_spare->fa_size == fa->fa_size);
+	spinlock_acquire(&fa->fa_reflock);
+	fa->fa_refcount++;
+	spinlock_release(&fa->fa_reflock);
+	lock_release(src->ft_lock);
+	dest->ft_files = fa;
 
 	*dest_ret = dest;
 	return 0;
@@ -132,7 +405,7 @@ filetable_copy(struct filetable *src, struct filetable **dest_ret)
 bool
 filetable_okfd(struct filetable *ft, int fd)
 {
-	/* We have a fixed-size table so we don't need to check the size */
+	/* The table grows on demand, so the limit is all that matters */
 	(void)ft;
 
 	return (fd >= 0 && fd < OPEN_MAX);
@@ -145,46 +418,58 @@ filetable_okfd(struct filetable *ft, int fd)
  * This checks that the file handle is in range and fails rather than
  * returning a null openfile; it only yields files that are actually
  * open.
+ *
+ * No lock is taken: we mark ourselves as inside (t_ftseq odd) before
+ * looking, so anyone changing the table waits for us before freeing
+ * what we might be looking at. The returned openfile carries its own
+ * reference, so it stays good after we're marked outside again.
  */
 int
 filetable_get(struct filetable *ft, int fd, struct openfile **ret)
 {
+	struct fdarray *fa;
 	struct openfile *file;
 
 	if (!filetable_okfd(ft, fd)) {
 		return EBADF;
 	}
 
-	file = ft->ft_openfiles[fd];
+	curthread->t_ftseq++;
+	membar_any_any();
+
+	fa = ft->ft_files;
+	membar_load_load();
+	file = ((unsigned)fd < fa->fa_size) ? fa->fa_files[fd] : NULL;
+	if (file != NULL) {
+		openfile_incref(file);
+	}
+
+	membar_any_any();
+	curthread->t_ftseq++;
+
 	if (file == NULL) {
 		return EBADF;
 	}
-
 	*ret = file;
 	return 0;
 }
 
 /*
- * Put a file handle back when done with it. This does not actually do
- * anything (other than crosscheck) but it's always good practice to
- * build things so when you take them out you put them back again
- * rather than dropping them on the floor. Then if you need to do
- * something at cleanup time you can put it in this function instead
- * of having to hunt for all the places to insert the new logic.
- *
- * (For example, if you have multithreaded processes you will need to
- * insert additional lock and/or refcount manipulations here and in
- * filetable_get.)
+ * Put a file handle back when done with it. This drops the reference
+ * taken by filetable_get; if the descriptor was closed in the
+ * meantime, that may be the last one and close the file.
  *
  * The openfile should be the one returned from filetable_get. If you
- * want to manipulate the table so the assertion's no longer true, get
- * your own reference to the openfile (with openfile_incref) and call
- * filetable_put before mucking about.
+ * want to keep using it afterwards, get your own reference to the
+ * openfile (with openfile_incref) before calling filetable_put.
  */
 void
 filetable_put(struct filetable *ft, int fd, struct openfile *file)
 {
-	KASSERT(ft->ft_openfiles[fd] == file);
+	(void)ft;
+	(void)fd;
+
+	openfile_decref(file);
 }
 
 /*
@@ -200,17 +485,41 @@ filetable_put(struct filetable *ft, int fd, struct openfile *file)
 int
 filetable_place(struct filetable *ft, struct openfile *file, int *fd_ret)
 {
-	int fd;
+	struct fdarray *fa;
+	unsigned fd;
+	int result;
 
-	for (fd = 0; fd < OPEN_MAX; fd++) {
-		if (ft->ft_openfiles[fd] == NULL) {
-			ft->ft_openfiles[fd] = file;
-			*fd_ret = fd;
-			return 0;
+	lock_acquire(ft->ft_lock);
+	result = filetable_prepare(ft, 0);
+	if (result) {
+		lock_release(ft->ft_lock);
+		return result;
+	}
+
+	fa = ft->ft_files;
+	if (bitmap_alloc(fa->fa_used, &fd)) {
+		/* Full; grow, and the first new slot is the one. */
+		if (fa->fa_size == OPEN_MAX) {
+			lock_release(ft->ft_lock);
+			return EMFILE;
 		}
+		fd = fa->fa_size;
+		result = filetable_prepare(ft, fd + 1);
+		if (result) {
+			lock_release(ft->ft_lock);
+			return result;
+		}
+		fa = ft->ft_files;
+		bitmap_mark(fa->fa_used, fd);
 	}
 
-	return EMFILE;
+	/* The openfile must be set up before anyone can find it. */
+	membar_store_store();
+	fa->fa_files[fd] = file;
+	lock_release(ft->ft_lock);
+
+	*fd_ret = fd;
+	return 0;
 }
 
 /*
@@ -221,17 +530,59 @@ filetable_place(struct filetable *ft, struct openfile *file, int *fd_ret)
  * reference to the old openfile object (if not NULL); this should
  * generally be decref'd.
  *
- * Doesn't fail.
+ * Fails only if the table has to grow and there's no memory for
+ * that; then nothing has changed. Clearing a slot (placing NULL)
+ * never fails, since the slot is in range and unsharing uses the
+ * spare set aside by filetable_copy.
  *
  * Note that you can use this to place NULL in the filetable, which is
  * potentially handy.
  */
-void
+int
 filetable_placeat(struct filetable *ft, struct openfile *newfile, int fd,
 		  struct openfile **oldfile_ret)
 {
+	struct fdarray *fa;
+	struct openfile *oldfile;
+	int result;
+
 	KASSERT(filetable_okfd(ft, fd));
 
-	*oldfile_ret = ft->ft_openfiles[fd];
-	ft->ft_openfiles[fd] = newfile;
+	lock_acquire(ft->ft_lock);
+	fa = ft->ft_files;
+	if (newfile == NULL &&
+	    ((unsigned)fd >= fa->fa_size || fa->fa_files[fd] == NULL)) {
+		lock_release(ft->ft_lock);
+		*oldfile_ret = NULL;
+		return 0;
+	}
+
+	result = filetable_prepare(ft, fd + 1);
+	if (result) {
+		KASSERT(newfile != NULL);
+		lock_release(ft->ft_lock);
+		return result;
+	}
+	fa = ft->ft_files;
+
+	oldfile = fa->fa_files[fd];
+	if (newfile != NULL) {
+		membar_store_store();
+		if (oldfile == NULL) {
+			bitmap_mark(fa->fa_used, fd);
+		}
+	}
+	else {
+		bitmap_unmark(fa->fa_used, fd);
+	}
+	fa->fa_files[fd] = newfile;
+	lock_release(ft->ft_lock);
+
+	/* Don't let the caller drop the old file while a lookup has it. */
+	if (oldfile != NULL) {
+		filetable_synchronize();
+	}
+
+	*oldfile_ret = oldfile;
+	return 0;
 }
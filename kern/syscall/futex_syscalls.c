@@ -0,0 +1,297 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009, 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * futex() system call.
+ *
+ * A futex is just an aligned int in user memory. The kernel keeps no
+ * state for it except while somebody is asleep on it: a wait queue,
+ * keyed on the address space and user address of the int, is made
+ * when the first thread waits and thrown away when the last one
+ * leaves. The queues are hashed into a fixed set of buckets, each
+ * with its own lock, so unrelated futexes mostly don't contend.
+ *
+ * The value check in FUTEX_WAIT and the wakeup in FUTEX_WAKE are both
+ * done under the bucket lock, so a waker that changes the int and then
+ * calls FUTEX_WAKE can't slip in between a waiter's check and its
+ * sleep.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/futex.h>
+#include <lib.h>
+#include <array.h>
+#include <proc.h>
+#include <synch.h>
+#include <copyinout.h>
+#include <syscall.h>
+
+/* Number of hash buckets. Should be a power of 2. */
+#define FUTEX_NBUCKETS	32
+
+/*
+ * One wait queue.
+ *
+ * fq_sleepers is the number of threads asleep on fq_cv that haven't
+ * been signalled yet; fq_users also counts signalled threads that
+ * haven't woken up and left. The queue is freed when fq_users drops
+ * to zero.
+ */
+struct futexq {
+	struct addrspace *fq_as;
+	userptr_t fq_uaddr;
+	struct cv *fq_cv;
+	unsigned fq_sleepers;
+	unsigned fq_users;
+};
+
+DECLARRAY(futexq, static __UNUSED inline);
+DEFARRAY(futexq, static __UNUSED inline);
+
+struct futexbucket {
+	struct lock *fb_lock;
+	struct futexqarray fb_queues;
+};
+
+static struct futexbucket futextable[FUTEX_NBUCKETS];
+
+/*
+ * Set things up.
+ */
+void
+futex_bootstrap(void)
+{
+	unsigned i;
+
+	for (i=0; i<FUTEX_NBUCKETS; i++) {
+		futextable[i].fb_lock = lock_create("futex");
+		if (futextable[i].fb_lock == NULL) {
+			panic("futex_bootstrap: Out of memory\n");
+		}
+		futexqarray_init(&futextable[i].fb_queues);
+	}
+}
+
+/*
+ * Pick the bucket for a futex.
+ */
+static
+struct futexbucket *
+futex_hash(struct addrspace *as, userptr_t uaddr)
+{
+	uintptr_t key;
+
+	/* the low two bits of both are always zero */
+	key = ((uintptr_t)as >> 2) ^ ((uintptr_t)uaddr >> 2);
+	key ^= key >> 11;
+	return &futextable[key % FUTEX_NBUCKETS];
+}
+
+/*
+ * Find the wait queue for a futex in its bucket. If CREATE is set,
+ * make one if there isn't one yet; otherwise return NULL if there
+ * isn't one. The bucket lock must be held.
+ */
+static
+struct futexq *
+futexq_find(struct futexbucket *fb, struct addrspace *as, userptr_t uaddr,
+	    bool create)
+{
+	struct futexq *fq;
+	unsigned i, num;
+	int result;
+
+	KASSERT(lock_do_i_hold(fb->fb_lock));
+
+	num = futexqarray_num(&fb->fb_queues);
+	for (i=0; i<num; i++) {
+		fq = futexqarray_get(&fb->fb_queues, i);
+		if (fq->fq_as == as && fq->fq_uaddr == uaddr) {
+			return fq;
+		}
+	}
+	if (!create) {
+		return NULL;
+	}
+
+	fq = kmalloc(sizeof(*fq));
+	if (fq == NULL) {
+		return NULL;
+	}
+	fq->fq_cv = cv_create("futex");
+	if (fq->fq_cv == NULL) {
+		kfree(fq);
+		return NULL;
+	}
+	fq->fq_as = as;
+	fq->fq_uaddr = uaddr;
+	fq->fq_sleepers = 0;
+	fq->fq_users = 0;
+
+	result = futexqarray_add(&fb->fb_queues, fq, NULL);
+	if (result) {
+		cv_destroy(fq->fq_cv);
+		kfree(fq);
+		return NULL;
+	}
+	return fq;
+}
+
+/*
+ * Remove an unused wait queue from its bucket and free it. The
+ * bucket lock must be held.
+ */
+static
+void
+futexq_destroy(struct futexbucket *fb, struct futexq *fq)
+{
+	unsigned i, num;
+
+	KASSERT(lock_do_i_hold(fb->fb_lock));
+	KASSERT(fq->fq_users == 0);
+	KASSERT(fq->fq_sleepers == 0);
+
+	num = futexqarray_num(&fb->fb_queues);
+	for (i=0; i<num; i++) {
+		if (futexqarray_get(&fb->fb_queues, i) == fq) {
+			/* order doesn't matter; move the last one here */
+			futexqarray_set(&fb->fb_queues, i,
+				futexqarray_get(&fb->fb_queues, num - 1));
+			futexqarray_setsize(&fb->fb_queues, num - 1);
+			break;
+		}
+	}
+	KASSERT(i < num);
+
+	cv_destroy(fq->fq_cv);
+	kfree(fq);
+}
+
+/*
+ * FUTEX_WAIT: sleep if *uaddr == val.
+ */
+static
+int
+futex_wait(struct addrspace *as, userptr_t uaddr, int val)
+{
+	struct futexbucket *fb;
+	struct futexq *fq;
+	int curval;
+	int result;
+
+	fb = futex_hash(as, uaddr);
+	lock_acquire(fb->fb_lock);
+
+	result = copyin(uaddr, &curval, sizeof(curval));
+	if (result) {
+		lock_release(fb->fb_lock);
+		return result;
+	}
+	if (curval != val) {
+		lock_release(fb->fb_lock);
+		return EAGAIN;
+	}
+
+	fq = futexq_find(fb, as, uaddr, true);
+	if (fq == NULL) {
+		lock_release(fb->fb_lock);
+		return ENOMEM;
+	}
+
+	fq->fq_sleepers++;
+	fq->fq_users++;
+	cv_wait(fq->fq_cv, fb->fb_lock);
+	fq->fq_users--;
+
+	if (fq->fq_users == 0) {
+		futexq_destroy(fb, fq);
+	}
+	lock_release(fb->fb_lock);
+	return 0;
+}
+
+/*
+ * FUTEX_WAKE: wake up to COUNT threads sleeping on uaddr. Returns
+ * the number actually woken.
+ */
+static
+int
+futex_wake(struct addrspace *as, userptr_t uaddr, int count)
+{
+	struct futexbucket *fb;
+	struct futexq *fq;
+	int woken;
+
+	fb = futex_hash(as, uaddr);
+	lock_acquire(fb->fb_lock);
+
+	woken = 0;
+	fq = futexq_find(fb, as, uaddr, false);
+	if (fq != NULL) {
+		while (woken < count && fq->fq_sleepers > 0) {
+			cv_signal(fq->fq_cv, fb->fb_lock);
+			fq->fq_sleepers--;
+			woken++;
+		}
+	}
+
+	lock_release(fb->fb_lock);
+	return woken;
+}
+
+/*
+ * The system call.
+ */
+int
+sys_futex(userptr_t uaddr, int op, int val, int *retval)
+{
+	struct addrspace *as;
+
+	as = proc_getas();
+	if (as == NULL) {
+		return EINVAL;
+	}
+	if ((uintptr_t)uaddr % sizeof(int) != 0) {
+		return EINVAL;
+	}
+
+	switch (op) {
+	    case FUTEX_WAIT:
+		*retval = 0;
+		return futex_wait(as, uaddr, val);
+	    case FUTEX_WAKE:
+		if (val < 0) {
+			return EINVAL;
+		}
+		*retval = futex_wake(as, uaddr, val);
+		return 0;
+	}
+	return EINVAL;
+}
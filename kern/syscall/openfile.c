@@ -37,7 +37,25 @@
 #include <lib.h>
 #include <synch.h>
 #include <vfs.h>
+#include <vnode.h>
 #include <openfile.h>
+#include <kmem_cache.h>
+
+/* Cache for openfile structures. */
+static struct kmem_cache *openfile_cache;
+
+/*
+ * Set up the openfile cache.
+ */
+void
+openfile_bootstrap(void)
+{
+	openfile_cache = kmem_cache_create("openfile",
+					   sizeof(struct openfile), 0, NULL);
+	if (openfile_cache == NULL) {
+		panic("openfile_bootstrap: Out of memory\n");
+	}
+}
 
 /*
  * Constructor for struct openfile.
@@ -53,23 +71,27 @@ openfile_create(struct vnode *vn, int accmode)
 		accmode == O_WRONLY ||
 		accmode == O_RDWR);
 
-	file = kmalloc(sizeof(struct openfile));
+	file = kmem_cache_alloc(openfile_cache);
 	if (file == NULL) {
 		return NULL;
 	}
 
 	file->of_offsetlock = lock_create("openfile");
 	if (file->of_offsetlock == NULL) {
-		kfree(file);
+		kmem_cache_free(openfile_cache, file);
 		return NULL;
 	}
 
 	spinlock_init(&file->of_reflock);
+	spinlock_init(&file->of_ralock);
 
 	file->of_vnode = vn;
 	file->of_accmode = accmode;
 	file->of_offset = 0;
 	file->of_refcount = 1;
+	file->of_ranext = 0;
+	file->of_raend = 0;
+	file->of_rawindow = 0;
 
 	return file;
 }
@@ -85,9 +107,10 @@ openfile_destroy(struct openfile *file)
 	/* balance vfs_open with vfs_close (not VOP_DECREF) */
 	vfs_close(file->of_vnode);
 
+	spinlock_cleanup(&file->of_ralock);
 	spinlock_cleanup(&file->of_reflock);
 	lock_destroy(file->of_offsetlock);
-	kfree(file);
+	kmem_cache_free(openfile_cache, file);
 }
 
 /*
@@ -116,6 +139,66 @@ openfile_open(char *filename, int openflags, mode_t mode,
 	return 0;
 }
 
+/*
+ * Wrap a vnode that was opened some other way than vfs_open, such as
+ * one end of a pipe. On success the openfile takes over the caller's
+ * reference to VN.
+ */
+int
+openfile_fromvnode(struct vnode *vn, int accmode, struct openfile **ret)
+{
+	struct openfile *file;
+
+	file = openfile_create(vn, accmode);
+	if (file == NULL) {
+		return ENOMEM;
+	}
+
+	*ret = file;
+	return 0;
+}
+
+/*
+ * Called after reading LEN bytes at POS. If the read carried on from
+ * the last one, grow the window and, once less than half a window is
+ * left read ahead of the new position, ask the file to read ahead up
+ * to a full window past it. The request goes to VOP_READAHEAD outside
+ * the spinlock, since the filesystem may sleep.
+ */
+void
+openfile_readahead(struct openfile *file, off_t pos, size_t len)
+{
+	off_t start, end;
+
+	spinlock_acquire(&file->of_ralock);
+	if (pos != file->of_ranext) {
+		/* Not sequential (or not yet); start over. */
+		file->of_rawindow = 0;
+		file->of_raend = 0;
+	}
+	else if (file->of_rawindow == 0) {
+		file->of_rawindow = OPENFILE_RAMIN;
+	}
+	else if (file->of_rawindow < OPENFILE_RAMAX) {
+		file->of_rawindow *= 2;
+	}
+	file->of_ranext = pos + len;
+
+	start = end = 0;
+	if (file->of_rawindow > 0 &&
+	    file->of_raend - file->of_ranext < file->of_rawindow / 2) {
+		start = file->of_raend > file->of_ranext ?
+			file->of_raend : file->of_ranext;
+		end = file->of_ranext + file->of_rawindow;
+		file->of_raend = end;
+	}
+	spinlock_release(&file->of_ralock);
+
+	if (start < end) {
+		VOP_READAHEAD(file->of_vnode, start, end - start);
+	}
+}
+
 /*
  * Increment the reference count on an openfile.
  */
@@ -0,0 +1,363 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009, 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * poll() and select() system calls.
+ *
+ * Both come down to poll_files, which asks each file whether it's
+ * ready with VOP_POLL. The first pass also registers a pollwait with
+ * each file, so if nothing is ready we can sleep until any of them
+ * might be, then ask again. We keep a reference to every file until
+ * we're done, so none of them can go away while we're registered.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/poll.h>
+#include <kern/time.h>
+#include <limits.h>
+#include <lib.h>
+#include <clock.h>
+#include <timeout.h>
+#include <proc.h>
+#include <current.h>
+#include <copyinout.h>
+#include <vnode.h>
+#include <openfile.h>
+#include <filetable.h>
+#include <poll.h>
+#include <syscall.h>
+
+/* Most pollfds poll() takes at once. */
+#define POLL_MAXFDS	OPEN_MAX
+
+/* Wait forever, for poll_files. */
+#define POLL_FOREVER	(-1)
+
+/*
+ * Convert milliseconds to ticks, rounding up so we never wait less
+ * than asked.
+ */
+static
+int
+poll_mstoticks(int ms)
+{
+	const int mspertick = 1000 / HZ;
+
+	return ms / mspertick + (ms % mspertick != 0);
+}
+
+/*
+ * Check the NFDS files in FDS, setting each revents and *NREADY to
+ * the number with anything to report, and wait up to TICKS ticks
+ * (0 for not at all, or POLL_FOREVER) for at least one.
+ *
+ * File handles that aren't open get POLLNVAL; negative ones are
+ * skipped.
+ */
+static
+int
+poll_files(struct pollfd *fds, unsigned nfds, int ticks, int *nready)
+{
+	struct openfile **files;
+	struct pollwait pw;
+	uint64_t deadline, now;
+	bool registering;
+	unsigned i, n;
+	int revents, result;
+
+	files = kmalloc((nfds > 0 ? nfds : 1) * sizeof(*files));
+	if (files == NULL) {
+		return ENOMEM;
+	}
+	result = pollwait_init(&pw);
+	if (result) {
+		kfree(files);
+		return result;
+	}
+
+	for (i=0; i<nfds; i++) {
+		files[i] = NULL;
+		fds[i].revents = 0;
+		if (fds[i].fd < 0) {
+			continue;
+		}
+		result = filetable_get(curproc->p_filetable, fds[i].fd,
+				       &files[i]);
+		if (result) {
+			files[i] = NULL;
+			fds[i].revents = POLLNVAL;
+			result = 0;
+		}
+	}
+
+	deadline = (ticks > 0) ? timeout_now() + ticks : 0;
+	registering = (ticks != 0);
+	while (1) {
+		n = 0;
+		for (i=0; i<nfds; i++) {
+			if (files[i] == NULL) {
+				if (fds[i].revents != 0) {
+					n++;
+				}
+				continue;
+			}
+			result = VOP_POLL(files[i]->of_vnode, fds[i].events,
+					  registering ? &pw : NULL, &revents);
+			if (result) {
+				goto out;
+			}
+			fds[i].revents = revents &
+				(fds[i].events | POLLERR | POLLHUP);
+			if (fds[i].revents != 0) {
+				n++;
+			}
+		}
+		registering = false;
+
+		if (n > 0 || ticks == 0) {
+			break;
+		}
+
+		if (ticks == POLL_FOREVER) {
+			result = pollwait_sleep(&pw, 0);
+		}
+		else {
+			now = timeout_now();
+			if (now >= deadline) {
+				break;
+			}
+			if (deadline - now > TIMEOUT_MAXTICKS) {
+				result = pollwait_sleep(&pw, TIMEOUT_MAXTICKS);
+			}
+			else {
+				result = pollwait_sleep(&pw, deadline - now);
+			}
+		}
+		if (result == ETIMEDOUT) {
+			/* Look once more, then give up. */
+			ticks = 0;
+			result = 0;
+		}
+		else if (result) {
+			goto out;
+		}
+	}
+	*nready = n;
+
+ out:
+	pollwait_cleanup(&pw);
+	for (i=0; i<nfds; i++) {
+		if (files[i] != NULL) {
+			filetable_put(curproc->p_filetable, fds[i].fd,
+				      files[i]);
+		}
+	}
+	kfree(files);
+	return result;
+}
+
+/*
+ * poll() - copy in the pollfds, use poll_files, copy back out.
+ */
+int
+sys_poll(userptr_t ufds, nfds_t nfds, int timeout, int *retval)
+{
+	struct pollfd *fds;
+	int ticks, result;
+
+	if (nfds < 0 || nfds > POLL_MAXFDS) {
+		return EINVAL;
+	}
+
+	fds = kmalloc((nfds > 0 ? nfds : 1) * sizeof(*fds));
+	if (fds == NULL) {
+		return ENOMEM;
+	}
+	result = copyin(ufds, fds, nfds * sizeof(*fds));
+	if (result) {
+		kfree(fds);
+		return result;
+	}
+
+	ticks = (timeout < 0) ? POLL_FOREVER : poll_mstoticks(timeout);
+	result = poll_files(fds, nfds, ticks, retval);
+	if (result == 0) {
+		result = copyout(fds, ufds, nfds * sizeof(*fds));
+	}
+	kfree(fds);
+	return result;
+}
+
+/*
+ * Copy in one of select's fd_sets, or clear SET if the pointer is
+ * NULL.
+ */
+static
+int
+select_getset(userptr_t uset, fd_set *set)
+{
+	if (uset == NULL) {
+		FD_ZERO(set);
+		return 0;
+	}
+	return copyin(uset, set, sizeof(*set));
+}
+
+/*
+ * select() - turn the fd_sets into pollfds, use poll_files, and turn
+ * the results back into fd_sets. End of file and errors count as
+ * readable (and errors as writable), since then reading (or writing)
+ * won't block.
+ */
+int
+sys_select(int nfds, userptr_t ureadfds, userptr_t uwritefds,
+	   userptr_t uexceptfds, userptr_t utimeout, int *retval)
+{
+	fd_set readfds, writefds, exceptfds;
+	struct timeval tv;
+	struct pollfd *fds;
+	unsigned npoll, i;
+	int fd, ticks, nready, count, result;
+
+	if (nfds < 0 || nfds > FD_SETSIZE) {
+		return EINVAL;
+	}
+
+	result = select_getset(ureadfds, &readfds);
+	if (result) {
+		return result;
+	}
+	result = select_getset(uwritefds, &writefds);
+	if (result) {
+		return result;
+	}
+	result = select_getset(uexceptfds, &exceptfds);
+	if (result) {
+		return result;
+	}
+
+	if (utimeout == NULL) {
+		ticks = POLL_FOREVER;
+	}
+	else {
+		result = copyin(utimeout, &tv, sizeof(tv));
+		if (result) {
+			return result;
+		}
+		if (tv.tv_sec < 0 || tv.tv_usec < 0 ||
+		    tv.tv_usec >= 1000000) {
+			return EINVAL;
+		}
+		if (tv.tv_sec >= TIMEOUT_MAXTICKS / HZ) {
+			ticks = TIMEOUT_MAXTICKS;
+		}
+		else {
+			ticks = tv.tv_sec * HZ +
+				poll_mstoticks((tv.tv_usec + 999) / 1000);
+		}
+	}
+
+	fds = kmalloc((nfds > 0 ? nfds : 1) * sizeof(*fds));
+	if (fds == NULL) {
+		return ENOMEM;
+	}
+	npoll = 0;
+	for (fd = 0; fd < nfds; fd++) {
+		fds[npoll].fd = fd;
+		fds[npoll].events = 0;
+		if (FD_ISSET(fd, &readfds)) {
+			fds[npoll].events |= POLLIN;
+		}
+		if (FD_ISSET(fd, &writefds)) {
+			fds[npoll].events |= POLLOUT;
+		}
+		if (FD_ISSET(fd, &exceptfds)) {
+			fds[npoll].events |= POLLPRI;
+		}
+		if (fds[npoll].events != 0) {
+			npoll++;
+		}
+	}
+
+	result = poll_files(fds, npoll, ticks, &nready);
+	if (result) {
+		goto out;
+	}
+
+	FD_ZERO(&readfds);
+	FD_ZERO(&writefds);
+	FD_ZERO(&exceptfds);
+	count = 0;
+	for (i=0; i<npoll; i++) {
+		fd = fds[i].fd;
+		if (fds[i].revents & POLLNVAL) {
+			result = EBADF;
+			goto out;
+		}
+		if ((fds[i].events & POLLIN) &&
+		    (fds[i].revents & (POLLIN | POLLHUP | POLLERR))) {
+			FD_SET(fd, &readfds);
+			count++;
+		}
+		if ((fds[i].events & POLLOUT) &&
+		    (fds[i].revents & (POLLOUT | POLLERR))) {
+			FD_SET(fd, &writefds);
+			count++;
+		}
+		if (fds[i].revents & POLLPRI) {
+			FD_SET(fd, &exceptfds);
+			count++;
+		}
+	}
+
+	if (ureadfds != NULL) {
+		result = copyout(&readfds, ureadfds, sizeof(readfds));
+		if (result) {
+			goto out;
+		}
+	}
+	if (uwritefds != NULL) {
+		result = copyout(&writefds, uwritefds, sizeof(writefds));
+		if (result) {
+			goto out;
+		}
+	}
+	if (uexceptfds != NULL) {
+		result = copyout(&exceptfds, uexceptfds, sizeof(exceptfds));
+		if (result) {
+			goto out;
+		}
+	}
+	*retval = count;
+
+ out:
+	kfree(fds);
+	return result;
+}
@@ -34,14 +34,18 @@
 #include <types.h>
 #include <kern/errno.h>
 #include <kern/wait.h>
+#include <kern/time.h>
+#include <kern/resource.h>
 #include <lib.h>
 #include <machine/trapframe.h>
 #include <clock.h>
 #include <thread.h>
 #include <proc.h>
 #include <current.h>
+#include <synch.h>
 #include <copyinout.h>
 #include <pid.h>
+#include <usage.h>
 #include <syscall.h>
 
 /* note that sys_execv is in runprogram.c */
@@ -137,6 +141,59 @@ sys_fork(struct trapframe *tf, pid_t *retval)
 	return 0;
 }
 
+/*
+ * sys_vfork
+ *
+ * Like fork, but the new process borrows our address space instead
+ * of copying it, and we sleep until it has exec'd or exited and
+ * doesn't need it any more. This is much cheaper than fork when the
+ * child is just going to exec something.
+ */
+int
+sys_vfork(struct trapframe *tf, pid_t *retval)
+{
+	struct trapframe *ntf;
+	struct semaphore *donesem;
+	int result;
+	struct proc *newproc;
+
+	/* The child frees this, as for fork. */
+	ntf = kmalloc(sizeof(struct trapframe));
+	if (ntf==NULL) {
+		return ENOMEM;
+	}
+	*ntf = *tf;
+
+	donesem = sem_create("vfork", 0);
+	if (donesem == NULL) {
+		kfree(ntf);
+		return ENOMEM;
+	}
+
+	result = proc_vfork(donesem, &newproc);
+	if (result) {
+		sem_destroy(donesem);
+		kfree(ntf);
+		return result;
+	}
+	*retval = newproc->p_pid;
+
+	result = thread_fork(curthread->t_name, newproc,
+			     fork_newthread, ntf, 0);
+	if (result) {
+		proc_unfork(newproc);
+		sem_destroy(donesem);
+		kfree(ntf);
+		return result;
+	}
+
+	/* Wait until the child gives the address space back. */
+	P(donesem);
+	sem_destroy(donesem);
+
+	return 0;
+}
+
 /*
  * sys_waitpid
  * just pass off the work to the pid code.
@@ -144,16 +201,65 @@ sys_fork(struct trapframe *tf, pid_t *retval)
 int
 sys_waitpid(pid_t pid, userptr_t retstatus, int flags, pid_t *retval)
 {
+	return sys_wait4(pid, retstatus, flags, NULL, retval);
+}
+
+/*
+ * sys_wait4
+ * waitpid that also returns the child's resource usage.
+ */
+int
+sys_wait4(pid_t pid, userptr_t retstatus, int flags, userptr_t retusage,
+	  pid_t *retval)
+{
+	struct usage usage;
+	struct rusage ru;
 	int status;
 	int result;
 
-	result = pid_wait(pid, &status, flags, retval);
+	result = pid_wait(pid, &status, flags, retval, &usage);
 	if (result) {
 		return result;
 	}
+	if (*retval == 0) {
+		/* WNOHANG and it hasn't exited */
+		return 0;
+	}
 
 	if (retstatus != NULL) {
 		result = copyout(&status, retstatus, sizeof(int));
+		if (result) {
+			return result;
+		}
+	}
+	if (retusage != NULL) {
+		usage_torusage(&usage, &ru);
+		result = copyout(&ru, retusage, sizeof(ru));
 	}
 	return result;
 }
+
+/*
+ * sys_getrusage
+ * resources used by this process or by its waited-for children.
+ */
+int
+sys_getrusage(int who, userptr_t retusage)
+{
+	struct usage usage;
+	struct rusage ru;
+
+	switch (who) {
+	    case RUSAGE_SELF:
+		proc_getusage(curproc, false, &usage);
+		break;
+	    case RUSAGE_CHILDREN:
+		proc_getusage(curproc, true, &usage);
+		break;
+	    default:
+		return EINVAL;
+	}
+
+	usage_torusage(&usage, &ru);
+	return copyout(&ru, retusage, sizeof(ru));
+}
@@ -47,6 +47,7 @@
 #include <vfs.h>
 #include <openfile.h>
 #include <filetable.h>
+#include <aio.h>
 #include <syscall.h>
 #include <test.h>
 
@@ -386,12 +387,26 @@ loadexec(char *path, vaddr_t *entrypoint, vaddr_t *stackptr)
         }
 
 	/*
-	 * Wipe out old address space.
+	 * Asynchronous I/O still outstanding belongs to the old image,
+	 * and would deliver its reads into the new one. Wait for it and
+	 * throw it away.
+	 */
+	if (curproc->p_aio != NULL) {
+		aio_destroy(curproc->p_aio);
+		curproc->p_aio = NULL;
+	}
+
+	/*
+	 * Wipe out old address space, or if it's borrowed from a vfork
+	 * parent, give it back.
 	 *
 	 * Note: once this is done, execv() must not fail, because there's
 	 * nothing left for it to return an error to.
 	 */
-	if (oldvm) {
+	if (curproc->p_vforksem != NULL) {
+		proc_vforkdone(curproc);
+	}
+	else if (oldvm) {
 		as_destroy(oldvm);
 	}
 
@@ -431,7 +446,11 @@ placed_open(const char *path, int openflags, int fd)
 	}
 
 	/* place the file in the filetable in the right slot */
-	filetable_placeat(curproc->p_filetable, newfile, fd, &oldfile);
+	result = filetable_placeat(curproc->p_filetable, newfile, fd, &oldfile);
+	if (result) {
+		openfile_decref(newfile);
+		return result;
+	}
 
 	/* the table should previously have been empty */
 	KASSERT(oldfile == NULL);
@@ -0,0 +1,125 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009, 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * __sysctl() system call.
+ *
+ * A small subset of the BSD interface: a name is an array of ints,
+ * and reading a node copies its value to OLDP and its size to
+ * *OLDLENP. If OLDP is NULL only the size is returned, so callers can
+ * size their buffer first. Nothing can be set yet.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/sysctl.h>
+#include <lib.h>
+#include <copyinout.h>
+#include <kmallocprof.h>
+#include <syscall.h>
+
+/*
+ * CTL_VM subtree.
+ */
+static
+int
+sysctl_vm(const int *name, unsigned namelen,
+	  userptr_t oldp, size_t *oldlen)
+{
+	if (namelen != 1) {
+		return ENOTDIR;
+	}
+	switch (name[0]) {
+#if OPT_KMALLOCPROF
+	    case VM_KMALLOCSITES:
+		return kmprof_sysctl(oldp, oldlen);
+#endif
+	    default:
+		(void)oldp;
+		(void)oldlen;
+		break;
+	}
+	return ENOENT;
+}
+
+int
+sys___sysctl(const_userptr_t uname, unsigned namelen,
+	     userptr_t oldp, userptr_t oldlenp,
+	     const_userptr_t newp, size_t newlen)
+{
+	int name[CTL_MAXNAME];
+	size_t oldlen;
+	int result;
+
+	if (namelen < 2 || namelen > CTL_MAXNAME) {
+		return EINVAL;
+	}
+	if (newp != NULL || newlen != 0) {
+		return EPERM;
+	}
+
+	result = copyin(uname, name, namelen * sizeof(name[0]));
+	if (result) {
+		return result;
+	}
+
+	oldlen = 0;
+	if (oldlenp != NULL) {
+		result = copyin(oldlenp, &oldlen, sizeof(oldlen));
+		if (result) {
+			return result;
+		}
+	}
+	else if (oldp != NULL) {
+		return EINVAL;
+	}
+
+	switch (name[0]) {
+	    case CTL_VM:
+		result = sysctl_vm(name + 1, namelen - 1, oldp, &oldlen);
+		break;
+	    default:
+		result = ENOENT;
+		break;
+	}
+	if (result != 0 && result != ENOMEM) {
+		return result;
+	}
+
+	/* On ENOMEM, the truncated length still goes back. */
+	if (oldlenp != NULL) {
+		int result2;
+
+		result2 = copyout(&oldlen, oldlenp, sizeof(oldlen));
+		if (result2) {
+			return result2;
+		}
+	}
+	return result;
+}
@@ -0,0 +1,247 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009, 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Buffer cache writeback test: a writer dirtying more blocks than the
+ * dirty limit allows is throttled, so no more than the limit are
+ * ever dirty at once, and everything written gets to the disk intact
+ * once the cache is flushed.
+ *
+ * The "disk" is a fake filesystem kept in memory, a separately
+ * allocated block at a time, so the test doesn't touch any real volume.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <uio.h>
+#include <fs.h>
+#include <buf.h>
+#include <test.h>
+
+#define BT_CACHE	64	/* cache size for the test */
+#define BT_DIRTYMAX	25	/* dirty limit for the test, percent */
+#define BT_NBLOCKS	48	/* blocks written; several times the limit */
+
+static char *bt_disk[BT_NBLOCKS];
+static bool bt_written[BT_NBLOCKS];
+static unsigned bt_nwritten;
+static struct spinlock bt_spinlock = SPINLOCK_INITIALIZER;
+
+static
+unsigned char
+bt_byte(unsigned block, unsigned pos)
+{
+	return (block * 13 + pos * 7 + (pos >> 8)) & 0xff;
+}
+
+/*
+ * The fake filesystem's block I/O: copy to or from bt_disk, and
+ * count the blocks written.
+ */
+static
+int
+bt_blockio(struct fs *fs, struct uio *uio)
+{
+	unsigned block, n, i;
+	int result;
+
+	(void)fs;
+
+	KASSERT(uio->uio_offset % BUF_SIZE == 0);
+	KASSERT(uio->uio_resid % BUF_SIZE == 0);
+	block = uio->uio_offset / BUF_SIZE;
+	n = uio->uio_resid / BUF_SIZE;
+	if (block + n > BT_NBLOCKS) {
+		return EINVAL;
+	}
+
+	if (uio->uio_rw == UIO_WRITE) {
+		spinlock_acquire(&bt_spinlock);
+		for (i=block; i<block+n; i++) {
+			if (!bt_written[i]) {
+				bt_written[i] = true;
+				bt_nwritten++;
+			}
+		}
+		spinlock_release(&bt_spinlock);
+	}
+	for (i=block; i<block+n; i++) {
+		result = uiomove(bt_disk[i], BUF_SIZE, uio);
+		if (result) {
+			return result;
+		}
+	}
+	return 0;
+}
+
+static const struct fs_ops bt_fsops = {
+	.fsop_sync = NULL,
+	.fsop_getvolname = NULL,
+	.fsop_getroot = NULL,
+	.fsop_unmount = NULL,
+	.fsop_blockio = bt_blockio,
+	.fsop_writeback = NULL,
+};
+
+static struct fs bt_fs = {
+	.fs_data = NULL,
+	.fs_ops = &bt_fsops,
+};
+
+/*
+ * Dirty every block, throttling first like a filesystem would, and
+ * check the dirty ones never exceed LIMIT.
+ */
+static
+void
+bt_write(unsigned limit)
+{
+	struct buf *b;
+	unsigned char *data;
+	unsigned block, pos, nwritten;
+	int result;
+
+	for (block=0; block<BT_NBLOCKS; block++) {
+		buf_throttle();
+		result = buf_get(&bt_fs, block, &b);
+		if (result) {
+			panic("buftest: buf_get: %s\n", strerror(result));
+		}
+		data = buf_map(b);
+		for (pos=0; pos<BUF_SIZE; pos++) {
+			data[pos] = bt_byte(block, pos);
+		}
+		buf_markdirty(b);
+		buf_release(b);
+
+		spinlock_acquire(&bt_spinlock);
+		nwritten = bt_nwritten;
+		spinlock_release(&bt_spinlock);
+		if (block + 1 - nwritten > limit) {
+			panic("buftest: %u blocks dirty, limit is %u\n",
+			      block + 1 - nwritten, limit);
+		}
+	}
+}
+
+/*
+ * Check every block on the disk, then read each back through the
+ * cache (which has forgotten them) and check it again.
+ */
+static
+void
+bt_verify(void)
+{
+	struct buf *b;
+	unsigned char *data;
+	unsigned block, pos;
+	int result;
+
+	for (block=0; block<BT_NBLOCKS; block++) {
+		KASSERT(bt_written[block]);
+		for (pos=0; pos<BUF_SIZE; pos++) {
+			if ((unsigned char)bt_disk[block][pos] !=
+			    bt_byte(block, pos)) {
+				panic("buftest: block %u byte %u wrong on "
+				      "disk\n", block, pos);
+			}
+		}
+	}
+
+	for (block=0; block<BT_NBLOCKS; block++) {
+		result = buf_read(&bt_fs, block, &b);
+		if (result) {
+			panic("buftest: buf_read: %s\n", strerror(result));
+		}
+		data = buf_map(b);
+		for (pos=0; pos<BUF_SIZE; pos++) {
+			if (data[pos] != bt_byte(block, pos)) {
+				panic("buftest: block %u byte %u wrong "
+				      "reading back\n", block, pos);
+			}
+		}
+		buf_release(b);
+	}
+}
+
+int
+buftest(int nargs, char **args)
+{
+	unsigned max, dirtyage, dirtymax, limit, i;
+	int result;
+
+	(void)nargs;
+	(void)args;
+
+	for (i=0; i<BT_NBLOCKS; i++) {
+		bt_disk[i] = kmalloc(BUF_SIZE);
+		if (bt_disk[i] == NULL) {
+			panic("buftest: Out of memory\n");
+		}
+		bzero(bt_disk[i], BUF_SIZE);
+		bt_written[i] = false;
+	}
+	bt_nwritten = 0;
+
+	buf_gettunables(&max, &dirtyage, &dirtymax);
+	buf_setmax(BT_CACHE);
+	buf_setdirtymax(BT_DIRTYMAX);
+	limit = BT_CACHE * BT_DIRTYMAX / 100;
+
+	kprintf("Starting buffer cache writeback test...\n");
+
+	bt_write(limit);
+	kprintf("  %u blocks written, %u reached the disk before any "
+		"sync.\n", BT_NBLOCKS, bt_nwritten);
+	/* More than the limit were written, so some must have. */
+	KASSERT(bt_nwritten > 0);
+
+	result = buf_flush(&bt_fs);
+	if (result) {
+		panic("buftest: buf_flush: %s\n", strerror(result));
+	}
+	KASSERT(bt_nwritten == BT_NBLOCKS);
+	buf_dropall(&bt_fs);
+	bt_verify();
+	kprintf("  Data survived the sync.\n");
+
+	/* Reading back left them cached, but clean. */
+	buf_dropall(&bt_fs);
+	buf_setdirtymax(dirtymax);
+	buf_setmax(max);
+	for (i=0; i<BT_NBLOCKS; i++) {
+		kfree(bt_disk[i]);
+		bt_disk[i] = NULL;
+	}
+
+	kprintf("Buffer cache writeback test done.\n");
+	return 0;
+}
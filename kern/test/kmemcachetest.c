@@ -0,0 +1,203 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009, 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Object cache test: objects are distinct, aligned, and constructed;
+ * constructed state survives free and reallocation; and concurrent
+ * allocation from several threads works.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <thread.h>
+#include <synch.h>
+#include <kmem_cache.h>
+#include <test.h>
+
+#define KMC_NOBJS	200	/* several slabs' worth */
+#define KMC_NTHREADS	6
+#define KMC_ROUNDS	50
+#define KMC_MAGIC	0x5eed5eed
+
+/* An awkward size, to check the objects don't overlap. */
+struct kmcobj {
+	uint32_t ko_magic;	/* set by the constructor */
+	uint64_t ko_data;
+	char ko_pad[37];
+};
+
+static struct kmem_cache *kmc_cache;
+static volatile unsigned kmc_ctors;
+static struct semaphore *kmc_donesem;
+
+static
+void
+kmc_ctor(void *obj)
+{
+	struct kmcobj *ko = obj;
+
+	ko->ko_magic = KMC_MAGIC;
+	kmc_ctors++;
+}
+
+static
+void
+kmc_single(void)
+{
+	struct kmcobj **objs;
+	unsigned i, ctors;
+
+	objs = kmalloc(KMC_NOBJS * sizeof(*objs));
+	if (objs == NULL) {
+		panic("kmemcachetest: Out of memory\n");
+	}
+
+	for (i=0; i<KMC_NOBJS; i++) {
+		objs[i] = kmem_cache_alloc(kmc_cache);
+		if (objs[i] == NULL) {
+			panic("kmemcachetest: kmem_cache_alloc failed\n");
+		}
+		KASSERT((vaddr_t)objs[i] % 8 == 0);
+		KASSERT(objs[i]->ko_magic == KMC_MAGIC);
+		objs[i]->ko_data = i;
+		memset(objs[i]->ko_pad, i & 0xff, sizeof(objs[i]->ko_pad));
+	}
+
+	/* Check the objects don't overlap. */
+	for (i=0; i<KMC_NOBJS; i++) {
+		KASSERT(objs[i]->ko_data == i);
+		KASSERT(objs[i]->ko_pad[sizeof(objs[i]->ko_pad) - 1] ==
+			(char)(i & 0xff));
+	}
+
+	/* Free every other one and get them back. */
+	for (i=0; i<KMC_NOBJS; i+=2) {
+		kmem_cache_free(kmc_cache, objs[i]);
+	}
+	ctors = kmc_ctors;
+	for (i=0; i<KMC_NOBJS; i+=2) {
+		objs[i] = kmem_cache_alloc(kmc_cache);
+		if (objs[i] == NULL) {
+			panic("kmemcachetest: kmem_cache_alloc failed\n");
+		}
+		/* Still constructed from before. */
+		KASSERT(objs[i]->ko_magic == KMC_MAGIC);
+	}
+	KASSERT(kmc_ctors == ctors);
+
+	for (i=0; i<KMC_NOBJS; i++) {
+		kmem_cache_free(kmc_cache, objs[i]);
+	}
+	kfree(objs);
+}
+
+static
+void
+kmc_thread(void *junk, unsigned long num)
+{
+	struct kmcobj *objs[KMC_NOBJS / KMC_NTHREADS];
+	unsigned i, round;
+
+	(void)junk;
+
+	for (round=0; round<KMC_ROUNDS; round++) {
+		for (i=0; i<KMC_NOBJS / KMC_NTHREADS; i++) {
+			objs[i] = kmem_cache_alloc(kmc_cache);
+			if (objs[i] == NULL) {
+				panic("kmemcachetest: kmem_cache_alloc "
+				      "failed\n");
+			}
+			KASSERT(objs[i]->ko_magic == KMC_MAGIC);
+			objs[i]->ko_data = num;
+		}
+		thread_yield();
+		for (i=0; i<KMC_NOBJS / KMC_NTHREADS; i++) {
+			if (objs[i]->ko_data != num) {
+				panic("kmemcachetest: thread %lu's object "
+				      "overwritten\n", num);
+			}
+			kmem_cache_free(kmc_cache, objs[i]);
+		}
+	}
+	V(kmc_donesem);
+}
+
+static
+void
+kmc_concurrent(void)
+{
+	unsigned i;
+	int result;
+
+	for (i=0; i<KMC_NTHREADS; i++) {
+		result = thread_fork("kmemcachetest", NULL, kmc_thread,
+				     NULL, i);
+		if (result) {
+			panic("kmemcachetest: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+	for (i=0; i<KMC_NTHREADS; i++) {
+		P(kmc_donesem);
+	}
+}
+
+int
+kmemcachetest(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	if (kmc_donesem == NULL) {
+		kmc_donesem = sem_create("kmc_donesem", 0);
+		if (kmc_donesem == NULL) {
+			panic("kmemcachetest: sem_create failed\n");
+		}
+	}
+	kmc_cache = kmem_cache_create("kmctest", sizeof(struct kmcobj), 0,
+				      kmc_ctor);
+	if (kmc_cache == NULL) {
+		panic("kmemcachetest: kmem_cache_create failed\n");
+	}
+	kmc_ctors = 0;
+
+	kprintf("Starting object cache test...\n");
+	kmc_single();
+	kprintf("  Single-thread allocation works.\n");
+	kmc_concurrent();
+	kprintf("  Concurrent allocation works.\n");
+	kmem_cache_printstats();
+
+	kmem_cache_destroy(kmc_cache);
+	kmc_cache = NULL;
+
+	kprintf("Object cache test done.\n");
+	return 0;
+}
@@ -0,0 +1,261 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009, 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Pipe test: data written by one thread comes out the other end in
+ * order, for write sizes smaller and larger than the ring; the reader
+ * sees EOF after the write end closes; and writing after the read end
+ * closes fails with EPIPE.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <uio.h>
+#include <thread.h>
+#include <synch.h>
+#include <vm.h>
+#include <vnode.h>
+#include <pipe.h>
+#include <test.h>
+
+#define PT_TOTAL	(64 * 1024)
+#define PT_NPAGES	5		/* buffer pages; bigger than the ring */
+#define PT_BUFSIZE	(PT_NPAGES * PAGE_SIZE)
+
+static const size_t pt_chunks[] = { 1, 100, 4096, 5000, PT_BUFSIZE };
+#define PT_NCHUNKS	(sizeof(pt_chunks) / sizeof(pt_chunks[0]))
+
+static struct semaphore *pt_donesem;
+
+static
+unsigned char
+pt_byte(unsigned pos)
+{
+	return (pos * 7 + (pos >> 8)) & 0xff;
+}
+
+/*
+ * The test's buffers are sets of single pages, since kmalloc can't
+ * give us more than one page at a time.
+ */
+static
+void
+pt_bufcreate(unsigned char **pages)
+{
+	unsigned i;
+
+	for (i=0; i<PT_NPAGES; i++) {
+		pages[i] = kmalloc(PAGE_SIZE);
+		if (pages[i] == NULL) {
+			panic("pipetest: Out of memory\n");
+		}
+	}
+}
+
+static
+void
+pt_bufdestroy(unsigned char **pages)
+{
+	unsigned i;
+
+	for (i=0; i<PT_NPAGES; i++) {
+		kfree(pages[i]);
+	}
+}
+
+/*
+ * Set up a uio for the first LEN bytes of the buffer PAGES.
+ */
+static
+void
+pt_uioinit(unsigned char **pages, struct iovec *iov, struct uio *ku,
+	   size_t len, enum uio_rw rw)
+{
+	size_t left;
+	unsigned i;
+
+	KASSERT(len <= PT_BUFSIZE);
+
+	left = len;
+	for (i=0; left > 0; i++) {
+		iov[i].iov_kbase = pages[i];
+		iov[i].iov_len = left < PAGE_SIZE ? left : PAGE_SIZE;
+		left -= iov[i].iov_len;
+	}
+	ku->uio_iov = iov;
+	ku->uio_iovcnt = i;
+	ku->uio_offset = 0;
+	ku->uio_resid = len;
+	ku->uio_segflg = UIO_SYSSPACE;
+	ku->uio_rw = rw;
+	ku->uio_space = NULL;
+}
+
+/*
+ * Write PT_TOTAL bytes in chunks of size NUM, then close the write
+ * end.
+ */
+static
+void
+pt_writer(void *vn, unsigned long num)
+{
+	struct vnode *writevn = vn;
+	unsigned char *pages[PT_NPAGES];
+	struct iovec iov[PT_NPAGES];
+	struct uio ku;
+	unsigned pos, i;
+	size_t len;
+	int result;
+
+	pt_bufcreate(pages);
+
+	for (pos = 0; pos < PT_TOTAL; pos += len) {
+		len = num;
+		if (len > PT_TOTAL - pos) {
+			len = PT_TOTAL - pos;
+		}
+		for (i=0; i<len; i++) {
+			pages[i / PAGE_SIZE][i % PAGE_SIZE] = pt_byte(pos + i);
+		}
+		pt_uioinit(pages, iov, &ku, len, UIO_WRITE);
+		result = VOP_WRITE(writevn, &ku);
+		if (result) {
+			panic("pipetest: write: %s\n", strerror(result));
+		}
+		KASSERT(ku.uio_resid == 0);
+	}
+
+	pt_bufdestroy(pages);
+	VOP_DECREF(writevn);
+	V(pt_donesem);
+}
+
+static
+void
+pt_stream(size_t chunk)
+{
+	struct vnode *readvn, *writevn;
+	unsigned char *pages[PT_NPAGES];
+	struct iovec iov[PT_NPAGES];
+	struct uio ku;
+	unsigned pos, i;
+	size_t got;
+	int result;
+
+	result = pipe_create(&readvn, &writevn);
+	if (result) {
+		panic("pipetest: pipe_create: %s\n", strerror(result));
+	}
+	pt_bufcreate(pages);
+
+	result = thread_fork("pipetest", NULL, pt_writer, writevn, chunk);
+	if (result) {
+		panic("pipetest: thread_fork: %s\n", strerror(result));
+	}
+
+	pos = 0;
+	while (1) {
+		pt_uioinit(pages, iov, &ku, PT_BUFSIZE, UIO_READ);
+		result = VOP_READ(readvn, &ku);
+		if (result) {
+			panic("pipetest: read: %s\n", strerror(result));
+		}
+		got = PT_BUFSIZE - ku.uio_resid;
+		if (got == 0) {
+			break;
+		}
+		for (i=0; i<got; i++) {
+			if (pages[i / PAGE_SIZE][i % PAGE_SIZE] !=
+			    pt_byte(pos + i)) {
+				panic("pipetest: %u-byte writes: wrong data "
+				      "at offset %u\n", (unsigned)chunk,
+				      pos + i);
+			}
+		}
+		pos += got;
+	}
+	P(pt_donesem);
+
+	/* All of it, then EOF. */
+	KASSERT(pos == PT_TOTAL);
+	kprintf("  %u-byte writes passed.\n", (unsigned)chunk);
+
+	pt_bufdestroy(pages);
+	VOP_DECREF(readvn);
+}
+
+static
+void
+pt_epipe(void)
+{
+	struct vnode *readvn, *writevn;
+	struct iovec iov;
+	struct uio ku;
+	char c = 'x';
+	int result;
+
+	result = pipe_create(&readvn, &writevn);
+	if (result) {
+		panic("pipetest: pipe_create: %s\n", strerror(result));
+	}
+	VOP_DECREF(readvn);
+
+	uio_kinit(&iov, &ku, &c, 1, 0, UIO_WRITE);
+	result = VOP_WRITE(writevn, &ku);
+	KASSERT(result == EPIPE);
+	kprintf("  Write with no reader gets EPIPE.\n");
+
+	VOP_DECREF(writevn);
+}
+
+int
+pipetest(int nargs, char **args)
+{
+	unsigned i;
+
+	(void)nargs;
+	(void)args;
+
+	if (pt_donesem == NULL) {
+		pt_donesem = sem_create("pt_donesem", 0);
+		if (pt_donesem == NULL) {
+			panic("pipetest: sem_create failed\n");
+		}
+	}
+
+	kprintf("Starting pipe test...\n");
+	for (i=0; i<PT_NCHUNKS; i++) {
+		pt_stream(pt_chunks[i]);
+	}
+	pt_epipe();
+
+	kprintf("Pipe test done.\n");
+	return 0;
+}
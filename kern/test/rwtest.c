@@ -0,0 +1,305 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009, 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Reader-writer lock tests.
+ *
+ * rwtest checks that readers and writers exclude each other properly
+ * and that nobody starves. rwbench runs a read-mostly workload over
+ * the same data under a plain lock and then under a reader-writer
+ * lock, and reports how long each took.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <clock.h>
+#include <thread.h>
+#include <synch.h>
+#include <test.h>
+
+#define NRWTHREADS    16
+#define NRWLOOPS      200
+#define NRWVALS       8
+
+/* Make one in every WRITEFREQ operations a write. */
+#define WRITEFREQ     16
+
+/* Iterations of busywork inside each critical section. */
+#define SPINWORK      200
+
+static volatile unsigned long rwvals[NRWVALS];
+static volatile unsigned rwreaders;
+static volatile unsigned rwmaxreaders;
+static volatile bool rwfailed;
+static struct rwlock *testrw;
+static struct lock *testrwlock;
+static struct spinlock rwcount_lock = SPINLOCK_INITIALIZER;
+static struct semaphore *rwdonesem;
+
+static
+void
+rwinit(void)
+{
+	unsigned i;
+
+	if (testrw == NULL) {
+		testrw = rwlock_create("testrw");
+		if (testrw == NULL) {
+			panic("rwtest: rwlock_create failed\n");
+		}
+	}
+	if (testrwlock == NULL) {
+		testrwlock = lock_create("testrwlock");
+		if (testrwlock == NULL) {
+			panic("rwtest: lock_create failed\n");
+		}
+	}
+	if (rwdonesem == NULL) {
+		rwdonesem = sem_create("rwdonesem", 0);
+		if (rwdonesem == NULL) {
+			panic("rwtest: sem_create failed\n");
+		}
+	}
+
+	for (i=0; i<NRWVALS; i++) {
+		rwvals[i] = 0;
+	}
+	rwreaders = 0;
+	rwmaxreaders = 0;
+	rwfailed = false;
+}
+
+static
+void
+spinwork(void)
+{
+	volatile unsigned j;
+
+	for (j=0; j<SPINWORK; j++);
+}
+
+/*
+ * A reader sees all the values equal; a writer bumps all of them.
+ * If a reader ever catches a writer halfway, the values differ.
+ */
+static
+void
+readvals(unsigned long num)
+{
+	unsigned i;
+	unsigned long val;
+
+	val = rwvals[0];
+	spinwork();
+	for (i=1; i<NRWVALS; i++) {
+		if (rwvals[i] != val) {
+			kprintf("thread %lu: saw torn write (%lu vs. %lu)\n",
+				num, rwvals[i], val);
+			rwfailed = true;
+		}
+	}
+}
+
+static
+void
+writevals(void)
+{
+	unsigned i;
+
+	for (i=0; i<NRWVALS; i++) {
+		rwvals[i]++;
+		spinwork();
+	}
+}
+
+static
+void
+rwtestthread(void *junk, unsigned long num)
+{
+	unsigned i;
+
+	(void)junk;
+
+	for (i=0; i<NRWLOOPS; i++) {
+		if ((i + num) % WRITEFREQ == 0) {
+			rwlock_acquire_write(testrw);
+			if (rwreaders != 0) {
+				kprintf("thread %lu: writer got in with %u "
+					"readers\n", num, rwreaders);
+				rwfailed = true;
+			}
+			writevals();
+			rwlock_release_write(testrw);
+		}
+		else {
+			rwlock_acquire_read(testrw);
+
+			spinlock_acquire(&rwcount_lock);
+			rwreaders++;
+			if (rwreaders > rwmaxreaders) {
+				rwmaxreaders = rwreaders;
+			}
+			spinlock_release(&rwcount_lock);
+
+			readvals(num);
+
+			spinlock_acquire(&rwcount_lock);
+			rwreaders--;
+			spinlock_release(&rwcount_lock);
+
+			rwlock_release_read(testrw);
+		}
+	}
+	V(rwdonesem);
+}
+
+int
+rwtest(int nargs, char **args)
+{
+	int i, result;
+
+	(void)nargs;
+	(void)args;
+
+	rwinit();
+	kprintf("Starting rwlock test...\n");
+
+	for (i=0; i<NRWTHREADS; i++) {
+		result = thread_fork("rwtest", NULL, rwtestthread, NULL, i);
+		if (result) {
+			panic("rwtest: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+	for (i=0; i<NRWTHREADS; i++) {
+		P(rwdonesem);
+	}
+
+	kprintf("Max concurrent readers: %u\n", rwmaxreaders);
+	if (rwfailed) {
+		kprintf("rwlock test FAILED\n");
+	}
+	else {
+		kprintf("rwlock test done.\n");
+	}
+	return 0;
+}
+
+////////////////////////////////////////////////////////////
+
+/*
+ * Contention benchmark. The same read-mostly workload is run twice,
+ * once serialized through a lock and once through the rwlock.
+ */
+
+static
+void
+rwbenchthread(void *junk, unsigned long num)
+{
+	bool userw = junk != NULL;
+	unsigned i;
+
+	for (i=0; i<NRWLOOPS; i++) {
+		if ((i + num) % WRITEFREQ == 0) {
+			if (userw) {
+				rwlock_acquire_write(testrw);
+				writevals();
+				rwlock_release_write(testrw);
+			}
+			else {
+				lock_acquire(testrwlock);
+				writevals();
+				lock_release(testrwlock);
+			}
+		}
+		else {
+			if (userw) {
+				rwlock_acquire_read(testrw);
+				readvals(num);
+				rwlock_release_read(testrw);
+			}
+			else {
+				lock_acquire(testrwlock);
+				readvals(num);
+				lock_release(testrwlock);
+			}
+		}
+	}
+	V(rwdonesem);
+}
+
+static
+void
+rwbench_run(const char *what, bool userw)
+{
+	struct timespec before, after, duration;
+	int i, result;
+
+	gettime(&before);
+	for (i=0; i<NRWTHREADS; i++) {
+		/* any non-null pointer selects the rwlock */
+		result = thread_fork("rwbench", NULL, rwbenchthread,
+				     userw ? (void *)testrw : NULL, i);
+		if (result) {
+			panic("rwbench: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+	for (i=0; i<NRWTHREADS; i++) {
+		P(rwdonesem);
+	}
+	gettime(&after);
+	timespec_sub(&after, &before, &duration);
+
+	kprintf("%-8s %d threads x %d ops (1/%d writes): "
+		"%llu.%09lu seconds\n", what, NRWTHREADS, NRWLOOPS, WRITEFREQ,
+		(unsigned long long) duration.tv_sec,
+		(unsigned long) duration.tv_nsec);
+}
+
+int
+rwbench(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	rwinit();
+	kprintf("Starting rwlock contention benchmark...\n");
+
+	rwbench_run("lock", false);
+	rwbench_run("rwlock", true);
+
+	if (rwfailed) {
+		kprintf("rwlock benchmark FAILED\n");
+	}
+	else {
+		kprintf("rwlock benchmark done.\n");
+	}
+	return 0;
+}
@@ -0,0 +1,183 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009, 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Spinlock throughput and fairness benchmark.
+ *
+ * Runs 1, 2, 4, ... threads up to a limit, all hammering one spinlock
+ * for a fixed time, and reports total acquisitions per millisecond
+ * and how evenly they were spread across the threads (the least
+ * successful thread's count as a percentage of the most successful).
+ * Run it on machines with different numbers of CPUs, and with and
+ * without "options ticketlock", to compare.
+ *
+ * Threads are not pinned, so with more threads than CPUs some of them
+ * share a CPU and the fairness figure includes the scheduler's.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <clock.h>
+#include <thread.h>
+#include <synch.h>
+#include <test.h>
+
+#define SPB_MAXTHREADS	32
+#define SPB_DEFTHREADS	8
+#define SPB_SECONDS	2
+
+/* Iterations of busywork inside and outside the critical section. */
+#define SPB_INSIDE	20
+#define SPB_OUTSIDE	20
+
+/* Per-thread counters, padded so they don't share cache lines. */
+struct spbcounter {
+	volatile unsigned long count;
+	char pad[64 - sizeof(unsigned long)];
+};
+
+static struct spbcounter spb_counters[SPB_MAXTHREADS];
+static struct spinlock spb_lock = SPINLOCK_INITIALIZER;
+static volatile unsigned long spb_shared;
+static volatile bool spb_stop;
+static struct semaphore *spb_donesem;
+
+static
+void
+spb_thread(void *junk, unsigned long num)
+{
+	volatile unsigned j;
+
+	(void)junk;
+
+	while (!spb_stop) {
+		spinlock_acquire(&spb_lock);
+		spb_shared++;
+		for (j=0; j<SPB_INSIDE; j++);
+		spinlock_release(&spb_lock);
+
+		spb_counters[num].count++;
+		for (j=0; j<SPB_OUTSIDE; j++);
+	}
+	V(spb_donesem);
+}
+
+static
+void
+spb_run(unsigned nthreads)
+{
+	struct timespec before, after, duration;
+	unsigned long total, min, max, msecs;
+	unsigned i;
+	int result;
+
+	for (i=0; i<nthreads; i++) {
+		spb_counters[i].count = 0;
+	}
+	spb_shared = 0;
+	spb_stop = false;
+
+	gettime(&before);
+	for (i=0; i<nthreads; i++) {
+		result = thread_fork("spinlockbench", NULL, spb_thread,
+				     NULL, i);
+		if (result) {
+			panic("spinlockbench: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+	clocksleep(SPB_SECONDS);
+	spb_stop = true;
+	for (i=0; i<nthreads; i++) {
+		P(spb_donesem);
+	}
+	gettime(&after);
+	timespec_sub(&after, &before, &duration);
+
+	total = 0;
+	min = max = spb_counters[0].count;
+	for (i=0; i<nthreads; i++) {
+		total += spb_counters[i].count;
+		if (spb_counters[i].count < min) {
+			min = spb_counters[i].count;
+		}
+		if (spb_counters[i].count > max) {
+			max = spb_counters[i].count;
+		}
+	}
+	msecs = duration.tv_sec * 1000 + duration.tv_nsec / 1000000;
+	if (msecs == 0) {
+		msecs = 1;
+	}
+
+	kprintf("%2u threads: %8lu acquires/ms, fairness %3lu%% "
+		"(min %lu, max %lu)\n", nthreads, total / msecs,
+		max == 0 ? 100 : min * 100 / max, min, max);
+	if (spb_shared != total) {
+		kprintf("spinlockbench: lost updates (%lu vs. %lu)\n",
+			spb_shared, total);
+	}
+}
+
+int
+spinlockbench(int nargs, char **args)
+{
+	unsigned maxthreads, n;
+
+	if (nargs > 2) {
+		kprintf("Usage: spb [maxthreads]\n");
+		return EINVAL;
+	}
+	maxthreads = (nargs == 2) ? (unsigned)atoi(args[1]) : SPB_DEFTHREADS;
+	if (maxthreads < 1 || maxthreads > SPB_MAXTHREADS) {
+		kprintf("spinlockbench: maxthreads must be 1-%d\n",
+			SPB_MAXTHREADS);
+		return EINVAL;
+	}
+
+	if (spb_donesem == NULL) {
+		spb_donesem = sem_create("spb_donesem", 0);
+		if (spb_donesem == NULL) {
+			panic("spinlockbench: sem_create failed\n");
+		}
+	}
+
+#if OPT_TICKETLOCK
+	kprintf("Starting spinlock benchmark (ticket locks)...\n");
+#else
+	kprintf("Starting spinlock benchmark (test-and-set locks)...\n");
+#endif
+	for (n = 1; n < maxthreads; n *= 2) {
+		spb_run(n);
+	}
+	spb_run(maxthreads);
+	kprintf("Spinlock benchmark done.\n");
+	return 0;
+}
@@ -309,6 +309,88 @@ threadlisttest_f(void)
 	KASSERT(tl.tl_count == 0);
 }
 
+/*
+ * Check that TL holds exactly fakethreads[0] through fakethreads[N-1],
+ * in order, following the links both ways.
+ */
+static
+void
+check_prefix(struct threadlist *tl, unsigned n)
+{
+	struct thread *t;
+	unsigned i;
+
+	KASSERT(tl->tl_count == n);
+
+	i=0;
+	THREADLIST_FORALL(t, *tl) {
+		KASSERT(i < n);
+		KASSERT(t == fakethreads[i]);
+		i++;
+	}
+	KASSERT(i == n);
+
+	i=0;
+	THREADLIST_FORALL_REV(t, *tl) {
+		KASSERT(i < n);
+		KASSERT(t == fakethreads[n - i - 1]);
+		i++;
+	}
+	KASSERT(i == n);
+}
+
+static
+void
+threadlisttest_g(void)
+{
+	struct threadlist tl, from;
+	struct thread *t;
+	unsigned i;
+
+	threadlist_init(&tl);
+	threadlist_init(&from);
+
+	/* both empty */
+	threadlist_splice(&tl, &from);
+	KASSERT(threadlist_isempty(&tl));
+	KASSERT(threadlist_isempty(&from));
+
+	/* empty source */
+	threadlist_addtail(&tl, fakethreads[0]);
+	threadlist_addtail(&tl, fakethreads[1]);
+	threadlist_splice(&tl, &from);
+	check_prefix(&tl, 2);
+	KASSERT(threadlist_isempty(&from));
+
+	/* empty destination */
+	threadlist_splice(&from, &tl);
+	check_prefix(&from, 2);
+	KASSERT(threadlist_isempty(&tl));
+
+	/* both non-empty */
+	for (i=2; i<NUMNAMES; i++) {
+		threadlist_addtail(&tl, fakethreads[i]);
+	}
+	threadlist_splice(&from, &tl);
+	check_prefix(&from, NUMNAMES);
+	KASSERT(threadlist_isempty(&tl));
+
+	/* and the source is still usable afterwards */
+	threadlist_addhead(&tl, fakethreads[0]);
+	KASSERT(tl.tl_count == 1);
+	t = threadlist_remtail(&tl);
+	KASSERT(t == fakethreads[0]);
+
+	for (i=0; i<NUMNAMES; i++) {
+		t = threadlist_remhead(&from);
+		KASSERT(t == fakethreads[i]);
+	}
+	KASSERT(from.tl_count == 0);
+
+	threadlist_cleanup(&from);
+	threadlist_cleanup(&tl);
+}
+
 ////////////////////////////////////////////////////////////
 // external interface
 
@@ -332,6 +414,7 @@ threadlisttest(int nargs, char **args)
 	threadlisttest_d();
 	threadlisttest_e();
 	threadlisttest_f();
+	threadlisttest_g();
 
 	for (i=0; i<NUMNAMES; i++) {
 		fakethread_destroy(fakethreads[i]);
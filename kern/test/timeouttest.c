@@ -0,0 +1,228 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009, 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Timer wheel tests: timeouts firing on time across wheel levels,
+ * cancellation, P_timed, cv_timedwait, and clocknanosleep.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <clock.h>
+#include <thread.h>
+#include <synch.h>
+#include <timeout.h>
+#include <test.h>
+
+/* Delays in level 0, on the level 1 boundary, and past it. */
+static const unsigned tmo_delays[] = { 1, 2, 10, 63, 64, 65, 127, 200 };
+#define NTMO (sizeof(tmo_delays) / sizeof(tmo_delays[0]))
+
+struct tmo {
+	struct timeout t_timeout;
+	uint64_t t_start;
+	volatile uint64_t t_fired;
+};
+
+static struct tmo tmos[NTMO];
+static struct semaphore *tmo_sem;
+static struct lock *tmo_lock;
+static struct cv *tmo_cv;
+
+static
+void
+tmo_fire(void *vtmo)
+{
+	struct tmo *t = vtmo;
+
+	t->t_fired = timeout_now();
+	V(tmo_sem);
+}
+
+static
+void
+tmo_init(void)
+{
+	if (tmo_sem == NULL) {
+		tmo_sem = sem_create("tmo_sem", 0);
+		tmo_lock = lock_create("tmo_lock");
+		tmo_cv = cv_create("tmo_cv");
+		if (tmo_sem == NULL || tmo_lock == NULL || tmo_cv == NULL) {
+			panic("timeouttest: out of memory\n");
+		}
+	}
+}
+
+static
+void
+tmo_firing(void)
+{
+	unsigned i;
+	uint64_t late;
+
+	for (i=0; i<NTMO; i++) {
+		timeout_init(&tmos[i].t_timeout, tmo_fire, &tmos[i]);
+		tmos[i].t_fired = 0;
+		tmos[i].t_start = timeout_now();
+		timeout_set(&tmos[i].t_timeout, tmo_delays[i]);
+	}
+	for (i=0; i<NTMO; i++) {
+		if (P_timed(tmo_sem, 5 * HZ) == ETIMEDOUT) {
+			panic("timeouttest: timeout %u never fired\n", i);
+		}
+	}
+	for (i=0; i<NTMO; i++) {
+		timeout_cancel(&tmos[i].t_timeout);
+		/* the tick may advance between reading it and setting */
+		late = tmos[i].t_fired - (tmos[i].t_start + tmo_delays[i]);
+		if (tmos[i].t_fired < tmos[i].t_start + tmo_delays[i] ||
+		    late > 1) {
+			panic("timeouttest: %u ticks: set at %llu, "
+			      "fired at %llu\n", tmo_delays[i],
+			      (unsigned long long)tmos[i].t_start,
+			      (unsigned long long)tmos[i].t_fired);
+		}
+	}
+}
+
+static
+void
+tmo_cancelling(void)
+{
+	struct timespec ts;
+	bool pending;
+
+	timeout_init(&tmos[0].t_timeout, tmo_fire, &tmos[0]);
+	tmos[0].t_fired = 0;
+	timeout_set(&tmos[0].t_timeout, HZ / 2);
+	pending = timeout_cancel(&tmos[0].t_timeout);
+
+	ts.tv_sec = 0;
+	ts.tv_nsec = 600000000;
+	clocknanosleep(&ts);
+
+	/* A cancelled timeout doesn't fire, and can't be cancelled again. */
+	KASSERT(pending);
+	KASSERT(tmos[0].t_fired == 0);
+	KASSERT(!timeout_cancel(&tmos[0].t_timeout));
+}
+
+static
+void
+tmo_signaller(void *junk, unsigned long ticks)
+{
+	struct timespec ts;
+
+	(void)junk;
+
+	ts.tv_sec = 0;
+	ts.tv_nsec = ticks * (1000000000 / HZ);
+	clocknanosleep(&ts);
+
+	lock_acquire(tmo_lock);
+	cv_signal(tmo_cv, tmo_lock);
+	lock_release(tmo_lock);
+}
+
+static
+void
+tmo_timedwaits(void)
+{
+	uint64_t start, end;
+	int result;
+
+	start = timeout_now();
+	result = P_timed(tmo_sem, 20);
+	end = timeout_now();
+	KASSERT(result == ETIMEDOUT);
+	KASSERT(end - start >= 20);
+
+	V(tmo_sem);
+	result = P_timed(tmo_sem, 20);
+	KASSERT(result == 0);
+
+	lock_acquire(tmo_lock);
+	start = timeout_now();
+	result = cv_timedwait(tmo_cv, tmo_lock, 20);
+	end = timeout_now();
+	KASSERT(result == ETIMEDOUT);
+	KASSERT(end - start >= 20);
+	KASSERT(lock_do_i_hold(tmo_lock));
+
+	result = thread_fork("tmo_signaller", NULL, tmo_signaller, NULL, 5);
+	if (result) {
+		panic("timeouttest: thread_fork failed: %s\n",
+		      strerror(result));
+	}
+	result = cv_timedwait(tmo_cv, tmo_lock, 5 * HZ);
+	/* Woken by the signaller, not the timeout. */
+	KASSERT(result == 0);
+	KASSERT(lock_do_i_hold(tmo_lock));
+	lock_release(tmo_lock);
+}
+
+static
+void
+tmo_nanosleep(void)
+{
+	struct timespec ts, before, after, took;
+
+	ts.tv_sec = 0;
+	ts.tv_nsec = 250000000;
+	gettime(&before);
+	clocknanosleep(&ts);
+	gettime(&after);
+	timespec_sub(&after, &before, &took);
+
+	kprintf("  clocknanosleep(250ms) took %llu.%09lu seconds\n",
+		(unsigned long long)took.tv_sec, (unsigned long)took.tv_nsec);
+	KASSERT(took.tv_sec > 0 || took.tv_nsec >= 250000000);
+}
+
+int
+timeouttest(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	tmo_init();
+	kprintf("Starting timeout test...\n");
+
+	tmo_firing();
+	kprintf("  Timeouts fire on time.\n");
+	tmo_cancelling();
+	kprintf("  Cancelling works.\n");
+	tmo_timedwaits();
+	kprintf("  Timed waits work.\n");
+	tmo_nanosleep();
+
+	kprintf("Timeout test done.\n");
+	return 0;
+}
@@ -181,7 +181,7 @@ waittest(int nargs, char **args)
 		kid = kids2[kids2_head];
 		kids2_head = (kids2_head+1) % NTHREADS;
 		kprintf("Waiting on pid %d...\n", kid);
-		err = pid_wait(kid, &status, 0, NULL);
+		err = pid_wait(kid, &status, 0, NULL, NULL);
 		printstatus(kid, err, status);
 	}
 
@@ -216,7 +216,7 @@ waittest(int nargs, char **args)
 		P(exitsems[i]);
 		kprintf("Appears that pid %d P()'d\n", kid);
 		kprintf("Waiting on pid %d...\n", kid);
-		err = pid_wait(kid, &status, 0, NULL);
+		err = pid_wait(kid, &status, 0, NULL, NULL);
 		printstatus(kid, err, status);
 	}
 
@@ -253,7 +253,7 @@ waittest(int nargs, char **args)
 		P(exitsems[i]);
 		kprintf("Appears that pid %d P()'d\n", kid);
 		kprintf("Waiting on pid %d...\n", kid);
-		err = pid_wait(kid, &status, 0, NULL);
+		err = pid_wait(kid, &status, 0, NULL, NULL);
 		printstatus(kid, err, status);
 	}
 
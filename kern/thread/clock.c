@@ -34,6 +34,7 @@
 #include <clock.h>
 #include <thread.h>
 #include <current.h>
+#include <timeout.h>
 
 /*
  * Time handling.
@@ -59,6 +60,13 @@
 static struct wchan *lbolt;
 static struct spinlock lbolt_lock;
 
+/*
+ * Threads in clocknanosleep wait here. Nobody wakes this channel;
+ * they're woken by their timeouts.
+ */
+static struct wchan *napchan;
+static struct spinlock naplock;
+
 /*
  * Setup.
  */
@@ -70,6 +78,11 @@ hardclock_bootstrap(void)
 	if (lbolt == NULL) {
 		panic("Couldn't create lbolt\n");
 	}
+	spinlock_init(&naplock);
+	napchan = wchan_create("nanosleep");
+	if (napchan == NULL) {
+		panic("Couldn't create nanosleep wchan\n");
+	}
 }
 
 /*
@@ -97,6 +110,19 @@ hardclock(void)
 	 */
 
 	curcpu->c_hardclocks++;
+
+	/* Charge the tick to whatever it interrupted. */
+	if (curthread->t_intr_fromuser) {
+		curthread->t_usage.u_uticks++;
+	}
+	else {
+		curthread->t_usage.u_sticks++;
+	}
+
+	if (curcpu->c_number == 0) {
+		/* one cpu drives the timer wheel */
+		timeout_hardclock();
+	}
 	if ((curcpu->c_hardclocks % MIGRATE_HARDCLOCKS) == 0) {
 		thread_consider_migration();
 	}
@@ -119,3 +145,38 @@ clocksleep(int num_secs)
 	}
 	spinlock_release(&lbolt_lock);
 }
+
+/*
+ * Suspend execution for (at least) the given time, with the
+ * resolution of the hardclock.
+ */
+void
+clocknanosleep(const struct timespec *duration)
+{
+	struct timespec now, deadline, left;
+	uint64_t ticks;
+
+	gettime(&now);
+	timespec_add(&now, duration, &deadline);
+
+	while (1) {
+		gettime(&now);
+		if (now.tv_sec > deadline.tv_sec ||
+		    (now.tv_sec == deadline.tv_sec &&
+		     now.tv_nsec >= deadline.tv_nsec)) {
+			break;
+		}
+		timespec_sub(&deadline, &now, &left);
+
+		/* round up, so we don't wake early */
+		ticks = (uint64_t)left.tv_sec * HZ +
+			((uint64_t)left.tv_nsec * HZ + 999999999) / 1000000000;
+		if (ticks > TIMEOUT_MAXTICKS) {
+			ticks = TIMEOUT_MAXTICKS;
+		}
+
+		spinlock_acquire(&naplock);
+		wchan_timedsleep(napchan, &naplock, ticks);
+		spinlock_release(&naplock);
+	}
+}
@@ -0,0 +1,302 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009, 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Lock contention statistics.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <cpu.h>
+#include <spl.h>
+#include <spinlock.h>
+#include <membar.h>
+#include <lockstat.h>
+
+/* Longest lock name kept in a dump snapshot. */
+#define LOCKSTAT_NAMELEN	24
+
+/* Most entries lockstat_dump will print. */
+#define LOCKSTAT_MAXDUMP	100
+
+/*
+ * Global list of records, and the lock for it. This can't be a
+ * struct spinlock, since acquiring one of those reports in here; use
+ * the machine-level lock word directly instead.
+ */
+static volatile spinlock_data_t lockstat_listlock = SPINLOCK_DATA_INITIALIZER;
+static struct lockstat *lockstat_list;
+
+static
+int
+lockstat_lock(void)
+{
+	int s;
+
+	s = splhigh();
+	while (spinlock_data_get(&lockstat_listlock) != 0 ||
+	       spinlock_data_testandset(&lockstat_listlock) != 0) {
+		/* spin */
+	}
+	membar_store_any();
+	return s;
+}
+
+static
+void
+lockstat_unlock(int s)
+{
+	membar_any_store();
+	spinlock_data_set(&lockstat_listlock, 0);
+	splx(s);
+}
+
+/*
+ * Clear the counters.
+ */
+static
+void
+lockstat_clear(struct lockstat *ls)
+{
+	ls->ls_acquires = 0;
+	ls->ls_contended = 0;
+	ls->ls_waitcycles = 0;
+	ls->ls_maxwait = 0;
+	ls->ls_blockerpc = 0;
+}
+
+/*
+ * Set up a record for a lock called NAME, or if NAME is NULL, one
+ * set up by the code at INITPC. It goes on the list the first time
+ * the lock is acquired, so locks that are never used don't clutter
+ * the dumps.
+ */
+void
+lockstat_init(struct lockstat *ls, const char *name, vaddr_t initpc)
+{
+	ls->ls_name = name;
+	ls->ls_initpc = initpc;
+	ls->ls_holderpc = 0;
+	lockstat_clear(ls);
+	ls->ls_onlist = false;
+	ls->ls_prev = ls->ls_next = NULL;
+}
+
+/*
+ * Take a record off the list before its lock goes away.
+ */
+void
+lockstat_cleanup(struct lockstat *ls)
+{
+	int s;
+
+	if (!ls->ls_onlist) {
+		return;
+	}
+
+	s = lockstat_lock();
+	if (ls->ls_prev != NULL) {
+		ls->ls_prev->ls_next = ls->ls_next;
+	}
+	else {
+		KASSERT(lockstat_list == ls);
+		lockstat_list = ls->ls_next;
+	}
+	if (ls->ls_next != NULL) {
+		ls->ls_next->ls_prev = ls->ls_prev;
+	}
+	ls->ls_prev = ls->ls_next = NULL;
+	ls->ls_onlist = false;
+	lockstat_unlock(s);
+}
+
+/*
+ * Timestamp for the start of a wait.
+ */
+uint32_t
+lockstat_now(void)
+{
+	return cpu_cycles();
+}
+
+/*
+ * Record an acquisition. Called by the new holder with the lock held.
+ * PC is the call site of the acquire; if the acquire had to wait,
+ * START is when the wait began.
+ */
+void
+lockstat_acquired(struct lockstat *ls, vaddr_t pc,
+		  bool contended, uint32_t start)
+{
+	uint32_t wait;
+	int s;
+
+	if (!ls->ls_onlist) {
+		s = lockstat_lock();
+		ls->ls_prev = NULL;
+		ls->ls_next = lockstat_list;
+		if (lockstat_list != NULL) {
+			lockstat_list->ls_prev = ls;
+		}
+		lockstat_list = ls;
+		ls->ls_onlist = true;
+		lockstat_unlock(s);
+
+		/* A static spinlock; name it for its first user. */
+		if (ls->ls_name == NULL && ls->ls_initpc == 0) {
+			ls->ls_initpc = pc;
+		}
+	}
+
+	ls->ls_acquires++;
+	if (contended) {
+		/* wraparound of the counter cancels out here */
+		wait = cpu_cycles() - start;
+		ls->ls_contended++;
+		ls->ls_waitcycles += wait;
+		if (wait > ls->ls_maxwait) {
+			ls->ls_maxwait = wait;
+		}
+		/* whoever acquired it last is whoever we waited for */
+		ls->ls_blockerpc = ls->ls_holderpc;
+	}
+	ls->ls_holderpc = pc;
+}
+
+/*
+ * Copy of a record, taken so it can be printed without holding the
+ * list lock (kprintf may sleep) and without the lock going away.
+ */
+struct lockstat_snap {
+	char name[LOCKSTAT_NAMELEN];
+	const void *addr;
+	unsigned acquires;
+	unsigned contended;
+	uint64_t waitcycles;
+	uint32_t maxwait;
+	vaddr_t holderpc;
+	vaddr_t blockerpc;
+};
+
+/*
+ * Print the MAX most contended locks, most contended first. Locks
+ * with equal contention are ordered by total wait time.
+ */
+void
+lockstat_dump(unsigned max)
+{
+	struct lockstat_snap *snaps;
+	struct lockstat *ls;
+	unsigned num, total, i, j;
+	int s;
+
+	if (max > LOCKSTAT_MAXDUMP) {
+		max = LOCKSTAT_MAXDUMP;
+	}
+	snaps = kmalloc(max * sizeof(*snaps));
+	if (snaps == NULL) {
+		kprintf("lockstat: Out of memory\n");
+		return;
+	}
+
+	num = 0;
+	total = 0;
+	s = lockstat_lock();
+	for (ls = lockstat_list; ls != NULL; ls = ls->ls_next) {
+		total++;
+		if (ls->ls_contended == 0) {
+			continue;
+		}
+
+		/* insertion sort into the top MAX */
+		for (i = num; i > 0; i--) {
+			if (snaps[i-1].contended > ls->ls_contended ||
+			    (snaps[i-1].contended == ls->ls_contended &&
+			     snaps[i-1].waitcycles >= ls->ls_waitcycles)) {
+				break;
+			}
+		}
+		if (i == max) {
+			continue;
+		}
+		j = (num < max) ? num++ : max - 1;
+		for (; j > i; j--) {
+			snaps[j] = snaps[j-1];
+		}
+		if (ls->ls_name != NULL) {
+			snprintf(snaps[i].name, sizeof(snaps[i].name), "%s",
+				 ls->ls_name);
+		}
+		else {
+			snprintf(snaps[i].name, sizeof(snaps[i].name),
+				 "spinlock 0x%08lx",
+				 (unsigned long)ls->ls_initpc);
+		}
+		snaps[i].addr = ls;
+		snaps[i].acquires = ls->ls_acquires;
+		snaps[i].contended = ls->ls_contended;
+		snaps[i].waitcycles = ls->ls_waitcycles;
+		snaps[i].maxwait = ls->ls_maxwait;
+		snaps[i].holderpc = ls->ls_holderpc;
+		snaps[i].blockerpc = ls->ls_blockerpc;
+	}
+	lockstat_unlock(s);
+
+	kprintf("lockstat: %u locks in use, %u contended shown\n", total, num);
+	kprintf("%-23s %-10s %9s %9s %12s %10s %10s %10s\n",
+		"name", "record", "acquires", "contended", "wait cycles",
+		"max wait", "holder", "blocker");
+	for (i=0; i<num; i++) {
+		kprintf("%-23s %p %9u %9u %12llu %10u 0x%08lx 0x%08lx\n",
+			snaps[i].name, snaps[i].addr,
+			snaps[i].acquires, snaps[i].contended,
+			(unsigned long long)snaps[i].waitcycles,
+			snaps[i].maxwait,
+			(unsigned long)snaps[i].holderpc,
+			(unsigned long)snaps[i].blockerpc);
+	}
+
+	kfree(snaps);
+}
+
+/*
+ * Zero all the counters, to start a new measurement window.
+ */
+void
+lockstat_reset(void)
+{
+	struct lockstat *ls;
+	int s;
+
+	s = lockstat_lock();
+	for (ls = lockstat_list; ls != NULL; ls = ls->ls_next) {
+		lockstat_clear(ls);
+	}
+	lockstat_unlock(s);
+}
@@ -51,8 +51,13 @@ void
 spinlock_init(struct spinlock *splk)
 {
 	spinlock_data_set(&splk->splk_lock, 0);
+#if OPT_TICKETLOCK
+	spinlock_data_set(&splk->splk_next, 0);
+#endif
 	splk->splk_holder = NULL;
 	HANGMAN_LOCKABLEINIT(&splk->splk_hangman, "spinlock");
+	/* Reported by where this was called from. */
+	LOCKSTAT_INIT_UNNAMED(&splk->splk_stat);
 }
 
 /*
@@ -62,7 +67,13 @@ void
 spinlock_cleanup(struct spinlock *splk)
 {
 	KASSERT(splk->splk_holder == NULL);
+#if OPT_TICKETLOCK
+	KASSERT(spinlock_data_get(&splk->splk_lock) ==
+		spinlock_data_get(&splk->splk_next));
+#else
 	KASSERT(spinlock_data_get(&splk->splk_lock) == 0);
+#endif
+	LOCKSTAT_CLEANUP(&splk->splk_stat);
 }
 
 /*
@@ -76,6 +87,11 @@ void
 spinlock_acquire(struct spinlock *splk)
 {
 	struct cpu *mycpu;
+	bool contended;
+	uint32_t start;
+#if OPT_TICKETLOCK
+	spinlock_data_t ticket;
+#endif
 
 	splraise(IPL_NONE, IPL_HIGH);
 
@@ -93,6 +109,23 @@ spinlock_acquire(struct spinlock *splk)
 		mycpu = NULL;
 	}
 
+	contended = false;
+	start = 0;
+#if OPT_TICKETLOCK
+	/*
+	 * Take a ticket and wait for it to come up. The ticket
+	 * counter may wrap; that's fine as long as there are fewer
+	 * than 2^32 CPUs waiting.
+	 */
+	ticket = spinlock_data_fetchinc(&splk->splk_next);
+	if (spinlock_data_get(&splk->splk_lock) != ticket) {
+		contended = true;
+		start = LOCKSTAT_NOW();
+		while (spinlock_data_get(&splk->splk_lock) != ticket) {
+			/* spin */
+		}
+	}
+#else
 	while (1) {
 		/*
 		 * Do test-test-and-set, that is, read first before
@@ -104,17 +137,21 @@ spinlock_acquire(struct spinlock *splk)
 		 * previously unheld and we now own it. If it was 1,
 		 * we don't.
 		 */
-		if (spinlock_data_get(&splk->splk_lock) != 0) {
-			continue;
-		}
-		if (spinlock_data_testandset(&splk->splk_lock) != 0) {
+		if (spinlock_data_get(&splk->splk_lock) != 0 ||
+		    spinlock_data_testandset(&splk->splk_lock) != 0) {
+			if (!contended) {
+				contended = true;
+				start = LOCKSTAT_NOW();
+			}
 			continue;
 		}
 		break;
 	}
+#endif
 
 	membar_store_any();
 	splk->splk_holder = mycpu;
+	LOCKSTAT_ACQUIRED(&splk->splk_stat, contended, start);
 
 	if (CURCPU_EXISTS()) {
 		HANGMAN_ACQUIRE(&curcpu->c_hangman, &splk->splk_hangman);
@@ -137,7 +174,13 @@ spinlock_release(struct spinlock *splk)
 
 	splk->splk_holder = NULL;
 	membar_any_store();
+#if OPT_TICKETLOCK
+	/* only the holder writes the now-serving word, so no LL/SC needed */
+	spinlock_data_set(&splk->splk_lock,
+			  spinlock_data_get(&splk->splk_lock) + 1);
+#else
 	spinlock_data_set(&splk->splk_lock, 0);
+#endif
 	spllower(IPL_HIGH, IPL_NONE);
 }
 
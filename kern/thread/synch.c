@@ -33,12 +33,69 @@
  */
 
 #include <types.h>
+#include <kern/errno.h>
 #include <lib.h>
 #include <spinlock.h>
 #include <wchan.h>
+#include <timeout.h>
 #include <thread.h>
 #include <current.h>
 #include <synch.h>
+#include <kmem_cache.h>
+
+////////////////////////////////////////////////////////////
+//
+// Object caches.
+
+static struct kmem_cache *sem_cache;
+static struct kmem_cache *lock_cache;
+static struct kmem_cache *cv_cache;
+static struct kmem_cache *rwlock_cache;
+
+/*
+ * Constructors. These set up the state that the destroy functions
+ * assert is back to its initial value, so freed objects keep it.
+ */
+static
+void
+lock_ctor(void *obj)
+{
+	struct lock *lock = obj;
+
+	lock->lk_holder = NULL;
+}
+
+static
+void
+rwlock_ctor(void *obj)
+{
+	struct rwlock *rw = obj;
+
+	rw->rw_writer = NULL;
+	rw->rw_readers = 0;
+	rw->rw_waitreaders = 0;
+	rw->rw_waitwriters = 0;
+}
+
+/*
+ * Create the caches. Called early in boot, before anything creates
+ * any synchronization objects.
+ */
+void
+synch_bootstrap(void)
+{
+	sem_cache = kmem_cache_create("semaphore", sizeof(struct semaphore),
+				      0, NULL);
+	lock_cache = kmem_cache_create("lock", sizeof(struct lock),
+				       0, lock_ctor);
+	cv_cache = kmem_cache_create("cv", sizeof(struct cv), 0, NULL);
+	rwlock_cache = kmem_cache_create("rwlock", sizeof(struct rwlock),
+					 0, rwlock_ctor);
+	if (sem_cache == NULL || lock_cache == NULL || cv_cache == NULL ||
+	    rwlock_cache == NULL) {
+		panic("synch_bootstrap: Out of memory\n");
+	}
+}
 
 ////////////////////////////////////////////////////////////
 //
@@ -49,21 +106,21 @@ sem_create(const char *name, unsigned initial_count)
 {
 	struct semaphore *sem;
 	
-	sem = kmalloc(sizeof(*sem));
+	sem = kmem_cache_alloc(sem_cache);
 	if (sem == NULL) {
 		return NULL;
 	}
 	
 	sem->sem_name = kstrdup(name);
 	if (sem->sem_name == NULL) {
-		kfree(sem);
+		kmem_cache_free(sem_cache, sem);
 		return NULL;
 	}
 
 	sem->sem_wchan = wchan_create(sem->sem_name);
 	if (sem->sem_wchan == NULL) {
 		kfree(sem->sem_name);
-		kfree(sem);
+		kmem_cache_free(sem_cache, sem);
 		return NULL;
 	}
 
@@ -82,7 +139,7 @@ sem_destroy(struct semaphore *sem)
 	spinlock_cleanup(&sem->sem_lock);
 	wchan_destroy(sem->sem_wchan);
 	kfree(sem->sem_name);
-	kfree(sem);
+	kmem_cache_free(sem_cache, sem);
 }
 
 void
@@ -134,6 +191,36 @@ V(struct semaphore *sem)
 	spinlock_release(&sem->sem_lock);
 }
 
+int
+P_timed(struct semaphore *sem, unsigned ticks)
+{
+	uint64_t deadline, now;
+
+	KASSERT(sem != NULL);
+	KASSERT(curthread->t_in_interrupt == false);
+
+	deadline = timeout_now() + ticks;
+
+	spinlock_acquire(&sem->sem_lock);
+	while (sem->sem_count == 0) {
+		/*
+		 * Someone else may have got in first after a V woke
+		 * us, so sleep again for whatever time is left.
+		 */
+		now = timeout_now();
+		if (now >= deadline) {
+			spinlock_release(&sem->sem_lock);
+			return ETIMEDOUT;
+		}
+		wchan_timedsleep(sem->sem_wchan, &sem->sem_lock,
+				 deadline - now);
+	}
+	KASSERT(sem->sem_count > 0);
+	sem->sem_count--;
+	spinlock_release(&sem->sem_lock);
+	return 0;
+}
+
 ////////////////////////////////////////////////////////////
 //
 // Lock.
@@ -143,27 +230,28 @@ lock_create(const char *name)
 {
 	struct lock *lock;
 
-	lock = kmalloc(sizeof(*lock));
+	lock = kmem_cache_alloc(lock_cache);
 	if (lock == NULL) {
 		return NULL;
 	}
 
 	lock->lk_name = kstrdup(name);
 	if (lock->lk_name == NULL) {
-		kfree(lock);
+		kmem_cache_free(lock_cache, lock);
 		return NULL;
 	}
 
 	HANGMAN_LOCKABLEINIT(&lock->lk_hangman, lock->lk_name);
+	LOCKSTAT_INIT(&lock->lk_stat, lock->lk_name);
 
 	lock->lk_wchan = wchan_create(lock->lk_name);
 	if (lock->lk_wchan == NULL) {
 		kfree(lock->lk_name);
-		kfree(lock);
+		kmem_cache_free(lock_cache, lock);
 		return NULL;
 	}
 	spinlock_init(&lock->lk_lock);
-	lock->lk_holder = NULL;
+	/* lk_holder is set up by lock_ctor */
 
 	return lock;
 }
@@ -176,14 +264,18 @@ lock_destroy(struct lock *lock)
 	KASSERT(lock->lk_holder == NULL);
 	spinlock_cleanup(&lock->lk_lock);
 	wchan_destroy(lock->lk_wchan);
+	LOCKSTAT_CLEANUP(&lock->lk_stat);
 
 	kfree(lock->lk_name);
-	kfree(lock);
+	kmem_cache_free(lock_cache, lock);
 }
 
 void
 lock_acquire(struct lock *lock)
 {
+	bool contended;
+	uint32_t start;
+
 	DEBUGASSERT(lock != NULL);
 	KASSERT(curthread->t_in_interrupt == false);
 
@@ -193,11 +285,14 @@ lock_acquire(struct lock *lock)
 	HANGMAN_WAIT(&curthread->t_hangman, &lock->lk_hangman);
 
 	KASSERT(lock->lk_holder != curthread);
+	contended = lock->lk_holder != NULL;
+	start = contended ? LOCKSTAT_NOW() : 0;
 	while (lock->lk_holder != NULL) {
 		/* As in the semaphore. */
 		wchan_sleep(lock->lk_wchan, &lock->lk_lock);
 	}
 	lock->lk_holder = curthread;
+	LOCKSTAT_ACQUIRED(&lock->lk_stat, contended, start);
 
 	/* Call this (atomically) once the lock is acquired */
 	HANGMAN_ACQUIRE(&curthread->t_hangman, &lock->lk_hangman);
@@ -246,21 +341,21 @@ cv_create(const char *name)
 {
 	struct cv *cv;
 
-	cv = kmalloc(sizeof(*cv));
+	cv = kmem_cache_alloc(cv_cache);
 	if (cv == NULL) {
 		return NULL;
 	}
 
 	cv->cv_name = kstrdup(name);
 	if (cv->cv_name==NULL) {
-		kfree(cv);
+		kmem_cache_free(cv_cache, cv);
 		return NULL;
 	}
 
 	cv->cv_wchan = wchan_create(cv->cv_name);
 	if (cv->cv_wchan == NULL) {
 		kfree(cv->cv_name);
-		kfree(cv);
+		kmem_cache_free(cv_cache, cv);
 		return NULL;
 	}
 
@@ -277,7 +372,7 @@ cv_destroy(struct cv *cv)
 	wchan_destroy(cv->cv_wchan);
 
 	kfree(cv->cv_name);
-	kfree(cv);
+	kmem_cache_free(cv_cache, cv);
 }
 
 void
@@ -298,6 +393,19 @@ cv_wait(struct cv *cv, struct lock *lock)
 	lock_acquire(lock);
 }
 
+int
+cv_timedwait(struct cv *cv, struct lock *lock, unsigned ticks)
+{
+	int result;
+
+	spinlock_acquire(&cv->cv_wchanlock);
+	lock_release(lock);
+	result = wchan_timedsleep(cv->cv_wchan, &cv->cv_wchanlock, ticks);
+	spinlock_release(&cv->cv_wchanlock);
+	lock_acquire(lock);
+	return result;
+}
+
 void
 cv_signal(struct cv *cv, struct lock *lock)
 {
@@ -315,3 +423,181 @@ cv_broadcast(struct cv *cv, struct lock *lock)
 	wchan_wakeall(cv->cv_wchan, &cv->cv_wchanlock);
 	spinlock_release(&cv->cv_wchanlock);
 }
+
+////////////////////////////////////////////////////////////
+//
+// Reader-writer lock.
+
+struct rwlock *
+rwlock_create(const char *name)
+{
+	struct rwlock *rw;
+
+	rw = kmem_cache_alloc(rwlock_cache);
+	if (rw == NULL) {
+		return NULL;
+	}
+
+	rw->rw_name = kstrdup(name);
+	if (rw->rw_name == NULL) {
+		kmem_cache_free(rwlock_cache, rw);
+		return NULL;
+	}
+
+	HANGMAN_LOCKABLEINIT(&rw->rw_hangman, rw->rw_name);
+
+	rw->rw_readwchan = wchan_create(rw->rw_name);
+	if (rw->rw_readwchan == NULL) {
+		kfree(rw->rw_name);
+		kmem_cache_free(rwlock_cache, rw);
+		return NULL;
+	}
+	rw->rw_writewchan = wchan_create(rw->rw_name);
+	if (rw->rw_writewchan == NULL) {
+		wchan_destroy(rw->rw_readwchan);
+		kfree(rw->rw_name);
+		kmem_cache_free(rwlock_cache, rw);
+		return NULL;
+	}
+
+	spinlock_init(&rw->rw_lock);
+	/* the other counts are set up by rwlock_ctor */
+	rw->rw_readgrant = 0;
+
+	return rw;
+}
+
+void
+rwlock_destroy(struct rwlock *rw)
+{
+	KASSERT(rw != NULL);
+
+	KASSERT(rw->rw_writer == NULL);
+	KASSERT(rw->rw_readers == 0);
+	KASSERT(rw->rw_waitreaders == 0);
+	KASSERT(rw->rw_waitwriters == 0);
+
+	spinlock_cleanup(&rw->rw_lock);
+	wchan_destroy(rw->rw_writewchan);
+	wchan_destroy(rw->rw_readwchan);
+
+	kfree(rw->rw_name);
+	kmem_cache_free(rwlock_cache, rw);
+}
+
+void
+rwlock_acquire_read(struct rwlock *rw)
+{
+	DEBUGASSERT(rw != NULL);
+	KASSERT(curthread->t_in_interrupt == false);
+
+	spinlock_acquire(&rw->rw_lock);
+
+	KASSERT(rw->rw_writer != curthread);
+
+	/*
+	 * Wait while there's a writer, and also while writers are
+	 * queued, unless the last writer out granted passage to the
+	 * readers that were waiting behind it.
+	 */
+	HANGMAN_WAIT(&curthread->t_hangman, &rw->rw_hangman);
+	while (rw->rw_writer != NULL ||
+	       (rw->rw_waitwriters > 0 && rw->rw_readgrant == 0)) {
+		rw->rw_waitreaders++;
+		wchan_sleep(rw->rw_readwchan, &rw->rw_lock);
+		rw->rw_waitreaders--;
+	}
+	if (rw->rw_readgrant > 0) {
+		rw->rw_readgrant--;
+	}
+	rw->rw_readers++;
+
+	/* Readers don't occupy the lockable; just clear the wait. */
+	HANGMAN_ACQUIRE(&curthread->t_hangman, &rw->rw_hangman);
+	HANGMAN_RELEASE(&curthread->t_hangman, &rw->rw_hangman);
+
+	spinlock_release(&rw->rw_lock);
+}
+
+void
+rwlock_release_read(struct rwlock *rw)
+{
+	DEBUGASSERT(rw != NULL);
+
+	spinlock_acquire(&rw->rw_lock);
+
+	KASSERT(rw->rw_readers > 0);
+	KASSERT(rw->rw_writer == NULL);
+	rw->rw_readers--;
+	if (rw->rw_readers == 0 && rw->rw_readgrant == 0) {
+		wchan_wakeone(rw->rw_writewchan, &rw->rw_lock);
+	}
+
+	spinlock_release(&rw->rw_lock);
+}
+
+void
+rwlock_acquire_write(struct rwlock *rw)
+{
+	DEBUGASSERT(rw != NULL);
+	KASSERT(curthread->t_in_interrupt == false);
+
+	spinlock_acquire(&rw->rw_lock);
+
+	HANGMAN_WAIT(&curthread->t_hangman, &rw->rw_hangman);
+
+	KASSERT(rw->rw_writer != curthread);
+	while (rw->rw_writer != NULL || rw->rw_readers > 0 ||
+	       rw->rw_readgrant > 0) {
+		rw->rw_waitwriters++;
+		wchan_sleep(rw->rw_writewchan, &rw->rw_lock);
+		rw->rw_waitwriters--;
+	}
+	rw->rw_writer = curthread;
+
+	HANGMAN_ACQUIRE(&curthread->t_hangman, &rw->rw_hangman);
+
+	spinlock_release(&rw->rw_lock);
+}
+
+void
+rwlock_release_write(struct rwlock *rw)
+{
+	DEBUGASSERT(rw != NULL);
+
+	spinlock_acquire(&rw->rw_lock);
+
+	KASSERT(rw->rw_writer == curthread);
+	KASSERT(rw->rw_readers == 0);
+	rw->rw_writer = NULL;
+
+	/*
+	 * If readers queued up behind us, let all of them in ahead of
+	 * any other writer; otherwise hand off to the next writer.
+	 */
+	if (rw->rw_waitreaders > 0) {
+		rw->rw_readgrant = rw->rw_waitreaders;
+		wchan_wakeall(rw->rw_readwchan, &rw->rw_lock);
+	}
+	else {
+		wchan_wakeone(rw->rw_writewchan, &rw->rw_lock);
+	}
+
+	HANGMAN_RELEASE(&curthread->t_hangman, &rw->rw_hangman);
+
+	spinlock_release(&rw->rw_lock);
+}
+
+bool
+rwlock_do_i_hold_write(struct rwlock *rw)
+{
+	bool ret;
+
+	DEBUGASSERT(rw != NULL);
+
+	spinlock_acquire(&rw->rw_lock);
+	ret = (rw->rw_writer == curthread);
+	spinlock_release(&rw->rw_lock);
+
+	return ret;
+}
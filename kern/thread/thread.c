@@ -53,6 +53,8 @@
 #include <mainbus.h>
 #include <vnode.h>
 #include <pid.h>
+#include <timeout.h>
+#include <kmem_cache.h>
 
 
 /* Magic number used as a guard value on kernel thread stacks. */
@@ -64,6 +66,10 @@ struct wchan {
 	struct threadlist wc_threads;	/* list of waiting threads */
 };
 
+/* Object caches for threads and wait channels. */
+static struct kmem_cache *thread_cache;
+static struct kmem_cache *wchan_cache;
+
 /* Master array of CPUs. */
 DECLARRAY(cpu, static __UNUSED inline);
 DEFARRAY(cpu, static __UNUSED inline);
@@ -111,6 +117,19 @@ thread_checkstack(struct thread *thread)
 	}
 }
 
+/*
+ * Constructor for the thread cache. The list node's self-pointer
+ * survives threadlistnode_cleanup, so only needs setting once.
+ */
+static
+void
+thread_ctor(void *obj)
+{
+	struct thread *thread = obj;
+
+	threadlistnode_init(&thread->t_listnode, thread);
+}
+
 /*
  * Create a thread. This is used both to create a first thread
  * for each CPU and to create subsequent forked threads.
@@ -123,14 +142,14 @@ thread_create(const char *name)
 
 	DEBUGASSERT(name != NULL);
 
-	thread = kmalloc(sizeof(*thread));
+	thread = kmem_cache_alloc(thread_cache);
 	if (thread == NULL) {
 		return NULL;
 	}
 
 	thread->t_name = kstrdup(name);
 	if (thread->t_name == NULL) {
-		kfree(thread);
+		kmem_cache_free(thread_cache, thread);
 		return NULL;
 	}
 	thread->t_wchan_name = "NEW";
@@ -138,7 +157,7 @@ thread_create(const char *name)
 
 	/* Thread subsystem fields */
 	thread_machdep_init(&thread->t_machdep);
-	threadlistnode_init(&thread->t_listnode, thread);
+	/* t_listnode is set up by thread_ctor */
 	thread->t_stack = NULL;
 	thread->t_context = NULL;
 	thread->t_cpu = NULL;
@@ -147,9 +166,13 @@ thread_create(const char *name)
 
 	/* Interrupt state fields */
 	thread->t_in_interrupt = false;
+	thread->t_intr_fromuser = false;
 	thread->t_curspl = IPL_HIGH;
 	thread->t_iplhigh_count = 1; /* corresponding to t_curspl */
 
+	bzero(&thread->t_usage, sizeof(thread->t_usage));
+	thread->t_ftseq = 0;
+
 	/* If you add to struct thread, be sure to initialize here */
 
 	return thread;
@@ -287,7 +310,7 @@ thread_destroy(struct thread *thread)
 	thread->t_wchan_name = "DESTROYED";
 
 	kfree(thread->t_name);
-	kfree(thread);
+	kmem_cache_free(thread_cache, thread);
 }
 
 /*
@@ -374,6 +397,12 @@ thread_shutdown(void)
 void
 thread_bootstrap(void)
 {
+	thread_cache = kmem_cache_create("thread", sizeof(struct thread),
+					 0, thread_ctor);
+	if (thread_cache == NULL) {
+		panic("thread_bootstrap: Out of memory\n");
+	}
+
 	cpuarray_init(&allcpus);
 
 	/*
@@ -484,6 +513,34 @@ thread_make_runnable(struct thread *target, bool already_have_lock)
 	}
 }
 
+/*
+ * Make a whole list of threads runnable at once. They must all belong
+ * to TARGETCPU. The list is spliced onto the run queue, so this takes
+ * the run queue lock (and sends an IPI) once rather than per thread.
+ * Leaves LIST empty.
+ */
+static
+void
+thread_make_runnable_list(struct cpu *targetcpu, struct threadlist *list)
+{
+	struct thread *target;
+
+	spinlock_acquire(&targetcpu->c_runqueue_lock);
+
+	THREADLIST_FORALL(target, *list) {
+		KASSERT(target->t_cpu == targetcpu);
+		target->t_state = S_READY;
+	}
+	threadlist_splice(&targetcpu->c_runqueue, list);
+
+	if (targetcpu->c_isidle && targetcpu != curcpu->c_self) {
+		/* As above. */
+		ipi_send(targetcpu, IPI_UNIDLE);
+	}
+
+	spinlock_release(&targetcpu->c_runqueue_lock);
+}
+
 /*
  * Create a new thread based on an existing one.
  *
@@ -603,8 +660,10 @@ thread_switch(threadstate_t newstate, struct wchan *wc, struct spinlock *lk)
 		panic("Illegal S_RUN in thread_switch\n");
 	    case S_READY:
 		thread_make_runnable(cur, true /*have lock*/);
+		cur->t_usage.u_nivcsw++;
 		break;
 	    case S_SLEEP:
+		cur->t_usage.u_nvcsw++;
 		cur->t_wchan_name = wc->wc_name;
 		/*
 		 * Add the thread to the list in the wait channel, and
@@ -962,6 +1021,34 @@ thread_consider_migration(void)
  * Wait channel functions
  */
 
+/*
+ * Constructor for the wchan cache. wchan_destroy requires the list
+ * to be empty, so it stays initialized while on the free list.
+ */
+static
+void
+wchan_ctor(void *obj)
+{
+	struct wchan *wc = obj;
+
+	threadlist_init(&wc->wc_threads);
+}
+
+/*
+ * Set up the wait channel cache. This has to happen before anything
+ * creates a semaphore, lock, or CV, which is before proc_bootstrap
+ * and thread_bootstrap.
+ */
+void
+wchan_bootstrap(void)
+{
+	wchan_cache = kmem_cache_create("wchan", sizeof(struct wchan), 0,
+					wchan_ctor);
+	if (wchan_cache == NULL) {
+		panic("wchan_bootstrap: Out of memory\n");
+	}
+}
+
 /*
  * Create a wait channel. NAME is a symbolic string name for it.
  * This is what's displayed by ps -alx in Unix.
@@ -975,11 +1062,11 @@ wchan_create(const char *name)
 {
 	struct wchan *wc;
 
-	wc = kmalloc(sizeof(*wc));
+	wc = kmem_cache_alloc(wchan_cache);
 	if (wc == NULL) {
 		return NULL;
 	}
-	threadlist_init(&wc->wc_threads);
+	/* wc_threads is set up by wchan_ctor */
 	wc->wc_name = name;
 
 	return wc;
@@ -993,7 +1080,7 @@ void
 wchan_destroy(struct wchan *wc)
 {
 	threadlist_cleanup(&wc->wc_threads);
-	kfree(wc);
+	kmem_cache_free(wchan_cache, wc);
 }
 
 /*
@@ -1019,6 +1106,81 @@ wchan_sleep(struct wchan *wc, struct spinlock *lk)
 	spinlock_acquire(lk);
 }
 
+/*
+ * State for wchan_timedsleep, shared with its timeout function.
+ */
+struct wchan_timer {
+	struct timeout wt_timeout;
+	struct wchan *wt_wc;
+	struct spinlock *wt_lk;
+	struct thread *wt_thread;
+	bool wt_expired;
+};
+
+/*
+ * Timeout function for wchan_timedsleep. If the thread is still on
+ * the wait channel, nobody woke it in time; take it off and wake it.
+ */
+static
+void
+wchan_timer_expire(void *vwt)
+{
+	struct wchan_timer *wt = vwt;
+	struct thread *t;
+
+	spinlock_acquire(wt->wt_lk);
+	THREADLIST_FORALL(t, wt->wt_wc->wc_threads) {
+		if (t == wt->wt_thread) {
+			threadlist_remove(&wt->wt_wc->wc_threads, t);
+			wt->wt_expired = true;
+			thread_make_runnable(t, false);
+			break;
+		}
+	}
+	spinlock_release(wt->wt_lk);
+}
+
+/*
+ * Like wchan_sleep, but give up after TICKS hardclock ticks. Returns
+ * 0 if woken up, or ETIMEDOUT.
+ */
+int
+wchan_timedsleep(struct wchan *wc, struct spinlock *lk, unsigned ticks)
+{
+	struct wchan_timer wt;
+
+	/* may not sleep in an interrupt handler */
+	KASSERT(!curthread->t_in_interrupt);
+
+	/* must hold the spinlock */
+	KASSERT(spinlock_do_i_hold(lk));
+
+	/* must not hold other spinlocks */
+	KASSERT(curcpu->c_spinlocks == 1);
+
+	wt.wt_wc = wc;
+	wt.wt_lk = lk;
+	wt.wt_thread = curthread;
+	wt.wt_expired = false;
+	timeout_init(&wt.wt_timeout, wchan_timer_expire, &wt);
+
+	/*
+	 * Because we hold LK, the timeout can't look for us on the
+	 * channel before thread_switch has put us there.
+	 */
+	timeout_set(&wt.wt_timeout, ticks);
+	thread_switch(S_SLEEP, wc, lk);
+
+	/*
+	 * Cancel (or wait out) the timeout before retaking LK, since
+	 * the timeout function needs LK and WT is on our stack.
+	 */
+	timeout_cancel(&wt.wt_timeout);
+	spinlock_acquire(lk);
+
+	return wt.wt_expired ? ETIMEDOUT : 0;
+}
+
 /*
  * Wake up one thread sleeping on a wait channel.
  */
@@ -1055,29 +1217,45 @@ void
 wchan_wakeall(struct wchan *wc, struct spinlock *lk)
 {
 	struct thread *target;
-	struct threadlist list;
+	struct cpu *targetcpu;
+	struct threadlist list, batch, rest;
 
 	KASSERT(spinlock_do_i_hold(lk));
 
 	threadlist_init(&list);
+	threadlist_init(&batch);
+	threadlist_init(&rest);
 
 	/*
 	 * Grab all the threads from the channel, moving them to a
 	 * private list.
 	 */
-	while ((target = threadlist_remhead(&wc->wc_threads)) != NULL) {
-		threadlist_addtail(&list, target);
-	}
+	threadlist_splice(&list, &wc->wc_threads);
 
 	/*
-	 * We could conceivably sort by cpu first to cause fewer lock
-	 * ops and fewer IPIs, but for now at least don't bother. Just
-	 * make each thread runnable.
+	 * Sort them by cpu, so each cpu's run queue is locked (and
+	 * poked) once no matter how many of its threads were asleep
+	 * here: take the cpu of the first thread left, pull out all
+	 * the threads for that cpu, and hand them over as a batch.
+	 * The rest go around again.
 	 */
 	while ((target = threadlist_remhead(&list)) != NULL) {
-		thread_make_runnable(target, false);
+		targetcpu = target->t_cpu;
+		threadlist_addtail(&batch, target);
+		while ((target = threadlist_remhead(&list)) != NULL) {
+			if (target->t_cpu == targetcpu) {
+				threadlist_addtail(&batch, target);
+			}
+			else {
+				threadlist_addtail(&rest, target);
+			}
+		}
+		thread_make_runnable_list(targetcpu, &batch);
+		threadlist_splice(&list, &rest);
 	}
 
+	threadlist_cleanup(&rest);
+	threadlist_cleanup(&batch);
 	threadlist_cleanup(&list);
 }
 
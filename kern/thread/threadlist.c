@@ -238,3 +238,28 @@ threadlist_remove(struct threadlist *tl, struct thread *t)
 	DEBUGASSERT(tl->tl_count > 0);
 	tl->tl_count--;
 }
+
+void
+threadlist_splice(struct threadlist *tl, struct threadlist *from)
+{
+	struct threadlistnode *first, *last;
+
+	DEBUGASSERT(tl != NULL);
+	DEBUGASSERT(from != NULL);
+
+	if (from->tl_count == 0) {
+		return;
+	}
+	first = from->tl_head.tln_next;
+	last = from->tl_tail.tln_prev;
+
+	first->tln_prev = tl->tl_tail.tln_prev;
+	last->tln_next = &tl->tl_tail;
+	first->tln_prev->tln_next = first;
+	tl->tl_tail.tln_prev = last;
+	tl->tl_count += from->tl_count;
+
+	from->tl_head.tln_next = &from->tl_tail;
+	from->tl_tail.tln_prev = &from->tl_head;
+	from->tl_count = 0;
+}
@@ -0,0 +1,245 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009, 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Timer wheel.
+ *
+ * There are TW_LEVELS levels of TW_SIZE slots each. A timeout due
+ * less than TW_SIZE ticks from now goes in level 0, in the slot for
+ * its exact tick. One due further out goes in the first level L
+ * whose span (TW_SIZE^(L+1) ticks) covers it, in the slot given by
+ * bits [TW_BITS*L, TW_BITS*(L+1)) of its expiry tick. Whenever the
+ * low TW_BITS*L bits of the current tick are zero, the slot of level
+ * L for the current tick is emptied and its timeouts re-inserted, at
+ * which point they land one level lower (or in level 0).
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <current.h>
+#include <thread.h>
+#include <timeout.h>
+
+#define TW_BITS		6
+#define TW_SIZE		(1U << TW_BITS)
+#define TW_MASK		(TW_SIZE - 1)
+#define TW_LEVELS	4
+
+#if TW_BITS * TW_LEVELS != 24
+#error "TIMEOUT_MAXTICKS in timeout.h is wrong"
+#endif
+
+/* States for to_state */
+#define TO_IDLE		0
+#define TO_PENDING	1
+#define TO_RUNNING	2
+
+static struct spinlock tw_lock = SPINLOCK_INITIALIZER;
+static struct timeout *tw_wheel[TW_LEVELS][TW_SIZE];
+
+/* Next tick to be processed. */
+static uint64_t tw_now;
+
+/*
+ * Put a timeout in the right slot for its expiry time. Caller must
+ * hold tw_lock.
+ */
+static
+void
+tw_insert(struct timeout *to)
+{
+	struct timeout **slot;
+	uint64_t delta;
+	unsigned level;
+
+	KASSERT(spinlock_do_i_hold(&tw_lock));
+
+	if (to->to_expire < tw_now) {
+		/* overdue (can happen during a cascade); run it next */
+		to->to_expire = tw_now;
+	}
+	delta = to->to_expire - tw_now;
+
+	for (level = 0; level < TW_LEVELS - 1; level++) {
+		if (delta < (1ULL << (TW_BITS * (level + 1)))) {
+			break;
+		}
+	}
+	slot = &tw_wheel[level][(to->to_expire >> (TW_BITS * level))
+				& TW_MASK];
+
+	to->to_next = *slot;
+	if (to->to_next != NULL) {
+		to->to_next->to_pprev = &to->to_next;
+	}
+	to->to_pprev = slot;
+	*slot = to;
+	to->to_state = TO_PENDING;
+}
+
+/*
+ * Take a timeout out of its slot. Caller must hold tw_lock.
+ */
+static
+void
+tw_remove(struct timeout *to)
+{
+	KASSERT(spinlock_do_i_hold(&tw_lock));
+	KASSERT(to->to_state == TO_PENDING);
+
+	*to->to_pprev = to->to_next;
+	if (to->to_next != NULL) {
+		to->to_next->to_pprev = to->to_pprev;
+	}
+	to->to_next = NULL;
+	to->to_pprev = NULL;
+	to->to_state = TO_IDLE;
+}
+
+/*
+ * Re-insert everything in one slot of a coarser level.
+ */
+static
+void
+tw_cascade(unsigned level, unsigned index)
+{
+	struct timeout *to;
+
+	while ((to = tw_wheel[level][index]) != NULL) {
+		tw_remove(to);
+		tw_insert(to);
+	}
+}
+
+void
+timeout_init(struct timeout *to, void (*func)(void *), void *data)
+{
+	to->to_next = NULL;
+	to->to_pprev = NULL;
+	to->to_expire = 0;
+	to->to_func = func;
+	to->to_data = data;
+	to->to_state = TO_IDLE;
+}
+
+void
+timeout_set(struct timeout *to, unsigned ticks)
+{
+	if (ticks == 0) {
+		ticks = 1;
+	}
+	if (ticks > TIMEOUT_MAXTICKS) {
+		ticks = TIMEOUT_MAXTICKS;
+	}
+
+	spinlock_acquire(&tw_lock);
+	if (to->to_state == TO_PENDING) {
+		tw_remove(to);
+	}
+	to->to_expire = tw_now + ticks;
+	tw_insert(to);
+	spinlock_release(&tw_lock);
+}
+
+bool
+timeout_cancel(struct timeout *to)
+{
+	bool ret;
+
+	KASSERT(curthread->t_in_interrupt == false);
+
+	spinlock_acquire(&tw_lock);
+	while (to->to_state == TO_RUNNING) {
+		/* Let it finish; it runs with tw_lock released. */
+		spinlock_release(&tw_lock);
+		spinlock_acquire(&tw_lock);
+	}
+	ret = (to->to_state == TO_PENDING);
+	if (ret) {
+		tw_remove(to);
+	}
+	spinlock_release(&tw_lock);
+	return ret;
+}
+
+uint64_t
+timeout_now(void)
+{
+	uint64_t ret;
+
+	/* 64-bit reads aren't atomic here */
+	spinlock_acquire(&tw_lock);
+	ret = tw_now;
+	spinlock_release(&tw_lock);
+	return ret;
+}
+
+/*
+ * Process one tick: cascade if we're at a boundary, then run
+ * everything due now.
+ */
+void
+timeout_hardclock(void)
+{
+	struct timeout *to;
+	unsigned level, index;
+
+	spinlock_acquire(&tw_lock);
+
+	index = tw_now & TW_MASK;
+	if (index == 0) {
+		for (level = 1; level < TW_LEVELS; level++) {
+			index = (tw_now >> (TW_BITS * level)) & TW_MASK;
+			tw_cascade(level, index);
+			if (index != 0) {
+				break;
+			}
+		}
+		index = 0;
+	}
+
+	while ((to = tw_wheel[0][index]) != NULL) {
+		KASSERT(to->to_expire == tw_now);
+		tw_remove(to);
+		to->to_state = TO_RUNNING;
+
+		spinlock_release(&tw_lock);
+		to->to_func(to->to_data);
+		spinlock_acquire(&tw_lock);
+
+		/* it may have been re-armed */
+		if (to->to_state == TO_RUNNING) {
+			to->to_state = TO_IDLE;
+		}
+	}
+
+	tw_now++;
+	spinlock_release(&tw_lock);
+}
@@ -0,0 +1,1162 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009, 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Buffer cache (see buf.h).
+ *
+ * Every buffer with a name is on a hash chain. Buffers nobody
+ * refers to are also on the LRU list, oldest first; a buffer's
+ * reference count covers both the thread holding it and any threads
+ * waiting for it, so while it's nonzero the buffer can't be reused
+ * or freed out from under them. Dirty buffers are also on the dirty
+ * list, in the order they became dirty, so the oldest come first.
+ *
+ * buf_lock protects all of this. It's a sleep lock, but it's never
+ * held across device I/O: a thread doing I/O on a buffer holds it
+ * (b_busy) instead, which keeps everyone else off that one block.
+ *
+ * Buffers are allocated as needed up to buf_max. After that the
+ * oldest unreferenced buffer is reused, after writing it back if
+ * it's dirty. If every buffer is in use we go over the limit rather
+ * than wait; a filesystem operation can hold several buffers at
+ * once, and waiting could deadlock.
+ *
+ * Writeback goes in batches: take a reference to up to BUF_BATCH
+ * dirty buffers, sort them by filesystem and block, hold them in that
+ * order, and write each run of consecutive blocks with one
+ * fsop_blockio. Buffers someone else is holding are left out rather
+ * than waited for while we hold the rest, since that someone may be
+ * waiting for one of ours; buf_flush then does them one at a time.
+ *
+ * Prefetch requests go on a small ring and are read in by a few
+ * worker threads, so the thread asking never waits for the disk. A
+ * request for a block that's already cached, or that arrives when the
+ * ring is full, is dropped; it's only a hint. Each worker records the
+ * filesystem it's reading from in buf_pffs, so buf_dropall can wait
+ * it out.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <uio.h>
+#include <clock.h>
+#include <timeout.h>
+#include <synch.h>
+#include <thread.h>
+#include <vfs.h>
+#include <buf.h>
+
+/* Number of hash chains. */
+#define BUF_HASHSIZE	256
+
+/* Most buffers written back per batch, and per device request. */
+#define BUF_BATCH	32
+#define BUF_MAXRUN	16
+
+/* Prefetch worker threads, and most prefetch requests queued. */
+#define BUF_PFTHREADS	2
+#define BUF_PFQUEUE	64
+
+struct buf {
+	struct fs *b_fs;		/* filesystem */
+	daddr_t b_block;		/* block number */
+	void *b_data;			/* BUF_SIZE bytes */
+	unsigned b_refcount;		/* holder and waiters */
+	bool b_busy;			/* someone holds it */
+	bool b_valid;			/* b_data matches the block */
+	bool b_dirty;			/* b_data needs writing back */
+	bool b_prefetched;		/* read ahead and not yet used */
+	uint64_t b_dirtytime;		/* when it became dirty (ticks) */
+	unsigned b_flushpass;		/* last buf_flush to look at it */
+	struct buf *b_hashnext;		/* hash chain */
+	struct buf *b_lruprev;		/* LRU list */
+	struct buf *b_lrunext;
+	struct buf *b_dirtyprev;	/* dirty list */
+	struct buf *b_dirtynext;
+};
+
+static struct lock *buf_lock;
+static struct cv *buf_cv;		/* a buffer stopped being busy */
+static struct cv *buf_syncercv;		/* wakes the syncer */
+static struct cv *buf_throttlecv;	/* the syncer did some work */
+static struct buf **buf_hash;
+static struct buf *buf_lruhead, *buf_lrutail;
+static struct buf *buf_dirtyhead, *buf_dirtytail;
+static unsigned buf_num, buf_max = BUF_DEFAULTMAX;
+static unsigned buf_ndirty;
+static unsigned buf_dirtyage = BUF_DEFAULTAGE;
+static unsigned buf_dirtymax = BUF_DEFAULTDIRTYMAX;
+static unsigned buf_flushpasses;
+static bool buf_syncerrunning;
+static bool buf_syncerstalled;	/* over limit, can't help it */
+
+/* Prefetch ring, and what each worker is reading from. */
+static struct cv *buf_pfcv;		/* a prefetch was queued */
+static struct fs *buf_pfqfs[BUF_PFQUEUE];
+static daddr_t buf_pfqblock[BUF_PFQUEUE];
+static unsigned buf_pfqhead, buf_pfqcount;
+static struct fs *buf_pffs[BUF_PFTHREADS];
+static bool buf_pfrunning;
+
+/* Statistics. */
+static unsigned buf_hits, buf_misses, buf_evictions;
+static unsigned buf_writebacks, buf_writereqs, buf_throttles;
+static unsigned buf_prefetches, buf_pfhits, buf_pfdropped;
+
+////////////////////////////////////////////////////////////
+// Hash chains and lists
+
+static
+unsigned
+buf_hashfunc(struct fs *fs, daddr_t block)
+{
+	return ((uintptr_t)fs / sizeof(void *) + block) % BUF_HASHSIZE;
+}
+
+static
+struct buf *
+buf_lookup(struct fs *fs, daddr_t block)
+{
+	struct buf *b;
+
+	for (b = buf_hash[buf_hashfunc(fs, block)]; b != NULL;
+	     b = b->b_hashnext) {
+		if (b->b_fs == fs && b->b_block == block) {
+			return b;
+		}
+	}
+	return NULL;
+}
+
+static
+void
+buf_hashin(struct buf *b)
+{
+	unsigned h;
+
+	h = buf_hashfunc(b->b_fs, b->b_block);
+	b->b_hashnext = buf_hash[h];
+	buf_hash[h] = b;
+}
+
+static
+void
+buf_hashout(struct buf *b)
+{
+	struct buf **pb;
+
+	pb = &buf_hash[buf_hashfunc(b->b_fs, b->b_block)];
+	while (*pb != b) {
+		KASSERT(*pb != NULL);
+		pb = &(*pb)->b_hashnext;
+	}
+	*pb = b->b_hashnext;
+	b->b_hashnext = NULL;
+}
+
+static
+void
+buf_lruadd(struct buf *b)
+{
+	b->b_lrunext = NULL;
+	b->b_lruprev = buf_lrutail;
+	if (buf_lrutail != NULL) {
+		buf_lrutail->b_lrunext = b;
+	}
+	else {
+		buf_lruhead = b;
+	}
+	buf_lrutail = b;
+}
+
+static
+void
+buf_lruremove(struct buf *b)
+{
+	if (b->b_lruprev != NULL) {
+		b->b_lruprev->b_lrunext = b->b_lrunext;
+	}
+	else {
+		buf_lruhead = b->b_lrunext;
+	}
+	if (b->b_lrunext != NULL) {
+		b->b_lrunext->b_lruprev = b->b_lruprev;
+	}
+	else {
+		buf_lrutail = b->b_lruprev;
+	}
+	b->b_lruprev = b->b_lrunext = NULL;
+}
+
+/*
+ * Mark B dirty, putting it at the end of the dirty list if it wasn't
+ * dirty already. A buffer dirtied again keeps its place, so it's
+ * still written back on time.
+ */
+static
+void
+buf_makedirty(struct buf *b)
+{
+	if (b->b_dirty) {
+		return;
+	}
+	b->b_dirty = true;
+	b->b_dirtytime = timeout_now();
+	b->b_dirtynext = NULL;
+	b->b_dirtyprev = buf_dirtytail;
+	if (buf_dirtytail != NULL) {
+		buf_dirtytail->b_dirtynext = b;
+	}
+	else {
+		buf_dirtyhead = b;
+	}
+	buf_dirtytail = b;
+	buf_ndirty++;
+}
+
+static
+void
+buf_makeclean(struct buf *b)
+{
+	if (!b->b_dirty) {
+		return;
+	}
+	b->b_dirty = false;
+	if (b->b_dirtyprev != NULL) {
+		b->b_dirtyprev->b_dirtynext = b->b_dirtynext;
+	}
+	else {
+		buf_dirtyhead = b->b_dirtynext;
+	}
+	if (b->b_dirtynext != NULL) {
+		b->b_dirtynext->b_dirtyprev = b->b_dirtyprev;
+	}
+	else {
+		buf_dirtytail = b->b_dirtyprev;
+	}
+	b->b_dirtyprev = b->b_dirtynext = NULL;
+	buf_ndirty--;
+}
+
+/*
+ * Number of dirty buffers at which writers are throttled.
+ */
+static
+unsigned
+buf_dirtylimit(void)
+{
+	unsigned limit;
+
+	limit = buf_max * buf_dirtymax / 100;
+	return limit > 0 ? limit : 1;
+}
+
+////////////////////////////////////////////////////////////
+// Buffer management; all of these need buf_lock
+
+static
+struct buf *
+buf_create(void)
+{
+	struct buf *b;
+
+	b = kmalloc(sizeof(*b));
+	if (b == NULL) {
+		return NULL;
+	}
+	b->b_data = kmalloc(BUF_SIZE);
+	if (b->b_data == NULL) {
+		kfree(b);
+		return NULL;
+	}
+	b->b_fs = NULL;
+	b->b_block = 0;
+	b->b_refcount = 0;
+	b->b_busy = false;
+	b->b_valid = false;
+	b->b_dirty = false;
+	b->b_prefetched = false;
+	b->b_dirtytime = 0;
+	b->b_flushpass = 0;
+	b->b_hashnext = NULL;
+	b->b_lruprev = b->b_lrunext = NULL;
+	b->b_dirtyprev = b->b_dirtynext = NULL;
+	buf_num++;
+	return b;
+}
+
+static
+void
+buf_destroy(struct buf *b)
+{
+	KASSERT(b->b_refcount == 0);
+	buf_makeclean(b);
+	buf_hashout(b);
+	buf_lruremove(b);
+	kfree(b->b_data);
+	kfree(b);
+	buf_num--;
+}
+
+/*
+ * Take a reference to B, so it stays put.
+ */
+static
+void
+buf_ref(struct buf *b)
+{
+	if (b->b_refcount++ == 0) {
+		buf_lruremove(b);
+	}
+}
+
+/*
+ * Drop a reference. An unreferenced buffer goes on the LRU list, or
+ * is freed if it's clean and either invalid or over the cache's
+ * limit.
+ */
+static
+void
+buf_unref(struct buf *b)
+{
+	KASSERT(b->b_refcount > 0);
+
+	if (--b->b_refcount == 0) {
+		/* For buf_dropall. */
+		cv_broadcast(buf_cv, buf_lock);
+
+		buf_lruadd(b);
+		if (!b->b_dirty && (!b->b_valid || buf_num > buf_max)) {
+			buf_destroy(b);
+		}
+		else if (b->b_dirty && buf_ndirty >= buf_dirtylimit()) {
+			cv_signal(buf_syncercv, buf_lock);
+		}
+	}
+}
+
+/*
+ * Wait until we can hold B, which we have a reference to.
+ */
+static
+void
+buf_acquire(struct buf *b)
+{
+	KASSERT(b->b_refcount > 0);
+
+	while (b->b_busy) {
+		cv_wait(buf_cv, buf_lock);
+	}
+	b->b_busy = true;
+}
+
+static
+void
+buf_hold(struct buf *b)
+{
+	buf_ref(b);
+	buf_acquire(b);
+}
+
+/*
+ * Stop holding B and drop the reference.
+ */
+static
+void
+buf_unhold(struct buf *b)
+{
+	KASSERT(b->b_busy);
+
+	b->b_busy = false;
+	cv_broadcast(buf_cv, buf_lock);
+	buf_unref(b);
+}
+
+/*
+ * Write back the run of N held, dirty buffers starting at BUFS, which
+ * are consecutive blocks of one filesystem, in one request. Releases
+ * buf_lock while the I/O is done.
+ */
+static
+int
+buf_writerun(struct buf **bufs, unsigned n)
+{
+	struct iovec iov[BUF_MAXRUN];
+	struct uio ku;
+	unsigned i;
+	int result;
+
+	KASSERT(n > 0 && n <= BUF_MAXRUN);
+
+	for (i=0; i<n; i++) {
+		KASSERT(bufs[i]->b_busy);
+		KASSERT(bufs[i]->b_dirty);
+		KASSERT(bufs[i]->b_fs == bufs[0]->b_fs);
+		KASSERT(bufs[i]->b_block == bufs[0]->b_block + i);
+		iov[i].iov_kbase = bufs[i]->b_data;
+		iov[i].iov_len = BUF_SIZE;
+	}
+	ku.uio_iov = iov;
+	ku.uio_iovcnt = n;
+	ku.uio_offset = (off_t)bufs[0]->b_block * BUF_SIZE;
+	ku.uio_resid = n * BUF_SIZE;
+	ku.uio_segflg = UIO_SYSSPACE;
+	ku.uio_rw = UIO_WRITE;
+	ku.uio_space = NULL;
+
+	lock_release(buf_lock);
+	result = FSOP_BLOCKIO(bufs[0]->b_fs, &ku);
+	lock_acquire(buf_lock);
+	if (result == 0) {
+		for (i=0; i<n; i++) {
+			buf_makeclean(bufs[i]);
+		}
+		buf_writebacks += n;
+		buf_writereqs++;
+	}
+	return result;
+}
+
+/*
+ * Sort buffers by filesystem and block. Batches are small, so
+ * insertion sort does.
+ */
+static
+bool
+buf_before(struct buf *a, struct buf *b)
+{
+	if (a->b_fs != b->b_fs) {
+		return (uintptr_t)a->b_fs < (uintptr_t)b->b_fs;
+	}
+	return a->b_block < b->b_block;
+}
+
+static
+void
+buf_sort(struct buf **bufs, unsigned n)
+{
+	struct buf *b;
+	unsigned i, j;
+
+	for (i=1; i<n; i++) {
+		b = bufs[i];
+		for (j=i; j>0 && buf_before(b, bufs[j-1]); j--) {
+			bufs[j] = bufs[j-1];
+		}
+		bufs[j] = b;
+	}
+}
+
+/*
+ * Write back the N buffers in BUFS, which we have references to, and
+ * drop the references. Those someone else is holding are skipped
+ * unless WAIT is set, in which case they're done afterwards, one at a
+ * time. Returns the first error.
+ */
+static
+int
+buf_writebatch(struct buf **bufs, unsigned n, bool wait)
+{
+	struct buf *busy[BUF_BATCH];
+	unsigned i, j, nheld, nbusy;
+	int result, err = 0;
+
+	KASSERT(n <= BUF_BATCH);
+
+	buf_sort(bufs, n);
+
+	/* Hold what we can without waiting. */
+	nheld = nbusy = 0;
+	for (i=0; i<n; i++) {
+		if (bufs[i]->b_busy) {
+			busy[nbusy++] = bufs[i];
+		}
+		else {
+			bufs[i]->b_busy = true;
+			bufs[nheld++] = bufs[i];
+		}
+	}
+
+	/* Write out each run of consecutive dirty blocks. */
+	for (i=0; i<nheld; i=j) {
+		if (!bufs[i]->b_dirty) {
+			j = i + 1;
+			continue;
+		}
+		for (j=i+1; j<nheld && j-i<BUF_MAXRUN; j++) {
+			if (!bufs[j]->b_dirty ||
+			    bufs[j]->b_fs != bufs[i]->b_fs ||
+			    bufs[j]->b_block != bufs[i]->b_block + (j-i)) {
+				break;
+			}
+		}
+		result = buf_writerun(&bufs[i], j - i);
+		if (result && err == 0) {
+			err = result;
+		}
+	}
+	for (i=0; i<nheld; i++) {
+		buf_unhold(bufs[i]);
+	}
+
+	for (i=0; i<nbusy; i++) {
+		if (!wait) {
+			buf_unref(busy[i]);
+			continue;
+		}
+		buf_acquire(busy[i]);
+		if (busy[i]->b_dirty) {
+			result = buf_writerun(&busy[i], 1);
+			if (result && err == 0) {
+				err = result;
+			}
+		}
+		buf_unhold(busy[i]);
+	}
+	return err;
+}
+
+/*
+ * Find, or make, the buffer for BLOCK of FS and hold it. It isn't
+ * necessarily valid. Counts a hit or a miss if READING.
+ */
+static
+int
+buf_getbuf(struct fs *fs, daddr_t block, bool reading, struct buf **ret)
+{
+	struct buf *b;
+	int result;
+
+	KASSERT(fs != NULL);
+	KASSERT(fs->fs_ops->fsop_blockio != NULL);
+
+	lock_acquire(buf_lock);
+ again:
+	b = buf_lookup(fs, block);
+	if (b != NULL) {
+		buf_hold(b);
+		if (reading) {
+			if (b->b_valid) {
+				buf_hits++;
+				if (b->b_prefetched) {
+					b->b_prefetched = false;
+					buf_pfhits++;
+				}
+			}
+			else {
+				buf_misses++;
+			}
+		}
+		lock_release(buf_lock);
+		*ret = b;
+		return 0;
+	}
+
+	b = (buf_num < buf_max) ? NULL : buf_lruhead;
+	if (b == NULL) {
+		b = buf_create();
+		if (b == NULL) {
+			lock_release(buf_lock);
+			return ENOMEM;
+		}
+	}
+	else {
+		/* Take the oldest one; write it back first if needed. */
+		buf_hold(b);
+		if (b->b_dirty) {
+			result = buf_writerun(&b, 1);
+			if (result) {
+				buf_unhold(b);
+				lock_release(buf_lock);
+				return result;
+			}
+		}
+		if (b->b_refcount > 1) {
+			/* Someone wanted it while we were writing. */
+			buf_unhold(b);
+			goto again;
+		}
+		/* We slept, so someone else may have made ours. */
+		if (buf_lookup(fs, block) != NULL) {
+			buf_unhold(b);
+			goto again;
+		}
+		buf_hashout(b);
+		buf_evictions++;
+	}
+
+	KASSERT(!b->b_dirty);
+	b->b_fs = fs;
+	b->b_block = block;
+	b->b_valid = false;
+	b->b_prefetched = false;
+	buf_hashin(b);
+	b->b_refcount = 1;
+	b->b_busy = true;
+	if (reading) {
+		buf_misses++;
+	}
+	lock_release(buf_lock);
+
+	*ret = b;
+	return 0;
+}
+
+/*
+ * Read the contents of held buffer B from disk if they aren't valid
+ * already. On error the buffer is discarded.
+ */
+static
+int
+buf_readin(struct buf *b)
+{
+	struct iovec iov;
+	struct uio ku;
+	int result;
+
+	KASSERT(b->b_busy);
+
+	if (b->b_valid) {
+		return 0;
+	}
+	uio_kinit(&iov, &ku, b->b_data, BUF_SIZE,
+		  (off_t)b->b_block * BUF_SIZE, UIO_READ);
+	result = FSOP_BLOCKIO(b->b_fs, &ku);
+	if (result) {
+		buf_discard(b);
+		return result;
+	}
+	lock_acquire(buf_lock);
+	b->b_valid = true;
+	lock_release(buf_lock);
+	return 0;
+}
+
+////////////////////////////////////////////////////////////
+// Prefetch
+
+/*
+ * A prefetch worker thread. Takes requests off the ring and reads
+ * each block into the cache, leaving it on the LRU list like any
+ * other released buffer.
+ */
+static
+void
+buf_prefetcher(void *unused, unsigned long which)
+{
+	struct fs *fs;
+	daddr_t block;
+	struct buf *b;
+	int result;
+
+	(void)unused;
+	KASSERT(which < BUF_PFTHREADS);
+
+	lock_acquire(buf_lock);
+	while (1) {
+		while (buf_pfqcount == 0) {
+			cv_wait(buf_pfcv, buf_lock);
+		}
+		fs = buf_pfqfs[buf_pfqhead];
+		block = buf_pfqblock[buf_pfqhead];
+		buf_pfqhead = (buf_pfqhead + 1) % BUF_PFQUEUE;
+		buf_pfqcount--;
+		buf_pffs[which] = fs;
+		lock_release(buf_lock);
+
+		result = buf_getbuf(fs, block, false, &b);
+		if (result == 0 && !b->b_valid) {
+			result = buf_readin(b);
+			if (result == 0) {
+				lock_acquire(buf_lock);
+				b->b_prefetched = true;
+				buf_prefetches++;
+				lock_release(buf_lock);
+				buf_release(b);
+			}
+		}
+		else if (result == 0) {
+			buf_release(b);
+		}
+
+		lock_acquire(buf_lock);
+		buf_pffs[which] = NULL;
+		/* For buf_dropall. */
+		cv_broadcast(buf_cv, buf_lock);
+	}
+}
+
+////////////////////////////////////////////////////////////
+// Syncer
+
+/*
+ * Collect up to BUF_BATCH dirty buffers nobody is using, oldest
+ * first: those older than the dirty age, or if PRESSED, any. Takes a
+ * reference to each.
+ */
+static
+unsigned
+buf_collectold(struct buf **bufs, bool pressed)
+{
+	struct buf *b;
+	uint64_t now;
+	unsigned n;
+
+	now = timeout_now();
+	n = 0;
+	for (b = buf_dirtyhead; b != NULL && n < BUF_BATCH;
+	     b = b->b_dirtynext) {
+		if (!pressed && now - b->b_dirtytime < buf_dirtyage * HZ) {
+			/* The rest are younger still. */
+			break;
+		}
+		if (b->b_refcount > 0) {
+			continue;
+		}
+		buf_ref(b);
+		bufs[n++] = b;
+	}
+	return n;
+}
+
+/*
+ * The syncer thread. Once a second, or when woken because there's
+ * too much dirty data, writes back old buffers. Once over the dirty
+ * limit it keeps going, regardless of age, until down to half the
+ * limit. Every dirty age it also has the filesystems push their own
+ * dirty metadata into the cache.
+ */
+static
+void
+buf_syncer(void *unused1, unsigned long unused2)
+{
+	struct buf *batch[BUF_BATCH];
+	uint64_t lastwriteback;
+	unsigned n;
+	bool pressed = false;
+
+	(void)unused1;
+	(void)unused2;
+
+	lastwriteback = timeout_now();
+	lock_acquire(buf_lock);
+	while (1) {
+		if (!pressed) {
+			(void)cv_timedwait(buf_syncercv, buf_lock, HZ);
+		}
+
+		if (timeout_now() - lastwriteback >= buf_dirtyage * HZ) {
+			lock_release(buf_lock);
+			vfs_writeback();
+			lock_acquire(buf_lock);
+			lastwriteback = timeout_now();
+		}
+
+		if (buf_ndirty >= buf_dirtylimit()) {
+			pressed = true;
+		}
+		n = buf_collectold(batch, pressed);
+		if (n == 0 || buf_writebatch(batch, n, false) != 0) {
+			/* Nothing more we can do for now. */
+			buf_syncerstalled = pressed;
+			pressed = false;
+		}
+		else {
+			buf_syncerstalled = false;
+			if (buf_ndirty <= buf_dirtylimit() / 2) {
+				pressed = false;
+			}
+		}
+		cv_broadcast(buf_throttlecv, buf_lock);
+	}
+}
+
+////////////////////////////////////////////////////////////
+// Interface
+
+void
+buf_bootstrap(void)
+{
+	unsigned i;
+
+	buf_lock = lock_create("buffer cache");
+	if (buf_lock == NULL) {
+		panic("buf_bootstrap: Out of memory\n");
+	}
+	buf_cv = cv_create("buffer cache");
+	if (buf_cv == NULL) {
+		panic("buf_bootstrap: Out of memory\n");
+	}
+	buf_syncercv = cv_create("syncer");
+	if (buf_syncercv == NULL) {
+		panic("buf_bootstrap: Out of memory\n");
+	}
+	buf_throttlecv = cv_create("buffer throttle");
+	if (buf_throttlecv == NULL) {
+		panic("buf_bootstrap: Out of memory\n");
+	}
+	buf_pfcv = cv_create("prefetch");
+	if (buf_pfcv == NULL) {
+		panic("buf_bootstrap: Out of memory\n");
+	}
+	buf_hash = kmalloc(BUF_HASHSIZE * sizeof(buf_hash[0]));
+	if (buf_hash == NULL) {
+		panic("buf_bootstrap: Out of memory\n");
+	}
+	for (i=0; i<BUF_HASHSIZE; i++) {
+		buf_hash[i] = NULL;
+	}
+}
+
+void
+buf_syncer_bootstrap(void)
+{
+	int result;
+
+	result = thread_fork("syncer", NULL, buf_syncer, NULL, 0);
+	if (result) {
+		panic("buf_syncer_bootstrap: thread_fork: %s\n",
+		      strerror(result));
+	}
+	lock_acquire(buf_lock);
+	buf_syncerrunning = true;
+	lock_release(buf_lock);
+}
+
+void
+buf_prefetch_bootstrap(void)
+{
+	unsigned i;
+	int result;
+
+	for (i=0; i<BUF_PFTHREADS; i++) {
+		result = thread_fork("prefetch", NULL, buf_prefetcher,
+				     NULL, i);
+		if (result) {
+			panic("buf_prefetch_bootstrap: thread_fork: %s\n",
+			      strerror(result));
+		}
+	}
+	lock_acquire(buf_lock);
+	buf_pfrunning = true;
+	lock_release(buf_lock);
+}
+
+int
+buf_read(struct fs *fs, daddr_t block, struct buf **ret)
+{
+	struct buf *b;
+	int result;
+
+	result = buf_getbuf(fs, block, true, &b);
+	if (result) {
+		return result;
+	}
+	result = buf_readin(b);
+	if (result) {
+		return result;
+	}
+	*ret = b;
+	return 0;
+}
+
+void
+buf_prefetch(struct fs *fs, daddr_t block)
+{
+	unsigned i, slot;
+
+	KASSERT(fs->fs_ops->fsop_blockio != NULL);
+
+	lock_acquire(buf_lock);
+	if (!buf_pfrunning || buf_lookup(fs, block) != NULL) {
+		lock_release(buf_lock);
+		return;
+	}
+	for (i=0; i<buf_pfqcount; i++) {
+		slot = (buf_pfqhead + i) % BUF_PFQUEUE;
+		if (buf_pfqfs[slot] == fs && buf_pfqblock[slot] == block) {
+			lock_release(buf_lock);
+			return;
+		}
+	}
+	if (buf_pfqcount == BUF_PFQUEUE) {
+		buf_pfdropped++;
+		lock_release(buf_lock);
+		return;
+	}
+	slot = (buf_pfqhead + buf_pfqcount) % BUF_PFQUEUE;
+	buf_pfqfs[slot] = fs;
+	buf_pfqblock[slot] = block;
+	buf_pfqcount++;
+	cv_signal(buf_pfcv, buf_lock);
+	lock_release(buf_lock);
+}
+
+int
+buf_get(struct fs *fs, daddr_t block, struct buf **ret)
+{
+	return buf_getbuf(fs, block, false, ret);
+}
+
+void *
+buf_map(struct buf *b)
+{
+	KASSERT(b->b_busy);
+	return b->b_data;
+}
+
+bool
+buf_isvalid(struct buf *b)
+{
+	KASSERT(b->b_busy);
+	return b->b_valid;
+}
+
+void
+buf_markdirty(struct buf *b)
+{
+	KASSERT(b->b_busy);
+
+	lock_acquire(buf_lock);
+	b->b_valid = true;
+	buf_makedirty(b);
+	lock_release(buf_lock);
+}
+
+void
+buf_release(struct buf *b)
+{
+	lock_acquire(buf_lock);
+	buf_unhold(b);
+	lock_release(buf_lock);
+}
+
+void
+buf_discard(struct buf *b)
+{
+	lock_acquire(buf_lock);
+	b->b_valid = false;
+	buf_makeclean(b);
+	buf_unhold(b);
+	lock_release(buf_lock);
+}
+
+/*
+ * Each dirty buffer is written at most once per call, marked with
+ * this call's pass number, so writers dirtying buffers behind us
+ * can't keep us going forever.
+ */
+int
+buf_flush(struct fs *fs)
+{
+	struct buf *batch[BUF_BATCH];
+	struct buf *b;
+	unsigned pass, n;
+	int result, err = 0;
+
+	lock_acquire(buf_lock);
+	pass = ++buf_flushpasses;
+	while (1) {
+		n = 0;
+		for (b = buf_dirtyhead; b != NULL && n < BUF_BATCH;
+		     b = b->b_dirtynext) {
+			if (b->b_fs == fs && b->b_flushpass != pass) {
+				b->b_flushpass = pass;
+				buf_ref(b);
+				batch[n++] = b;
+			}
+		}
+		if (n == 0) {
+			break;
+		}
+		result = buf_writebatch(batch, n, true);
+		if (result && err == 0) {
+			err = result;
+		}
+	}
+	cv_broadcast(buf_throttlecv, buf_lock);
+	lock_release(buf_lock);
+	return err;
+}
+
+/*
+ * The syncer or a prefetch worker may be holding the buffer, in the
+ * middle of writing or reading it, so wait for it like anyone else
+ * before clearing it; otherwise a read finishing afterwards would
+ * make it valid again. Once nobody else wants it, letting go of it
+ * destroys it.
+ */
+void
+buf_drop(struct fs *fs, daddr_t block)
+{
+	struct buf *b;
+
+	lock_acquire(buf_lock);
+	b = buf_lookup(fs, block);
+	if (b != NULL) {
+		buf_hold(b);
+		b->b_valid = false;
+		buf_makeclean(b);
+		buf_unhold(b);
+	}
+	lock_release(buf_lock);
+}
+
+/*
+ * The syncer may still have references to some of the buffers (from
+ * before they were flushed), so wait for those to go away. Likewise
+ * cancel any prefetches for FS and wait for those being read.
+ */
+void
+buf_dropall(struct fs *fs)
+{
+	struct buf *b, *next;
+	unsigned i, n, from, to;
+
+	lock_acquire(buf_lock);
+
+	n = buf_pfqcount;
+	buf_pfqcount = 0;
+	for (i=0; i<n; i++) {
+		from = (buf_pfqhead + i) % BUF_PFQUEUE;
+		if (buf_pfqfs[from] != fs) {
+			to = (buf_pfqhead + buf_pfqcount) % BUF_PFQUEUE;
+			buf_pfqfs[to] = buf_pfqfs[from];
+			buf_pfqblock[to] = buf_pfqblock[from];
+			buf_pfqcount++;
+		}
+	}
+	for (i=0; i<BUF_PFTHREADS; i++) {
+		while (buf_pffs[i] == fs) {
+			cv_wait(buf_cv, buf_lock);
+		}
+	}
+
+	for (i=0; i<BUF_HASHSIZE; i++) {
+	 again:
+		for (b = buf_hash[i]; b != NULL; b = next) {
+			next = b->b_hashnext;
+			if (b->b_fs != fs) {
+				continue;
+			}
+			if (b->b_refcount > 0) {
+				cv_wait(buf_cv, buf_lock);
+				goto again;
+			}
+			if (b->b_dirty) {
+				kprintf("buf: Discarding dirty block %u\n",
+					(unsigned)b->b_block);
+			}
+			buf_destroy(b);
+		}
+	}
+	lock_release(buf_lock);
+}
+
+void
+buf_throttle(void)
+{
+	lock_acquire(buf_lock);
+	if (buf_syncerrunning && buf_ndirty >= buf_dirtylimit()) {
+		buf_throttles++;
+		cv_signal(buf_syncercv, buf_lock);
+		while (buf_ndirty >= buf_dirtylimit() && !buf_syncerstalled) {
+			cv_wait(buf_throttlecv, buf_lock);
+		}
+	}
+	lock_release(buf_lock);
+}
+
+void
+buf_setmax(unsigned max)
+{
+	KASSERT(max >= BUF_MINMAX);
+
+	lock_acquire(buf_lock);
+	buf_max = max;
+	/* Free what we can now; the rest goes as it's released. */
+	while (buf_num > buf_max && buf_lruhead != NULL &&
+	       !buf_lruhead->b_dirty) {
+		buf_destroy(buf_lruhead);
+	}
+	lock_release(buf_lock);
+}
+
+void
+buf_setdirtyage(unsigned seconds)
+{
+	lock_acquire(buf_lock);
+	buf_dirtyage = seconds;
+	cv_signal(buf_syncercv, buf_lock);
+	lock_release(buf_lock);
+}
+
+void
+buf_setdirtymax(unsigned percent)
+{
+	KASSERT(percent > 0 && percent <= 100);
+
+	lock_acquire(buf_lock);
+	buf_dirtymax = percent;
+	cv_signal(buf_syncercv, buf_lock);
+	lock_release(buf_lock);
+}
+
+void
+buf_gettunables(unsigned *max, unsigned *dirtyage, unsigned *dirtymax)
+{
+	lock_acquire(buf_lock);
+	*max = buf_max;
+	*dirtyage = buf_dirtyage;
+	*dirtymax = buf_dirtymax;
+	lock_release(buf_lock);
+}
+
+void
+buf_printstats(void)
+{
+	unsigned lookups;
+
+	lock_acquire(buf_lock);
+	lookups = buf_hits + buf_misses;
+	kprintf("Buffer cache: %u buffers (max %u) of %u bytes\n",
+		buf_num, buf_max, BUF_SIZE);
+	kprintf("    %u reads, %u hits, %u misses, hit rate %u%%\n",
+		lookups, buf_hits, buf_misses,
+		lookups == 0 ? 0 : (unsigned)(buf_hits * 100ULL / lookups));
+	kprintf("    %u dirty (limit %u), dirty age %u seconds\n",
+		buf_ndirty, buf_dirtylimit(), buf_dirtyage);
+	kprintf("    %u writebacks in %u requests, %u evictions, "
+		"%u writers throttled\n",
+		buf_writebacks, buf_writereqs, buf_evictions, buf_throttles);
+	kprintf("    %u blocks prefetched, %u used, %u requests dropped\n",
+		buf_prefetches, buf_pfhits, buf_pfdropped);
+	lock_release(buf_lock);
+}
@@ -0,0 +1,416 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009, 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Name cache (see dcache.h).
+ *
+ * Every entry is on a hash chain, hashed on its directory and name,
+ * and on the LRU list, most recently used first. dcache_lock, a sleep
+ * lock, protects both, the generation number, and the statistics.
+ *
+ * Dropping an entry's references can make a filesystem reclaim the
+ * vnodes, which may mean I/O, so entries are taken out of the cache
+ * with the lock held and their references dropped after letting go.
+ *
+ * Statistics are kept per filesystem, on a list with one record for
+ * each filesystem that has been looked up in since it was mounted.
+ * Every filesystem with entries has a record, so the entry counts
+ * stay right.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <synch.h>
+#include <vnode.h>
+#include <dcache.h>
+
+/* Number of hash chains. */
+#define DCACHE_HASHSIZE	128
+
+struct dcentry {
+	struct vnode *dc_dir;		/* directory (referenced) */
+	struct vnode *dc_vn;		/* what's there (referenced) or NULL */
+	struct dcentry *dc_hashnext;	/* hash chain */
+	struct dcentry **dc_hashpprev;	/* pointer to us on hash chain */
+	struct dcentry *dc_lruprev;	/* LRU list */
+	struct dcentry *dc_lrunext;
+	char dc_name[DCACHE_NAMELEN+1];
+};
+
+struct dcstats {
+	struct fs *ds_fs;		/* filesystem */
+	unsigned ds_hits;		/* lookups found */
+	unsigned ds_neghits;		/* of which for names not there */
+	unsigned ds_misses;		/* lookups not found */
+	unsigned ds_entries;		/* entries in the cache */
+	struct dcstats *ds_next;
+};
+
+static struct lock *dcache_lock;
+static struct dcentry *dcache_hash[DCACHE_HASHSIZE];
+static struct dcentry *dcache_lruhead;	/* most recently used */
+static struct dcentry *dcache_lrutail;	/* least recently used */
+static unsigned dcache_num;		/* number of entries */
+static unsigned dcache_gen;		/* bumped by every purge */
+static struct dcstats *dcache_stats;
+
+void
+dcache_bootstrap(void)
+{
+	dcache_lock = lock_create("dcache");
+	if (dcache_lock == NULL) {
+		panic("dcache: Could not create lock\n");
+	}
+}
+
+////////////////////////////////////////////////////////////
+// Internals; all called with dcache_lock held.
+
+static
+unsigned
+dcache_hashfunc(struct vnode *dir, const char *name)
+{
+	unsigned h;
+
+	h = (unsigned)(uintptr_t)dir >> 4;
+	while (*name) {
+		h = h * 31 + (unsigned char)*name++;
+	}
+	return h % DCACHE_HASHSIZE;
+}
+
+static
+struct dcentry *
+dcache_find(struct vnode *dir, const char *name)
+{
+	struct dcentry *dc;
+
+	dc = dcache_hash[dcache_hashfunc(dir, name)];
+	while (dc != NULL) {
+		if (dc->dc_dir == dir && !strcmp(dc->dc_name, name)) {
+			return dc;
+		}
+		dc = dc->dc_hashnext;
+	}
+	return NULL;
+}
+
+/*
+ * Find the statistics for FS. If there are none yet and CREATE is
+ * set, start some; this can fail for lack of memory.
+ */
+static
+struct dcstats *
+dcache_getstats(struct fs *fs, bool create)
+{
+	struct dcstats *ds;
+
+	for (ds = dcache_stats; ds != NULL; ds = ds->ds_next) {
+		if (ds->ds_fs == fs) {
+			return ds;
+		}
+	}
+	if (!create) {
+		return NULL;
+	}
+	ds = kmalloc(sizeof(*ds));
+	if (ds == NULL) {
+		return NULL;
+	}
+	ds->ds_fs = fs;
+	ds->ds_hits = 0;
+	ds->ds_neghits = 0;
+	ds->ds_misses = 0;
+	ds->ds_entries = 0;
+	ds->ds_next = dcache_stats;
+	dcache_stats = ds;
+	return ds;
+}
+
+static
+void
+dcache_lru_remove(struct dcentry *dc)
+{
+	if (dc->dc_lruprev != NULL) {
+		dc->dc_lruprev->dc_lrunext = dc->dc_lrunext;
+	}
+	else {
+		dcache_lruhead = dc->dc_lrunext;
+	}
+	if (dc->dc_lrunext != NULL) {
+		dc->dc_lrunext->dc_lruprev = dc->dc_lruprev;
+	}
+	else {
+		dcache_lrutail = dc->dc_lruprev;
+	}
+}
+
+static
+void
+dcache_lru_addhead(struct dcentry *dc)
+{
+	dc->dc_lruprev = NULL;
+	dc->dc_lrunext = dcache_lruhead;
+	if (dcache_lruhead != NULL) {
+		dcache_lruhead->dc_lruprev = dc;
+	}
+	else {
+		dcache_lrutail = dc;
+	}
+	dcache_lruhead = dc;
+}
+
+/*
+ * Take an entry out of the cache. Its references are left for the
+ * caller to drop.
+ */
+static
+void
+dcache_remove(struct dcentry *dc)
+{
+	struct dcstats *ds;
+
+	*dc->dc_hashpprev = dc->dc_hashnext;
+	if (dc->dc_hashnext != NULL) {
+		dc->dc_hashnext->dc_hashpprev = dc->dc_hashpprev;
+	}
+	dcache_lru_remove(dc);
+
+	ds = dcache_getstats(dc->dc_dir->vn_fs, false);
+	KASSERT(ds != NULL && ds->ds_entries > 0);
+	ds->ds_entries--;
+	KASSERT(dcache_num > 0);
+	dcache_num--;
+}
+
+/*
+ * Drop an entry's references, without dcache_lock, and free it.
+ */
+static
+void
+dcache_destroy(struct dcentry *dc)
+{
+	if (dc->dc_vn != NULL) {
+		VOP_DECREF(dc->dc_vn);
+	}
+	VOP_DECREF(dc->dc_dir);
+	kfree(dc);
+}
+
+////////////////////////////////////////////////////////////
+// Interface
+
+bool
+dcache_cacheable(struct vnode *dir, const char *name)
+{
+	if (dir->vn_fs == NULL) {
+		/* a device */
+		return false;
+	}
+	if (name[0] == 0 || !strcmp(name, ".") || !strcmp(name, "..")) {
+		return false;
+	}
+	return strlen(name) <= DCACHE_NAMELEN && strchr(name, '/') == NULL;
+}
+
+bool
+dcache_lookup(struct vnode *dir, const char *name,
+	      struct vnode **ret, unsigned *gen)
+{
+	struct dcentry *dc;
+	struct dcstats *ds;
+
+	KASSERT(dcache_cacheable(dir, name));
+
+	lock_acquire(dcache_lock);
+	ds = dcache_getstats(dir->vn_fs, true);
+	dc = dcache_find(dir, name);
+	if (dc == NULL) {
+		if (ds != NULL) {
+			ds->ds_misses++;
+		}
+		*gen = dcache_gen;
+		lock_release(dcache_lock);
+		return false;
+	}
+
+	if (ds != NULL) {
+		ds->ds_hits++;
+		if (dc->dc_vn == NULL) {
+			ds->ds_neghits++;
+		}
+	}
+	dcache_lru_remove(dc);
+	dcache_lru_addhead(dc);
+	if (dc->dc_vn != NULL) {
+		VOP_INCREF(dc->dc_vn);
+	}
+	*ret = dc->dc_vn;
+	lock_release(dcache_lock);
+	return true;
+}
+
+void
+dcache_enter(struct vnode *dir, const char *name, struct vnode *vn,
+	     unsigned gen)
+{
+	struct dcentry *dc, *old = NULL, **chain;
+	struct dcstats *ds;
+
+	KASSERT(dcache_cacheable(dir, name));
+	KASSERT(vn == NULL || vn->vn_fs == dir->vn_fs);
+
+	lock_acquire(dcache_lock);
+	if (gen != dcache_gen || dcache_find(dir, name) != NULL) {
+		/* Possibly out of date already, or someone beat us to it. */
+		lock_release(dcache_lock);
+		return;
+	}
+	ds = dcache_getstats(dir->vn_fs, true);
+	if (ds == NULL) {
+		lock_release(dcache_lock);
+		return;
+	}
+
+	dc = kmalloc(sizeof(*dc));
+	if (dc == NULL) {
+		lock_release(dcache_lock);
+		return;
+	}
+	if (dcache_num >= DCACHE_MAX) {
+		/* Make room by throwing out the oldest entry. */
+		old = dcache_lrutail;
+		KASSERT(old != NULL);
+		dcache_remove(old);
+	}
+
+	VOP_INCREF(dir);
+	if (vn != NULL) {
+		VOP_INCREF(vn);
+	}
+	dc->dc_dir = dir;
+	dc->dc_vn = vn;
+	strcpy(dc->dc_name, name);
+
+	chain = &dcache_hash[dcache_hashfunc(dir, name)];
+	dc->dc_hashnext = *chain;
+	if (dc->dc_hashnext != NULL) {
+		dc->dc_hashnext->dc_hashpprev = &dc->dc_hashnext;
+	}
+	dc->dc_hashpprev = chain;
+	*chain = dc;
+	dcache_lru_addhead(dc);
+	ds->ds_entries++;
+	dcache_num++;
+	lock_release(dcache_lock);
+
+	if (old != NULL) {
+		dcache_destroy(old);
+	}
+}
+
+void
+dcache_purge(struct vnode *dir, const char *name)
+{
+	struct dcentry *dc;
+
+	if (!dcache_cacheable(dir, name)) {
+		return;
+	}
+
+	lock_acquire(dcache_lock);
+	dcache_gen++;
+	dc = dcache_find(dir, name);
+	if (dc != NULL) {
+		dcache_remove(dc);
+	}
+	lock_release(dcache_lock);
+
+	if (dc != NULL) {
+		dcache_destroy(dc);
+	}
+}
+
+void
+dcache_purgefs(struct fs *fs)
+{
+	struct dcentry *dc, *next, *doomed = NULL;
+	struct dcstats *ds, **dsp;
+
+	lock_acquire(dcache_lock);
+	dcache_gen++;
+	for (dc = dcache_lruhead; dc != NULL; dc = next) {
+		next = dc->dc_lrunext;
+		if (dc->dc_dir->vn_fs == fs) {
+			dcache_remove(dc);
+			/* The hash chain is free now; collect them on it. */
+			dc->dc_hashnext = doomed;
+			doomed = dc;
+		}
+	}
+	for (dsp = &dcache_stats; *dsp != NULL; dsp = &(*dsp)->ds_next) {
+		if ((*dsp)->ds_fs == fs) {
+			ds = *dsp;
+			KASSERT(ds->ds_entries == 0);
+			*dsp = ds->ds_next;
+			kfree(ds);
+			break;
+		}
+	}
+	lock_release(dcache_lock);
+
+	while (doomed != NULL) {
+		dc = doomed;
+		doomed = dc->dc_hashnext;
+		dcache_destroy(dc);
+	}
+}
+
+void
+dcache_printstats(void)
+{
+	struct dcstats *ds;
+	const char *name;
+	unsigned lookups;
+
+	lock_acquire(dcache_lock);
+	kprintf("Name cache: %u entries (max %u)\n", dcache_num, DCACHE_MAX);
+	for (ds = dcache_stats; ds != NULL; ds = ds->ds_next) {
+		name = FSOP_GETVOLNAME(ds->ds_fs);
+		lookups = ds->ds_hits + ds->ds_misses;
+		kprintf("    %s: %u lookups, %u hits (%u negative), "
+			"%u misses, hit rate %u%%, %u entries\n",
+			name != NULL ? name : "(unnamed)",
+			lookups, ds->ds_hits, ds->ds_neghits, ds->ds_misses,
+			lookups == 0 ? 0 :
+			(unsigned)(ds->ds_hits * 100ULL / lookups),
+			ds->ds_entries);
+	}
+	lock_release(dcache_lock);
+}
@@ -225,6 +225,21 @@ dev_isseekable(struct vnode *v)
 	return true;
 }
 
+/*
+ * For poll(). Devices that never block don't need a devop_poll.
+ */
+static
+int
+dev_poll(struct vnode *v, int events, struct pollwait *pw, int *revents)
+{
+	struct device *d = v->vn_data;
+
+	if (d->d_ops->devop_poll == NULL) {
+		return vop_poll_ready(v, events, pw, revents);
+	}
+	return DEVOP_POLL(d, events, pw, revents);
+}
+
 /*
  * For fsync() - meaningless, do nothing.
  */
@@ -335,10 +350,13 @@ static const struct vnode_ops dev_vnode_ops = {
 	.vop_stat = dev_stat,
 	.vop_gettype = dev_gettype,
 	.vop_isseekable = dev_isseekable,
+	.vop_poll = dev_poll,
 	.vop_fsync = null_fsync,
 	.vop_mmap = dev_mmap,
 	.vop_truncate = dev_truncate,
 	.vop_namefile = dev_namefile,
+	.vop_copyfrom = vopfail_copyfrom_xdev,
+	.vop_readahead = vop_readahead_none,
 	.vop_creat = vopfail_creat_notdir,
 	.vop_symlink = vopfail_symlink_notdir,
 	.vop_mkdir = vopfail_mkdir_notdir,
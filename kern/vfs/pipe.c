@@ -0,0 +1,630 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009, 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Pipes.
+ *
+ * The buffer is a ring of PIPE_NPAGES separately allocated pages
+ * (kmalloc can't give us more than one contiguous page), each
+ * allocated the first time a writer reaches it. One reader and one
+ * writer at a time work on the ring; the per-side sleep locks queue
+ * up the rest. The two sides only share the spinlock, which protects
+ * the ring indexes and is never held while copying, so a reader and
+ * a writer copy concurrently.
+ *
+ * When a reader finds the ring empty it leaves its uio in pp_direct
+ * before going to sleep. The next writer then copies straight from
+ * its own buffer into the reader's, skipping the ring and one of the
+ * two copies. The reader's buffer is in another address space, so
+ * this goes through vm_userpage; if the reader's page isn't resident
+ * the writer gives up and uses the ring, and the reader faults the
+ * page in itself when it copies out.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/poll.h>
+#include <stat.h>
+#include <lib.h>
+#include <uio.h>
+#include <spinlock.h>
+#include <wchan.h>
+#include <synch.h>
+#include <vm.h>
+#include <poll.h>
+#include <vnode.h>
+#include <pipe.h>
+
+#define PIPE_NPAGES	4
+#define PIPE_SIZE	(PIPE_NPAGES * PAGE_SIZE)
+
+struct pipe {
+	struct vnode pp_readvn;		/* the read end */
+	struct vnode pp_writevn;	/* the write end */
+
+	struct lock *pp_readlock;	/* held for each whole read */
+	struct lock *pp_writelock;	/* held for each whole write */
+
+	struct spinlock pp_lock;	/* protects the fields below */
+	struct wchan *pp_readwchan;	/* reader waiting for data */
+	struct wchan *pp_writewchan;	/* writer waiting for space */
+	bool pp_readopen;		/* read end still open */
+	bool pp_writeopen;		/* write end still open */
+	unsigned pp_head;		/* ring offset of first byte */
+	unsigned pp_count;		/* bytes in the ring */
+	struct uio *pp_direct;		/* waiting reader's uio, or NULL */
+	bool pp_directbusy;		/* a writer is filling a reader's uio */
+
+	struct pollhead pp_pollhead;	/* pollers on either end */
+
+	/* Only the writer allocates these, so no lock needed. */
+	char *pp_pages[PIPE_NPAGES];
+};
+
+/*
+ * Free a pipe once both ends are gone.
+ */
+static
+void
+pipe_destroy(struct pipe *pp)
+{
+	unsigned i;
+
+	KASSERT(pp->pp_direct == NULL);
+	KASSERT(!pp->pp_directbusy);
+
+	for (i=0; i<PIPE_NPAGES; i++) {
+		if (pp->pp_pages[i] != NULL) {
+			kfree(pp->pp_pages[i]);
+		}
+	}
+	pollhead_cleanup(&pp->pp_pollhead);
+	wchan_destroy(pp->pp_writewchan);
+	wchan_destroy(pp->pp_readwchan);
+	spinlock_cleanup(&pp->pp_lock);
+	lock_destroy(pp->pp_writelock);
+	lock_destroy(pp->pp_readlock);
+	kfree(pp);
+}
+
+/*
+ * Copy from the writer's uio WUIO into a waiting reader's uio RUIO,
+ * for as long as the reader's pages are resident. Sets *MOVED to the
+ * number of bytes copied.
+ */
+static
+int
+pipe_directcopy(struct uio *ruio, struct uio *wuio, size_t *moved)
+{
+	struct iovec *iov;
+	vaddr_t uaddr, kaddr;
+	size_t len;
+	int result;
+
+	KASSERT(ruio->uio_rw == UIO_READ);
+	KASSERT(wuio->uio_rw == UIO_WRITE);
+
+	*moved = 0;
+	while (ruio->uio_resid > 0 && wuio->uio_resid > 0) {
+		iov = ruio->uio_iov;
+		if (iov->iov_len == 0) {
+			KASSERT(ruio->uio_iovcnt > 1);
+			ruio->uio_iov++;
+			ruio->uio_iovcnt--;
+			continue;
+		}
+
+		len = iov->iov_len;
+		if (ruio->uio_segflg == UIO_SYSSPACE) {
+			kaddr = (vaddr_t)iov->iov_kbase;
+		}
+		else {
+			/* Not our address space; one page at a time. */
+			uaddr = (vaddr_t)iov->iov_ubase;
+			kaddr = vm_userpage(ruio->uio_space, uaddr, true);
+			if (kaddr == 0) {
+				break;
+			}
+			if (len > PAGE_SIZE - uaddr % PAGE_SIZE) {
+				len = PAGE_SIZE - uaddr % PAGE_SIZE;
+			}
+		}
+		if (len > wuio->uio_resid) {
+			len = wuio->uio_resid;
+		}
+
+		result = uiomove((void *)kaddr, len, wuio);
+		if (result) {
+			return result;
+		}
+
+		/* What uiomove would have done to the reader's uio. */
+		iov->iov_kbase = (char *)iov->iov_kbase + len;
+		iov->iov_len -= len;
+		ruio->uio_resid -= len;
+		ruio->uio_offset += len;
+		*moved += len;
+	}
+	return 0;
+}
+
+/*
+ * Called for read.
+ *
+ * Returns as soon as some data has been read, like other Unix pipes;
+ * waits only if there's nothing at all. Returns 0 bytes (EOF) if the
+ * ring is empty and the write end is closed.
+ */
+static
+int
+pipe_read(struct vnode *v, struct uio *uio)
+{
+	struct pipe *pp = v->vn_data;
+	size_t startresid, len;
+	unsigned offset;
+	char *page;
+	int result;
+
+	if (v != &pp->pp_readvn) {
+		return EBADF;
+	}
+	KASSERT(uio->uio_rw == UIO_READ);
+
+	startresid = uio->uio_resid;
+	result = 0;
+
+	lock_acquire(pp->pp_readlock);
+	spinlock_acquire(&pp->pp_lock);
+	while (uio->uio_resid > 0) {
+		if (pp->pp_count == 0) {
+			if (uio->uio_resid < startresid || !pp->pp_writeopen) {
+				break;
+			}
+
+			/*
+			 * Offer our buffer to the next writer and wait
+			 * for it, for data to show up in the ring
+			 * anyway (from a write already under way), or
+			 * for the write end to close. Once a writer has
+			 * taken the buffer we must stay put until it's
+			 * done with it.
+			 */
+			pp->pp_direct = uio;
+			while (pp->pp_directbusy ||
+			       (pp->pp_direct == uio && pp->pp_count == 0 &&
+				pp->pp_writeopen)) {
+				wchan_sleep(pp->pp_readwchan, &pp->pp_lock);
+			}
+			pp->pp_direct = NULL;
+			continue;
+		}
+
+		offset = pp->pp_head;
+		len = pp->pp_count;
+		if (len > PAGE_SIZE - offset % PAGE_SIZE) {
+			len = PAGE_SIZE - offset % PAGE_SIZE;
+		}
+		if (len > uio->uio_resid) {
+			len = uio->uio_resid;
+		}
+		page = pp->pp_pages[offset / PAGE_SIZE];
+		KASSERT(page != NULL);
+
+		spinlock_release(&pp->pp_lock);
+		result = uiomove(page + offset % PAGE_SIZE, len, uio);
+		spinlock_acquire(&pp->pp_lock);
+		if (result) {
+			break;
+		}
+
+		pp->pp_head = (pp->pp_head + len) % PIPE_SIZE;
+		pp->pp_count -= len;
+		wchan_wakeall(pp->pp_writewchan, &pp->pp_lock);
+		pollhead_wakeup(&pp->pp_pollhead);
+	}
+	spinlock_release(&pp->pp_lock);
+	lock_release(pp->pp_readlock);
+
+	return result;
+}
+
+/*
+ * Called for write.
+ *
+ * Holds the write lock throughout, so writes from different threads
+ * never interleave. Waits for space as needed; fails with EPIPE if
+ * the read end is closed before anything could be written.
+ */
+static
+int
+pipe_write(struct vnode *v, struct uio *uio)
+{
+	struct pipe *pp = v->vn_data;
+	struct uio *ruio;
+	size_t startresid, len, moved;
+	unsigned offset;
+	char *page;
+	int result;
+
+	if (v != &pp->pp_writevn) {
+		return EBADF;
+	}
+	KASSERT(uio->uio_rw == UIO_WRITE);
+
+	startresid = uio->uio_resid;
+	result = 0;
+
+	lock_acquire(pp->pp_writelock);
+	spinlock_acquire(&pp->pp_lock);
+	while (uio->uio_resid > 0) {
+		if (!pp->pp_readopen) {
+			result = EPIPE;
+			break;
+		}
+
+		/*
+		 * If a reader is waiting, fill its buffer directly.
+		 * Only when the ring is empty, though, or we'd get
+		 * ahead of what's in it.
+		 */
+		if (pp->pp_direct != NULL && pp->pp_count == 0) {
+			ruio = pp->pp_direct;
+			pp->pp_direct = NULL;
+			pp->pp_directbusy = true;
+			spinlock_release(&pp->pp_lock);
+
+			result = pipe_directcopy(ruio, uio, &moved);
+
+			spinlock_acquire(&pp->pp_lock);
+			pp->pp_directbusy = false;
+			wchan_wakeall(pp->pp_readwchan, &pp->pp_lock);
+			pollhead_wakeup(&pp->pp_pollhead);
+			if (result) {
+				break;
+			}
+			if (moved > 0) {
+				continue;
+			}
+			/* Reader's page isn't resident; use the ring. */
+		}
+
+		if (pp->pp_count == PIPE_SIZE) {
+			wchan_sleep(pp->pp_writewchan, &pp->pp_lock);
+			continue;
+		}
+
+		offset = (pp->pp_head + pp->pp_count) % PIPE_SIZE;
+		len = PIPE_SIZE - pp->pp_count;
+		if (len > PAGE_SIZE - offset % PAGE_SIZE) {
+			len = PAGE_SIZE - offset % PAGE_SIZE;
+		}
+		if (len > uio->uio_resid) {
+			len = uio->uio_resid;
+		}
+		spinlock_release(&pp->pp_lock);
+
+		page = pp->pp_pages[offset / PAGE_SIZE];
+		if (page == NULL) {
+			page = kmalloc(PAGE_SIZE);
+			if (page == NULL) {
+				spinlock_acquire(&pp->pp_lock);
+				result = ENOMEM;
+				break;
+			}
+			pp->pp_pages[offset / PAGE_SIZE] = page;
+		}
+		result = uiomove(page + offset % PAGE_SIZE, len, uio);
+
+		spinlock_acquire(&pp->pp_lock);
+		if (result) {
+			break;
+		}
+		pp->pp_count += len;
+		wchan_wakeall(pp->pp_readwchan, &pp->pp_lock);
+		pollhead_wakeup(&pp->pp_pollhead);
+	}
+	spinlock_release(&pp->pp_lock);
+	lock_release(pp->pp_writelock);
+
+	if (result == EPIPE && uio->uio_resid < startresid) {
+		/* report the partial write; the next one gets EPIPE */
+		result = 0;
+	}
+	return result;
+}
+
+/*
+ * Called when the last reference to one end goes away. Wake up
+ * anyone on the other end so they see EOF or EPIPE, and free the
+ * pipe if both ends are now gone.
+ */
+static
+int
+pipe_reclaim(struct vnode *v)
+{
+	struct pipe *pp = v->vn_data;
+	bool destroy;
+
+	spinlock_acquire(&pp->pp_lock);
+	if (v == &pp->pp_readvn) {
+		KASSERT(pp->pp_readopen);
+		pp->pp_readopen = false;
+		wchan_wakeall(pp->pp_writewchan, &pp->pp_lock);
+	}
+	else {
+		KASSERT(v == &pp->pp_writevn);
+		KASSERT(pp->pp_writeopen);
+		pp->pp_writeopen = false;
+		wchan_wakeall(pp->pp_readwchan, &pp->pp_lock);
+	}
+	pollhead_wakeup(&pp->pp_pollhead);
+	destroy = !pp->pp_readopen && !pp->pp_writeopen;
+	spinlock_release(&pp->pp_lock);
+
+	/* Nothing can look a pipe up, so no new references can appear. */
+	vnode_cleanup(v);
+
+	if (destroy) {
+		pipe_destroy(pp);
+	}
+	return 0;
+}
+
+/*
+ * Called for each open. Pipes can't be opened by name, so this
+ * isn't reached.
+ */
+static
+int
+pipe_eachopen(struct vnode *v, int flags)
+{
+	(void)v;
+	(void)flags;
+	return EINVAL;
+}
+
+/*
+ * Called for ioctl(). No ioctls.
+ */
+static
+int
+pipe_ioctl(struct vnode *v, int op, userptr_t data)
+{
+	(void)v;
+	(void)op;
+	(void)data;
+	return EINVAL;
+}
+
+/*
+ * Called for stat(). The size is the number of bytes waiting to be
+ * read.
+ */
+static
+int
+pipe_stat(struct vnode *v, struct stat *statbuf)
+{
+	struct pipe *pp = v->vn_data;
+
+	bzero(statbuf, sizeof(struct stat));
+
+	spinlock_acquire(&pp->pp_lock);
+	statbuf->st_size = pp->pp_count;
+	spinlock_release(&pp->pp_lock);
+
+	statbuf->st_mode = S_IFIFO | 0600;
+	statbuf->st_nlink = 1;
+	statbuf->st_blksize = PIPE_SIZE;
+	return 0;
+}
+
+/*
+ * Return the type.
+ */
+static
+int
+pipe_gettype(struct vnode *v, mode_t *ret)
+{
+	(void)v;
+	*ret = S_IFIFO;
+	return 0;
+}
+
+/*
+ * Pipes aren't seekable.
+ */
+static
+bool
+pipe_isseekable(struct vnode *v)
+{
+	(void)v;
+	return false;
+}
+
+/*
+ * Called for poll(). The read end is readable when there's data, and
+ * hung up once the buffer is empty and the write end is closed. The
+ * write end is writable when there's space, and in error once the
+ * read end is closed.
+ */
+static
+int
+pipe_poll(struct vnode *v, int events, struct pollwait *pw, int *revents)
+{
+	struct pipe *pp = v->vn_data;
+
+	if (pw != NULL) {
+		pollwait_register(pw, &pp->pp_pollhead);
+	}
+
+	*revents = 0;
+	spinlock_acquire(&pp->pp_lock);
+	if (v == &pp->pp_readvn) {
+		if (pp->pp_count > 0) {
+			*revents |= events & (POLLIN | POLLRDNORM);
+		}
+		else if (!pp->pp_writeopen) {
+			*revents |= POLLHUP;
+		}
+	}
+	else {
+		if (!pp->pp_readopen) {
+			*revents |= POLLERR;
+		}
+		else if (pp->pp_count < PIPE_SIZE) {
+			*revents |= events & (POLLOUT | POLLWRNORM);
+		}
+	}
+	spinlock_release(&pp->pp_lock);
+
+	return 0;
+}
+
+/*
+ * For fsync() - nothing to do.
+ */
+static
+int
+pipe_fsync(struct vnode *v)
+{
+	(void)v;
+	return 0;
+}
+
+/*
+ * For ftruncate().
+ */
+static
+int
+pipe_truncate(struct vnode *v, off_t len)
+{
+	(void)v;
+	(void)len;
+	return EINVAL;
+}
+
+/*
+ * Function table for both ends of a pipe.
+ */
+static const struct vnode_ops pipe_vnode_ops = {
+	.vop_magic = VOP_MAGIC,
+
+	.vop_eachopen = pipe_eachopen,
+	.vop_reclaim = pipe_reclaim,
+	.vop_read = pipe_read,
+	.vop_readlink = vopfail_uio_inval,
+	.vop_getdirentry = vopfail_uio_notdir,
+	.vop_write = pipe_write,
+	.vop_ioctl = pipe_ioctl,
+	.vop_stat = pipe_stat,
+	.vop_gettype = pipe_gettype,
+	.vop_isseekable = pipe_isseekable,
+	.vop_poll = pipe_poll,
+	.vop_fsync = pipe_fsync,
+	.vop_mmap = vopfail_mmap_nosys,
+	.vop_truncate = pipe_truncate,
+	.vop_namefile = vopfail_uio_notdir,
+	.vop_copyfrom = vopfail_copyfrom_xdev,
+	.vop_readahead = vop_readahead_none,
+	.vop_creat = vopfail_creat_notdir,
+	.vop_symlink = vopfail_symlink_notdir,
+	.vop_mkdir = vopfail_mkdir_notdir,
+	.vop_link = vopfail_link_notdir,
+	.vop_remove = vopfail_string_notdir,
+	.vop_rmdir = vopfail_string_notdir,
+	.vop_rename = vopfail_rename_notdir,
+	.vop_lookup = vopfail_lookup_notdir,
+	.vop_lookparent = vopfail_lookparent_notdir,
+};
+
+/*
+ * Make a pipe.
+ */
+int
+pipe_create(struct vnode **readvn_ret, struct vnode **writevn_ret)
+{
+	struct pipe *pp;
+	unsigned i;
+	int result;
+
+	pp = kmalloc(sizeof(*pp));
+	if (pp == NULL) {
+		return ENOMEM;
+	}
+	pp->pp_readlock = lock_create("pipe read");
+	if (pp->pp_readlock == NULL) {
+		goto fail;
+	}
+	pp->pp_writelock = lock_create("pipe write");
+	if (pp->pp_writelock == NULL) {
+		goto fail_readlock;
+	}
+	pp->pp_readwchan = wchan_create("pipe read");
+	if (pp->pp_readwchan == NULL) {
+		goto fail_writelock;
+	}
+	pp->pp_writewchan = wchan_create("pipe write");
+	if (pp->pp_writewchan == NULL) {
+		goto fail_readwchan;
+	}
+	spinlock_init(&pp->pp_lock);
+	pp->pp_readopen = true;
+	pp->pp_writeopen = true;
+	pp->pp_head = 0;
+	pp->pp_count = 0;
+	pp->pp_direct = NULL;
+	pp->pp_directbusy = false;
+	pollhead_init(&pp->pp_pollhead);
+	for (i=0; i<PIPE_NPAGES; i++) {
+		pp->pp_pages[i] = NULL;
+	}
+
+	result = vnode_init(&pp->pp_readvn, &pipe_vnode_ops, NULL, pp);
+	if (result) {
+		panic("pipe_create: vnode_init: %s\n", strerror(result));
+	}
+	result = vnode_init(&pp->pp_writevn, &pipe_vnode_ops, NULL, pp);
+	if (result) {
+		panic("pipe_create: vnode_init: %s\n", strerror(result));
+	}
+
+	*readvn_ret = &pp->pp_readvn;
+	*writevn_ret = &pp->pp_writevn;
+	return 0;
+
+ fail_readwchan:
+	wchan_destroy(pp->pp_readwchan);
+ fail_writelock:
+	lock_destroy(pp->pp_writelock);
+ fail_readlock:
+	lock_destroy(pp->pp_readlock);
+ fail:
+	kfree(pp);
+	return ENOMEM;
+}
@@ -0,0 +1,170 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009, 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * File-to-file copy.
+ *
+ * The filesystem gets the first try (vop_copyfrom), since it may be
+ * able to move blocks around without going through a buffer at all.
+ * If it can't, usually because the two files are on different
+ * filesystems, we read into a kernel buffer and write back out; that
+ * still saves the trip through user space a read/write loop would
+ * make.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <uio.h>
+#include <vm.h>
+#include <vnode.h>
+#include <vfs.h>
+
+/*
+ * Size of the bounce buffer, in pages. kmalloc can't give us more
+ * than one page at a time, so it's a set of pages used as one uio.
+ */
+#define VFSCOPY_NPAGES	8
+
+/*
+ * Copy through a kernel buffer, a buffer-load at a time, until LEN
+ * bytes are done or SRC runs out.
+ */
+static
+int
+vfs_copy_buffered(struct vnode *dst, off_t dstpos,
+		  struct vnode *src, off_t srcpos, size_t len, size_t *copied)
+{
+	char *pages[VFSCOPY_NPAGES];
+	struct iovec iov[VFSCOPY_NPAGES];
+	struct uio ku;
+	size_t done, want, got, left;
+	unsigned npages, i;
+	int result;
+
+	*copied = 0;
+
+	/* Don't allocate more buffer than the copy needs. */
+	npages = 0;
+	while (npages < VFSCOPY_NPAGES && npages * PAGE_SIZE < len) {
+		pages[npages] = kmalloc(PAGE_SIZE);
+		if (pages[npages] == NULL) {
+			break;
+		}
+		npages++;
+	}
+	if (npages == 0) {
+		return len == 0 ? 0 : ENOMEM;
+	}
+
+	result = 0;
+	done = 0;
+	while (done < len) {
+		want = len - done;
+		if (want > npages * PAGE_SIZE) {
+			want = npages * PAGE_SIZE;
+		}
+
+		/* Read up to WANT bytes. */
+		left = want;
+		for (i=0; left > 0; i++) {
+			iov[i].iov_kbase = pages[i];
+			iov[i].iov_len = left < PAGE_SIZE ? left : PAGE_SIZE;
+			left -= iov[i].iov_len;
+		}
+		ku.uio_iov = iov;
+		ku.uio_iovcnt = i;
+		ku.uio_offset = srcpos + done;
+		ku.uio_resid = want;
+		ku.uio_segflg = UIO_SYSSPACE;
+		ku.uio_rw = UIO_READ;
+		ku.uio_space = NULL;
+		result = VOP_READ(src, &ku);
+		if (result) {
+			break;
+		}
+		got = want - ku.uio_resid;
+		if (got == 0) {
+			/* EOF */
+			break;
+		}
+
+		/* Write back what we got. */
+		left = got;
+		for (i=0; left > 0; i++) {
+			iov[i].iov_kbase = pages[i];
+			iov[i].iov_len = left < PAGE_SIZE ? left : PAGE_SIZE;
+			left -= iov[i].iov_len;
+		}
+		ku.uio_iov = iov;
+		ku.uio_iovcnt = i;
+		ku.uio_offset = dstpos + done;
+		ku.uio_resid = got;
+		ku.uio_rw = UIO_WRITE;
+		result = VOP_WRITE(dst, &ku);
+		done += got - ku.uio_resid;
+		if (result) {
+			break;
+		}
+		if (ku.uio_resid > 0) {
+			/* Short write; give up where it stopped. */
+			break;
+		}
+	}
+
+	for (i=0; i<npages; i++) {
+		kfree(pages[i]);
+	}
+	*copied = done;
+	return result;
+}
+
+/*
+ * Copy LEN bytes from SRC at SRCPOS to DST at DSTPOS. Sets *COPIED to
+ * the number of bytes copied, which is less than LEN if SRC ends
+ * first or if an error stopped the copy partway.
+ */
+int
+vfs_copy(struct vnode *dst, off_t dstpos, struct vnode *src, off_t srcpos,
+	 size_t len, size_t *copied)
+{
+	int result;
+
+	if (dst == src) {
+		*copied = 0;
+		return EINVAL;
+	}
+
+	result = VOP_COPYFROM(dst, dstpos, src, srcpos, len, copied);
+	if (result == EXDEV) {
+		result = vfs_copy_buffered(dst, dstpos, src, srcpos, len,
+					   copied);
+	}
+	return result;
+}
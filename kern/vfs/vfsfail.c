@@ -114,6 +114,37 @@ vopfail_truncate_isdir(struct vnode *vn, off_t pos)
 	return EISDIR;
 }
 
+////////////////////////////////////////////////////////////
+// copyfrom
+
+int
+vopfail_copyfrom_isdir(struct vnode *vn, off_t dstpos,
+		       struct vnode *src, off_t srcpos, size_t len,
+		       size_t *copied)
+{
+	(void)vn;
+	(void)dstpos;
+	(void)src;
+	(void)srcpos;
+	(void)len;
+	*copied = 0;
+	return EISDIR;
+}
+
+int
+vopfail_copyfrom_xdev(struct vnode *vn, off_t dstpos,
+		      struct vnode *src, off_t srcpos, size_t len,
+		      size_t *copied)
+{
+	(void)vn;
+	(void)dstpos;
+	(void)src;
+	(void)srcpos;
+	(void)len;
+	*copied = 0;
+	return EXDEV;
+}
+
 ////////////////////////////////////////////////////////////
 // creat
 
@@ -39,6 +39,7 @@
 #include <vfs.h>
 #include <fs.h>
 #include <vnode.h>
+#include <dcache.h>
 
 static struct vnode *bootfs_vnode = NULL;
 
@@ -234,6 +235,44 @@ getdevice(char *path, char **subpath, struct vnode **startvn)
 	return 0;
 }
 
+/*
+ * Look up PATH relative to DIR, trying the name cache first if PATH
+ * is a name it can hold. The name is copied because VOP_LOOKUP may
+ * destroy it.
+ */
+static
+int
+lookup_cached(struct vnode *dir, char *path, struct vnode **retval)
+{
+	char name[DCACHE_NAMELEN+1];
+	struct vnode *vn;
+	unsigned gen;
+	int result;
+
+	if (!dcache_cacheable(dir, path)) {
+		return VOP_LOOKUP(dir, path, retval);
+	}
+
+	if (dcache_lookup(dir, path, &vn, &gen)) {
+		if (vn == NULL) {
+			return ENOENT;
+		}
+		*retval = vn;
+		return 0;
+	}
+
+	strcpy(name, path);
+	result = VOP_LOOKUP(dir, path, &vn);
+	if (result == 0) {
+		dcache_enter(dir, name, vn, gen);
+		*retval = vn;
+	}
+	else if (result == ENOENT) {
+		dcache_enter(dir, name, NULL, gen);
+	}
+	return result;
+}
+
 /*
  * Name-to-vnode translation.
  * (In BSD, both of these are subsumed by namei().)
@@ -292,7 +331,7 @@ vfs_lookup(char *path, struct vnode **retval)
 		return 0;
 	}
 
-	result = VOP_LOOKUP(startvn, path, retval);
+	result = lookup_cached(startvn, path, retval);
 
 	VOP_DECREF(startvn);
 	vfs_biglock_release();
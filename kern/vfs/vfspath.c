@@ -38,6 +38,7 @@
 #include <lib.h>
 #include <vfs.h>
 #include <vnode.h>
+#include <dcache.h>
 
 
 /* Does most of the work for open(). */
@@ -67,13 +68,25 @@ vfs_open(char *path, int openflags, mode_t mode, struct vnode **ret)
 		char name[NAME_MAX+1];
 		struct vnode *dir;
 		int excl = (openflags & O_EXCL)!=0;
+		unsigned gen;
 
 		result = vfs_lookparent(path, &dir, name, sizeof(name));
 		if (result) {
 			return result;
 		}
 
-		result = VOP_CREAT(dir, name, excl, mode, &vn);
+		/*
+		 * If the name cache says the file is there, and that's
+		 * allowed, there's nothing to create.
+		 */
+		if (!excl && dcache_cacheable(dir, name) &&
+		    dcache_lookup(dir, name, &vn, &gen) && vn != NULL) {
+			result = 0;
+		}
+		else {
+			result = VOP_CREAT(dir, name, excl, mode, &vn);
+			dcache_purge(dir, name);
+		}
 
 		VOP_DECREF(dir);
 	}
@@ -146,6 +159,7 @@ vfs_remove(char *path)
 	}
 
 	result = VOP_REMOVE(dir, name);
+	dcache_purge(dir, name);
 	VOP_DECREF(dir);
 
 	return result;
@@ -179,6 +193,8 @@ vfs_rename(char *oldpath, char *newpath)
 	}
 
 	result = VOP_RENAME(olddir, oldname, newdir, newname);
+	dcache_purge(olddir, oldname);
+	dcache_purge(newdir, newname);
 
 	VOP_DECREF(newdir);
 	VOP_DECREF(olddir);
@@ -213,6 +229,7 @@ vfs_link(char *oldpath, char *newpath)
 	}
 
 	result = VOP_LINK(newdir, newname, oldfile);
+	dcache_purge(newdir, newname);
 
 	VOP_DECREF(newdir);
 	VOP_DECREF(oldfile);
@@ -240,6 +257,7 @@ vfs_symlink(const char *contents, char *path)
 	}
 
 	result = VOP_SYMLINK(newdir, newname, contents);
+	dcache_purge(newdir, newname);
 	VOP_DECREF(newdir);
 
 	return result;
@@ -286,6 +304,7 @@ vfs_mkdir(char *path, mode_t mode)
 	}
 
 	result = VOP_MKDIR(parent, name, mode);
+	dcache_purge(parent, name);
 
 	VOP_DECREF(parent);
 
@@ -308,6 +327,7 @@ vfs_rmdir(char *path)
 	}
 
 	result = VOP_RMDIR(parent, name);
+	dcache_purge(parent, name);
 
 	VOP_DECREF(parent);
 
@@ -0,0 +1,191 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009, 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Readiness notification (see poll.h).
+ *
+ * Each registration is a pollentry linking one pollwait to one
+ * pollhead. It's on two lists: the pollhead's, which pollhead_wakeup
+ * walks, and the pollwait's, which pollwait_cleanup walks to take the
+ * entries back off the pollheads.
+ *
+ * Lock order is pollhead, then pollwait. Once pollwait_cleanup has
+ * taken an entry off its pollhead (under the pollhead's lock) no
+ * wakeup can reach the pollwait through it, so it's then safe to free.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <wchan.h>
+#include <poll.h>
+
+struct pollentry {
+	struct pollwait *pe_wait;	/* who registered */
+	struct pollhead *pe_head;	/* where */
+	struct pollentry *pe_next;	/* next on pollhead */
+	struct pollentry **pe_pprev;	/* pointer to us on pollhead */
+	struct pollentry *pe_waitnext;	/* next on pollwait */
+};
+
+////////////////////////////////////////////////////////////
+// pollhead
+
+void
+pollhead_init(struct pollhead *ph)
+{
+	spinlock_init(&ph->ph_lock);
+	ph->ph_entries = NULL;
+}
+
+void
+pollhead_cleanup(struct pollhead *ph)
+{
+	KASSERT(ph->ph_entries == NULL);
+	spinlock_cleanup(&ph->ph_lock);
+}
+
+void
+pollhead_wakeup(struct pollhead *ph)
+{
+	struct pollentry *pe;
+	struct pollwait *pw;
+
+	spinlock_acquire(&ph->ph_lock);
+	for (pe = ph->ph_entries; pe != NULL; pe = pe->pe_next) {
+		pw = pe->pe_wait;
+		spinlock_acquire(&pw->pw_lock);
+		pw->pw_woken = true;
+		wchan_wakeall(pw->pw_wchan, &pw->pw_lock);
+		spinlock_release(&pw->pw_lock);
+	}
+	spinlock_release(&ph->ph_lock);
+}
+
+////////////////////////////////////////////////////////////
+// pollwait
+
+int
+pollwait_init(struct pollwait *pw)
+{
+	pw->pw_wchan = wchan_create("poll");
+	if (pw->pw_wchan == NULL) {
+		return ENOMEM;
+	}
+	spinlock_init(&pw->pw_lock);
+	pw->pw_woken = false;
+	pw->pw_error = 0;
+	pw->pw_entries = NULL;
+	return 0;
+}
+
+void
+pollwait_cleanup(struct pollwait *pw)
+{
+	struct pollentry *pe;
+	struct pollhead *ph;
+
+	while (pw->pw_entries != NULL) {
+		pe = pw->pw_entries;
+		pw->pw_entries = pe->pe_waitnext;
+
+		ph = pe->pe_head;
+		spinlock_acquire(&ph->ph_lock);
+		*pe->pe_pprev = pe->pe_next;
+		if (pe->pe_next != NULL) {
+			pe->pe_next->pe_pprev = pe->pe_pprev;
+		}
+		spinlock_release(&ph->ph_lock);
+
+		kfree(pe);
+	}
+
+	spinlock_cleanup(&pw->pw_lock);
+	wchan_destroy(pw->pw_wchan);
+}
+
+void
+pollwait_register(struct pollwait *pw, struct pollhead *ph)
+{
+	struct pollentry *pe;
+
+	/* Once is enough; the same pollhead often serves several fds. */
+	for (pe = pw->pw_entries; pe != NULL; pe = pe->pe_waitnext) {
+		if (pe->pe_head == ph) {
+			return;
+		}
+	}
+
+	pe = kmalloc(sizeof(*pe));
+	if (pe == NULL) {
+		pw->pw_error = ENOMEM;
+		return;
+	}
+	pe->pe_wait = pw;
+	pe->pe_head = ph;
+	pe->pe_waitnext = pw->pw_entries;
+	pw->pw_entries = pe;
+
+	spinlock_acquire(&ph->ph_lock);
+	pe->pe_next = ph->ph_entries;
+	if (pe->pe_next != NULL) {
+		pe->pe_next->pe_pprev = &pe->pe_next;
+	}
+	pe->pe_pprev = &ph->ph_entries;
+	ph->ph_entries = pe;
+	spinlock_release(&ph->ph_lock);
+}
+
+int
+pollwait_sleep(struct pollwait *pw, unsigned ticks)
+{
+	int result = 0;
+
+	if (pw->pw_error) {
+		return pw->pw_error;
+	}
+
+	spinlock_acquire(&pw->pw_lock);
+	while (!pw->pw_woken) {
+		if (ticks == 0) {
+			wchan_sleep(pw->pw_wchan, &pw->pw_lock);
+		}
+		else {
+			result = wchan_timedsleep(pw->pw_wchan, &pw->pw_lock,
+						  ticks);
+			if (result) {
+				break;
+			}
+		}
+	}
+	pw->pw_woken = false;
+	spinlock_release(&pw->pw_lock);
+
+	return result;
+}
@@ -32,6 +32,7 @@
  */
 #include <types.h>
 #include <kern/errno.h>
+#include <kern/poll.h>
 #include <lib.h>
 #include <synch.h>
 #include <vfs.h>
@@ -176,3 +177,30 @@ vnode_check(struct vnode *v, const char *opstr)
 	spinlock_release(&v->vn_countlock);
 	/*vfs_biglock_release();*/
 }
+
+/*
+ * vop_poll for objects that never make anyone wait: ready for
+ * reading and writing, always, so there's nothing to register for.
+ */
+int
+vop_poll_ready(struct vnode *vn, int events, struct pollwait *pw,
+	       int *revents)
+{
+	(void)vn;
+	(void)pw;
+
+	*revents = events & (POLLIN | POLLRDNORM | POLLOUT | POLLWRNORM);
+	return 0;
+}
+
+/*
+ * vop_readahead for objects where reading ahead doesn't help, or that
+ * don't have anywhere to put what's read.
+ */
+void
+vop_readahead_none(struct vnode *vn, off_t pos, off_t len)
+{
+	(void)vn;
+	(void)pos;
+	(void)len;
+}
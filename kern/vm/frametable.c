@@ -53,11 +53,13 @@ vaddr_t alloc_kpages(unsigned int npages)
 		if(frameTable != NULL){
 			//we support only one page
 			if(npages != 1){
+				spinlock_release(&frameTable_lock);
 				return 0;
 			}
 			
 			//If there is no more free frame
 			if (first_free_index == -1){
+				spinlock_release(&frameTable_lock);
 				return 0;
 			}
 			
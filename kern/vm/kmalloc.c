@@ -29,8 +29,13 @@
 
 #include <types.h>
 #include <lib.h>
+#include <spl.h>
 #include <spinlock.h>
+#include <cpu.h>
+#include <current.h>
 #include <vm.h>
+#include <kmallocprof.h>
+#include <platform/maxcpus.h>
 
 /*
  * Kernel malloc.
@@ -160,10 +165,8 @@ struct pageref {
 ////////////////////////////////////////
 
 /*
- * Use one spinlock for the whole thing. Making parts of the kmalloc
- * logic per-cpu is worthwhile for scalability; however, for the time
- * being at least we won't, because it adds a lot of complexity and in
- * OS/161 performance and scalability aren't super-critical.
+ * Use one spinlock for the pages and pagerefs. Most kmalloc and kfree
+ * calls don't take it, though; see "Per-CPU magazines" below.
  */
 
 static struct spinlock kmalloc_spinlock = SPINLOCK_INITIALIZER;
@@ -345,6 +348,71 @@ freepageref(struct pageref *p)
 static struct pageref *sizebases[NSIZES];
 static struct pageref *allbase;
 
+/*
+ * Map from physical page number to the pageref for that page, if it
+ * is a subpage allocator page, so kfree can find a block's pageref
+ * (and thus its size) without searching allbase. This covers the
+ * same 16M as the pagerefs; heap pages above that, if there were
+ * any, would be found by searching.
+ *
+ * Entries change only with kmalloc_spinlock held, when a page is
+ * taken into or released from the subpage allocator. An entry can be
+ * read without the lock by someone who owns a block on that page,
+ * since the page can't be released while the block is in use.
+ */
+#define PAGEMAP_SIZE TOTAL_PAGEREFS
+
+static struct pageref *pagemap[PAGEMAP_SIZE];
+
+////////////////////////////////////////
+
+/*
+ * Per-CPU magazines.
+ *
+ * Each CPU keeps, for each block size, a magazine: a small stack of
+ * free blocks. Subpage kmalloc and kfree use the current CPU's
+ * magazine with just interrupts off, and only go to the pages (and
+ * kmalloc_spinlock) when it's empty or full. Then they move half a
+ * magazine's worth of blocks at once, so the lock is taken at most
+ * once every several calls, and rarely at all by a CPU whose
+ * allocations and frees roughly balance out.
+ *
+ * As far as the pages are concerned, blocks in magazines are in use.
+ * So when memory runs short (a page allocation fails), the CPU that
+ * noticed gives back everything in its magazines, frees whatever
+ * pages that empties, and retries; and it bumps mag_draingen, which
+ * asks every other CPU to do the same the next time it touches its
+ * magazines. A CPU can only touch its own, so that's the best it can
+ * do without interrupting the others.
+ *
+ * Magazines are bypassed in early boot before curthread exists. They
+ * are compiled out with GUARDS and LABELS, which need to see every
+ * allocation and free.
+ */
+#if !defined(GUARDS) && !defined(LABELS)
+#define MAGAZINES
+#endif
+
+#ifdef MAGAZINES
+
+/* Most blocks in a magazine, and most bytes for the big sizes. */
+#define MAG_ROUNDS 16
+#define MAG_BYTES  PAGE_SIZE
+
+struct magazine {
+	unsigned m_rounds;		/* number of blocks held */
+	void *m_blocks[MAG_ROUNDS];	/* the blocks; top is most recent */
+};
+
+/* Only touched by the CPU they belong to, at splhigh. */
+static struct magazine magazines[MAXCPUS][NSIZES];
+static unsigned mag_drainseen[MAXCPUS];	/* mag_draingen when last drained */
+
+/* Bumped (under kmalloc_spinlock) to ask every CPU to drain. */
+static volatile unsigned mag_draingen;
+
+#endif /* MAGAZINES */
+
 ////////////////////////////////////////
 
 #ifdef GUARDS
@@ -812,10 +880,100 @@ kheap_printstats(void)
 	}
 
 	spinlock_release(&kmalloc_spinlock);
+
+#ifdef MAGAZINES
+	{
+		unsigned i, j, n;
+
+		/* unlocked, so possibly slightly stale */
+		kprintf("Blocks held in per-CPU magazines:\n");
+		for (j=0; j<NSIZES; j++) {
+			n = 0;
+			for (i=0; i<MAXCPUS; i++) {
+				n += magazines[i][j].m_rounds;
+			}
+			kprintf("   size %-4lu  %u\n",
+				(unsigned long)sizes[j], n);
+		}
+	}
+#endif
 }
 
 ////////////////////////////////////////
 
+/*
+ * Set the pagemap entry for PAGE.
+ */
+static
+void
+pagemap_set(vaddr_t page, struct pageref *pr)
+{
+	paddr_t pagenum;
+
+	KASSERT(spinlock_do_i_hold(&kmalloc_spinlock));
+
+	pagenum = KVADDR_TO_PADDR(page) / PAGE_SIZE;
+	if (pagenum < PAGEMAP_SIZE) {
+		pagemap[pagenum] = pr;
+	}
+}
+
+/*
+ * Get the pagemap entry for the page containing ADDR. Returns NULL
+ * both for pages that aren't subpage pages and for pages outside the
+ * map.
+ */
+static
+struct pageref *
+pagemap_get(vaddr_t addr)
+{
+	paddr_t pagenum;
+
+	/* addresses outside KSEG0 wrap around to out of range */
+	pagenum = KVADDR_TO_PADDR(addr) / PAGE_SIZE;
+	if (pagenum < PAGEMAP_SIZE) {
+		return pagemap[pagenum];
+	}
+	return NULL;
+}
+
+/*
+ * Find the pageref for the page containing ADDR, or NULL if it isn't
+ * a subpage page. Caller must hold kmalloc_spinlock.
+ */
+static
+struct pageref *
+pageref_lookup(vaddr_t addr)
+{
+	struct pageref *pr;
+	vaddr_t prpage;
+	paddr_t pagenum;
+
+	KASSERT(spinlock_do_i_hold(&kmalloc_spinlock));
+
+	pagenum = KVADDR_TO_PADDR(addr) / PAGE_SIZE;
+	if (pagenum < PAGEMAP_SIZE) {
+		pr = pagemap[pagenum];
+		if (pr != NULL) {
+			checksubpage(pr);
+		}
+		return pr;
+	}
+
+	for (pr = allbase; pr; pr = pr->next_all) {
+		prpage = PR_PAGEADDR(pr);
+
+		/* check for corruption */
+		KASSERT(PR_BLOCKTYPE(pr) < NSIZES);
+		checksubpage(pr);
+
+		if (addr >= prpage && addr < prpage + PAGE_SIZE) {
+			return pr;
+		}
+	}
+	return NULL;
+}
+
 /*
  * Remove a pageref from both lists that it's on.
  */
@@ -867,18 +1025,18 @@ int blocktype(size_t clientsz)
 }
 
 /*
- * Allocate a block of size SZ, where SZ is not large enough to
- * warrant a whole-page allocation.
+ * Take a free block of type BLKTYPE off one of the pages, getting a
+ * fresh page if none has one. Called with kmalloc_spinlock held.
+ * Returns NULL if out of memory.
+ *
+ * We release the spinlock while calling alloc_kpages. This avoids
+ * deadlock if alloc_kpages needs to come back here. Note that this
+ * means things can change behind our back...
  */
 static
 void *
-subpage_kmalloc(size_t sz
-#ifdef LABELS
-		, vaddr_t label
-#endif
-	)
+subpage_getblock(unsigned blktype)
 {
-	unsigned blktype;	// index into sizes[] that we're using
 	struct pageref *pr;	// pageref for page we're allocating from
 	vaddr_t prpage;		// PR_PAGEADDR(pr)
 	vaddr_t fla;		// free list entry address
@@ -887,27 +1045,7 @@ subpage_kmalloc(size_t sz
 
 	volatile int i;
 
-#ifdef GUARDS
-	size_t clientsz;
-#endif
-
-#ifdef GUARDS
-	clientsz = sz;
-	sz += GUARD_OVERHEAD;
-#endif
-#ifdef LABELS
-#ifdef GUARDS
-	/* Include the label in what GUARDS considers the client data. */
-	clientsz += LABEL_PTROFFSET;
-#endif
-	sz += LABEL_PTROFFSET;
-#endif
-	blktype = blocktype(sz);
-#ifdef GUARDS
-	sz = sizes[blktype];
-#endif
-
-	spinlock_acquire(&kmalloc_spinlock);
+	KASSERT(spinlock_do_i_hold(&kmalloc_spinlock));
 
 	checksubpages();
 
@@ -940,16 +1078,9 @@ subpage_kmalloc(size_t sz
 				KASSERT(pr->nfree == 0);
 				pr->freelist_offset = INVALID_OFFSET;
 			}
-#ifdef GUARDS
-			retptr = establishguardband(retptr, clientsz, sz);
-#endif
-#ifdef LABELS
-			retptr = establishlabel(retptr, label);
-#endif
 
 			checksubpages();
 
-			spinlock_release(&kmalloc_spinlock);
 			return retptr;
 		}
 	}
@@ -957,10 +1088,6 @@ subpage_kmalloc(size_t sz
 	/*
 	 * No page of the right size available.
 	 * Make a new one.
-	 *
-	 * We release the spinlock while calling alloc_kpages. This
-	 * avoids deadlock if alloc_kpages needs to come back here.
-	 * Note that this means things can change behind our back...
 	 */
 
 	spinlock_release(&kmalloc_spinlock);
@@ -968,6 +1095,7 @@ subpage_kmalloc(size_t sz
 	if (prpage==0) {
 		/* Out of memory. */
 		kprintf("kmalloc: Subpage allocator couldn't get a page\n");
+		spinlock_acquire(&kmalloc_spinlock);
 		return NULL;
 	}
 	KASSERT(prpage % PAGE_SIZE == 0);
@@ -983,6 +1111,7 @@ subpage_kmalloc(size_t sz
 		spinlock_release(&kmalloc_spinlock);
 		free_kpages(prpage);
 		kprintf("kmalloc: Subpage allocator couldn't get pageref\n");
+		spinlock_acquire(&kmalloc_spinlock);
 		return NULL;
 	}
 
@@ -1013,21 +1142,24 @@ subpage_kmalloc(size_t sz
 	pr->next_all = allbase;
 	allbase = pr;
 
+	pagemap_set(prpage, pr);
+
 	/* This is kind of cheesy, but avoids duplicating the alloc code. */
 	goto doalloc;
 }
 
 /*
- * Free a pointer previously returned from subpage_kmalloc. If the
- * pointer is not on any heap page we recognize, return -1.
+ * Put the block at PTRADDR back on the free list of its page, whose
+ * pageref is PR. Called with kmalloc_spinlock held. If this leaves
+ * the whole page free, the pageref is released and the page address
+ * returned, for the caller to pass to free_kpages once it has
+ * dropped the spinlock; otherwise returns 0.
  */
 static
-int
-subpage_kfree(void *ptr)
+vaddr_t
+subpage_putblock(struct pageref *pr, vaddr_t ptraddr)
 {
 	int blktype;		// index into sizes[] that we're using
-	vaddr_t ptraddr;	// same as ptr
-	struct pageref *pr;	// pageref for page we're freeing in
 	vaddr_t prpage;		// PR_PAGEADDR(pr)
 	vaddr_t fla;		// free list entry address
 	struct freelist *fl;	// free list entry
@@ -1036,64 +1168,17 @@ subpage_kfree(void *ptr)
 	size_t blocksize, smallerblocksize;
 #endif
 
-	ptraddr = (vaddr_t)ptr;
-#ifdef GUARDS
-	if (ptraddr % PAGE_SIZE == 0) {
-		/*
-		 * With guard bands, all client-facing subpage
-		 * pointers are offset by GUARD_PTROFFSET (which is 4)
-		 * from the underlying blocks and are therefore not
-		 * page-aligned. So a page-aligned pointer is not one
-		 * of ours. Catch this up front, as otherwise
-		 * subtracting GUARD_PTROFFSET could give a pointer on
-		 * a page we *do* own, and then we'll panic because
-		 * it's not a valid one.
-		 */
-		return -1;
-	}
-	ptraddr -= GUARD_PTROFFSET;
-#endif
-#ifdef LABELS
-	if (ptraddr % PAGE_SIZE == 0) {
-		/* ditto */
-		return -1;
-	}
-	ptraddr -= LABEL_PTROFFSET;
-#endif
-
-	spinlock_acquire(&kmalloc_spinlock);
-
-	checksubpages();
-
-	/* Silence warnings with gcc 4.8 -Og (but not -O2) */
-	prpage = 0;
-	blktype = 0;
-
-	for (pr = allbase; pr; pr = pr->next_all) {
-		prpage = PR_PAGEADDR(pr);
-		blktype = PR_BLOCKTYPE(pr);
-		KASSERT(blktype >= 0 && blktype < NSIZES);
-
-		/* check for corruption */
-		KASSERT(blktype>=0 && blktype<NSIZES);
-		checksubpage(pr);
-
-		if (ptraddr >= prpage && ptraddr < prpage + PAGE_SIZE) {
-			break;
-		}
-	}
-
-	if (pr==NULL) {
-		/* Not on any of our pages - not a subpage allocation */
-		spinlock_release(&kmalloc_spinlock);
-		return -1;
-	}
+	KASSERT(spinlock_do_i_hold(&kmalloc_spinlock));
 
+	prpage = PR_PAGEADDR(pr);
+	blktype = PR_BLOCKTYPE(pr);
+	KASSERT(blktype >= 0 && blktype < NSIZES);
 	offset = ptraddr - prpage;
 
 	/* Check for proper positioning and alignment */
 	if (offset >= PAGE_SIZE || offset % sizes[blktype] != 0) {
-		panic("kfree: subpage free of invalid addr %p\n", ptr);
+		panic("kfree: subpage free of invalid addr 0x%lx\n",
+		      (unsigned long)ptraddr);
 	}
 
 #ifdef GUARDS
@@ -1141,13 +1226,358 @@ subpage_kfree(void *ptr)
 	if (pr->nfree == PAGE_SIZE / sizes[blktype]) {
 		/* Whole page is free. */
 		remove_lists(pr, blktype);
+		pagemap_set(prpage, NULL);
 		freepageref(pr);
-		/* Call free_kpages without kmalloc_spinlock. */
+		return prpage;
+	}
+	return 0;
+}
+
+#ifdef MAGAZINES
+
+/*
+ * Number of blocks a magazine of type BLKTYPE holds.
+ */
+static
+unsigned
+mag_capacity(unsigned blktype)
+{
+	unsigned cap;
+
+	cap = MAG_BYTES / sizes[blktype];
+	return cap < MAG_ROUNDS ? cap : MAG_ROUNDS;
+}
+
+/*
+ * Give the oldest N blocks in MAG back to the pages, freeing any page
+ * that leaves empty. Call at splhigh.
+ */
+static
+void
+mag_flush(struct magazine *mag, unsigned n)
+{
+	struct pageref *pr;
+	vaddr_t addr, freepage;
+	unsigned i;
+
+	KASSERT(n <= mag->m_rounds);
+	if (n == 0) {
+		return;
+	}
+
+	spinlock_acquire(&kmalloc_spinlock);
+	for (i=0; i<n; i++) {
+		addr = (vaddr_t)mag->m_blocks[i];
+		pr = pageref_lookup(addr);
+		KASSERT(pr != NULL);
+		freepage = subpage_putblock(pr, addr);
+		if (freepage != 0) {
+			spinlock_release(&kmalloc_spinlock);
+			free_kpages(freepage);
+			spinlock_acquire(&kmalloc_spinlock);
+		}
+	}
+	spinlock_release(&kmalloc_spinlock);
+	for (i=n; i<mag->m_rounds; i++) {
+		mag->m_blocks[i - n] = mag->m_blocks[i];
+	}
+	mag->m_rounds -= n;
+}
+
+/*
+ * Empty all of the current CPU's magazines. Call at splhigh.
+ */
+static
+void
+mag_drainmine(void)
+{
+	unsigned cpu, j;
+
+	cpu = curcpu->c_number;
+	KASSERT(cpu < MAXCPUS);
+	mag_drainseen[cpu] = mag_draingen;
+	for (j=0; j<NSIZES; j++) {
+		mag_flush(&magazines[cpu][j], magazines[cpu][j].m_rounds);
+	}
+}
+
+/*
+ * Memory is short: empty the current CPU's magazines now, and ask
+ * the other CPUs to empty theirs.
+ */
+static
+void
+mag_drain(void)
+{
+	int s;
+
+	s = splhigh();
+	spinlock_acquire(&kmalloc_spinlock);
+	mag_draingen++;
+	spinlock_release(&kmalloc_spinlock);
+	mag_drainmine();
+	splx(s);
+}
+
+/*
+ * Get the current CPU's magazine for BLKTYPE, first draining them
+ * all if another CPU has asked. Call at splhigh.
+ */
+static
+struct magazine *
+mag_mine(unsigned blktype)
+{
+	unsigned cpu;
+
+	cpu = curcpu->c_number;
+	KASSERT(cpu < MAXCPUS);
+	if (mag_drainseen[cpu] != mag_draingen) {
+		mag_drainmine();
+	}
+	return &magazines[cpu][blktype];
+}
+
+/*
+ * Fill the empty magazine MAG, of type BLKTYPE, halfway from the
+ * pages, or as far as memory allows. Call at splhigh.
+ */
+static
+void
+mag_refill(struct magazine *mag, unsigned blktype)
+{
+	unsigned i, batch;
+	void *block;
+
+	KASSERT(mag->m_rounds == 0);
+
+	batch = mag_capacity(blktype) / 2;
+	spinlock_acquire(&kmalloc_spinlock);
+	for (i=0; i<batch; i++) {
+		block = subpage_getblock(blktype);
+		if (block == NULL) {
+			break;
+		}
+		mag->m_blocks[mag->m_rounds++] = block;
+	}
+	spinlock_release(&kmalloc_spinlock);
+}
+
+/*
+ * Allocate a block of type BLKTYPE from the current CPU's magazine,
+ * refilling it first if it's empty.
+ */
+static
+void *
+mag_get(unsigned blktype)
+{
+	struct magazine *mag;
+	void *block;
+	int s;
+
+	s = splhigh();
+	mag = mag_mine(blktype);
+
+	if (mag->m_rounds == 0) {
+		mag_refill(mag, blktype);
+		if (mag->m_rounds == 0) {
+			/* No page to be had; give back ours and retry. */
+			mag_drain();
+			mag_refill(mag, blktype);
+		}
+		if (mag->m_rounds == 0) {
+			splx(s);
+			return NULL;
+		}
+	}
+
+	block = mag->m_blocks[--mag->m_rounds];
+	splx(s);
+	return block;
+}
+
+/*
+ * Free the block at PTRADDR, managed by pageref PR, into the current
+ * CPU's magazine. If the magazine is full, first flush the older
+ * half of it back to the pages.
+ */
+static
+void
+mag_put(struct pageref *pr, vaddr_t ptraddr)
+{
+	struct magazine *mag;
+	unsigned blktype, cap;
+	vaddr_t offset;
+	int s;
+#ifdef SLOW
+	unsigned i;
+#endif
+
+	blktype = PR_BLOCKTYPE(pr);
+	KASSERT(blktype < NSIZES);
+	offset = ptraddr - PR_PAGEADDR(pr);
+	if (offset >= PAGE_SIZE || offset % sizes[blktype] != 0) {
+		panic("kfree: subpage free of invalid addr 0x%lx\n",
+		      (unsigned long)ptraddr);
+	}
+
+	s = splhigh();
+	mag = mag_mine(blktype);
+	cap = mag_capacity(blktype);
+
+#ifdef SLOW
+	/* catch freeing the same block twice in quick succession */
+	for (i=0; i<mag->m_rounds; i++) {
+		KASSERT(mag->m_blocks[i] != (void *)ptraddr);
+	}
+#endif
+
+	if (mag->m_rounds == cap) {
+		mag_flush(mag, cap / 2);
+	}
+
+	mag->m_blocks[mag->m_rounds++] = (void *)ptraddr;
+	splx(s);
+}
+
+/*
+ * Free PTR into a magazine if it's a subpage block. Returns -1 if it
+ * isn't one (or we can't tell without searching, in which case
+ * subpage_kfree will do that).
+ *
+ * This looks at the page map without kmalloc_spinlock. That's safe
+ * because the caller owns the block, so its page can't be released
+ * or reused meanwhile.
+ */
+static
+int
+mag_kfree(void *ptr)
+{
+	struct pageref *pr;
+
+	pr = pagemap_get((vaddr_t)ptr);
+	if (pr == NULL) {
+		return -1;
+	}
+	mag_put(pr, (vaddr_t)ptr);
+	return 0;
+}
+
+#endif /* MAGAZINES */
+
+/*
+ * Allocate a block of size SZ, where SZ is not large enough to
+ * warrant a whole-page allocation.
+ */
+static
+void *
+subpage_kmalloc(size_t sz
+#ifdef LABELS
+		, vaddr_t label
+#endif
+	)
+{
+	unsigned blktype;	// index into sizes[] that we're using
+	void *retptr;		// our result
+
+#ifdef GUARDS
+	size_t clientsz;
+#endif
+
+#ifdef GUARDS
+	clientsz = sz;
+	sz += GUARD_OVERHEAD;
+#endif
+#ifdef LABELS
+#ifdef GUARDS
+	/* Include the label in what GUARDS considers the client data. */
+	clientsz += LABEL_PTROFFSET;
+#endif
+	sz += LABEL_PTROFFSET;
+#endif
+	blktype = blocktype(sz);
+#ifdef GUARDS
+	sz = sizes[blktype];
+#endif
+
+#ifdef MAGAZINES
+	if (CURCPU_EXISTS()) {
+		return mag_get(blktype);
+	}
+#endif
+
+	spinlock_acquire(&kmalloc_spinlock);
+
+	retptr = subpage_getblock(blktype);
+	if (retptr == NULL) {
 		spinlock_release(&kmalloc_spinlock);
-		free_kpages(prpage);
+		return NULL;
+	}
+
+#ifdef GUARDS
+	retptr = establishguardband(retptr, clientsz, sz);
+#endif
+#ifdef LABELS
+	retptr = establishlabel(retptr, label);
+#endif
+
+	spinlock_release(&kmalloc_spinlock);
+	return retptr;
+}
+
+/*
+ * Free a pointer previously returned from subpage_kmalloc. If the
+ * pointer is not on any heap page we recognize, return -1.
+ */
+static
+int
+subpage_kfree(void *ptr)
+{
+	vaddr_t ptraddr;	// same as ptr
+	struct pageref *pr;	// pageref for page we're freeing in
+	vaddr_t freepage;	// page to release, if any
+
+	ptraddr = (vaddr_t)ptr;
+#ifdef GUARDS
+	if (ptraddr % PAGE_SIZE == 0) {
+		/*
+		 * With guard bands, all client-facing subpage
+		 * pointers are offset by GUARD_PTROFFSET (which is 4)
+		 * from the underlying blocks and are therefore not
+		 * page-aligned. So a page-aligned pointer is not one
+		 * of ours. Catch this up front, as otherwise
+		 * subtracting GUARD_PTROFFSET could give a pointer on
+		 * a page we *do* own, and then we'll panic because
+		 * it's not a valid one.
+		 */
+		return -1;
+	}
+	ptraddr -= GUARD_PTROFFSET;
+#endif
+#ifdef LABELS
+	if (ptraddr % PAGE_SIZE == 0) {
+		/* ditto */
+		return -1;
 	}
-	else {
+	ptraddr -= LABEL_PTROFFSET;
+#endif
+
+	spinlock_acquire(&kmalloc_spinlock);
+
+	checksubpages();
+
+	pr = pageref_lookup(ptraddr);
+	if (pr==NULL) {
+		/* Not on any of our pages - not a subpage allocation */
 		spinlock_release(&kmalloc_spinlock);
+		return -1;
+	}
+
+	freepage = subpage_putblock(pr, ptraddr);
+
+	/* Call free_kpages without kmalloc_spinlock. */
+	spinlock_release(&kmalloc_spinlock);
+	if (freepage != 0) {
+		free_kpages(freepage);
 	}
 
 #ifdef SLOWER /* Don't get the lock unless checksubpages does something. */
@@ -1159,6 +1589,7 @@ subpage_kfree(void *ptr)
 	return 0;
 }
 
+
 //
 ////////////////////////////////////////////////////////////
 
@@ -1170,17 +1601,21 @@ void *
 kmalloc(size_t sz)
 {
 	size_t checksz;
-#ifdef LABELS
+	void *ptr;
+#if defined(LABELS) || OPT_KMALLOCPROF
 	vaddr_t label;
 #endif
+#if OPT_KMALLOCPROF
+	struct pageref *pr;
+#endif
 
-#ifdef LABELS
+#if defined(LABELS) || OPT_KMALLOCPROF
 #ifdef __GNUC__
 	label = (vaddr_t)__builtin_return_address(0);
 #else
 #error "Don't know how to get return address with this compiler"
 #endif /* __GNUC__ */
-#endif /* LABELS */
+#endif /* LABELS || OPT_KMALLOCPROF */
 
 	checksz = sz + GUARD_OVERHEAD + LABEL_OVERHEAD;
 	if (checksz >= LARGEST_SUBPAGE_SIZE) {
@@ -1190,19 +1625,38 @@ kmalloc(size_t sz)
 		/* Round up to a whole number of pages. */
 		npages = (sz + PAGE_SIZE - 1)/PAGE_SIZE;
 		address = alloc_kpages(npages);
+#ifdef MAGAZINES
+		if (address == 0 && CURCPU_EXISTS()) {
+			/* Give back what the magazines hold and retry. */
+			mag_drain();
+			address = alloc_kpages(npages);
+		}
+#endif
 		if (address==0) {
 			return NULL;
 		}
 		KASSERT(address % PAGE_SIZE == 0);
+#if OPT_KMALLOCPROF
+		kmprof_allocpages(address, npages, label);
+#endif
 
 		return (void *)address;
 	}
 
 #ifdef LABELS
-	return subpage_kmalloc(sz, label);
+	ptr = subpage_kmalloc(sz, label);
 #else
-	return subpage_kmalloc(sz);
+	ptr = subpage_kmalloc(sz);
 #endif
+#if OPT_KMALLOCPROF
+	COMPILE_ASSERT(SMALLEST_SUBPAGE_SIZE >= KMPROF_GRAIN);
+	/* We own the block, so its page map entry can't change. */
+	pr = (ptr != NULL) ? pagemap_get((vaddr_t)ptr) : NULL;
+	if (pr != NULL) {
+		kmprof_allocblock(ptr, sizes[PR_BLOCKTYPE(pr)], label);
+	}
+#endif
+	return ptr;
 }
 
 /*
@@ -1211,12 +1665,31 @@ kmalloc(size_t sz)
 void
 kfree(void *ptr)
 {
+#if OPT_KMALLOCPROF
+	struct pageref *pr;
+#endif
+
 	/*
 	 * Try subpage first; if that fails, assume it's a big allocation.
 	 */
 	if (ptr == NULL) {
 		return;
-	} else if (subpage_kfree(ptr)) {
+	}
+#if OPT_KMALLOCPROF
+	pr = pagemap_get((vaddr_t)ptr);
+	if (pr != NULL) {
+		kmprof_freeblock(ptr, sizes[PR_BLOCKTYPE(pr)]);
+	}
+	else if ((vaddr_t)ptr % PAGE_SIZE == 0) {
+		kmprof_freepages((vaddr_t)ptr);
+	}
+#endif
+#ifdef MAGAZINES
+	if (CURCPU_EXISTS() && mag_kfree(ptr) == 0) {
+		return;
+	}
+#endif
+	if (subpage_kfree(ptr)) {
 		KASSERT((vaddr_t)ptr%PAGE_SIZE==0);
 		free_kpages((vaddr_t)ptr);
 	}
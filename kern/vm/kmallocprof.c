@@ -0,0 +1,541 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009, 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * kmalloc call-site profiling.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <spl.h>
+#include <spinlock.h>
+#include <membar.h>
+#include <cpu.h>
+#include <current.h>
+#include <vm.h>
+#include <copyinout.h>
+#include <kmallocprof.h>
+#include <platform/maxcpus.h>
+
+/*
+ * Size of the site table, and how far we probe. With the "other" slot
+ * that makes 256, so a site number fits in a byte and a CPU's
+ * counters fill a page.
+ */
+#define KMPROF_NSITES	255
+#define KMPROF_MAXPROBE	32
+
+/* Site number for allocations that didn't get a slot of their own. */
+#define KMPROF_OTHER	KMPROF_NSITES
+
+/* Pages covered by the page tables; this is all of System/161's RAM. */
+#define KMPROF_MAXPAGES	((16 * 1024 * 1024) / PAGE_SIZE)
+
+/* Bytes in a block map: one per KMPROF_GRAIN bytes of the page. */
+#define KMPROF_MAPSIZE	(PAGE_SIZE / KMPROF_GRAIN)
+
+/* Most sites kmprof_dump will print. */
+#define KMPROF_MAXDUMP	100
+
+struct kmprof_site {
+	vaddr_t ks_pc;			/* call site; 0 if slot is free */
+	size_t ks_peak;			/* most live seen by kmprof_read */
+};
+
+/*
+ * One CPU's counters for one site. Live bytes are allocbytes minus
+ * freebytes summed over all CPUs; the subtraction is right even after
+ * the counters wrap.
+ */
+struct kmprof_count {
+	uint32_t kc_allocs;
+	uint32_t kc_frees;
+	uint32_t kc_allocbytes;
+	uint32_t kc_freebytes;
+};
+
+/* Site for each whole-page allocation, by first physical page. */
+struct kmprof_page {
+	uint16_t kp_site;		/* site + 1, or 0 if not tracked */
+	uint16_t kp_npages;
+};
+
+static struct kmprof_site kmprof_sites[KMPROF_NSITES + 1];
+static struct kmprof_page kmprof_pages[KMPROF_MAXPAGES];
+
+/*
+ * Site of each subpage block, by physical page: a byte for each
+ * KMPROF_GRAIN bytes of the page, set for the byte a block starts in.
+ * A page's map is made the first time a block on it is allocated and
+ * kept from then on, whatever the page is used for later; it's
+ * rewritten block by block as they're allocated, so stale entries
+ * don't matter. Maps are carved out of whole pages.
+ */
+static uint8_t *kmprof_blockmaps[KMPROF_MAXPAGES];
+static uint8_t *kmprof_mappool;
+static unsigned kmprof_mappoolleft;
+
+/*
+ * Counters, per CPU and per site. Only the CPU they belong to touches
+ * them, at splhigh, so they need no lock. The boot CPU uses the
+ * static set, since it kmallocs before anything can be set up; the
+ * others get a page each the first time they kmalloc or kfree. A CPU
+ * that can't get one shares kmprof_sharedcounts under
+ * kmprof_sharedlock instead.
+ */
+static struct kmprof_count kmprof_bootcounts[KMPROF_NSITES + 1];
+static struct kmprof_count *kmprof_cpucounts[MAXCPUS];
+static struct kmprof_count kmprof_sharedcounts[KMPROF_NSITES + 1];
+
+/*
+ * Not struct spinlocks: these have to work from the first kmalloc,
+ * before anything could initialize those, and lockstat would
+ * otherwise report them. Use the machine-level lock word directly, as
+ * lockstat.c does. kmprof_claimlock is for claiming site slots and
+ * making block maps, and for updating peaks.
+ */
+static volatile spinlock_data_t kmprof_claimlock = SPINLOCK_DATA_INITIALIZER;
+static volatile spinlock_data_t kmprof_sharedlock = SPINLOCK_DATA_INITIALIZER;
+
+static
+int
+kmprof_lock(volatile spinlock_data_t *lk)
+{
+	int s;
+
+	s = splhigh();
+	while (spinlock_data_get(lk) != 0 ||
+	       spinlock_data_testandset(lk) != 0) {
+		/* spin */
+	}
+	membar_store_any();
+	return s;
+}
+
+static
+void
+kmprof_unlock(volatile spinlock_data_t *lk, int s)
+{
+	membar_any_store();
+	spinlock_data_set(lk, 0);
+	splx(s);
+}
+
+/*
+ * Find (or make) the table entry for call site PC.
+ *
+ * Slots only ever go from free to claimed, so searching doesn't need
+ * the lock; only claiming does.
+ */
+static
+unsigned
+kmprof_findsite(vaddr_t pc)
+{
+	unsigned i, index;
+	vaddr_t found;
+	int s;
+
+	index = (pc >> 2) % KMPROF_NSITES;
+	for (i=0; i<KMPROF_MAXPROBE; i++) {
+		found = kmprof_sites[index].ks_pc;
+		if (found == 0) {
+			s = kmprof_lock(&kmprof_claimlock);
+			found = kmprof_sites[index].ks_pc;
+			if (found == 0) {
+				kmprof_sites[index].ks_pc = found = pc;
+			}
+			kmprof_unlock(&kmprof_claimlock, s);
+		}
+		if (found == pc) {
+			return index;
+		}
+		index = (index + 1) % KMPROF_NSITES;
+	}
+	return KMPROF_OTHER;
+}
+
+/*
+ * Get the current CPU's counters, setting them up the first time.
+ * Call at splhigh. Sets *SHARED if they're kmprof_sharedcounts.
+ */
+static
+struct kmprof_count *
+kmprof_mycounts(bool *shared)
+{
+	struct kmprof_count *counts;
+	unsigned cpu;
+
+	COMPILE_ASSERT(sizeof(kmprof_bootcounts) <= PAGE_SIZE);
+
+	*shared = false;
+	if (!CURCPU_EXISTS()) {
+		/* Early boot; there's only the boot CPU. */
+		return kmprof_bootcounts;
+	}
+	cpu = curcpu->c_number;
+	KASSERT(cpu < MAXCPUS);
+	counts = kmprof_cpucounts[cpu];
+	if (counts != NULL) {
+		return counts;
+	}
+
+	if (cpu == 0) {
+		counts = kmprof_bootcounts;
+	}
+	else {
+		counts = (struct kmprof_count *)alloc_kpages(1);
+		if (counts == NULL) {
+			*shared = true;
+			return kmprof_sharedcounts;
+		}
+		bzero(counts, sizeof(kmprof_bootcounts));
+	}
+	/* Zeroed before readers can find them. */
+	membar_store_store();
+	kmprof_cpucounts[cpu] = counts;
+	return counts;
+}
+
+/*
+ * Count an allocation (or, if ISFREE, a free) of BYTES for SITE.
+ */
+static
+void
+kmprof_count(unsigned site, size_t bytes, bool isfree)
+{
+	struct kmprof_count *kc;
+	bool shared;
+	int s, s2;
+
+	s = splhigh();
+	kc = &kmprof_mycounts(&shared)[site];
+	s2 = shared ? kmprof_lock(&kmprof_sharedlock) : 0;
+	if (isfree) {
+		kc->kc_frees++;
+		kc->kc_freebytes += bytes;
+	}
+	else {
+		kc->kc_allocs++;
+		kc->kc_allocbytes += bytes;
+	}
+	if (shared) {
+		kmprof_unlock(&kmprof_sharedlock, s2);
+	}
+	splx(s);
+}
+
+/*
+ * Get the block map for physical page PAGENUM, making it if need be.
+ * Returns NULL if there's no memory for one.
+ */
+static
+uint8_t *
+kmprof_getmap(paddr_t pagenum)
+{
+	uint8_t *map;
+	int s;
+
+	map = kmprof_blockmaps[pagenum];
+	if (map != NULL) {
+		membar_load_load();
+		return map;
+	}
+
+	s = kmprof_lock(&kmprof_claimlock);
+	map = kmprof_blockmaps[pagenum];
+	if (map == NULL) {
+		if (kmprof_mappoolleft == 0) {
+			kmprof_mappool = (uint8_t *)alloc_kpages(1);
+			if (kmprof_mappool != NULL) {
+				kmprof_mappoolleft = PAGE_SIZE /
+					KMPROF_MAPSIZE;
+			}
+		}
+		if (kmprof_mappoolleft > 0) {
+			map = kmprof_mappool;
+			kmprof_mappool += KMPROF_MAPSIZE;
+			kmprof_mappoolleft--;
+			/* Blocks allocated before now weren't counted. */
+			memset(map, KMPROF_OTHER, KMPROF_MAPSIZE);
+			membar_store_store();
+			kmprof_blockmaps[pagenum] = map;
+		}
+	}
+	kmprof_unlock(&kmprof_claimlock, s);
+	return map;
+}
+
+void
+kmprof_allocblock(void *ptr, size_t blocksize, vaddr_t pc)
+{
+	paddr_t pagenum;
+	uint8_t *map;
+	unsigned site;
+
+	COMPILE_ASSERT(KMPROF_NSITES <= 255);
+
+	pagenum = KVADDR_TO_PADDR((vaddr_t)ptr) / PAGE_SIZE;
+	if (pagenum >= KMPROF_MAXPAGES) {
+		/* can't find it again at kfree time, so don't count it */
+		return;
+	}
+	map = kmprof_getmap(pagenum);
+	if (map == NULL) {
+		/* Then kfree will find it under "other", if anywhere. */
+		site = KMPROF_OTHER;
+	}
+	else {
+		site = kmprof_findsite(pc);
+		map[((vaddr_t)ptr % PAGE_SIZE) / KMPROF_GRAIN] = site;
+	}
+	kmprof_count(site, blocksize, false);
+}
+
+void
+kmprof_allocpages(vaddr_t addr, unsigned npages, vaddr_t pc)
+{
+	paddr_t pagenum;
+	unsigned site;
+
+	pagenum = KVADDR_TO_PADDR(addr) / PAGE_SIZE;
+	if (pagenum >= KMPROF_MAXPAGES) {
+		/* can't find it again at kfree time, so don't count it */
+		return;
+	}
+	site = kmprof_findsite(pc);
+	/* we own these pages, so no locking needed */
+	kmprof_pages[pagenum].kp_site = site + 1;
+	kmprof_pages[pagenum].kp_npages = npages;
+	kmprof_count(site, npages * PAGE_SIZE, false);
+}
+
+void
+kmprof_freeblock(void *ptr, size_t blocksize)
+{
+	paddr_t pagenum;
+	uint8_t *map;
+	unsigned site;
+
+	pagenum = KVADDR_TO_PADDR((vaddr_t)ptr) / PAGE_SIZE;
+	if (pagenum >= KMPROF_MAXPAGES) {
+		return;
+	}
+	map = kmprof_blockmaps[pagenum];
+	if (map == NULL) {
+		site = KMPROF_OTHER;
+	}
+	else {
+		membar_load_load();
+		site = map[((vaddr_t)ptr % PAGE_SIZE) / KMPROF_GRAIN];
+	}
+	KASSERT(site <= KMPROF_OTHER);
+	kmprof_count(site, blocksize, true);
+}
+
+void
+kmprof_freepages(vaddr_t addr)
+{
+	struct kmprof_page *kp;
+	paddr_t pagenum;
+
+	pagenum = KVADDR_TO_PADDR(addr) / PAGE_SIZE;
+	if (pagenum >= KMPROF_MAXPAGES) {
+		return;
+	}
+	kp = &kmprof_pages[pagenum];
+	KASSERT(kp->kp_site > 0 && kp->kp_site <= KMPROF_OTHER + 1);
+	kmprof_count(kp->kp_site - 1, kp->kp_npages * PAGE_SIZE, true);
+	kp->kp_site = 0;
+	kp->kp_npages = 0;
+}
+
+////////////////////////////////////////////////////////////
+
+/*
+ * Add up the counters for table slot INDEX. Returns false if the slot
+ * isn't in use.
+ *
+ * With the counters split across CPUs there's no one moment at which
+ * to catch a site's peak, so the peak is the most live bytes seen
+ * here: it's as good as how often someone looks.
+ */
+static
+bool
+kmprof_read(unsigned index, struct kmallocsite *ret)
+{
+	struct kmprof_site *ks = &kmprof_sites[index];
+	struct kmprof_count *counts;
+	uint32_t allocbytes, freebytes;
+	unsigned cpu;
+	int s;
+
+	if (index != KMPROF_OTHER && ks->ks_pc == 0) {
+		return false;
+	}
+
+	ret->ks_pc = ks->ks_pc;
+	ret->ks_allocs = 0;
+	ret->ks_frees = 0;
+	allocbytes = freebytes = 0;
+	for (cpu=0; cpu<=MAXCPUS; cpu++) {
+		if (cpu == MAXCPUS) {
+			counts = kmprof_sharedcounts;
+		}
+		else if (cpu == 0) {
+			counts = kmprof_bootcounts;
+		}
+		else {
+			counts = kmprof_cpucounts[cpu];
+			if (counts == NULL) {
+				continue;
+			}
+			membar_load_load();
+		}
+		ret->ks_allocs += counts[index].kc_allocs;
+		ret->ks_frees += counts[index].kc_frees;
+		allocbytes += counts[index].kc_allocbytes;
+		freebytes += counts[index].kc_freebytes;
+	}
+	if (index == KMPROF_OTHER && ret->ks_allocs == 0) {
+		return false;
+	}
+	ret->ks_live = allocbytes - freebytes;
+
+	s = kmprof_lock(&kmprof_claimlock);
+	if (ret->ks_live > ks->ks_peak) {
+		ks->ks_peak = ret->ks_live;
+	}
+	ret->ks_peak = ks->ks_peak;
+	kmprof_unlock(&kmprof_claimlock, s);
+	return true;
+}
+
+/*
+ * Print the MAX call sites with the most bytes live.
+ */
+void
+kmprof_dump(unsigned max)
+{
+	struct kmallocsite *top, site;
+	unsigned num, total, i, j;
+	unsigned long live;
+
+	if (max > KMPROF_MAXDUMP) {
+		max = KMPROF_MAXDUMP;
+	}
+	top = kmalloc(max * sizeof(*top));
+	if (top == NULL) {
+		kprintf("kmprof: Out of memory\n");
+		return;
+	}
+
+	num = 0;
+	total = 0;
+	live = 0;
+	for (i=0; i<=KMPROF_OTHER; i++) {
+		if (!kmprof_read(i, &site)) {
+			continue;
+		}
+		total++;
+		live += site.ks_live;
+
+		/* insertion sort into the top MAX */
+		for (j = num; j > 0; j--) {
+			if (top[j-1].ks_live >= site.ks_live) {
+				break;
+			}
+		}
+		if (j == max) {
+			continue;
+		}
+		if (num < max) {
+			num++;
+		}
+		memmove(&top[j+1], &top[j], (num - 1 - j) * sizeof(*top));
+		top[j] = site;
+	}
+
+	kprintf("kmprof: %u call sites, %lu bytes live\n", total, live);
+	kprintf("%-10s %10s %10s %10s %10s\n",
+		"site", "live", "peak", "allocs", "frees");
+	for (i=0; i<num; i++) {
+		if (top[i].ks_pc == 0) {
+			kprintf("%-10s", "(other)");
+		}
+		else {
+			kprintf("0x%08lx", (unsigned long)top[i].ks_pc);
+		}
+		kprintf(" %10u %10u %10u %10u\n",
+			top[i].ks_live, top[i].ks_peak,
+			top[i].ks_allocs, top[i].ks_frees);
+	}
+
+	kfree(top);
+}
+
+/*
+ * Copy the call site records out to user buffer OLDP, which is
+ * *OLDLEN bytes long, and set *OLDLEN to the number of bytes used.
+ * With OLDP NULL, just set *OLDLEN to the size needed. Returns ENOMEM
+ * if the buffer was too small for all of them.
+ */
+int
+kmprof_sysctl(userptr_t oldp, size_t *oldlen)
+{
+	struct kmallocsite site;
+	unsigned i, num, max;
+	bool truncated;
+	int result;
+
+	max = *oldlen / sizeof(site);
+	num = 0;
+	truncated = false;
+	for (i=0; i<=KMPROF_OTHER; i++) {
+		if (!kmprof_read(i, &site)) {
+			continue;
+		}
+		if (oldp == NULL) {
+			num++;
+			continue;
+		}
+		if (num == max) {
+			truncated = true;
+			break;
+		}
+		result = copyout(&site, oldp + num * sizeof(site),
+				 sizeof(site));
+		if (result) {
+			return result;
+		}
+		num++;
+	}
+	*oldlen = num * sizeof(site);
+	return truncated ? ENOMEM : 0;
+}
@@ -0,0 +1,439 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009, 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Object caches.
+ *
+ * Each slab is one page from alloc_kpages. The objects are laid out
+ * from the start of the page, each followed by a link word used to
+ * chain it on its slab's free list while it's free (so the link never
+ * clobbers constructed state), and the slab header sits in whatever
+ * is left at the end of the page. That means kmem_cache_free can find
+ * the slab from the object's address alone.
+ *
+ * A cache keeps its slabs on three lists: full, partially used, and
+ * empty. Allocations come from partial slabs first so as to keep the
+ * number of slabs down. A slab that becomes empty is kept for reuse
+ * only if there are fewer than KMEM_MAXEMPTY empty slabs already;
+ * otherwise its page goes back to the VM system.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <vm.h>
+#include <kmem_cache.h>
+
+/* Default object alignment; enough for uint64_t and off_t. */
+#define KMEM_DEFALIGN	8
+
+/* Empty slabs kept per cache. */
+#define KMEM_MAXEMPTY	1
+
+struct kmem_slab {
+	struct kmem_cache *ks_cache;	/* cache we belong to */
+	struct kmem_slab *ks_prev;	/* list linkage */
+	struct kmem_slab *ks_next;
+	void *ks_free;			/* first free object */
+	unsigned ks_inuse;		/* number of allocated objects */
+};
+
+struct kmem_cache {
+	const char *kc_name;
+	size_t kc_size;			/* object size as requested */
+	size_t kc_stride;		/* distance between objects */
+	size_t kc_linkoff;		/* offset of link word in object */
+	unsigned kc_perslab;		/* objects per slab */
+	void (*kc_ctor)(void *);	/* constructor, or NULL */
+
+	struct spinlock kc_lock;	/* lock for everything below */
+	struct kmem_slab *kc_full;	/* slabs with no free objects */
+	struct kmem_slab *kc_partial;	/* slabs with some free objects */
+	struct kmem_slab *kc_empty;	/* slabs with no objects in use */
+	unsigned kc_nempty;		/* length of kc_empty */
+
+	/* statistics */
+	unsigned kc_slabs;		/* slabs in use */
+	unsigned kc_inuse;		/* objects allocated */
+	unsigned kc_maxinuse;		/* high-water mark of kc_inuse */
+	unsigned long kc_allocs;	/* total allocations */
+	unsigned long kc_frees;		/* total frees */
+	unsigned long kc_fails;		/* allocations that failed */
+
+	struct kmem_cache *kc_next;	/* list of all caches */
+};
+
+/* Free list link of a free object. */
+#define KMEM_LINK(kc, obj) \
+	(*(void **)((char *)(obj) + (kc)->kc_linkoff))
+
+/* Slab header for the page containing an object. */
+#define KMEM_SLAB(obj) \
+	((struct kmem_slab *)(((vaddr_t)(obj) & PAGE_FRAME) + \
+			      PAGE_SIZE - sizeof(struct kmem_slab)))
+
+/* All caches, for printing statistics. */
+static struct spinlock kmem_cacheslock = SPINLOCK_INITIALIZER;
+static struct kmem_cache *kmem_caches;
+
+////////////////////////////////////////////////////////////
+// slab lists
+
+/*
+ * Return the list a slab with INUSE objects allocated belongs on.
+ */
+static
+struct kmem_slab **
+kmem_slablist(struct kmem_cache *kc, unsigned inuse)
+{
+	if (inuse == 0) {
+		return &kc->kc_empty;
+	}
+	else if (inuse == kc->kc_perslab) {
+		return &kc->kc_full;
+	}
+	return &kc->kc_partial;
+}
+
+static
+void
+kmem_slab_insert(struct kmem_cache *kc, struct kmem_slab *ks)
+{
+	struct kmem_slab **head;
+
+	KASSERT(spinlock_do_i_hold(&kc->kc_lock));
+
+	head = kmem_slablist(kc, ks->ks_inuse);
+	ks->ks_prev = NULL;
+	ks->ks_next = *head;
+	if (*head != NULL) {
+		(*head)->ks_prev = ks;
+	}
+	*head = ks;
+	if (ks->ks_inuse == 0) {
+		kc->kc_nempty++;
+	}
+}
+
+static
+void
+kmem_slab_remove(struct kmem_cache *kc, struct kmem_slab *ks)
+{
+	struct kmem_slab **head;
+
+	KASSERT(spinlock_do_i_hold(&kc->kc_lock));
+
+	head = kmem_slablist(kc, ks->ks_inuse);
+	if (ks->ks_prev != NULL) {
+		ks->ks_prev->ks_next = ks->ks_next;
+	}
+	else {
+		KASSERT(*head == ks);
+		*head = ks->ks_next;
+	}
+	if (ks->ks_next != NULL) {
+		ks->ks_next->ks_prev = ks->ks_prev;
+	}
+	ks->ks_prev = ks->ks_next = NULL;
+	if (ks->ks_inuse == 0) {
+		KASSERT(kc->kc_nempty > 0);
+		kc->kc_nempty--;
+	}
+}
+
+/*
+ * Get a page and make it into a slab of constructed objects. Called
+ * without the cache lock, as both alloc_kpages and the constructor
+ * may need to take other locks.
+ */
+static
+struct kmem_slab *
+kmem_slab_create(struct kmem_cache *kc)
+{
+	struct kmem_slab *ks;
+	vaddr_t page;
+	char *obj;
+	unsigned i;
+
+	page = alloc_kpages(1);
+	if (page == 0) {
+		return NULL;
+	}
+	KASSERT(page % PAGE_SIZE == 0);
+
+	ks = KMEM_SLAB(page);
+	ks->ks_cache = kc;
+	ks->ks_prev = ks->ks_next = NULL;
+	ks->ks_free = (void *)page;
+	ks->ks_inuse = 0;
+
+	for (i=0; i<kc->kc_perslab; i++) {
+		obj = (char *)page + i * kc->kc_stride;
+		if (kc->kc_ctor != NULL) {
+			kc->kc_ctor(obj);
+		}
+		KMEM_LINK(kc, obj) = (i + 1 < kc->kc_perslab) ?
+			obj + kc->kc_stride : NULL;
+	}
+	return ks;
+}
+
+////////////////////////////////////////////////////////////
+// caches
+
+struct kmem_cache *
+kmem_cache_create(const char *name, size_t size, size_t align,
+		  void (*ctor)(void *))
+{
+	struct kmem_cache *kc;
+
+	KASSERT(size > 0);
+	if (align == 0) {
+		align = KMEM_DEFALIGN;
+	}
+	KASSERT((align & (align - 1)) == 0);
+	KASSERT(align <= PAGE_SIZE);
+
+	kc = kmalloc(sizeof(*kc));
+	if (kc == NULL) {
+		return NULL;
+	}
+
+	kc->kc_name = name;
+	kc->kc_size = size;
+	kc->kc_linkoff = ROUNDUP(size, sizeof(void *));
+	kc->kc_stride = ROUNDUP(kc->kc_linkoff + sizeof(void *), align);
+	kc->kc_perslab = (PAGE_SIZE - sizeof(struct kmem_slab)) /
+		kc->kc_stride;
+	if (kc->kc_perslab == 0) {
+		panic("kmem_cache_create: %s: %zu-byte objects don't fit "
+		      "in a slab\n", name, size);
+	}
+	kc->kc_ctor = ctor;
+
+	spinlock_init(&kc->kc_lock);
+	kc->kc_full = kc->kc_partial = kc->kc_empty = NULL;
+	kc->kc_nempty = 0;
+
+	kc->kc_slabs = 0;
+	kc->kc_inuse = 0;
+	kc->kc_maxinuse = 0;
+	kc->kc_allocs = 0;
+	kc->kc_frees = 0;
+	kc->kc_fails = 0;
+
+	spinlock_acquire(&kmem_cacheslock);
+	kc->kc_next = kmem_caches;
+	kmem_caches = kc;
+	spinlock_release(&kmem_cacheslock);
+
+	return kc;
+}
+
+void
+kmem_cache_destroy(struct kmem_cache *kc)
+{
+	struct kmem_cache **p;
+	struct kmem_slab *ks;
+
+	KASSERT(kc->kc_inuse == 0);
+	KASSERT(kc->kc_full == NULL);
+	KASSERT(kc->kc_partial == NULL);
+
+	spinlock_acquire(&kmem_cacheslock);
+	for (p = &kmem_caches; *p != kc; p = &(*p)->kc_next) {
+		KASSERT(*p != NULL);
+	}
+	*p = kc->kc_next;
+	spinlock_release(&kmem_cacheslock);
+
+	while ((ks = kc->kc_empty) != NULL) {
+		kc->kc_empty = ks->ks_next;
+		free_kpages((vaddr_t)ks & PAGE_FRAME);
+	}
+
+	spinlock_cleanup(&kc->kc_lock);
+	kfree(kc);
+}
+
+void *
+kmem_cache_alloc(struct kmem_cache *kc)
+{
+	struct kmem_slab *ks;
+	void *obj;
+
+	spinlock_acquire(&kc->kc_lock);
+	while (1) {
+		ks = (kc->kc_partial != NULL) ? kc->kc_partial : kc->kc_empty;
+		if (ks != NULL) {
+			break;
+		}
+
+		/* Need a new slab. */
+		spinlock_release(&kc->kc_lock);
+		ks = kmem_slab_create(kc);
+		spinlock_acquire(&kc->kc_lock);
+		if (ks == NULL) {
+			kc->kc_fails++;
+			spinlock_release(&kc->kc_lock);
+			return NULL;
+		}
+		kc->kc_slabs++;
+		kmem_slab_insert(kc, ks);
+		/* go around again; someone else may have freed meanwhile */
+	}
+
+	kmem_slab_remove(kc, ks);
+	obj = ks->ks_free;
+	KASSERT(obj != NULL);
+	ks->ks_free = KMEM_LINK(kc, obj);
+	ks->ks_inuse++;
+	kmem_slab_insert(kc, ks);
+
+	kc->kc_allocs++;
+	kc->kc_inuse++;
+	if (kc->kc_inuse > kc->kc_maxinuse) {
+		kc->kc_maxinuse = kc->kc_inuse;
+	}
+	spinlock_release(&kc->kc_lock);
+
+	return obj;
+}
+
+void
+kmem_cache_free(struct kmem_cache *kc, void *obj)
+{
+	struct kmem_slab *ks;
+	vaddr_t page, offset;
+
+	KASSERT(obj != NULL);
+
+	page = (vaddr_t)obj & PAGE_FRAME;
+	offset = (vaddr_t)obj - page;
+	ks = KMEM_SLAB(obj);
+	if (ks->ks_cache != kc || offset % kc->kc_stride != 0 ||
+	    offset / kc->kc_stride >= kc->kc_perslab) {
+		panic("kmem_cache_free: %p is not from cache %s\n",
+		      obj, kc->kc_name);
+	}
+
+	spinlock_acquire(&kc->kc_lock);
+	KASSERT(ks->ks_inuse > 0);
+	kmem_slab_remove(kc, ks);
+	KMEM_LINK(kc, obj) = ks->ks_free;
+	ks->ks_free = obj;
+	ks->ks_inuse--;
+
+	kc->kc_frees++;
+	kc->kc_inuse--;
+
+	if (ks->ks_inuse == 0 && kc->kc_nempty >= KMEM_MAXEMPTY) {
+		/* Give the page back; not with the cache lock held. */
+		kc->kc_slabs--;
+		spinlock_release(&kc->kc_lock);
+		free_kpages(page);
+		return;
+	}
+	kmem_slab_insert(kc, ks);
+	spinlock_release(&kc->kc_lock);
+}
+
+////////////////////////////////////////////////////////////
+// statistics
+
+/*
+ * Copy of a cache's statistics, so they can be printed without
+ * holding any spinlocks.
+ */
+struct kmem_cache_snap {
+	const char *name;
+	size_t size;
+	unsigned perslab;
+	unsigned slabs;
+	unsigned inuse;
+	unsigned maxinuse;
+	unsigned long allocs;
+	unsigned long frees;
+	unsigned long fails;
+};
+
+void
+kmem_cache_printstats(void)
+{
+	struct kmem_cache_snap *snaps;
+	struct kmem_cache *kc;
+	unsigned num, max, i;
+
+	/* Any caches created after we count them are left out. */
+	max = 0;
+	spinlock_acquire(&kmem_cacheslock);
+	for (kc = kmem_caches; kc != NULL; kc = kc->kc_next) {
+		max++;
+	}
+	spinlock_release(&kmem_cacheslock);
+
+	snaps = kmalloc(max * sizeof(*snaps));
+	if (snaps == NULL) {
+		kprintf("kmem_cache: Out of memory\n");
+		return;
+	}
+
+	num = 0;
+	spinlock_acquire(&kmem_cacheslock);
+	for (kc = kmem_caches; kc != NULL && num < max; kc = kc->kc_next) {
+		spinlock_acquire(&kc->kc_lock);
+		snaps[num].name = kc->kc_name;
+		snaps[num].size = kc->kc_size;
+		snaps[num].perslab = kc->kc_perslab;
+		snaps[num].slabs = kc->kc_slabs;
+		snaps[num].inuse = kc->kc_inuse;
+		snaps[num].maxinuse = kc->kc_maxinuse;
+		snaps[num].allocs = kc->kc_allocs;
+		snaps[num].frees = kc->kc_frees;
+		snaps[num].fails = kc->kc_fails;
+		spinlock_release(&kc->kc_lock);
+		num++;
+	}
+	spinlock_release(&kmem_cacheslock);
+
+	kprintf("%-14s %5s %5s %6s %7s %7s %10s %10s %5s %4s\n",
+		"cache", "size", "/slab", "slabs", "inuse", "max",
+		"allocs", "frees", "fails", "eff");
+	for (i=0; i<num; i++) {
+		kprintf("%-14s %5zu %5u %6u %7u %7u %10lu %10lu %5lu %3u%%\n",
+			snaps[i].name, snaps[i].size, snaps[i].perslab,
+			snaps[i].slabs, snaps[i].inuse, snaps[i].maxinuse,
+			snaps[i].allocs, snaps[i].frees, snaps[i].fails,
+			snaps[i].slabs == 0 ? 100 : (unsigned)
+			(snaps[i].inuse * snaps[i].size * 100 /
+			 (snaps[i].slabs * PAGE_SIZE)));
+	}
+
+	kfree(snaps);
+}
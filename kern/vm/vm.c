@@ -9,6 +9,7 @@
 #include <spl.h>
 #include <proc.h>
 #include <synch.h>
+#include <current.h>
 //
 
 /* Place your page table functions here */
@@ -250,6 +251,9 @@ vm_fault(int faulttype, vaddr_t faultaddress)
 		return ENOMEM;
 	}
 
+	// A new zero-filled page; there's no paging, so never a major fault
+	curthread->t_usage.u_minflt++;
+
 	// load TLB
 	int t = splhigh();
 	tlb_random(new_hpt_entry->VPN, new_hpt_entry->PFN);
@@ -258,6 +262,25 @@ vm_fault(int faulttype, vaddr_t faultaddress)
 	return 0;       
 }
 
+// Look up a user page of another address space, for pipes
+vaddr_t vm_userpage(struct addrspace *as, vaddr_t va, bool write)
+{
+	struct hpt_entry *entry;
+
+	if (va >= USERSPACETOP) {
+		return 0;
+	}
+
+	entry = hpt_lookup(as, va & PAGE_FRAME);
+	if (entry == NULL) {
+		return 0;
+	}
+	if (write && (entry->PFN & TLBLO_DIRTY) == 0) {
+		return 0;
+	}
+	return PADDR_TO_KVADDR(entry->PFN & TLBLO_PPAGE) + (va & ~PAGE_FRAME);
+}
+
 /*
  *
  * SMP-specific functions.  Unused in our configuration.
@@ -28,6 +28,7 @@
  */
 
 #include <unistd.h>
+#include <errno.h>
 #include <err.h>
 
 /*
@@ -35,29 +36,21 @@
  * Usage: cp oldfile newfile
  */
 
+/* how much to ask copy_file_range for at a time */
+#define COPYCHUNK	(1024*1024)
 
-/* Copy one file to another. */
+
+/*
+ * Copy the rest of FROMFD to TOFD by reading into a buffer and
+ * writing it back out.
+ */
 static
 void
-copy(const char *from, const char *to)
+copy_readwrite(int fromfd, const char *from, int tofd, const char *to)
 {
-	int fromfd;
-	int tofd;
 	char buf[1024];
 	int len, wr, wrtot;
 
-	/*
-	 * Open the files, and give up if they won't open
-	 */
-	fromfd = open(from, O_RDONLY);
-	if (fromfd<0) {
-		err(1, "%s", from);
-	}
-	tofd = open(to, O_WRONLY|O_CREAT|O_TRUNC);
-	if (tofd<0) {
-		err(1, "%s", to);
-	}
-
 	/*
 	 * As long as we get more than zero bytes, we haven't hit EOF.
 	 * Zero means EOF. Less than zero means an error occurred.
@@ -84,6 +77,46 @@ copy(const char *from, const char *to)
 	if (len<0) {
 		err(1, "%s", from);
 	}
+}
+
+/* Copy one file to another. */
+static
+void
+copy(const char *from, const char *to)
+{
+	int fromfd;
+	int tofd;
+	ssize_t len;
+
+	/*
+	 * Open the files, and give up if they won't open
+	 */
+	fromfd = open(from, O_RDONLY);
+	if (fromfd<0) {
+		err(1, "%s", from);
+	}
+	tofd = open(to, O_WRONLY|O_CREAT|O_TRUNC);
+	if (tofd<0) {
+		err(1, "%s", to);
+	}
+
+	/*
+	 * Have the kernel do the copy, so the data doesn't come up
+	 * here and go back down again. Zero means EOF. If the kernel
+	 * can't copy between these files at all (e.g. one of them is
+	 * a device, which can't seek), it fails before copying
+	 * anything, and we do it the old way.
+	 */
+	while ((len = copy_file_range(fromfd, NULL, tofd, NULL,
+				      COPYCHUNK, 0)) > 0) {
+		/* nothing */
+	}
+	if (len<0) {
+		if (errno != ENOSYS && errno != ESPIPE && errno != EINVAL) {
+			err(1, "%s to %s", from, to);
+		}
+		copy_readwrite(fromfd, from, tofd, to);
+	}
 
 	if (close(fromfd) < 0) {
 		err(1, "%s: close", from);
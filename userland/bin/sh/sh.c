@@ -33,10 +33,14 @@
  * Usage:
  *     sh
  *     sh -c command
+ *
+ * Commands may be joined into a pipeline with '|', and a trailing '&'
+ * runs a command (or pipeline) in the background.
  */
 
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <sys/resource.h>
 #include <assert.h>
 #include <unistd.h>
 #include <stdlib.h>
@@ -58,6 +62,9 @@
 /* avoid making this unreasonably large; causes problems under dumbvm */
 #define CMDLINE_MAX 4096
 
+/* most commands in one pipeline */
+#define MAXSTAGES 16
+
 /* struct to (portably) hold exit info */
 struct exitinfo {
 	unsigned val:8,
@@ -75,16 +82,16 @@ static pid_t bgpids[MAXBG];
 
 /*
  * can_bg
- * just checks for an open slot.
+ * just checks for num open slots.
  */
 static
 int
-can_bg(void)
+can_bg(int num)
 {
 	int i;
 
 	for (i = 0; i < MAXBG; i++) {
-		if (bgpids[i] == 0) {
+		if (bgpids[i] == 0 && --num == 0) {
 			return 1;
 		}
 	}
@@ -355,22 +362,103 @@ static struct {
 	{ NULL, NULL }
 };
 
+/*
+ * addtime
+ * adds one timeval to another, for totalling up the usage of a pipeline.
+ */
+static
+void
+addtime(struct timeval *sum, const struct timeval *t)
+{
+	sum->tv_sec += t->tv_sec;
+	sum->tv_usec += t->tv_usec;
+	if (sum->tv_usec >= 1000000) {
+		sum->tv_usec -= 1000000;
+		sum->tv_sec++;
+	}
+}
+
+/*
+ * runstage
+ * starts one command of a pipeline, reading from infd (if not -1) and
+ * writing to outfd (if not -1).  closefd, if not -1, is the other end of
+ * outfd's pipe, which the child mustn't hold open.  returns the pid, or -1.
+ */
+static
+pid_t
+runstage(char **args, int infd, int outfd, int closefd)
+{
+	pid_t pid;
+
+	/*
+	 * Use vfork, as the child just execs; this saves copying our
+	 * address space. The child runs in our memory until it execs
+	 * or exits, so it mustn't do anything else. (Moving file
+	 * handles around is fine; the file table isn't shared.)
+	 */
+	pid = vfork();
+	switch (pid) {
+		case -1:
+			/* error */
+			warn("vfork");
+			return -1;
+		case 0:
+			/* child */
+			if (closefd >= 0) {
+				close(closefd);
+			}
+			if (infd >= 0) {
+				if (dup2(infd, STDIN_FILENO) < 0) {
+					warn("dup2");
+					_exit(1);
+				}
+				close(infd);
+			}
+			if (outfd >= 0) {
+				if (dup2(outfd, STDOUT_FILENO) < 0) {
+					warn("dup2");
+					_exit(1);
+				}
+				close(outfd);
+			}
+			execvp(args[0], args);
+			warn("%s", args[0]);
+			/*
+			 * Use _exit() instead of exit() in the child
+			 * process to avoid calling atexit() functions,
+			 * which would cause hostcompat (if present) to
+			 * reset the tty state and mess up our input
+			 * handling.
+			 */
+			_exit(1);
+		default:
+			break;
+	}
+	return pid;
+}
+
 /*
  * docommand
  * tokenizes the command line using strtok.  if there aren't any commands,
  * simply returns.  checks to see if it's a builtin, running it if it is.
- * otherwise, it's a standard command.  check for the '&', try to background
- * the job if possible, otherwise just run it and wait on it.
+ * otherwise, it's a standard command, or a pipeline of them separated by
+ * '|'.  check for the '&', try to background the job if possible, otherwise
+ * just run it and wait on it.  the exit status of a pipeline is that of its
+ * last command.
  */
 static
 void
 docommand(char *buf, struct exitinfo *ei)
 {
 	char *args[NARG_MAX + 1];
-	int nargs, i;
+	char **stages[MAXSTAGES];
+	pid_t pids[MAXSTAGES];
+	int nargs, nstages, nstarted, i;
+	int infd, fds[2];
 	char *s;
-	pid_t pid;
 	int status;
+	struct rusage ru, totalru;
+	int gotusage;
 	int bg=0;
 	time_t startsecs, endsecs;
 	unsigned long startnsecs, endnsecs;
@@ -394,18 +482,35 @@ docommand(char *buf, struct exitinfo *ei)
 		return;
 	}
 
-	for (i=0; builtins[i].name; i++) {
-		if (!strcmp(builtins[i].name, args[0])) {
-			builtins[i].func(nargs, args, ei);
-			return;
+	/* split into pipeline stages, in place */
+	stages[0] = args;
+	nstages = 1;
+	for (i=0; i<nargs; i++) {
+		if (!strcmp(args[i], "|")) {
+			if (nstages >= MAXSTAGES) {
+				printf("Too many commands in pipeline\n");
+				exitinfo_exit(ei, 1);
+				return;
+			}
+			args[i] = NULL;
+			stages[nstages++] = &args[i+1];
+		}
+	}
+
+	if (nstages == 1) {
+		for (i=0; builtins[i].name; i++) {
+			if (!strcmp(builtins[i].name, args[0])) {
+				builtins[i].func(nargs, args, ei);
+				return;
+			}
 		}
 	}
 
 	/* Not a builtin; run it */
 
-	if (nargs > 0 && !strcmp(args[nargs-1], "&")) {
+	if (nargs > 0 && args[nargs-1] != NULL && !strcmp(args[nargs-1], "&")) {
 		/* background */
-		if (!can_bg()) {
+		if (!can_bg(nstages)) {
 			printf("%s: Too many background jobs; wait for "
 			       "some to finish before starting more\n",
 			       args[0]);
@@ -417,48 +522,86 @@ docommand(char *buf, struct exitinfo *ei)
 		bg = 1;
 	}
 
+	for (i=0; i<nstages; i++) {
+		if (stages[i][0] == NULL) {
+			printf("Missing command in pipeline\n");
+			exitinfo_exit(ei, 1);
+			return;
+		}
+	}
+
 	if (timing) {
 		__time(&startsecs, &startnsecs);
 	}
 
-	pid = fork();
-	switch (pid) {
-		case -1:
-			/* error */
-			warn("fork");
-			exitinfo_exit(ei, 255);
-			return;
-		case 0:
-			/* child */
-			execvp(args[0], args);
-			warn("%s", args[0]);
-			/*
-			 * Use _exit() instead of exit() in the child
-			 * process to avoid calling atexit() functions,
-			 * which would cause hostcompat (if present) to
-			 * reset the tty state and mess up our input
-			 * handling.
-			 */
-			_exit(1);
-		default:
+	/*
+	 * Start each command with its input from the previous one's
+	 * pipe, and (except for the last) its output to a new one.
+	 */
+	infd = -1;
+	for (nstarted=0; nstarted<nstages; nstarted++) {
+		if (nstarted < nstages-1) {
+			if (pipe(fds) < 0) {
+				warn("pipe");
+				break;
+			}
+		}
+		else {
+			fds[0] = fds[1] = -1;
+		}
+
+		pids[nstarted] = runstage(stages[nstarted], infd,
+					  fds[1], fds[0]);
+
+		if (infd >= 0) {
+			close(infd);
+		}
+		if (fds[1] >= 0) {
+			close(fds[1]);
+		}
+		infd = fds[0];
+		if (pids[nstarted] < 0) {
 			break;
+		}
+	}
+	if (infd >= 0) {
+		close(infd);
+	}
+	if (nstarted < nstages) {
+		/* couldn't start them all; collect the ones we did */
+		for (i=0; i<nstarted; i++) {
+			waitpid(pids[i], &status, 0);
+		}
+		exitinfo_exit(ei, 255);
+		return;
 	}
 
 	/* parent */
 	if (bg) {
 		/* background this command */
-		remember_bg(pid);
-		printf("[%d] %s ... &\n", pid, args[0]);
+		for (i=0; i<nstages; i++) {
+			remember_bg(pids[i]);
+			printf("[%d] %s ... &\n", pids[i], stages[i][0]);
+		}
 		exitinfo_exit(ei, 0);
 		return;
 	}
 
-	if (waitpid(pid, &status, 0) < 0) {
-		warn("waitpid");
-		exitinfo_exit(ei, 255);
-	}
-	else {
-		readstatus(status, ei);
+	gotusage = 1;
+	totalru.ru_utime.tv_sec = totalru.ru_utime.tv_usec = 0;
+	totalru.ru_stime.tv_sec = totalru.ru_stime.tv_usec = 0;
+	for (i=0; i<nstages; i++) {
+		if (wait4(pids[i], &status, 0, &ru) < 0) {
+			warn("wait4");
+			exitinfo_exit(ei, 255);
+			gotusage = 0;
+			continue;
+		}
+		if (i == nstages-1) {
+			readstatus(status, ei);
+		}
+		addtime(&totalru.ru_utime, &ru.ru_utime);
+		addtime(&totalru.ru_stime, &ru.ru_stime);
 	}
 
 	if (timing) {
@@ -471,6 +614,13 @@ docommand(char *buf, struct exitinfo *ei)
 		endsecs -= startsecs;
 		warnx("subprocess time: %lu.%09lu seconds",
 		      (unsigned long) endsecs, (unsigned long) endnsecs);
+		if (gotusage) {
+			warnx("user %lu.%06lu, system %lu.%06lu seconds",
+			      (unsigned long) totalru.ru_utime.tv_sec,
+			      (unsigned long) totalru.ru_utime.tv_usec,
+			      (unsigned long) totalru.ru_stime.tv_sec,
+			      (unsigned long) totalru.ru_stime.tv_usec);
+		}
 	}
 }
 
@@ -38,11 +38,17 @@
  * kernel includes. This way user-level code doesn't need to know
  * about the kern/ headers.
  */
+#include <kern/aio.h>
 #include <kern/fcntl.h>
+#include <kern/futex.h>
 #include <kern/ioctl.h>
+#include <kern/iovec.h>
+#include <kern/poll.h>
 #include <kern/reboot.h>
 #include <kern/seek.h>
+#include <kern/sysctl.h>
 #include <kern/time.h>
+#include <kern/resource.h>	/* uses struct timeval */
 #include <kern/unistd.h>
 #include <kern/wait.h>
 
@@ -62,6 +68,10 @@
  * header files as well, as follows:
  *
  *     waitpid:  sys/wait.h
+ *     readv:    sys/uio.h
+ *     writev:   sys/uio.h
+ *     poll:     poll.h
+ *     select:   sys/select.h
  *     open:     fcntl.h or sys/fcntl.h
  *     reboot:   sys/reboot.h
  *     ioctl:    sys/ioctl.h
@@ -146,8 +156,26 @@ int symlink(const char *target, const char *linkname);
 ssize_t readlink(const char *path, char *buf, size_t buflen);
 int dup2(int filehandle, int newhandle);
 int pipe(int filehandles[2]);
+int poll(struct pollfd *fds, nfds_t nfds, int timeout);
+int select(int nfds, fd_set *readfds, fd_set *writefds, fd_set *exceptfds,
+	   struct timeval *timeout);
+ssize_t pread(int filehandle, void *buf, size_t size, off_t pos);
+ssize_t pwrite(int filehandle, const void *buf, size_t size, off_t pos);
+ssize_t readv(int filehandle, const struct iovec *iov, int iovcnt);
+ssize_t writev(int filehandle, const struct iovec *iov, int iovcnt);
+ssize_t copy_file_range(int infile, off_t *inpos, int outfile, off_t *outpos,
+			size_t len, unsigned flags);
+int aio_submit(const struct aioreq *reqs, int nreqs);
+int aio_reap(struct aioevent *evs, int nevs, int minwait);
+pid_t vfork(void);
+pid_t wait4(pid_t pid, int *returncode, int flags, struct rusage *usage);
+int getrusage(int who, struct rusage *usage);
 int __time(time_t *seconds, unsigned long *nanoseconds);
+int nanosleep(const struct timespec *req, struct timespec *rem);
 ssize_t __getcwd(char *buf, size_t buflen);
+int futex(int *addr, int op, int val);
+int __sysctl(const int *name, unsigned namelen, void *oldp, size_t *oldlenp,
+	     const void *newp, size_t newlen);
 /* stat - see sys/stat.h */
 /* lstat - see sys/stat.h */
 
@@ -158,6 +186,7 @@ ssize_t __getcwd(char *buf, size_t buflen);
 int execvp(const char *prog, char *const *args); /* calls execv */
 char *getcwd(char *buf, size_t buflen);		/* calls __getcwd */
 time_t time(time_t *seconds);			/* calls __time */
+unsigned sleep(unsigned seconds);		/* calls nanosleep */
 
 /* UNSW versions of mmap() and munmap()
  * This are simplified compared to the standard version on UNIX
@@ -296,6 +296,27 @@ traverse(const struct sfs_dinode *sfi, void (*doblock)(uint32_t, uint32_t))
 	assert(fileblock == numblocks);
 }
 
+/*
+ * Bucket count of the directory being dumped, or 0 if it's linear.
+ */
+static unsigned dumpdirbuckets;
+
+/*
+ * Home bucket of a name in a hashed directory; same as the kernel's.
+ */
+static
+unsigned
+dirhash(const char *name, unsigned nbuckets)
+{
+	uint32_t h = SFS_DIRHASH_BASIS;
+
+	while (*name) {
+		h ^= (unsigned char)*name++;
+		h *= SFS_DIRHASH_PRIME;
+	}
+	return h & (nbuckets - 1);
+}
+
 static
 void
 dumpdirblock(uint32_t fileblock, uint32_t diskblock)
@@ -304,7 +325,6 @@ dumpdirblock(uint32_t fileblock, uint32_t diskblock)
 	int nsds = SFS_BLOCKSIZE/sizeof(struct sfs_direntry);
 	int i;
 
-	(void)fileblock;
 	if (diskblock == 0) {
 		printf("    [block %u - empty]\n", diskblock);
 		return;
@@ -319,7 +339,15 @@ dumpdirblock(uint32_t fileblock, uint32_t diskblock)
 		}
 		else {
 			sds[i].sfd_name[SFS_NAMELEN-1] = 0; /* just in case */
-			printf("        %u %s\n", ino, sds[i].sfd_name);
+			if (dumpdirbuckets == 0) {
+				printf("        %u %s\n", ino, sds[i].sfd_name);
+			}
+			else {
+				printf("        %u %s (bucket %u, home %u)\n",
+				       ino, sds[i].sfd_name, fileblock,
+				       dirhash(sds[i].sfd_name,
+					       dumpdirbuckets));
+			}
 		}
 	}
 }
@@ -335,7 +363,18 @@ dumpdir(uint32_t ino, const struct sfs_dinode *sfi)
 		warnx("Warning: dir size is not a multiple of dir entry size");
 	}
 	printf("Directory contents for inode %u: %d entries\n", ino, nentries);
+	dumpdirbuckets = SWAP16(sfi->sfi_dirbuckets);
+	if (dumpdirbuckets != 0 &&
+	    SWAP32(sfi->sfi_size) != dumpdirbuckets * SFS_BLOCKSIZE) {
+		warnx("Warning: hashed dir size does not match bucket count");
+		dumpdirbuckets = 0;
+	}
+	else if ((dumpdirbuckets & (dumpdirbuckets - 1)) != 0) {
+		warnx("Warning: dir bucket count is not a power of 2");
+		dumpdirbuckets = 0;
+	}
 	traverse(sfi, dumpdirblock);
+	dumpdirbuckets = 0;
 }
 
 static
@@ -449,6 +488,10 @@ dumpinode(uint32_t ino, const char *name)
 	dumpvalf("Type", "%u (%s)", SWAP16(sfi.sfi_type), typename);
 	dumpvalf("Size", "%u", SWAP32(sfi.sfi_size));
 	dumpvalf("Link count", "%u", SWAP16(sfi.sfi_linkcount));
+	if (sfi.sfi_dirbuckets != 0 || sfi.sfi_dirprobe != 0) {
+		dumpvalf("Hash buckets", "%u", SWAP16(sfi.sfi_dirbuckets));
+		dumpvalf("Longest probe", "%u", SWAP16(sfi.sfi_dirprobe));
+	}
 	printf("\n");
 
         printf("    Direct blocks:\n");
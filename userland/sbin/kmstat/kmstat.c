@@ -0,0 +1,121 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009, 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * kmstat - show where the kernel heap is going.
+ * Usage: kmstat [count]
+ *
+ * Fetches the kmalloc call-site statistics with __sysctl and prints
+ * the COUNT sites (default 20) holding the most memory. This needs a
+ * kernel built with "options kmallocprof". Feed the addresses to
+ * addr2line or look them up with nm on the kernel image.
+ */
+
+#include <sys/types.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <err.h>
+
+/* Extra room in case sites turn up between the two __sysctl calls. */
+#define SLACK 16
+
+static
+int
+bylive(const void *av, const void *bv)
+{
+	const struct kmallocsite *a = av;
+	const struct kmallocsite *b = bv;
+
+	if (a->ks_live != b->ks_live) {
+		return a->ks_live > b->ks_live ? -1 : 1;
+	}
+	if (a->ks_allocs != b->ks_allocs) {
+		return a->ks_allocs > b->ks_allocs ? -1 : 1;
+	}
+	return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+	int name[2] = { CTL_VM, VM_KMALLOCSITES };
+	struct kmallocsite *sites;
+	size_t len;
+	unsigned num, count, i;
+	unsigned long live;
+
+	if (argc == 1) {
+		count = 20;
+	}
+	else if (argc == 2) {
+		count = atoi(argv[1]);
+	}
+	else {
+		errx(1, "Usage: kmstat [count]");
+	}
+
+	if (__sysctl(name, 2, NULL, &len, NULL, 0) < 0) {
+		err(1, "__sysctl");
+	}
+	len += SLACK * sizeof(*sites);
+	sites = malloc(len);
+	if (sites == NULL) {
+		errx(1, "Out of memory");
+	}
+	if (__sysctl(name, 2, sites, &len, NULL, 0) < 0 && errno != ENOMEM) {
+		err(1, "__sysctl");
+	}
+	num = len / sizeof(*sites);
+
+	qsort(sites, num, sizeof(*sites), bylive);
+
+	live = 0;
+	for (i=0; i<num; i++) {
+		live += sites[i].ks_live;
+	}
+	printf("%u call sites, %lu bytes live\n", num, live);
+	printf("%-10s %10s %10s %10s %10s\n",
+	       "site", "live", "peak", "allocs", "frees");
+	for (i=0; i<num && i<count; i++) {
+		if (sites[i].ks_pc == 0) {
+			printf("%-10s", "(other)");
+		}
+		else {
+			printf("0x%08x", sites[i].ks_pc);
+		}
+		printf(" %10u %10u %10u %10u\n", sites[i].ks_live,
+		       sites[i].ks_peak, sites[i].ks_allocs,
+		       sites[i].ks_frees);
+	}
+
+	free(sites);
+	return 0;
+}
@@ -73,6 +73,9 @@ check(void)
 	assert(sizeof(struct sfs_superblock)==SFS_BLOCKSIZE);
 	assert(sizeof(struct sfs_dinode)==SFS_BLOCKSIZE);
 	assert(SFS_BLOCKSIZE % sizeof(struct sfs_direntry) == 0);
+	/* a hashed directory has to fit in a file */
+	assert(SFS_DIRHASH_MAXBUCKETS <=
+	       SFS_NDIRECT + SFS_DBPERIDB * SFS_NINDIRECT);
 }
 
 /*
@@ -178,6 +181,9 @@ writerootdir(void)
 	sfi.sfi_size = SWAP32(0);
 	sfi.sfi_type = SWAP16(SFS_TYPE_DIR);
 	sfi.sfi_linkcount = SWAP16(1);
+	/* It starts out empty, so linear; the kernel hashes it if it grows. */
+	sfi.sfi_dirbuckets = SWAP16(0);
+	sfi.sfi_dirprobe = SWAP16(0);
 
 	/* Write it out */
 	diskwrite(&sfi, SFS_ROOTDIR_INO);
@@ -247,6 +247,56 @@ check_inode_blocks(uint32_t ino, struct sfs_dinode *sfi, int isdir)
 	return changed;
 }
 
+/*
+ * Check the directory hashing fields of inode INO, loaded into SFI.
+ * Regular files must have them zero; directories must have them
+ * either zero (linear) or consistent with the size. Anything wrong
+ * is fixed by making the directory linear, which is always safe:
+ * the entries are the same either way, and the kernel rehashes the
+ * directory again if it grows.
+ *
+ * Returns nonzero if SFI has been modified and needs to be written
+ * back.
+ */
+static
+int
+check_inode_dirhash(uint32_t ino, struct sfs_dinode *sfi, int isdir)
+{
+	uint32_t nb = sfi->sfi_dirbuckets;
+
+	if (nb == 0 && sfi->sfi_dirprobe == 0) {
+		return 0;
+	}
+
+	if (!isdir) {
+		warnx("Inode %lu: directory hash fields set in regular file "
+		      "(cleared)", (unsigned long) ino);
+	}
+	else if (nb == 0 || (nb & (nb - 1)) != 0 ||
+		 nb > SFS_DIRHASH_MAXBUCKETS) {
+		warnx("Inode %lu: invalid directory bucket count %lu "
+		      "(made linear)", (unsigned long) ino, (unsigned long) nb);
+	}
+	else if (sfi->sfi_dirprobe >= nb) {
+		warnx("Inode %lu: directory probe length %lu too large "
+		      "(made linear)", (unsigned long) ino,
+		      (unsigned long) sfi->sfi_dirprobe);
+	}
+	else if (sfi->sfi_size != nb * SFS_BLOCKSIZE) {
+		warnx("Inode %lu: directory size %lu does not match "
+		      "%lu buckets (made linear)", (unsigned long) ino,
+		      (unsigned long) sfi->sfi_size, (unsigned long) nb);
+	}
+	else {
+		return 0;
+	}
+
+	setbadness(EXIT_RECOV);
+	sfi->sfi_dirbuckets = 0;
+	sfi->sfi_dirprobe = 0;
+	return 1;
+}
+
 /*
  * Do the pass1 inode-level checks on inode INO, which has already
  * been loaded into SFI. Note that sfi_type has already been
@@ -277,6 +327,10 @@ pass1_inode(uint32_t ino, struct sfs_dinode *sfi, int alreadychanged)
 		changed = 1;
 	}
 
+	if (check_inode_dirhash(ino, sfi, isdir)) {
+		changed = 1;
+	}
+
 	if (check_inode_blocks(ino, sfi, isdir)) {
 		changed = 1;
 	}
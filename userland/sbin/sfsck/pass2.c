@@ -297,6 +297,55 @@ pass2_dir(uint32_t ino, uint32_t parentino, const char *pathsofar)
 		ichanged = 1;
 	}
 
+	/*
+	 * If the directory is hashed, make sure every entry can be
+	 * found: anything we added or renamed above, or anything
+	 * written by something that doesn't know about hashing, may
+	 * be further from its bucket than the probe length allows.
+	 * Rather than move entries, lengthen the probe. (pass1 has
+	 * already checked the hash fields against the size.) If adding
+	 * `.' or `..' made the directory longer, it can't be hashed any
+	 * more; make it linear.
+	 */
+
+	if (sfi.sfi_dirbuckets != 0 &&
+	    sfi.sfi_size != sfi.sfi_dirbuckets * SFS_BLOCKSIZE) {
+		setbadness(EXIT_RECOV);
+		warnx("Directory %s: No longer fits its hash table "
+		      "(made linear)", pathsofar);
+		sfi.sfi_dirbuckets = 0;
+		sfi.sfi_dirprobe = 0;
+		ichanged = 1;
+	}
+
+	if (sfi.sfi_dirbuckets != 0) {
+		const unsigned perblock =
+			SFS_BLOCKSIZE/sizeof(struct sfs_direntry);
+		unsigned nb = sfi.sfi_dirbuckets;
+		unsigned dist, maxdist = 0;
+
+		for (i=0; i<ndirentries; i++) {
+			if (direntries[i].sfd_ino == SFS_NOINO) {
+				continue;
+			}
+			dist = (i / perblock -
+				sfsdir_hash(direntries[i].sfd_name, nb)) &
+				(nb - 1);
+			if (dist > maxdist) {
+				maxdist = dist;
+			}
+		}
+		if (maxdist > sfi.sfi_dirprobe) {
+			setbadness(EXIT_RECOV);
+			warnx("Directory %s: Entries outside hash probe "
+			      "length %lu (lengthened to %lu)",
+			      pathsofar, (unsigned long) sfi.sfi_dirprobe,
+			      (unsigned long) maxdist);
+			sfi.sfi_dirprobe = maxdist;
+			ichanged = 1;
+		}
+	}
+
 	/*
 	 * Write back anything that changed, clean up, and return.
 	 */
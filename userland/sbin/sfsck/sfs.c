@@ -81,6 +81,8 @@ swapinode(struct sfs_dinode *sfi)
 	sfi->sfi_size = SWAP32(sfi->sfi_size);
 	sfi->sfi_type = SWAP16(sfi->sfi_type);
 	sfi->sfi_linkcount = SWAP16(sfi->sfi_linkcount);
+	sfi->sfi_dirbuckets = SWAP16(sfi->sfi_dirbuckets);
+	sfi->sfi_dirprobe = SWAP16(sfi->sfi_dirprobe);
 
 	for (i=0; i<NUM_D; i++) {
 		SET_D(sfi, i) = SWAP32(GET_D(sfi, i));
@@ -462,3 +464,19 @@ sfsdir_tryadd(struct sfs_direntry *d, int nd, const char *name, uint32_t ino)
 	}
 	return -1;
 }
+
+/*
+ * Return the bucket NAME hashes to in a hashed directory with
+ * NBUCKETS buckets. This must match the kernel.
+ */
+unsigned
+sfsdir_hash(const char *name, unsigned nbuckets)
+{
+	uint32_t h = SFS_DIRHASH_BASIS;
+
+	while (*name) {
+		h ^= (unsigned char)*name++;
+		h *= SFS_DIRHASH_PRIME;
+	}
+	return h & (nbuckets - 1);
+}
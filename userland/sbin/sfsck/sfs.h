@@ -77,5 +77,8 @@ int sfsdir_tryadd(struct sfs_direntry *d, int nd,
 /* Sort a directory by creating a permutation vector. */
 void sfsdir_sort(struct sfs_direntry *d, unsigned nd, int *vector);
 
+/* Find the bucket a name belongs in, in a hashed directory. */
+unsigned sfsdir_hash(const char *name, unsigned nbuckets);
+
 
 #endif /* SFS_H */
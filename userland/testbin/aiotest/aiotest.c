@@ -0,0 +1,317 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009, 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * aiotest.c
+ *
+ * 	Checks aio_submit and aio_reap: a batch of writes and then of
+ * 	reads lands in the right places, every request is reported once
+ * 	with its own ar_data, requests survive their file handle being
+ * 	closed, the per-process limit holds, and the documented errors
+ * 	come back.
+ *
+ * Usage: aiotest [file]
+ */
+
+#include <unistd.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <err.h>
+
+#define DEFAULT_FILE	"aiotest.dat"
+
+/* Chunks of an odd size, so they aren't block-aligned. */
+#define NCHUNKS		8
+#define CHUNKSIZE	1500
+
+static char chunks[NCHUNKS][CHUNKSIZE];
+
+static
+void
+check(int ok, const char *what)
+{
+	if (!ok) {
+		errx(1, "FAILED: %s", what);
+	}
+	printf("  %s: ok\n", what);
+}
+
+static
+char
+filebyte(unsigned pos)
+{
+	return 'a' + (pos * 7 + pos / 512) % 26;
+}
+
+static
+void
+setreq(struct aioreq *req, int fd, int op, unsigned chunk)
+{
+	req->ar_fd = fd;
+	req->ar_op = op;
+	req->ar_pos = chunk * CHUNKSIZE;
+	req->ar_buf = chunks[chunk];
+	req->ar_len = CHUNKSIZE;
+	req->ar_data = chunks[chunk];
+}
+
+/*
+ * Reap exactly N completions, checking each one succeeded with a
+ * full transfer and naming a distinct chunk.
+ */
+static
+void
+reapall(int n, const char *what)
+{
+	struct aioevent evs[NCHUNKS];
+	int seen[NCHUNKS];
+	int got, r, i, chunk;
+
+	for (i=0; i<NCHUNKS; i++) {
+		seen[i] = 0;
+	}
+	got = 0;
+	while (got < n) {
+		r = aio_reap(evs, NCHUNKS, 1);
+		if (r < 0) {
+			err(1, "aio_reap");
+		}
+		if (r == 0) {
+			errx(1, "FAILED: %s: only %d of %d completions",
+			     what, got, n);
+		}
+		for (i=0; i<r; i++) {
+			if (evs[i].ae_error) {
+				errno = evs[i].ae_error;
+				err(1, "%s", what);
+			}
+			if (evs[i].ae_result != CHUNKSIZE) {
+				errx(1, "FAILED: %s: short transfer", what);
+			}
+			chunk = (char (*)[CHUNKSIZE])evs[i].ae_data - chunks;
+			if (chunk < 0 || chunk >= NCHUNKS || seen[chunk]) {
+				errx(1, "FAILED: %s: bad ae_data", what);
+			}
+			seen[chunk] = 1;
+		}
+		got += r;
+	}
+	check(got == n, what);
+}
+
+static
+void
+writeread(int fd)
+{
+	struct aioreq reqs[NCHUNKS];
+	unsigned i, j;
+	int r;
+
+	/* Write the file a chunk at a time, last chunk first. */
+	for (i=0; i<NCHUNKS; i++) {
+		for (j=0; j<CHUNKSIZE; j++) {
+			chunks[i][j] = filebyte(i * CHUNKSIZE + j);
+		}
+		setreq(&reqs[i], fd, AIO_WRITE, NCHUNKS - 1 - i);
+	}
+	r = aio_submit(reqs, NCHUNKS);
+	if (r < 0) {
+		err(1, "aio_submit");
+	}
+	check(r == NCHUNKS, "all writes submitted");
+
+	/* The write data is taken at submit time. */
+	memset(chunks, 0, sizeof(chunks));
+	reapall(NCHUNKS, "all writes reported once");
+	check(lseek(fd, 0, SEEK_CUR) == 0, "seek position is left alone");
+	check(lseek(fd, 0, SEEK_END) == NCHUNKS * CHUNKSIZE,
+	      "file has the right size");
+
+	/* Read it back. */
+	for (i=0; i<NCHUNKS; i++) {
+		setreq(&reqs[i], fd, AIO_READ, i);
+	}
+	r = aio_submit(reqs, NCHUNKS);
+	if (r < 0) {
+		err(1, "aio_submit");
+	}
+	check(r == NCHUNKS, "all reads submitted");
+	reapall(NCHUNKS, "all reads reported once");
+	for (i=0; i<NCHUNKS; i++) {
+		for (j=0; j<CHUNKSIZE; j++) {
+			if (chunks[i][j] != filebyte(i * CHUNKSIZE + j)) {
+				errx(1, "FAILED: chunk %u byte %u is wrong",
+				     i, j);
+			}
+		}
+	}
+	check(1, "reads have the data");
+}
+
+static
+void
+closedfile(const char *name)
+{
+	struct aioreq req;
+	struct aioevent ev;
+	int fd, r;
+
+	fd = open(name, O_RDONLY);
+	if (fd < 0) {
+		err(1, "%s", name);
+	}
+	setreq(&req, fd, AIO_READ, 0);
+	req.ar_pos = NCHUNKS * CHUNKSIZE;
+	r = aio_submit(&req, 1);
+	if (r < 0) {
+		err(1, "aio_submit");
+	}
+	close(fd);
+
+	r = aio_reap(&ev, 1, 1);
+	if (r < 0) {
+		err(1, "aio_reap");
+	}
+	check(r == 1 && ev.ae_error == 0 && ev.ae_result == 0,
+	      "read at EOF after close returns 0");
+
+	r = aio_reap(&ev, 1, 1);
+	check(r == 0, "reap with nothing outstanding returns 0");
+}
+
+static
+void
+limit(int fd)
+{
+	struct aioreq reqs[AIO_MAXREQS + 1];
+	struct aioevent evs[AIO_MAXREQS];
+	int r, i;
+
+	for (i=0; i<AIO_MAXREQS + 1; i++) {
+		setreq(&reqs[i], fd, AIO_READ, i % NCHUNKS);
+		reqs[i].ar_len = 1;
+	}
+	r = aio_submit(reqs, AIO_MAXREQS + 1);
+	check(r == AIO_MAXREQS, "submission stops at AIO_MAXREQS");
+
+	errno = 0;
+	r = aio_submit(reqs, 1);
+	check(r < 0 && errno == EAGAIN, "one more gets EAGAIN");
+
+	r = aio_reap(evs, AIO_MAXREQS, AIO_MAXREQS);
+	check(r == AIO_MAXREQS, "and they can all be reaped");
+}
+
+static
+void
+errors(const char *name, int fd)
+{
+	struct aioreq req;
+	struct aioevent ev;
+	int rdfd, fds[2], r;
+
+	setreq(&req, -1, AIO_READ, 0);
+	errno = 0;
+	r = aio_submit(&req, 1);
+	check(r < 0 && errno == EBADF, "bad file handle gets EBADF");
+
+	setreq(&req, fd, 99, 0);
+	errno = 0;
+	r = aio_submit(&req, 1);
+	check(r < 0 && errno == EINVAL, "bad operation gets EINVAL");
+
+	setreq(&req, fd, AIO_READ, 0);
+	req.ar_pos = -1;
+	errno = 0;
+	r = aio_submit(&req, 1);
+	check(r < 0 && errno == EINVAL, "negative position gets EINVAL");
+
+	setreq(&req, fd, AIO_READ, 0);
+	req.ar_len = AIO_MAXLEN + 1;
+	errno = 0;
+	r = aio_submit(&req, 1);
+	check(r < 0 && errno == EINVAL, "too long gets EINVAL");
+
+	rdfd = open(name, O_RDONLY);
+	if (rdfd < 0) {
+		err(1, "%s", name);
+	}
+	setreq(&req, rdfd, AIO_WRITE, 0);
+	errno = 0;
+	r = aio_submit(&req, 1);
+	check(r < 0 && errno == EBADF, "write to read-only file gets EBADF");
+	close(rdfd);
+
+	if (pipe(fds) < 0) {
+		err(1, "pipe");
+	}
+	setreq(&req, fds[0], AIO_READ, 0);
+	errno = 0;
+	r = aio_submit(&req, 1);
+	check(r < 0 && errno == ESPIPE, "read from a pipe gets ESPIPE");
+	close(fds[0]);
+	close(fds[1]);
+
+	errno = 0;
+	r = aio_reap(&ev, 1, 2);
+	check(r < 0 && errno == EINVAL, "minwait > nevs gets EINVAL");
+}
+
+int
+main(int argc, char *argv[])
+{
+	const char *name;
+	int fd;
+
+	name = DEFAULT_FILE;
+	if (argc == 2) {
+		name = argv[1];
+	}
+	else if (argc != 1) {
+		errx(1, "Usage: aiotest [file]");
+	}
+
+	fd = open(name, O_RDWR|O_CREAT|O_TRUNC, 0664);
+	if (fd < 0) {
+		err(1, "%s", name);
+	}
+
+	writeread(fd);
+	closedfile(name);
+	limit(fd);
+	errors(name, fd);
+
+	close(fd);
+	if (remove(name) < 0) {
+		err(1, "%s: remove", name);
+	}
+	printf("aiotest done.\n");
+	return 0;
+}
@@ -0,0 +1,203 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009, 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * bctest.c
+ *
+ * 	Checks that file data survives the buffer cache: writes more
+ * 	data than the cache holds, across several files and in pieces
+ * 	that don't line up with blocks, so buffers get evicted and
+ * 	written back, then reads it all back in a different order.
+ * 	Also overwrites parts of blocks in place and checks that the
+ * 	rest of each block is intact.
+ *
+ * 	Run it after "bcsize 16" at the kernel menu to make the cache
+ * 	small and eviction constant; "bc" then shows the hit rate.
+ *
+ * Usage: bctest [nfiles]
+ */
+
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <err.h>
+
+#define BLOCKSIZE	512
+#define FILEBLOCKS	60		/* per file */
+#define FILESIZE	(FILEBLOCKS * BLOCKSIZE)
+#define DEFAULT_NFILES	8		/* 480 blocks; the default cache is 256 */
+#define MAXFILES	32
+#define CHUNK		700		/* not a multiple of BLOCKSIZE */
+
+static char buf[FILESIZE];
+static int fds[MAXFILES];
+
+static
+char
+filebyte(int file, unsigned pos)
+{
+	return 'a' + (file * 11 + pos * 7 + pos / BLOCKSIZE) % 26;
+}
+
+static
+void
+mkname(char *name, size_t len, int file)
+{
+	snprintf(name, len, "bctest.%d", file);
+}
+
+static
+void
+writefile(int file)
+{
+	unsigned pos, n;
+	ssize_t r;
+
+	for (pos=0; pos<FILESIZE; pos++) {
+		buf[pos] = filebyte(file, pos);
+	}
+	for (pos=0; pos<FILESIZE; pos += n) {
+		n = FILESIZE - pos < CHUNK ? FILESIZE - pos : CHUNK;
+		r = write(fds[file], buf + pos, n);
+		if (r < 0) {
+			err(1, "file %d: write", file);
+		}
+		if ((unsigned)r != n) {
+			errx(1, "file %d: write: short count", file);
+		}
+	}
+}
+
+/*
+ * Read back block BLOCK of FILE and check it, with the bytes from
+ * SKIP up to SKIP+LEN expected to be 'X' instead.
+ */
+static
+void
+checkblock(int file, unsigned block, unsigned skip, unsigned len)
+{
+	char data[BLOCKSIZE];
+	unsigned i, pos;
+	ssize_t r;
+
+	r = pread(fds[file], data, BLOCKSIZE, block * BLOCKSIZE);
+	if (r < 0) {
+		err(1, "file %d: pread", file);
+	}
+	if (r != BLOCKSIZE) {
+		errx(1, "file %d block %u: short read", file, block);
+	}
+	for (i=0; i<BLOCKSIZE; i++) {
+		pos = block * BLOCKSIZE + i;
+		if (i >= skip && i < skip + len) {
+			if (data[i] != 'X') {
+				errx(1, "FAILED: file %d byte %u: "
+				     "overwrite lost", file, pos);
+			}
+		}
+		else if (data[i] != filebyte(file, pos)) {
+			errx(1, "FAILED: file %d byte %u: wrong data",
+			     file, pos);
+		}
+	}
+}
+
+int
+main(int argc, char *argv[])
+{
+	char name[32];
+	char xs[BLOCKSIZE];
+	unsigned block;
+	int nfiles, file;
+
+	nfiles = DEFAULT_NFILES;
+	if (argc == 2) {
+		nfiles = atoi(argv[1]);
+	}
+	else if (argc != 1) {
+		errx(1, "Usage: bctest [nfiles]");
+	}
+	if (nfiles < 1 || nfiles > MAXFILES) {
+		errx(1, "nfiles must be 1 to %d", MAXFILES);
+	}
+
+	printf("Writing %d files of %d blocks...\n", nfiles, FILEBLOCKS);
+	for (file=0; file<nfiles; file++) {
+		mkname(name, sizeof(name), file);
+		fds[file] = open(name, O_RDWR|O_CREAT|O_TRUNC, 0664);
+		if (fds[file] < 0) {
+			err(1, "%s", name);
+		}
+		writefile(file);
+	}
+
+	printf("Reading them back, interleaved...\n");
+	for (block=0; block<FILEBLOCKS; block++) {
+		for (file=nfiles-1; file>=0; file--) {
+			checkblock(file, block, 0, 0);
+		}
+	}
+
+	printf("Overwriting the middle of every fifth block...\n");
+	memset(xs, 'X', sizeof(xs));
+	for (file=0; file<nfiles; file++) {
+		for (block=0; block<FILEBLOCKS; block += 5) {
+			if (pwrite(fds[file], xs, 100,
+				   block * BLOCKSIZE + 200) != 100) {
+				err(1, "file %d: pwrite", file);
+			}
+		}
+		if (fsync(fds[file]) < 0) {
+			err(1, "file %d: fsync", file);
+		}
+	}
+
+	printf("Checking...\n");
+	for (file=0; file<nfiles; file++) {
+		for (block=0; block<FILEBLOCKS; block++) {
+			if (block % 5 == 0) {
+				checkblock(file, block, 200, 100);
+			}
+			else {
+				checkblock(file, block, 0, 0);
+			}
+		}
+	}
+
+	for (file=0; file<nfiles; file++) {
+		close(fds[file]);
+		mkname(name, sizeof(name), file);
+		if (remove(name) < 0) {
+			err(1, "%s: remove", name);
+		}
+	}
+	printf("bctest done.\n");
+	return 0;
+}
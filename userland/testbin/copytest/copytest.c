@@ -0,0 +1,257 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009, 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * copytest.c
+ *
+ * 	Checks copy_file_range: data arrives intact whether or not the
+ * 	positions are block-aligned, explicit positions are advanced
+ * 	while the seek positions are left alone (and the other way
+ * 	around), the copy stops at EOF, and the documented errors come
+ * 	back.
+ *
+ * Usage: copytest [srcfile dstfile]
+ */
+
+#include <unistd.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <err.h>
+
+#define DEFAULT_SRC	"copytest.src"
+#define DEFAULT_DST	"copytest.dst"
+
+/* Several blocks, and not a whole number of them. */
+#define FILESIZE	(5 * 512 + 100)
+
+static char buf[FILESIZE];
+
+static
+void
+check(int ok, const char *what)
+{
+	if (!ok) {
+		errx(1, "FAILED: %s", what);
+	}
+	printf("  %s: ok\n", what);
+}
+
+static
+char
+filebyte(unsigned pos)
+{
+	return 'a' + (pos * 7 + pos / 512) % 26;
+}
+
+/*
+ * Check that DST holds LEN bytes of the source file, starting at
+ * SRCPOS in the source, at DSTPOS.
+ */
+static
+int
+samedata(int dst, off_t dstpos, off_t srcpos, size_t len)
+{
+	ssize_t r;
+	size_t i;
+
+	r = pread(dst, buf, len, dstpos);
+	if (r < 0) {
+		err(1, "pread");
+	}
+	if ((size_t)r != len) {
+		return 0;
+	}
+	for (i=0; i<len; i++) {
+		if (buf[i] != filebyte(srcpos + i)) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+static
+void
+makesrc(int src)
+{
+	unsigned i;
+	ssize_t r;
+
+	for (i=0; i<FILESIZE; i++) {
+		buf[i] = filebyte(i);
+	}
+	r = write(src, buf, FILESIZE);
+	if (r < 0) {
+		err(1, "write");
+	}
+	if (r != FILESIZE) {
+		errx(1, "write: short count");
+	}
+}
+
+static
+void
+seekcopy(int src, int dst)
+{
+	ssize_t r;
+
+	if (lseek(src, 0, SEEK_SET) < 0 || lseek(dst, 0, SEEK_SET) < 0) {
+		err(1, "lseek");
+	}
+	r = copy_file_range(src, NULL, dst, NULL, FILESIZE * 2, 0);
+	if (r < 0) {
+		err(1, "copy_file_range");
+	}
+	check(r == FILESIZE, "copy stops at EOF");
+	check(samedata(dst, 0, 0, FILESIZE), "aligned copy has the data");
+	check(lseek(src, 0, SEEK_CUR) == FILESIZE &&
+	      lseek(dst, 0, SEEK_CUR) == FILESIZE,
+	      "both seek positions advance");
+
+	r = copy_file_range(src, NULL, dst, NULL, 10, 0);
+	check(r == 0, "copy at EOF returns 0");
+}
+
+static
+void
+poscopy(int src, int dst)
+{
+	off_t inpos, outpos;
+	ssize_t r;
+
+	if (lseek(src, 0, SEEK_SET) < 0 || lseek(dst, 0, SEEK_SET) < 0) {
+		err(1, "lseek");
+	}
+
+	/* Unaligned on both sides, and differently so. */
+	inpos = 100;
+	outpos = 1000;
+	r = copy_file_range(src, &inpos, dst, &outpos, 1500, 0);
+	if (r < 0) {
+		err(1, "copy_file_range");
+	}
+	check(r == 1500, "unaligned copy copies everything");
+	check(inpos == 1600 && outpos == 2500, "positions are advanced");
+	check(samedata(dst, 1000, 100, 1500), "unaligned copy has the data");
+	check(lseek(src, 0, SEEK_CUR) == 0 && lseek(dst, 0, SEEK_CUR) == 0,
+	      "seek positions are left alone");
+
+	/* Copying past the end of the output extends it. */
+	inpos = 0;
+	outpos = FILESIZE + 512;
+	r = copy_file_range(src, &inpos, dst, &outpos, 512, 0);
+	check(r == 512 && lseek(dst, 0, SEEK_END) == FILESIZE + 1024,
+	      "copy past the end extends the output");
+	check(samedata(dst, FILESIZE + 512, 0, 512), "and has the data");
+}
+
+static
+void
+errors(int src, int dst)
+{
+	off_t pos;
+	ssize_t r;
+	int fds[2];
+
+	errno = 0;
+	r = copy_file_range(dst, NULL, src, NULL, 10, 0);
+	check(r < 0 && errno == EBADF, "copy from write-only file gets EBADF");
+
+	errno = 0;
+	r = copy_file_range(src, NULL, dst, NULL, 10, 1);
+	check(r < 0 && errno == EINVAL, "nonzero flags get EINVAL");
+
+	pos = -1;
+	errno = 0;
+	r = copy_file_range(src, &pos, dst, NULL, 10, 0);
+	check(r < 0 && errno == EINVAL, "negative position gets EINVAL");
+
+	if (pipe(fds) < 0) {
+		err(1, "pipe");
+	}
+	errno = 0;
+	r = copy_file_range(src, NULL, fds[1], NULL, 10, 0);
+	check(r < 0 && errno == ESPIPE, "copy to a pipe gets ESPIPE");
+	close(fds[0]);
+	close(fds[1]);
+}
+
+int
+main(int argc, char *argv[])
+{
+	const char *srcname, *dstname;
+	int src, dst, rdsrc;
+
+	srcname = DEFAULT_SRC;
+	dstname = DEFAULT_DST;
+	if (argc == 3) {
+		srcname = argv[1];
+		dstname = argv[2];
+	}
+	else if (argc != 1) {
+		errx(1, "Usage: copytest [srcfile dstfile]");
+	}
+
+	src = open(srcname, O_RDWR|O_CREAT|O_TRUNC, 0664);
+	if (src < 0) {
+		err(1, "%s", srcname);
+	}
+	makesrc(src);
+	dst = open(dstname, O_RDWR|O_CREAT|O_TRUNC, 0664);
+	if (dst < 0) {
+		err(1, "%s", dstname);
+	}
+
+	seekcopy(src, dst);
+	poscopy(src, dst);
+
+	/* Need a write-only and a read-only handle for the errors. */
+	close(dst);
+	dst = open(dstname, O_WRONLY);
+	if (dst < 0) {
+		err(1, "%s", dstname);
+	}
+	rdsrc = open(srcname, O_RDONLY);
+	if (rdsrc < 0) {
+		err(1, "%s", srcname);
+	}
+	errors(rdsrc, dst);
+
+	close(rdsrc);
+	close(src);
+	close(dst);
+	if (remove(srcname) < 0) {
+		err(1, "%s: remove", srcname);
+	}
+	if (remove(dstname) < 0) {
+		err(1, "%s: remove", dstname);
+	}
+	printf("copytest done.\n");
+	return 0;
+}
@@ -0,0 +1,264 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009, 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * dctest.c
+ *
+ * 	Tests the kernel's name cache: names that have been looked up,
+ * 	or looked up and found missing, must still come out right after
+ * 	being created, renamed, linked, and removed. Then times repeated
+ * 	lookups of a name that exists and of one that doesn't.
+ *
+ * Usage: dctest [count]
+ *
+ * Run it where it can create files. The kernel menu's "dc" command
+ * shows the cache statistics afterwards.
+ */
+
+#include <sys/types.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <err.h>
+
+#define DEFAULT_COUNT	2000
+
+#define NAME_A		"dctest.a"
+#define NAME_B		"dctest.b"
+#define NAME_C		"dctest.c"
+#define NAME_NONE	"dctest.none"
+
+/*
+ * Check that NAME can't be opened.
+ */
+static
+void
+checkgone(const char *name)
+{
+	int fd;
+
+	fd = open(name, O_RDONLY);
+	if (fd >= 0) {
+		errx(1, "%s: opened, but shouldn't exist", name);
+	}
+	if (errno != ENOENT) {
+		err(1, "%s: open failed the wrong way", name);
+	}
+}
+
+/*
+ * Check that NAME opens and holds the single character CH.
+ */
+static
+void
+checkfile(const char *name, char ch)
+{
+	char buf[4];
+	ssize_t r;
+	int fd;
+
+	fd = open(name, O_RDONLY);
+	if (fd < 0) {
+		err(1, "%s: open", name);
+	}
+	r = read(fd, buf, sizeof(buf));
+	if (r < 0) {
+		err(1, "%s: read", name);
+	}
+	if (r != 1 || buf[0] != ch) {
+		errx(1, "%s: wrong contents", name);
+	}
+	close(fd);
+}
+
+static
+void
+makefile(const char *name, char ch)
+{
+	int fd;
+
+	fd = open(name, O_WRONLY|O_CREAT|O_EXCL, 0664);
+	if (fd < 0) {
+		err(1, "%s: create", name);
+	}
+	if (write(fd, &ch, 1) != 1) {
+		err(1, "%s: write", name);
+	}
+	close(fd);
+}
+
+static
+void
+consistency(void)
+{
+	int fd;
+
+	/* In case of leftovers from an earlier run. */
+	remove(NAME_A);
+	remove(NAME_B);
+	remove(NAME_C);
+
+	/* Twice, so the second one comes from the cache. */
+	checkgone(NAME_A);
+	checkgone(NAME_A);
+
+	makefile(NAME_A, 'a');
+	checkfile(NAME_A, 'a');
+	checkfile(NAME_A, 'a');
+
+	fd = open(NAME_A, O_WRONLY|O_CREAT|O_EXCL, 0664);
+	if (fd >= 0) {
+		errx(1, "%s: exclusive create of existing file worked",
+		     NAME_A);
+	}
+	if (errno != EEXIST) {
+		err(1, "%s: exclusive create failed the wrong way", NAME_A);
+	}
+
+	/* Plain O_CREAT of an existing file must get that file. */
+	fd = open(NAME_A, O_RDONLY|O_CREAT, 0664);
+	if (fd < 0) {
+		err(1, "%s: open with O_CREAT", NAME_A);
+	}
+	close(fd);
+	checkfile(NAME_A, 'a');
+
+	checkgone(NAME_B);
+	if (rename(NAME_A, NAME_B) < 0) {
+		err(1, "rename %s to %s", NAME_A, NAME_B);
+	}
+	checkgone(NAME_A);
+	checkfile(NAME_B, 'a');
+
+	checkgone(NAME_C);
+	if (link(NAME_B, NAME_C) < 0) {
+		err(1, "link %s to %s", NAME_B, NAME_C);
+	}
+	checkfile(NAME_C, 'a');
+
+	if (remove(NAME_B) < 0) {
+		err(1, "%s: remove", NAME_B);
+	}
+	checkgone(NAME_B);
+	checkfile(NAME_C, 'a');
+
+	/* A new file under an old name mustn't turn up as the old one. */
+	makefile(NAME_A, 'b');
+	checkfile(NAME_A, 'b');
+	if (remove(NAME_A) < 0) {
+		err(1, "%s: remove", NAME_A);
+	}
+	checkgone(NAME_A);
+	makefile(NAME_A, 'c');
+	checkfile(NAME_A, 'c');
+
+	if (remove(NAME_A) < 0) {
+		err(1, "%s: remove", NAME_A);
+	}
+	if (remove(NAME_C) < 0) {
+		err(1, "%s: remove", NAME_C);
+	}
+	checkgone(NAME_A);
+	checkgone(NAME_C);
+
+	printf("Names stayed consistent.\n");
+}
+
+/*
+ * Open NAME COUNT times, expecting it to exist or not as EXISTS says.
+ */
+static
+void
+timeopens(const char *name, bool exists, unsigned count)
+{
+	time_t s0, s1;
+	unsigned long ns0, ns1, usecs, msecs;
+	unsigned i;
+	int fd;
+
+	__time(&s0, &ns0);
+	for (i=0; i<count; i++) {
+		fd = open(name, O_RDONLY);
+		if (exists) {
+			if (fd < 0) {
+				err(1, "%s: open", name);
+			}
+			close(fd);
+		}
+		else if (fd >= 0) {
+			errx(1, "%s: opened, but shouldn't exist", name);
+		}
+	}
+	__time(&s1, &ns1);
+
+	if (ns1 < ns0) {
+		ns1 += 1000000000;
+		s1--;
+	}
+	usecs = (s1 - s0) * 1000000 + (ns1 - ns0) / 1000;
+	msecs = usecs / 1000;
+	if (msecs == 0) {
+		msecs = 1;
+	}
+
+	printf("%s name: %u opens in %lu.%06lu seconds, %lu opens/s\n",
+	       exists ? "Existing" : "Missing", count,
+	       usecs / 1000000, usecs % 1000000,
+	       (unsigned long)count * 1000 / msecs);
+}
+
+int
+main(int argc, char *argv[])
+{
+	unsigned count;
+
+	count = DEFAULT_COUNT;
+	if (argc == 2) {
+		count = atoi(argv[1]);
+	}
+	else if (argc > 2) {
+		errx(1, "Usage: dctest [count]");
+	}
+
+	consistency();
+
+	makefile(NAME_A, 'a');
+	timeopens(NAME_A, true, count);
+	timeopens(NAME_NONE, false, count);
+	if (remove(NAME_A) < 0) {
+		err(1, "%s: remove", NAME_A);
+	}
+
+	printf("dctest done.\n");
+	return 0;
+}
@@ -0,0 +1,229 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009, 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * dirhash.c
+ *
+ * 	Tests large directories, which SFS hashes once they grow: makes
+ * 	many files in one directory, checks that every one can still be
+ * 	found as others are renamed and removed around it, and times
+ * 	creating the files and looking them all up.
+ *
+ * Usage: dirhash [count]
+ *
+ * Run it where it can create files. Use more files than the kernel's
+ * name cache holds, so the lookups actually reach the directory;
+ * dumpsfs shows the directory's buckets afterwards.
+ */
+
+#include <sys/types.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <err.h>
+
+#define DEFAULT_COUNT	600
+#define MAX_COUNT	1000
+
+static
+void
+mkname(char *buf, size_t len, const char *prefix, unsigned n)
+{
+	snprintf(buf, len, "%s.%u", prefix, n);
+}
+
+/*
+ * Check that file number N under PREFIX exists and holds its number,
+ * or doesn't exist, as EXISTS says.
+ */
+static
+void
+check(const char *prefix, unsigned n, bool exists)
+{
+	char name[32];
+	unsigned val;
+	ssize_t r;
+	int fd;
+
+	mkname(name, sizeof(name), prefix, n);
+	fd = open(name, O_RDONLY);
+	if (!exists) {
+		if (fd >= 0) {
+			errx(1, "%s: opened, but shouldn't exist", name);
+		}
+		if (errno != ENOENT) {
+			err(1, "%s: open failed the wrong way", name);
+		}
+		return;
+	}
+	if (fd < 0) {
+		err(1, "%s: open", name);
+	}
+	r = read(fd, &val, sizeof(val));
+	if (r < 0) {
+		err(1, "%s: read", name);
+	}
+	if (r != sizeof(val) || val != n) {
+		errx(1, "%s: wrong contents", name);
+	}
+	close(fd);
+}
+
+static
+void
+makefile(unsigned n)
+{
+	char name[32];
+	int fd;
+
+	mkname(name, sizeof(name), "dh", n);
+	fd = open(name, O_WRONLY|O_CREAT|O_EXCL, 0664);
+	if (fd < 0) {
+		err(1, "%s: create", name);
+	}
+	if (write(fd, &n, sizeof(n)) != sizeof(n)) {
+		err(1, "%s: write", name);
+	}
+	close(fd);
+}
+
+static
+void
+removefile(const char *prefix, unsigned n)
+{
+	char name[32];
+
+	mkname(name, sizeof(name), prefix, n);
+	if (remove(name) < 0) {
+		err(1, "%s: remove", name);
+	}
+}
+
+static
+void
+report(const char *what, unsigned count, time_t s0, unsigned long ns0)
+{
+	time_t s1;
+	unsigned long ns1, usecs, msecs;
+
+	__time(&s1, &ns1);
+	if (ns1 < ns0) {
+		ns1 += 1000000000;
+		s1--;
+	}
+	usecs = (s1 - s0) * 1000000 + (ns1 - ns0) / 1000;
+	msecs = usecs / 1000;
+	if (msecs == 0) {
+		msecs = 1;
+	}
+
+	printf("%s: %u in %lu.%06lu seconds, %lu/s\n", what, count,
+	       usecs / 1000000, usecs % 1000000,
+	       (unsigned long)count * 1000 / msecs);
+}
+
+int
+main(int argc, char *argv[])
+{
+	char from[32], to[32];
+	unsigned count, i;
+	time_t s0;
+	unsigned long ns0;
+
+	count = DEFAULT_COUNT;
+	if (argc == 2) {
+		count = atoi(argv[1]);
+	}
+	else if (argc > 2) {
+		errx(1, "Usage: dirhash [count]");
+	}
+	if (count == 0 || count > MAX_COUNT) {
+		errx(1, "count must be between 1 and %u", MAX_COUNT);
+	}
+
+	/* In case of leftovers from an earlier run. */
+	for (i=0; i<count; i++) {
+		mkname(from, sizeof(from), "dh", i);
+		remove(from);
+		mkname(from, sizeof(from), "dhr", i);
+		remove(from);
+	}
+
+	__time(&s0, &ns0);
+	for (i=0; i<count; i++) {
+		makefile(i);
+	}
+	report("Creates", count, s0, ns0);
+
+	/* Twice, backwards the second time. */
+	__time(&s0, &ns0);
+	for (i=0; i<count; i++) {
+		check("dh", i, true);
+	}
+	for (i=count; i-- > 0; ) {
+		check("dh", i, true);
+	}
+	report("Lookups", count * 2, s0, ns0);
+
+	__time(&s0, &ns0);
+	for (i=0; i<count; i++) {
+		check("dhx", i, false);
+	}
+	report("Failed lookups", count, s0, ns0);
+
+	/* Rename every other file and remove every third. */
+	for (i=0; i<count; i+=2) {
+		mkname(from, sizeof(from), "dh", i);
+		mkname(to, sizeof(to), "dhr", i);
+		if (rename(from, to) < 0) {
+			err(1, "rename %s to %s", from, to);
+		}
+	}
+	for (i=0; i<count; i+=3) {
+		removefile(i % 2 == 0 ? "dhr" : "dh", i);
+	}
+	for (i=0; i<count; i++) {
+		check("dh", i, i % 2 != 0 && i % 3 != 0);
+		check("dhr", i, i % 2 == 0 && i % 3 != 0);
+	}
+	printf("Names stayed consistent.\n");
+
+	for (i=0; i<count; i++) {
+		if (i % 3 != 0) {
+			removefile(i % 2 == 0 ? "dhr" : "dh", i);
+		}
+	}
+
+	printf("dirhash done.\n");
+	return 0;
+}
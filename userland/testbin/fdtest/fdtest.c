@@ -0,0 +1,217 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009, 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * fdtest.c
+ *
+ * 	Checks the file table: handles are handed out lowest first all
+ * 	the way up to OPEN_MAX, dup2 reaches the top slot, and after
+ * 	fork each process's table changes independently of the other's
+ * 	while the files themselves (and their seek positions) are still
+ * 	shared.
+ *
+ * Usage: fdtest [file]
+ */
+
+#include <sys/wait.h>
+#include <unistd.h>
+#include <limits.h>
+#include <stdio.h>
+#include <errno.h>
+#include <err.h>
+
+#define DEFAULT_FILE	"fdtest.dat"
+
+static
+void
+check(int ok, const char *what)
+{
+	if (!ok) {
+		errx(1, "FAILED: %s", what);
+	}
+	printf("  %s: ok\n", what);
+}
+
+/*
+ * Open NAME until we run out of handles, checking each one is the
+ * lowest free. Returns the number opened.
+ */
+static
+int
+fillup(const char *name)
+{
+	int fd, expect, n;
+
+	n = 0;
+	expect = 3;
+	while (1) {
+		fd = open(name, O_RDONLY);
+		if (fd < 0) {
+			if (errno != EMFILE) {
+				err(1, "%s", name);
+			}
+			break;
+		}
+		if (fd != expect) {
+			errx(1, "FAILED: open returned %d, expected %d",
+			     fd, expect);
+		}
+		expect++;
+		n++;
+	}
+	return n;
+}
+
+static
+void
+lowest(const char *name)
+{
+	int n, fd, i;
+
+	n = fillup(name);
+	check(n == OPEN_MAX - 3, "table grows to OPEN_MAX");
+
+	close(10);
+	close(OPEN_MAX - 2);
+	close(40);
+	fd = open(name, O_RDONLY);
+	check(fd == 10, "lowest free handle is reused first");
+	fd = open(name, O_RDONLY);
+	check(fd == 40, "then the next lowest");
+	fd = open(name, O_RDONLY);
+	check(fd == OPEN_MAX - 2, "then the highest");
+
+	for (i=3; i<OPEN_MAX; i++) {
+		close(i);
+	}
+	fd = open(name, O_RDONLY);
+	check(fd == 3, "emptied table starts over at 3");
+	close(fd);
+}
+
+static
+void
+highdup(int fd)
+{
+	int r;
+
+	r = dup2(fd, OPEN_MAX - 1);
+	check(r == OPEN_MAX - 1, "dup2 to the top slot works");
+	check(lseek(OPEN_MAX - 1, 0, SEEK_CUR) == 0, "and it's usable");
+	close(OPEN_MAX - 1);
+
+	errno = 0;
+	r = dup2(fd, OPEN_MAX);
+	check(r < 0 && errno == EBADF, "dup2 past OPEN_MAX gets EBADF");
+}
+
+static
+void
+forked(const char *name, int fd)
+{
+	pid_t pid;
+	int status, cfd;
+
+	if (lseek(fd, 0, SEEK_SET) < 0) {
+		err(1, "lseek");
+	}
+
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	if (pid == 0) {
+		/* Move the shared seek position, then change our table. */
+		if (lseek(fd, 5, SEEK_SET) < 0) {
+			_exit(1);
+		}
+		if (close(fd) < 0) {
+			_exit(2);
+		}
+		cfd = open(name, O_RDONLY);
+		if (cfd != fd) {
+			_exit(3);
+		}
+		if (dup2(cfd, 60) != 60) {
+			_exit(4);
+		}
+		_exit(0);
+	}
+
+	if (waitpid(pid, &status, 0) < 0) {
+		err(1, "waitpid");
+	}
+	check(WIFEXITED(status) && WEXITSTATUS(status) == 0,
+	      "child's changes to its table work");
+	check(lseek(fd, 0, SEEK_CUR) == 5,
+	      "parent still has the file, and shares its seek position");
+	errno = 0;
+	check(lseek(60, 0, SEEK_CUR) < 0 && errno == EBADF,
+	      "child's new handles don't appear in the parent");
+}
+
+int
+main(int argc, char *argv[])
+{
+	const char *name;
+	int fd;
+
+	name = DEFAULT_FILE;
+	if (argc == 2) {
+		name = argv[1];
+	}
+	else if (argc != 1) {
+		errx(1, "Usage: fdtest [file]");
+	}
+
+	fd = open(name, O_RDWR|O_CREAT|O_TRUNC, 0664);
+	if (fd < 0) {
+		err(1, "%s", name);
+	}
+	if (write(fd, "0123456789", 10) != 10) {
+		err(1, "%s: write", name);
+	}
+	close(fd);
+
+	lowest(name);
+
+	fd = open(name, O_RDONLY);
+	if (fd < 0) {
+		err(1, "%s", name);
+	}
+	highdup(fd);
+	forked(name, fd);
+	close(fd);
+
+	if (remove(name) < 0) {
+		err(1, "%s: remove", name);
+	}
+	printf("fdtest done.\n");
+	return 0;
+}
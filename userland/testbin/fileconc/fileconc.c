@@ -0,0 +1,249 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009, 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * fileconc.c
+ *
+ * 	Concurrent file I/O test. Several processes each write and
+ * 	read back a file of their own, while all of them also append
+ * 	records to one shared file, through a descriptor inherited from
+ * 	the parent so they share its seek position, and create and
+ * 	remove names in the same directory. Afterwards every private
+ * 	file must be intact and the shared file must hold every record
+ * 	exactly once.
+ *
+ * 	With the filesystem no longer under one big lock the private
+ * 	files proceed in parallel; this checks nothing is lost when
+ * 	they do.
+ *
+ * Usage: fileconc [nprocs]
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <err.h>
+
+#define DEFAULT_NPROCS	6
+#define MAXPROCS	16
+#define FILESIZE	(24 * 512)
+#define CHUNK		300		/* not a multiple of the blocksize */
+#define NRECORDS	50		/* per process, in the shared file */
+#define SHARED		"fileconc.shared"
+
+struct record {
+	int r_proc;
+	int r_seq;
+	char r_pad[24];
+};
+
+static char buf[FILESIZE];
+
+static
+char
+filebyte(int proc, unsigned pos)
+{
+	return 'A' + (proc * 5 + pos * 3 + pos / 512) % 26;
+}
+
+static
+void
+mkname(char *name, size_t len, const char *what, int proc)
+{
+	snprintf(name, len, "fileconc.%s.%d", what, proc);
+}
+
+/*
+ * What each process does.
+ */
+static
+void
+child(int proc, int sfd)
+{
+	char name[32], tmpname[32];
+	struct record rec;
+	unsigned pos, n, i;
+	int fd, tfd;
+	ssize_t r;
+
+	mkname(name, sizeof(name), "file", proc);
+	mkname(tmpname, sizeof(tmpname), "tmp", proc);
+
+	fd = open(name, O_RDWR|O_CREAT|O_TRUNC, 0664);
+	if (fd < 0) {
+		err(1, "%s", name);
+	}
+	for (pos=0; pos<FILESIZE; pos++) {
+		buf[pos] = filebyte(proc, pos);
+	}
+	for (pos=0, i=0; pos<FILESIZE; pos += n, i++) {
+		n = FILESIZE - pos < CHUNK ? FILESIZE - pos : CHUNK;
+		r = write(fd, buf + pos, n);
+		if (r < 0 || (unsigned)r != n) {
+			err(1, "%s: write", name);
+		}
+
+		if (i < NRECORDS) {
+			memset(&rec, 0, sizeof(rec));
+			rec.r_proc = proc;
+			rec.r_seq = i;
+			r = write(sfd, &rec, sizeof(rec));
+			if (r != sizeof(rec)) {
+				err(1, "%s: write", SHARED);
+			}
+		}
+
+		/* Churn the directory too. */
+		tfd = open(tmpname, O_WRONLY|O_CREAT|O_TRUNC, 0664);
+		if (tfd < 0) {
+			err(1, "%s", tmpname);
+		}
+		close(tfd);
+		if (remove(tmpname) < 0) {
+			err(1, "%s: remove", tmpname);
+		}
+	}
+	for (; i < NRECORDS; i++) {
+		memset(&rec, 0, sizeof(rec));
+		rec.r_proc = proc;
+		rec.r_seq = i;
+		if (write(sfd, &rec, sizeof(rec)) != sizeof(rec)) {
+			err(1, "%s: write", SHARED);
+		}
+	}
+	close(sfd);
+
+	memset(buf, 0, FILESIZE);
+	r = pread(fd, buf, FILESIZE, 0);
+	if (r != FILESIZE) {
+		err(1, "%s: pread", name);
+	}
+	for (pos=0; pos<FILESIZE; pos++) {
+		if (buf[pos] != filebyte(proc, pos)) {
+			errx(1, "FAILED: %s: byte %u is wrong", name, pos);
+		}
+	}
+	close(fd);
+	if (remove(name) < 0) {
+		err(1, "%s: remove", name);
+	}
+	_exit(0);
+}
+
+int
+main(int argc, char *argv[])
+{
+	static char seen[MAXPROCS][NRECORDS];
+	struct record rec;
+	pid_t pids[MAXPROCS];
+	int nprocs, i, j, fd, status, failed;
+	ssize_t r;
+
+	nprocs = DEFAULT_NPROCS;
+	if (argc == 2) {
+		nprocs = atoi(argv[1]);
+	}
+	else if (argc != 1) {
+		errx(1, "Usage: fileconc [nprocs]");
+	}
+	if (nprocs < 1 || nprocs > MAXPROCS) {
+		errx(1, "nprocs must be 1 to %d", MAXPROCS);
+	}
+
+	fd = open(SHARED, O_RDWR|O_CREAT|O_TRUNC, 0664);
+	if (fd < 0) {
+		err(1, "%s", SHARED);
+	}
+
+	printf("Starting %d processes...\n", nprocs);
+	for (i=0; i<nprocs; i++) {
+		pids[i] = fork();
+		if (pids[i] < 0) {
+			err(1, "fork");
+		}
+		if (pids[i] == 0) {
+			child(i, fd);
+		}
+	}
+
+	failed = 0;
+	for (i=0; i<nprocs; i++) {
+		if (waitpid(pids[i], &status, 0) < 0) {
+			err(1, "waitpid");
+		}
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+			warnx("process %d failed", i);
+			failed = 1;
+		}
+	}
+	if (failed) {
+		errx(1, "FAILED");
+	}
+
+	printf("Checking the shared file...\n");
+	if (lseek(fd, 0, SEEK_SET) < 0) {
+		err(1, "%s: lseek", SHARED);
+	}
+	while ((r = read(fd, &rec, sizeof(rec))) == sizeof(rec)) {
+		if (rec.r_proc < 0 || rec.r_proc >= nprocs ||
+		    rec.r_seq < 0 || rec.r_seq >= NRECORDS) {
+			errx(1, "FAILED: garbage record in %s", SHARED);
+		}
+		if (seen[rec.r_proc][rec.r_seq]) {
+			errx(1, "FAILED: record %d/%d appears twice",
+			     rec.r_proc, rec.r_seq);
+		}
+		seen[rec.r_proc][rec.r_seq] = 1;
+	}
+	if (r < 0) {
+		err(1, "%s: read", SHARED);
+	}
+	if (r > 0) {
+		errx(1, "FAILED: %s ends with a partial record", SHARED);
+	}
+	for (i=0; i<nprocs; i++) {
+		for (j=0; j<NRECORDS; j++) {
+			if (!seen[i][j]) {
+				errx(1, "FAILED: record %d/%d is missing",
+				     i, j);
+			}
+		}
+	}
+
+	close(fd);
+	if (remove(SHARED) < 0) {
+		err(1, "%s: remove", SHARED);
+	}
+	printf("fileconc done.\n");
+	return 0;
+}
@@ -0,0 +1,175 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009, 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * futextest.c
+ *
+ * 	Checks the futex() system call, and shows a futex-based mutex
+ * 	whose uncontended path never enters the kernel.
+ *
+ * OS/161 processes are single-threaded and don't share memory, so
+ * nothing here can actually block; it checks the error and return
+ * value behavior instead, and times a loop of uncontended lock and
+ * unlock operations.
+ */
+
+#include <unistd.h>
+#include <stdio.h>
+#include <errno.h>
+#include <err.h>
+
+#define NLOOPS	100000
+
+/*
+ * Compare-and-swap using the MIPS ll/sc instructions. Returns the
+ * old value of *ptr; the swap happened if that equals OLDVAL.
+ */
+static
+int
+cas(volatile int *ptr, int oldval, int newval)
+{
+	int result, temp;
+
+	__asm volatile(
+		".set push;"
+		".set mips32;"
+		".set noreorder;"
+		"1: ll %0, 0(%2);"
+		"   bne %0, %3, 2f;"
+		"   move %1, %4;"
+		"   sc %1, 0(%2);"
+		"   beqz %1, 1b;"
+		"   nop;"
+		"2: sync;"
+		".set pop"
+		: "=&r" (result), "=&r" (temp)
+		: "r" (ptr), "r" (oldval), "r" (newval)
+		: "memory");
+	return result;
+}
+
+/*
+ * The mutex: 0 is unlocked, 1 is locked, 2 is locked with (possibly)
+ * somebody waiting.
+ */
+static volatile int mutex;
+static unsigned syscalls;
+
+static
+void
+mutex_lock(volatile int *m)
+{
+	int c;
+
+	c = cas(m, 0, 1);
+	if (c == 0) {
+		return;
+	}
+	do {
+		if (c == 2 || cas(m, 1, 2) != 0) {
+			syscalls++;
+			futex((int *)m, FUTEX_WAIT, 2);
+		}
+	} while ((c = cas(m, 0, 2)) != 0);
+}
+
+static
+void
+mutex_unlock(volatile int *m)
+{
+	if (cas(m, 1, 0) != 1) {
+		*m = 0;
+		syscalls++;
+		futex((int *)m, FUTEX_WAKE, 1);
+	}
+}
+
+static
+void
+semantics(void)
+{
+	int val = 5;
+	int result;
+
+	result = futex(&val, FUTEX_WAIT, 6);
+	if (result != -1 || errno != EAGAIN) {
+		errx(1, "FUTEX_WAIT on mismatched value: expected EAGAIN");
+	}
+
+	result = futex(&val, FUTEX_WAKE, 1);
+	if (result != 0) {
+		errx(1, "FUTEX_WAKE with no waiters returned %d", result);
+	}
+
+	result = futex((int *)((char *)&val + 1), FUTEX_WAKE, 1);
+	if (result != -1 || errno != EINVAL) {
+		errx(1, "Misaligned futex: expected EINVAL");
+	}
+
+	result = futex((int *)0x40000000, FUTEX_WAIT, 0);
+	if (result != -1 || errno != EFAULT) {
+		errx(1, "FUTEX_WAIT on bad address: expected EFAULT");
+	}
+
+	result = futex(&val, 42, 0);
+	if (result != -1 || errno != EINVAL) {
+		errx(1, "Bad futex op: expected EINVAL");
+	}
+	printf("futex semantics: ok\n");
+}
+
+int
+main(void)
+{
+	time_t s0, s1;
+	unsigned long ns0, ns1;
+	unsigned i;
+
+	semantics();
+
+	__time(&s0, &ns0);
+	for (i=0; i<NLOOPS; i++) {
+		mutex_lock(&mutex);
+		mutex_unlock(&mutex);
+	}
+	__time(&s1, &ns1);
+
+	if (ns1 < ns0) {
+		ns1 += 1000000000;
+		s1--;
+	}
+	printf("%u uncontended lock/unlock pairs: %lu.%09lu seconds, "
+	       "%u system calls\n", NLOOPS, (unsigned long)(s1 - s0),
+	       ns1 - ns0, syscalls);
+	if (syscalls != 0) {
+		errx(1, "Uncontended mutex entered the kernel");
+	}
+	printf("futextest done.\n");
+	return 0;
+}
@@ -0,0 +1,254 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009, 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * iovtest.c
+ *
+ * 	Checks readv, writev, pread, and pwrite: vectored I/O moves the
+ * 	buffers in order and advances the seek position by the total;
+ * 	positional I/O uses the given offset and leaves the seek
+ * 	position alone; and the documented errors come back. Also
+ * 	moves IOV_MAX one-byte buffers in one call, more than the kernel
+ * 	copies in at once.
+ *
+ * Usage: iovtest [file]
+ */
+
+#include <sys/uio.h>
+#include <limits.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <err.h>
+
+#define DEFAULT_FILE	"iovtest.dat"
+
+static const char part1[] = "The quick brown ";
+static const char part2[] = "fox jumps over ";
+static const char part3[] = "the lazy dog.";
+
+/* For manyvectors; too big for the stack. */
+static struct iovec bigiov[IOV_MAX + 1];
+static char bigout[IOV_MAX], bigin[IOV_MAX + 1];
+
+static
+void
+check(int ok, const char *what)
+{
+	if (!ok) {
+		errx(1, "FAILED: %s", what);
+	}
+	printf("  %s: ok\n", what);
+}
+
+static
+void
+checkpos(int fd, off_t expected, const char *what)
+{
+	off_t pos;
+
+	pos = lseek(fd, 0, SEEK_CUR);
+	if (pos < 0) {
+		err(1, "lseek");
+	}
+	check(pos == expected, what);
+}
+
+static
+void
+vectored(int fd)
+{
+	struct iovec iov[3];
+	char a[10], b[20], c[30];
+	size_t total;
+	ssize_t r;
+
+	total = strlen(part1) + strlen(part2) + strlen(part3);
+
+	iov[0].iov_base = (void *)part1;
+	iov[0].iov_len = strlen(part1);
+	iov[1].iov_base = (void *)part2;
+	iov[1].iov_len = strlen(part2);
+	iov[2].iov_base = (void *)part3;
+	iov[2].iov_len = strlen(part3);
+	r = writev(fd, iov, 3);
+	if (r < 0) {
+		err(1, "writev");
+	}
+	check((size_t)r == total, "writev writes every buffer");
+	checkpos(fd, total, "writev advances the seek position");
+
+	if (lseek(fd, 0, SEEK_SET) < 0) {
+		err(1, "lseek");
+	}
+	memset(c, 0, sizeof(c));
+	iov[0].iov_base = a;
+	iov[0].iov_len = sizeof(a);
+	iov[1].iov_base = b;
+	iov[1].iov_len = sizeof(b);
+	iov[2].iov_base = c;
+	iov[2].iov_len = sizeof(c);
+	r = readv(fd, iov, 3);
+	if (r < 0) {
+		err(1, "readv");
+	}
+	check((size_t)r == total, "readv reads to EOF");
+	check(!memcmp(a, "The quick ", 10) &&
+	      !memcmp(b, "brown fox jumps over", 20) &&
+	      !strcmp(c, " the lazy dog."),
+	      "readv scatters the data in order");
+	checkpos(fd, total, "readv advances the seek position");
+
+	errno = 0;
+	r = readv(fd, iov, 0);
+	check(r < 0 && errno == EINVAL, "readv of 0 buffers gets EINVAL");
+}
+
+static
+void
+positional(int fd)
+{
+	char buf[8];
+	off_t before;
+	ssize_t r;
+	int fds[2];
+
+	before = lseek(fd, 0, SEEK_CUR);
+
+	r = pwrite(fd, "FOX", 3, 16);
+	if (r < 0) {
+		err(1, "pwrite");
+	}
+	check(r == 3, "pwrite writes");
+	checkpos(fd, before, "pwrite leaves the seek position alone");
+
+	r = pread(fd, buf, 5, 14);
+	if (r < 0) {
+		err(1, "pread");
+	}
+	check(r == 5 && !memcmp(buf, "n FOX", 5), "pread reads at offset");
+	checkpos(fd, before, "pread leaves the seek position alone");
+
+	errno = 0;
+	r = pread(fd, buf, 1, -1);
+	check(r < 0 && errno == EINVAL, "pread at negative offset gets EINVAL");
+
+	if (pipe(fds) < 0) {
+		err(1, "pipe");
+	}
+	errno = 0;
+	r = pwrite(fds[1], "x", 1, 0);
+	check(r < 0 && errno == ESPIPE, "pwrite on a pipe gets ESPIPE");
+	close(fds[0]);
+	close(fds[1]);
+}
+
+static
+void
+manyvectors(int fd)
+{
+	ssize_t r;
+	unsigned i;
+
+	if (lseek(fd, 0, SEEK_SET) < 0) {
+		err(1, "lseek");
+	}
+	for (i=0; i<IOV_MAX; i++) {
+		bigout[i] = 'a' + i % 26;
+		bigiov[i].iov_base = &bigout[i];
+		bigiov[i].iov_len = 1;
+	}
+	r = writev(fd, bigiov, IOV_MAX);
+	if (r < 0) {
+		err(1, "writev");
+	}
+	check(r == IOV_MAX, "writev of IOV_MAX buffers writes them all");
+	checkpos(fd, IOV_MAX, "writev of IOV_MAX buffers advances the "
+		 "seek position");
+
+	if (lseek(fd, 0, SEEK_SET) < 0) {
+		err(1, "lseek");
+	}
+	/* Backwards, so each byte lands somewhere different. */
+	for (i=0; i<IOV_MAX; i++) {
+		bigin[i] = 0;
+		bigiov[i].iov_base = &bigin[IOV_MAX - 1 - i];
+		bigiov[i].iov_len = 1;
+	}
+	r = readv(fd, bigiov, IOV_MAX);
+	if (r < 0) {
+		err(1, "readv");
+	}
+	check(r == IOV_MAX, "readv of IOV_MAX buffers reads them all");
+	for (i=0; i<IOV_MAX; i++) {
+		if (bigin[IOV_MAX - 1 - i] != bigout[i]) {
+			break;
+		}
+	}
+	check(i == IOV_MAX, "readv of IOV_MAX buffers scatters in order");
+
+	bigiov[IOV_MAX].iov_base = &bigin[IOV_MAX];
+	bigiov[IOV_MAX].iov_len = 1;
+	errno = 0;
+	r = readv(fd, bigiov, IOV_MAX + 1);
+	check(r < 0 && errno == EINVAL, "readv of IOV_MAX+1 buffers gets "
+	      "EINVAL");
+}
+
+int
+main(int argc, char *argv[])
+{
+	const char *file;
+	int fd;
+
+	file = DEFAULT_FILE;
+	if (argc == 2) {
+		file = argv[1];
+	}
+	else if (argc > 2) {
+		errx(1, "Usage: iovtest [file]");
+	}
+
+	fd = open(file, O_RDWR|O_CREAT|O_TRUNC, 0664);
+	if (fd < 0) {
+		err(1, "%s", file);
+	}
+
+	vectored(fd);
+	positional(fd);
+	manyvectors(fd);
+
+	close(fd);
+	if (remove(file) < 0) {
+		err(1, "%s: remove", file);
+	}
+	printf("iovtest done.\n");
+	return 0;
+}
@@ -0,0 +1,245 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009, 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * openbench.c
+ *
+ * 	Measures how fast files can be opened and closed, first with
+ * 	nothing else open and then with every file also held open by
+ * 	some other process, so the filesystem has them all loaded in
+ * 	memory at once.
+ *
+ * Usage: openbench [nfiles]
+ *
+ * Each open has to find the file's vnode among those already loaded;
+ * this shows whether that gets slower as the number loaded grows.
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <err.h>
+
+#define DEFAULT_NFILES	400
+#define MAXFILES	1000
+#define HOLDPER		100	/* files each holder keeps open */
+#define NROUNDS		5
+
+static pid_t holders[(MAXFILES + HOLDPER - 1) / HOLDPER];
+
+static
+void
+mkname(char *buf, size_t len, unsigned num)
+{
+	snprintf(buf, len, "openb.%u", num);
+}
+
+static
+void
+createfiles(unsigned nfiles)
+{
+	char name[32];
+	unsigned i;
+	int fd;
+
+	for (i=0; i<nfiles; i++) {
+		mkname(name, sizeof(name), i);
+		fd = open(name, O_WRONLY|O_CREAT|O_TRUNC, 0664);
+		if (fd < 0) {
+			err(1, "%s: create", name);
+		}
+		close(fd);
+	}
+}
+
+static
+void
+removefiles(unsigned nfiles)
+{
+	char name[32];
+	unsigned i;
+
+	for (i=0; i<nfiles; i++) {
+		mkname(name, sizeof(name), i);
+		if (remove(name) < 0) {
+			warn("%s: remove", name);
+		}
+	}
+}
+
+/*
+ * Fork off processes that between them open every file and keep it
+ * open until the hold pipe reaches end of file. Each writes a byte to
+ * the ready pipe once it has all its files open.
+ */
+static
+unsigned
+startholders(unsigned nfiles, int holdfds[2], int readyfds[2])
+{
+	char name[32];
+	unsigned nholders, first, i;
+	pid_t pid;
+	char ch;
+
+	nholders = 0;
+	for (first = 0; first < nfiles; first += HOLDPER) {
+		pid = fork();
+		if (pid < 0) {
+			err(1, "fork");
+		}
+		if (pid == 0) {
+			close(holdfds[1]);
+			close(readyfds[0]);
+			for (i = first; i < nfiles && i < first + HOLDPER;
+			     i++) {
+				mkname(name, sizeof(name), i);
+				if (open(name, O_RDONLY) < 0) {
+					err(1, "%s: open", name);
+				}
+			}
+			ch = 'x';
+			if (write(readyfds[1], &ch, 1) != 1) {
+				err(1, "write");
+			}
+			/* Wait for the parent to close its end. */
+			while (read(holdfds[0], &ch, 1) > 0) {
+				/* nothing */
+			}
+			_exit(0);
+		}
+		holders[nholders++] = pid;
+	}
+	close(readyfds[1]);
+	close(holdfds[0]);
+
+	for (i=0; i<nholders; i++) {
+		if (read(readyfds[0], &ch, 1) != 1) {
+			errx(1, "A holder failed");
+		}
+	}
+	return nholders;
+}
+
+static
+void
+stopholders(unsigned nholders)
+{
+	unsigned i;
+	int status;
+
+	for (i=0; i<nholders; i++) {
+		if (waitpid(holders[i], &status, 0) < 0) {
+			err(1, "waitpid");
+		}
+		if (WIFSIGNALED(status) || WEXITSTATUS(status) != 0) {
+			errx(1, "Holder %u failed", i);
+		}
+	}
+}
+
+/*
+ * Open and close every file NROUNDS times.
+ */
+static
+void
+run(const char *what, unsigned nfiles)
+{
+	char name[32];
+	time_t s0, s1;
+	unsigned long ns0, ns1, usecs, msecs, nopens;
+	unsigned round, i;
+	int fd;
+
+	__time(&s0, &ns0);
+	for (round = 0; round < NROUNDS; round++) {
+		for (i=0; i<nfiles; i++) {
+			mkname(name, sizeof(name), i);
+			fd = open(name, O_RDONLY);
+			if (fd < 0) {
+				err(1, "%s: open", name);
+			}
+			close(fd);
+		}
+	}
+	__time(&s1, &ns1);
+
+	if (ns1 < ns0) {
+		ns1 += 1000000000;
+		s1--;
+	}
+	usecs = (s1 - s0) * 1000000 + (ns1 - ns0) / 1000;
+	msecs = usecs / 1000;
+	if (msecs == 0) {
+		msecs = 1;
+	}
+	nopens = (unsigned long)NROUNDS * nfiles;
+
+	printf("%s: %lu opens in %lu.%06lu seconds, %lu opens/s\n",
+	       what, nopens, usecs / 1000000, usecs % 1000000,
+	       nopens * 1000 / msecs);
+}
+
+int
+main(int argc, char *argv[])
+{
+	unsigned nfiles, nholders;
+	int holdfds[2], readyfds[2];
+
+	nfiles = DEFAULT_NFILES;
+	if (argc == 2) {
+		nfiles = atoi(argv[1]);
+	}
+	else if (argc > 2) {
+		errx(1, "Usage: openbench [nfiles]");
+	}
+	if (nfiles == 0 || nfiles > MAXFILES) {
+		errx(1, "nfiles must be between 1 and %u", MAXFILES);
+	}
+
+	createfiles(nfiles);
+	run("none held", nfiles);
+
+	if (pipe(holdfds) < 0 || pipe(readyfds) < 0) {
+		err(1, "pipe");
+	}
+	nholders = startholders(nfiles, holdfds, readyfds);
+
+	run("all held", nfiles);
+
+	close(holdfds[1]);
+	close(readyfds[0]);
+	stopholders(nholders);
+
+	removefiles(nfiles);
+	printf("openbench done.\n");
+	return 0;
+}
@@ -0,0 +1,205 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009, 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * pipebench.c
+ *
+ * 	Measures pipe throughput: a child writes a stream of data into
+ * 	a pipe and the parent reads it back, checking it, for several
+ * 	write sizes.
+ *
+ * Usage: pipebench [kilobytes]
+ *
+ * Small writes mostly go through the kernel's ring buffer; large ones
+ * mostly get copied straight into the waiting reader's buffer.
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <err.h>
+
+#define DEFAULT_KB	1024
+#define MAXCHUNK	16384
+
+static const unsigned chunksizes[] = { 64, 512, 4096, MAXCHUNK };
+#define NCHUNKSIZES (sizeof(chunksizes) / sizeof(chunksizes[0]))
+
+static unsigned char buf[MAXCHUNK];
+
+/*
+ * The byte at position POS in the stream.
+ */
+static
+unsigned char
+streambyte(unsigned long pos)
+{
+	return (pos ^ (pos >> 8) ^ (pos >> 16)) & 0xff;
+}
+
+static
+void
+writer(int fd, unsigned long total, unsigned chunk)
+{
+	unsigned long pos;
+	unsigned i, len;
+	ssize_t r;
+
+	for (pos = 0; pos < total; pos += len) {
+		len = chunk;
+		if (len > total - pos) {
+			len = total - pos;
+		}
+		for (i=0; i<len; i++) {
+			buf[i] = streambyte(pos + i);
+		}
+		r = write(fd, buf, len);
+		if (r < 0) {
+			err(1, "write");
+		}
+		if ((unsigned)r != len) {
+			errx(1, "write: short count %d of %u", (int)r, len);
+		}
+	}
+}
+
+/*
+ * Read until EOF, checking the data. Returns the number of reads.
+ */
+static
+unsigned long
+reader(int fd, unsigned long total)
+{
+	unsigned long pos, nreads;
+	ssize_t r, i;
+
+	pos = 0;
+	nreads = 0;
+	while (1) {
+		r = read(fd, buf, sizeof(buf));
+		if (r < 0) {
+			err(1, "read");
+		}
+		if (r == 0) {
+			break;
+		}
+		nreads++;
+		for (i=0; i<r; i++) {
+			if (buf[i] != streambyte(pos + i)) {
+				errx(1, "Wrong data at offset %lu",
+				     pos + i);
+			}
+		}
+		pos += r;
+	}
+	if (pos != total) {
+		errx(1, "Got %lu bytes, expected %lu", pos, total);
+	}
+	return nreads;
+}
+
+static
+void
+run(unsigned long total, unsigned chunk)
+{
+	time_t s0, s1;
+	unsigned long ns0, ns1, nreads, usecs, msecs;
+	int fds[2], status;
+	pid_t pid;
+
+	if (pipe(fds) < 0) {
+		err(1, "pipe");
+	}
+
+	__time(&s0, &ns0);
+
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	if (pid == 0) {
+		close(fds[0]);
+		writer(fds[1], total, chunk);
+		close(fds[1]);
+		_exit(0);
+	}
+	close(fds[1]);
+	nreads = reader(fds[0], total);
+	close(fds[0]);
+
+	if (waitpid(pid, &status, 0) < 0) {
+		err(1, "waitpid");
+	}
+	if (WIFSIGNALED(status) || WEXITSTATUS(status) != 0) {
+		errx(1, "Writer failed");
+	}
+
+	__time(&s1, &ns1);
+	if (ns1 < ns0) {
+		ns1 += 1000000000;
+		s1--;
+	}
+	usecs = (s1 - s0) * 1000000 + (ns1 - ns0) / 1000;
+	msecs = usecs / 1000;
+	if (msecs == 0) {
+		msecs = 1;
+	}
+
+	printf("%5u-byte writes: %lu.%06lu seconds, %lu KB/s, "
+	       "%lu bytes per read\n", chunk,
+	       usecs / 1000000, usecs % 1000000,
+	       total / 1024 * 1000 / msecs, total / nreads);
+}
+
+int
+main(int argc, char *argv[])
+{
+	unsigned long total;
+	unsigned i;
+
+	total = DEFAULT_KB;
+	if (argc == 2) {
+		total = atoi(argv[1]);
+	}
+	else if (argc > 2) {
+		errx(1, "Usage: pipebench [kilobytes]");
+	}
+	if (total == 0) {
+		errx(1, "Nothing to do");
+	}
+	total *= 1024;
+
+	for (i=0; i<NCHUNKSIZES; i++) {
+		run(total, chunksizes[i]);
+	}
+	printf("pipebench done.\n");
+	return 0;
+}
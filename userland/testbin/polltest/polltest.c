@@ -0,0 +1,237 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009, 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * polltest.c
+ *
+ * 	Checks poll and select: pipes report readable, writable, and
+ * 	hung up at the right times; regular files are always ready; a
+ * 	timeout expires when nothing happens; a sleeping poll wakes up
+ * 	when another process writes; and bad file handles are caught.
+ *
+ * Usage: polltest
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <poll.h>
+#include <sys/select.h>
+#include <unistd.h>
+#include <limits.h>
+#include <stdio.h>
+#include <errno.h>
+#include <err.h>
+
+#define TESTFILE	"polltest.dat"
+
+static
+void
+check(int ok, const char *what)
+{
+	if (!ok) {
+		errx(1, "FAILED: %s", what);
+	}
+	printf("  %s: ok\n", what);
+}
+
+static
+void
+pipestates(void)
+{
+	struct pollfd pfd[2];
+	int fds[2], r;
+	char c;
+
+	if (pipe(fds) < 0) {
+		err(1, "pipe");
+	}
+	pfd[0].fd = fds[0];
+	pfd[0].events = POLLIN;
+	pfd[1].fd = fds[1];
+	pfd[1].events = POLLOUT;
+
+	r = poll(pfd, 2, 0);
+	check(r == 1 && pfd[0].revents == 0 && pfd[1].revents == POLLOUT,
+	      "empty pipe is writable, not readable");
+
+	if (write(fds[1], "x", 1) != 1) {
+		err(1, "write");
+	}
+	r = poll(pfd, 2, 0);
+	check(r == 2 && pfd[0].revents == POLLIN,
+	      "pipe with data is readable");
+
+	if (read(fds[0], &c, 1) != 1) {
+		err(1, "read");
+	}
+	close(fds[1]);
+	r = poll(pfd, 1, 0);
+	check(r == 1 && pfd[0].revents == POLLHUP,
+	      "pipe with no writer is hung up");
+	close(fds[0]);
+}
+
+static
+void
+fileready(void)
+{
+	struct pollfd pfd;
+	int fd, r;
+
+	fd = open(TESTFILE, O_RDWR|O_CREAT|O_TRUNC, 0664);
+	if (fd < 0) {
+		err(1, "%s", TESTFILE);
+	}
+	pfd.fd = fd;
+	pfd.events = POLLIN | POLLOUT;
+	r = poll(&pfd, 1, -1);
+	check(r == 1 && pfd.revents == (POLLIN | POLLOUT),
+	      "regular file is always ready");
+	close(fd);
+	if (remove(TESTFILE) < 0) {
+		err(1, "%s: remove", TESTFILE);
+	}
+}
+
+static
+void
+timeout(void)
+{
+	struct pollfd pfd;
+	struct timeval tv;
+	fd_set rfds;
+	int fds[2], r;
+
+	if (pipe(fds) < 0) {
+		err(1, "pipe");
+	}
+	pfd.fd = fds[0];
+	pfd.events = POLLIN;
+	r = poll(&pfd, 1, 100);
+	check(r == 0 && pfd.revents == 0, "poll times out");
+
+	FD_ZERO(&rfds);
+	FD_SET(fds[0], &rfds);
+	tv.tv_sec = 0;
+	tv.tv_usec = 100000;
+	r = select(fds[0] + 1, &rfds, NULL, NULL, &tv);
+	check(r == 0 && !FD_ISSET(fds[0], &rfds), "select times out");
+
+	close(fds[0]);
+	close(fds[1]);
+}
+
+/*
+ * Wait in poll for two pipes at once while a child writes to the
+ * second one, after a delay so we're surely asleep.
+ */
+static
+void
+wakeup(void)
+{
+	struct pollfd pfd[2];
+	fd_set rfds;
+	int a[2], b[2], r, status, maxfd;
+	pid_t pid;
+
+	if (pipe(a) < 0 || pipe(b) < 0) {
+		err(1, "pipe");
+	}
+
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	if (pid == 0) {
+		sleep(1);
+		if (write(b[1], "y", 1) != 1) {
+			err(1, "write");
+		}
+		_exit(0);
+	}
+
+	pfd[0].fd = a[0];
+	pfd[0].events = POLLIN;
+	pfd[1].fd = b[0];
+	pfd[1].events = POLLIN;
+	r = poll(pfd, 2, -1);
+	check(r == 1 && pfd[0].revents == 0 && pfd[1].revents == POLLIN,
+	      "poll wakes up for the right pipe");
+
+	FD_ZERO(&rfds);
+	FD_SET(a[0], &rfds);
+	FD_SET(b[0], &rfds);
+	maxfd = a[0] > b[0] ? a[0] : b[0];
+	r = select(maxfd + 1, &rfds, NULL, NULL, NULL);
+	check(r == 1 && !FD_ISSET(a[0], &rfds) && FD_ISSET(b[0], &rfds),
+	      "select agrees");
+
+	if (waitpid(pid, &status, 0) < 0) {
+		err(1, "waitpid");
+	}
+	close(a[0]);
+	close(a[1]);
+	close(b[0]);
+	close(b[1]);
+}
+
+static
+void
+badfds(void)
+{
+	struct pollfd pfd[2];
+	fd_set rfds;
+	int r;
+
+	pfd[0].fd = -1;
+	pfd[0].events = POLLIN;
+	pfd[1].fd = OPEN_MAX - 1;
+	pfd[1].events = POLLIN;
+	r = poll(pfd, 2, 0);
+	check(r == 1 && pfd[0].revents == 0 && pfd[1].revents == POLLNVAL,
+	      "poll ignores negative fds, flags closed ones");
+
+	FD_ZERO(&rfds);
+	FD_SET(OPEN_MAX - 1, &rfds);
+	errno = 0;
+	r = select(OPEN_MAX, &rfds, NULL, NULL, NULL);
+	check(r < 0 && errno == EBADF, "select of closed fd gets EBADF");
+}
+
+int
+main(void)
+{
+	pipestates();
+	fileready();
+	timeout();
+	wakeup();
+	badfds();
+	printf("polltest done.\n");
+	return 0;
+}
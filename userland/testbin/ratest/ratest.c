@@ -0,0 +1,206 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009, 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * ratest.c
+ *
+ * 	Checks that readahead doesn't change what reads return. Makes
+ * 	a file with a hole in it, then reads it through sequentially in
+ * 	pieces of various sizes, backwards, through two descriptors at
+ * 	once, and with writes and a truncate landing on blocks that
+ * 	have just been read ahead.
+ *
+ * 	"bc" at the kernel menu afterwards shows how many blocks were
+ * 	prefetched and how many of those were used.
+ *
+ * Usage: ratest
+ */
+
+#include <unistd.h>
+#include <string.h>
+#include <stdio.h>
+#include <err.h>
+
+#define BLOCKSIZE	512
+#define FILEBLOCKS	200
+#define FILESIZE	(FILEBLOCKS * BLOCKSIZE)
+#define HOLESTART	(80 * BLOCKSIZE)	/* never written */
+#define HOLEEND		(100 * BLOCKSIZE)
+
+static const char name[] = "ratest.tmp";
+static char buf[FILESIZE];
+
+/*
+ * What byte POS should be, given that everything from CUT on has
+ * been truncated and rewritten with 'X'.
+ */
+static
+char
+filebyte(unsigned pos, unsigned cut)
+{
+	if (pos >= cut) {
+		return 'X';
+	}
+	if (pos >= HOLESTART && pos < HOLEEND) {
+		return 0;
+	}
+	return 'a' + (pos * 7 + pos / BLOCKSIZE) % 26;
+}
+
+static
+void
+check(const char *what, unsigned pos, size_t len, unsigned cut)
+{
+	unsigned i;
+
+	for (i=0; i<len; i++) {
+		if (buf[i] != filebyte(pos + i, cut)) {
+			errx(1, "FAILED: %s: byte %u is wrong", what, pos + i);
+		}
+	}
+}
+
+static
+void
+readall(int fd, size_t chunk, unsigned cut)
+{
+	unsigned pos;
+	ssize_t r;
+
+	if (lseek(fd, 0, SEEK_SET) < 0) {
+		err(1, "lseek");
+	}
+	for (pos=0; pos<FILESIZE; pos += r) {
+		r = read(fd, buf, chunk);
+		if (r < 0) {
+			err(1, "read");
+		}
+		if (r == 0) {
+			errx(1, "FAILED: unexpected EOF at %u", pos);
+		}
+		check("sequential read", pos, r, cut);
+	}
+	if (read(fd, buf, chunk) != 0) {
+		errx(1, "FAILED: no EOF at end of file");
+	}
+}
+
+static
+void
+preadblock(int fd, unsigned block, unsigned cut)
+{
+	ssize_t r;
+
+	r = pread(fd, buf, BLOCKSIZE, block * BLOCKSIZE);
+	if (r != BLOCKSIZE) {
+		err(1, "pread of block %u", block);
+	}
+	check("pread", block * BLOCKSIZE, BLOCKSIZE, cut);
+}
+
+int
+main(void)
+{
+	static const size_t chunks[] = { 1, 100, 512, 700, 4096, 9000 };
+	unsigned i, pos, block;
+	int fd, fd2;
+	ssize_t r;
+
+	fd = open(name, O_RDWR|O_CREAT|O_TRUNC, 0664);
+	if (fd < 0) {
+		err(1, "%s", name);
+	}
+
+	printf("Writing %d blocks with a hole...\n", FILEBLOCKS);
+	for (pos=0; pos<FILESIZE; pos++) {
+		buf[pos] = filebyte(pos, FILESIZE);
+	}
+	if (pwrite(fd, buf, HOLESTART, 0) != HOLESTART ||
+	    pwrite(fd, buf + HOLEEND, FILESIZE - HOLEEND, HOLEEND) !=
+	    FILESIZE - HOLEEND) {
+		err(1, "pwrite");
+	}
+
+	printf("Sequential reads...\n");
+	for (i=0; i<sizeof(chunks)/sizeof(chunks[0]); i++) {
+		readall(fd, chunks[i], FILESIZE);
+	}
+
+	printf("Backward reads...\n");
+	for (block=FILEBLOCKS; block-- > 0; ) {
+		preadblock(fd, block, FILESIZE);
+	}
+
+	printf("Two descriptors at once...\n");
+	fd2 = open(name, O_RDONLY);
+	if (fd2 < 0) {
+		err(1, "%s", name);
+	}
+	for (pos=0; pos<FILESIZE; pos += BLOCKSIZE) {
+		r = read(fd, buf, BLOCKSIZE);
+		if (r != BLOCKSIZE) {
+			err(1, "read");
+		}
+		check("read on first descriptor", pos, BLOCKSIZE, FILESIZE);
+		r = pread(fd2, buf, BLOCKSIZE, FILESIZE - BLOCKSIZE - pos);
+		if (r != BLOCKSIZE) {
+			err(1, "pread");
+		}
+		check("pread on second descriptor", FILESIZE - BLOCKSIZE - pos,
+		      BLOCKSIZE, FILESIZE);
+	}
+	close(fd2);
+
+	printf("Truncating and rewriting behind readahead...\n");
+	if (lseek(fd, 0, SEEK_SET) < 0) {
+		err(1, "lseek");
+	}
+	for (pos=0; pos<FILESIZE/2; pos += r) {
+		r = read(fd, buf, 1000);
+		if (r <= 0) {
+			err(1, "read");
+		}
+	}
+	if (ftruncate(fd, FILESIZE/2 + 300) < 0) {
+		err(1, "ftruncate");
+	}
+	memset(buf, 'X', FILESIZE);
+	if (pwrite(fd, buf, FILESIZE/2, FILESIZE/2) != FILESIZE/2) {
+		err(1, "pwrite");
+	}
+	readall(fd, 512, FILESIZE/2);
+	readall(fd, 3000, FILESIZE/2);
+
+	close(fd);
+	if (remove(name) < 0) {
+		err(1, "%s: remove", name);
+	}
+	printf("ratest done.\n");
+	return 0;
+}